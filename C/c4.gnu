@@ -105,10 +105,25 @@ CBL {
 		c4query_new;
 		c4query_new2;
 		c4query_setParameters;
+		c4query_setParameterValues;
 		c4query_columnCount;
 		c4query_columnTitle;
 		c4query_run;
+		c4query_runAsync;
+		c4query_cancel;
+		c4query_setTimeout;
 		c4query_explain;
+		c4query_setCollectStats;
+		c4query_getStats;
+		c4query_setSlowQueryThreshold;
+		c4query_setParallelism;
+		c4query_setPersistentResults;
+		c4query_runColumnar;
+
+		c4querycolumns_getRowCount;
+		c4querycolumns_getColumnCount;
+		c4querycolumns_getColumn;
+		c4querycolumns_release;
 
 		c4blob_keyFromString;
 		c4blob_keyToString;
@@ -161,6 +176,7 @@ CBL {
 		c4socket_gotHTTPResponse;
 
 		c4pred_registerModel;
+		c4pred_registerModelWithOptions;
 		c4pred_unregisterModel;
 
 		FLSlice_Equal;
@@ -323,11 +339,14 @@ CBL {
 		c4doc_generateID;
 
 		c4db_getIndexesInfo;
+		c4db_setQueryWorkloadRecording;
+		c4db_getIndexAdvice;
 
 		kC4DefaultEnumeratorOptions;
 		kC4DefaultQueryOptions;
 
 		c4queryenum_getRowCount;
+		c4queryenum_getContinuation;
 
 		c4query_fullTextMatched;
 
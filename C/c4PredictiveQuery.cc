@@ -31,8 +31,10 @@ using namespace fleece::impl;
 
 class C4PredictiveModelInternal : public PredictiveModel {
 public:
-    C4PredictiveModelInternal(const C4PredictiveModel &model)
+    C4PredictiveModelInternal(const C4PredictiveModel &model,
+                              const C4PredictiveModelOptions *options)
     :_c4Model(model)
+    ,_c4Options(options ? *options : C4PredictiveModelOptions{})
     { }
 
     virtual alloc_slice prediction(const Dict *input,
@@ -50,6 +52,33 @@ public:
         }
     }
 
+    virtual std::vector<alloc_slice> predictions(const std::vector<const Dict*> &inputs,
+                                                 DataFile::Delegate *dfDelegate,
+                                                 C4Error *outError) noexcept override {
+        if (!_c4Options.predictionBatch)
+            return PredictiveModel::predictions(inputs, dfDelegate, outError);
+        try {
+            std::vector<C4SliceResult> c4Results(inputs.size(), C4SliceResult{});
+            bool ok = _c4Options.predictionBatch(_c4Model.context,
+                                                 (const FLDict*)inputs.data(),
+                                                 inputs.size(),
+                                                 dynamic_cast<c4Database*>(dfDelegate),
+                                                 c4Results.data(),
+                                                 outError);
+            std::vector<alloc_slice> results;
+            results.reserve(inputs.size());
+            for (auto &r : c4Results)
+                results.emplace_back(std::move(r));     // adopts the C4SliceResult
+            if (!ok)
+                return {};
+            return results;
+        } catch (const std::exception &x) {
+            if (outError)
+                *outError = c4error_make(LiteCoreDomain, kC4ErrorUnexpectedError, slice(x.what()));
+            return {};
+        }
+    }
+
 protected:
     virtual ~C4PredictiveModelInternal() {
         if (_c4Model.unregistered)
@@ -58,15 +87,24 @@ protected:
 
 private:
     C4PredictiveModel _c4Model;
+    C4PredictiveModelOptions _c4Options;
 };
 
 #endif // COUCHBASE_ENTERPRISE
 
 
 void c4pred_registerModel(const char *name, C4PredictiveModel model) C4API {
+    c4pred_registerModelWithOptions(name, model, nullptr);
+}
+
+
+void c4pred_registerModelWithOptions(const char *name,
+                                     C4PredictiveModel model,
+                                     const C4PredictiveModelOptions *options) C4API
+{
 #ifdef COUCHBASE_ENTERPRISE
-    auto context = retained(new C4PredictiveModelInternal(model));
-    context->registerAs(name);
+    auto context = retained(new C4PredictiveModelInternal(model, options));
+    context->registerAs(name, options ? options->cacheCapacity : 0);
 #else
     C4WarnError("c4pred_registerModel() is not implemented; aborting");
     abort();
@@ -33,7 +33,10 @@ using namespace litecore;
 using namespace fleece::impl;
 
 CBL_CORE_API const C4QueryOptions kC4DefaultQueryOptions = {
-    true    // rankFullText
+    true,   // rankFullText
+    {},     // continuation
+    false,  // countOnly
+    0       // maxRows
 };
 
 
@@ -79,10 +82,45 @@ FLString c4query_columnTitle(C4Query *query, unsigned column) C4API {
 
 
 void c4query_setParameters(C4Query *query, C4String encodedParameters) C4API {
+    // (Invalid parameters make the next run fail; see c4Query::setParameters.)
     query->setParameters(encodedParameters);
 }
 
 
+void c4query_setParameterValues(C4Query *query,
+                                const C4QueryParameter params[],
+                                size_t count) C4API
+{
+    // (Like c4query_setParameters, an invalid parameter makes the next run fail.)
+    tryCatch(nullptr, [&]{
+        try {
+            Encoder enc;
+            enc.beginDictionary(count);
+            for (size_t i = 0; i < count; ++i) {
+                auto &param = params[i];
+                enc.writeKey(slice(param.name));
+                switch (param.type) {
+                    case kC4ParameterNull:   enc.writeNull(); break;
+                    case kC4ParameterBool:   enc.writeBool(param.value.boolean); break;
+                    case kC4ParameterInt:    enc.writeInt(param.value.integer); break;
+                    case kC4ParameterDouble: enc.writeDouble(param.value.number); break;
+                    case kC4ParameterString: enc.writeString(slice(param.value.string)); break;
+                    case kC4ParameterData:   enc.writeData(slice(param.value.data)); break;
+                    default:
+                        error::_throw(error::InvalidParameter,
+                                      "Unknown type %d of query parameter", (int)param.type);
+                }
+            }
+            enc.endDictionary();
+            query->setParameters(enc.finish());
+        } catch (...) {
+            query->setInvalidParameters(current_exception());
+            throw;
+        }
+    });
+}
+
+
 C4QueryEnumerator* c4query_run(C4Query *query,
                                const C4QueryOptions *c4options,
                                C4Slice encodedParameters,
@@ -94,6 +132,67 @@ C4QueryEnumerator* c4query_run(C4Query *query,
 }
 
 
+// Runs a query once on a LiveQuerier, then calls the client's callback and deletes itself.
+class C4QueryAsyncRun : public LiveQuerier::Delegate {
+public:
+    C4QueryAsyncRun(C4Query *query, C4QueryRunCallback callback, void *context)
+    :_query(query)
+    ,_callback(callback)
+    ,_context(context)
+    ,_querier(new LiveQuerier(query->database(), query->query(), false, this))
+    { }
+
+    void start(const Query::Options &options) {
+        _querier->start(options);
+    }
+
+    // called on the LiveQuerier's thread
+    void liveQuerierUpdated(QueryEnumerator *qe, C4Error err) override {
+        Retained<C4QueryEnumeratorImpl> e = _query->wrapEnumerator(qe);
+        _callback(_query, e, err, _context);
+        // The querier mustn't keep a pointer to this once it's deleted. (Its mailbox keeps it
+        // alive until this call returns.)
+        _querier->removeDelegate(this);
+        _querier->stop();
+        delete this;
+    }
+
+private:
+    Retained<C4Query> _query;
+    C4QueryRunCallback const _callback;
+    void* const _context;
+    Retained<LiveQuerier> _querier;
+};
+
+
+void c4query_runAsync(C4Query *query,
+                      const C4QueryOptions *c4options,
+                      C4Slice encodedParameters,
+                      C4QueryRunCallback callback,
+                      void *context) noexcept
+{
+    C4Error error;
+    bool ok = tryCatch(&error, [&]{
+        auto options = query->runOptions(c4options, encodedParameters);
+        auto run = make_unique<C4QueryAsyncRun>(query, callback, context);
+        run->start(options);
+        run.release();              // it deletes itself after calling the callback
+    });
+    if (!ok)
+        callback(query, nullptr, error, context);
+}
+
+
+void c4query_cancel(C4Query *query) C4API {
+    query->cancel();
+}
+
+
+void c4query_setTimeout(C4Query *query, double seconds) C4API {
+    query->setTimeout(seconds);
+}
+
+
 C4StringResult c4query_explain(C4Query *query) noexcept {
     return tryCatch<C4StringResult>(nullptr, [&]{
         string result = query->query()->explain();
@@ -104,6 +203,35 @@ C4StringResult c4query_explain(C4Query *query) noexcept {
 }
 
 
+static_assert(sizeof(C4QueryStats) == sizeof(Query::Statistics),
+              "C4QueryStats does not match Query::Statistics");
+
+
+void c4query_setCollectStats(C4Query *query, bool collect) C4API {
+    query->query()->setCollectingStatistics(collect);
+}
+
+
+bool c4query_getStats(C4Query *query, C4QueryStats *outStats) C4API {
+    return query->query()->getStatistics(*(Query::Statistics*)outStats);
+}
+
+
+void c4query_setSlowQueryThreshold(double seconds) C4API {
+    Query::setSlowQueryThreshold(seconds);
+}
+
+
+void c4query_setParallelism(C4Query *query, unsigned maxThreads) C4API {
+    query->query()->setParallelism(maxThreads);
+}
+
+
+void c4query_setPersistentResults(C4Query *query, bool persist) C4API {
+    query->setPersistResults(persist);
+}
+
+
 C4SliceResult c4query_fullTextMatched(C4Query *query,
                                       const C4FullTextMatch *term,
                                       C4Error *outError) noexcept
@@ -151,6 +279,16 @@ int64_t c4queryenum_getRowCount(C4QueryEnumerator *e,
 
 
 
+C4SliceResult c4queryenum_getContinuation(C4QueryEnumerator *e,
+                                          C4Error *outError) noexcept
+{
+    return tryCatch<C4SliceResult>(outError, [&]{
+        clearError(outError);
+        return C4SliceResult(asInternal(e)->continuation());
+    });
+}
+
+
 C4QueryEnumerator* c4queryenum_refresh(C4QueryEnumerator *e,
                                        C4Error *outError) noexcept
 {
@@ -177,6 +315,61 @@ void c4queryenum_release(C4QueryEnumerator *e) noexcept {
 }
 
 
+#pragma mark - COLUMNAR RESULTS API:
+
+
+// C4QueryColumns is just a public name for ColumnarResult.
+static inline ColumnarResult* asInternal(C4QueryColumns *columns) {
+    return (ColumnarResult*)columns;
+}
+
+
+C4QueryColumns* c4query_runColumnar(C4Query *query,
+                                    const C4QueryOptions *c4options,
+                                    C4Slice encodedParameters,
+                                    C4Error *outError) noexcept
+{
+    return tryCatch<C4QueryColumns*>(outError, [&]{
+        auto result = query->runColumnar(c4options, encodedParameters);
+        return (C4QueryColumns*)retain(result.get());
+    });
+}
+
+
+uint64_t c4querycolumns_getRowCount(C4QueryColumns *columns) noexcept {
+    return asInternal(columns)->rowCount();
+}
+
+
+unsigned c4querycolumns_getColumnCount(C4QueryColumns *columns) noexcept {
+    return asInternal(columns)->columnCount();
+}
+
+
+bool c4querycolumns_getColumn(C4QueryColumns *columns,
+                              unsigned columnIndex,
+                              C4QueryColumn *outColumn) noexcept
+{
+    auto result = asInternal(columns);
+    if (columnIndex >= result->columnCount())
+        return false;
+    auto &column = result->column(columnIndex);
+    auto ptr = [](auto &vec) {return vec.empty() ? nullptr : vec.data();};
+    outColumn->type = (C4QueryColumnType)column.type;
+    outColumn->validity = ptr(column.validity);
+    outColumn->integers = ptr(column.integers);
+    outColumn->doubles = ptr(column.doubles);
+    outColumn->offsets = ptr(column.offsets);
+    outColumn->bytes = ptr(column.bytes);
+    return true;
+}
+
+
+void c4querycolumns_release(C4QueryColumns *columns) noexcept {
+    release(asInternal(columns));
+}
+
+
 #pragma mark - QUERY OBSERVER API:
 
 
@@ -263,6 +456,41 @@ C4SliceResult c4db_getIndexesInfo(C4Database* database, C4Error* outError) noexc
 }
 
 
+void c4db_setQueryWorkloadRecording(C4Database* database, bool record) noexcept {
+    ((SQLiteDataFile*)database->dataFile())->queryWorkload().setRecording(record);
+}
+
+
+C4SliceResult c4db_getIndexAdvice(C4Database* database, C4Error* outError) noexcept {
+    return tryCatch<C4SliceResult>(outError, [&]{
+        IndexAdvice advice = ((SQLiteDataFile*)database->dataFile())->adviseIndexes();
+        Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("suggestions");
+        enc.beginArray();
+        for (auto &suggestion : advice.suggestions) {
+            enc.beginDictionary();
+            enc.writeKey("type");        enc.writeInt(suggestion.type);
+            enc.writeKey("expr");        enc.writeString(suggestion.expressionJSON);
+            enc.writeKey("reason");      enc.writeString(suggestion.reason);
+            enc.writeKey("queries");     enc.writeUInt(suggestion.queryCount);
+            enc.writeKey("runs");        enc.writeUInt(suggestion.runCount);
+            enc.writeKey("rowsScanned"); enc.writeUInt(suggestion.fullScanSteps);
+            enc.writeKey("time");        enc.writeDouble(suggestion.totalTime);
+            enc.endDictionary();
+        }
+        enc.endArray();
+        enc.writeKey("unused");
+        enc.beginArray();
+        for (auto &name : advice.unusedIndexes)
+            enc.writeString(name);
+        enc.endArray();
+        enc.endDictionary();
+        return C4SliceResult(enc.finish());
+    });
+}
+
+
 C4SliceResult c4db_getIndexRows(C4Database* database, C4String indexName, C4Error* outError) noexcept {
     return tryCatch<C4SliceResult>(outError, [&]{
         int64_t rowCount;
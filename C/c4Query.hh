@@ -10,6 +10,7 @@
 #include "c4Query.h"
 
 #include "c4Database.hh"
+#include "c4ExceptionUtils.hh"
 #include "c4QueryEnumeratorImpl.hh"
 #include "c4QueryObserver.hh"
 #include "LiveQuerier.hh"
@@ -17,6 +18,7 @@
 #include "InstanceCounted.hh"
 #include "RefCounted.hh"
 
+#include <exception>
 #include <mutex>
 #include <set>
 
@@ -36,40 +38,131 @@ struct c4Query : public RefCounted, public fleece::InstanceCountedIn<c4Query>, L
     Database* database() const              {return _database;}
     Query* query() const                    {return _query;}
     alloc_slice parameters() const          {return _parameters;}
-    void setParameters(slice parameters)    {_parameters = parameters;}
+
+    void setParameters(slice parameters) {
+        // Convert JSON to Fleece once here, instead of on every run. If the parameters aren't a
+        // valid dictionary, remember why, and throw that from runs that would have used them.
+        alloc_slice encoded;
+        try {
+            if (parameters) {
+                encoded = Query::encodeParameters(alloc_slice(parameters));
+                const fleece::impl::Value *root = fleece::impl::Value::fromData(encoded);
+                if (!root || !root->asDict())
+                    error::_throw(error::InvalidParameter, "Query parameters must be a dictionary");
+            }
+        } catch (...) {
+            setInvalidParameters(current_exception());
+            return;
+        }
+        LOCK(_mutex);
+        _parameters = encoded;
+        _parametersError = nullptr;
+    }
+
+    // Makes runs that would use the parameters throw `error` instead.
+    void setInvalidParameters(exception_ptr error) {
+        LOCK(_mutex);
+        _parameters = nullptr;
+        _parametersError = error;
+    }
 
     Retained<C4QueryEnumeratorImpl> createEnumerator(const C4QueryOptions *c4options, slice encodedParameters) {
-        Query::Options options(encodedParameters ? encodedParameters : _parameters);
+        Query::Options options = runOptions(c4options, encodedParameters);
         return wrapEnumerator( _query->createEnumerator(&options) );
     }
 
+    Retained<ColumnarResult> runColumnar(const C4QueryOptions *c4options, slice encodedParameters) {
+        Query::Options options = runOptions(c4options, encodedParameters);
+        return _query->runColumnar(&options);
+    }
+
+    // The Options for a run: its parameters, plus the current cancellation and timeout.
+    Query::Options runOptions(const C4QueryOptions *c4options, slice encodedParameters) {
+        LOCK(_mutex);
+        if (!encodedParameters && _parametersError)
+            rethrow_exception(_parametersError);
+        Query::Options options(encodedParameters ? encodedParameters : _parameters, 0, 0,
+                               alloc_slice(c4options ? slice(c4options->continuation) : nullslice));
+        options.cancellation = _cancellation;
+        options.timeout = _timeout;
+        if (c4options) {
+            options.countOnly = c4options->countOnly;
+            options.maxRows = c4options->maxRows;
+        }
+        return options;
+    }
+
+    // Stops all the runs in progress. Later runs get a new QueryCancellation, so they aren't.
+    void cancel() {
+        LOCK(_mutex);
+        _cancellation->cancel();
+        _cancellation = new QueryCancellation;
+    }
+
+    void setTimeout(double seconds) {
+        LOCK(_mutex);
+        _timeout = seconds;
+    }
+
+    void setPersistResults(bool persist) {
+        LOCK(_mutex);
+        _persistResults = persist;
+    }
+
     Retained<C4QueryEnumeratorImpl> wrapEnumerator(QueryEnumerator *e) {
         return e ? new C4QueryEnumeratorImpl(_database, _query, e) : nullptr;
     }
 
     void enableObserver(c4QueryObserver *obs, bool enable) {
-        LOCK(_mutex);
-        if (enable) {
-            _observers.insert(obs);
-            if (!_bgQuerier) {
-                _bgQuerier = new LiveQuerier(_database, _query, true, this);
-                _bgQuerier->start(_parameters);
+        // Serializes enabling/disabling. `_mutex` can't be held while calling into the
+        // Database, because it's locked by liveQuerierUpdated while observers' callbacks run,
+        // and those may enable or disable observers of other queries.
+        LOCK(_observerMutex);
+        Retained<LiveQuerier> stopQuerier;
+        bool start = false, persist = false;
+        exception_ptr parametersError;
+        alloc_slice parameters;
+        {
+            LOCK(_mutex);
+            if (enable) {
+                _observers.insert(obs);
+                start = !_bgQuerier;
+                persist = _persistResults;
+                parametersError = _parametersError;
+                parameters = _parameters;
+            } else {
+                _observers.erase(obs);
+                if (_observers.empty() && _bgQuerier)
+                    stopQuerier = move(_bgQuerier);
             }
-        } else {
-            _observers.erase(obs);
-            if (_observers.empty() && _bgQuerier) {
-                _bgQuerier->stop();
-                _bgQuerier = nullptr;
+        }
+        if (start && parametersError) {
+            // The query can't run, so give the observer the error instead of results:
+            C4Error error;
+            try {
+                rethrow_exception(parametersError);
+            } catch (const exception &x) {
+                recordException(x, &error);
             }
+            obs->notify(nullptr, error);
+        } else if (start) {
+            // Identical live queries on this database share a LiveQuerier:
+            auto querier = _database->addLiveQueryDelegate(_query, parameters, this, persist);
+            LOCK(_mutex);
+            _bgQuerier = querier;
+        } else if (stopQuerier) {
+            _database->removeLiveQueryDelegate(stopQuerier, this);
+            // The querier may be calling liveQuerierUpdated right now; stay alive till it's done.
+            Retained<c4Query> retainSelf = this;
+            stopQuerier->afterNotifications([retainSelf] { });
         }
     }
 
     // called on a background thread!
     void liveQuerierUpdated(QueryEnumerator *qe, C4Error err) override {
         Retained<C4QueryEnumeratorImpl> c4e = wrapEnumerator(qe);
+        // Only observers still enabled get called; after the last is disabled, none are.
         LOCK(_mutex);
-        if (!_bgQuerier)
-            return;
         for (auto &obs : _observers)
             obs->notify(c4e, err);
     }
@@ -78,8 +171,13 @@ private:
     Retained<Database> _database;
     Retained<Query> _query;
     alloc_slice _parameters;
+    exception_ptr _parametersError;
+    Retained<QueryCancellation> _cancellation {new QueryCancellation};
+    double _timeout {0};
+    bool _persistResults {false};
 
     mutable mutex _mutex;
+    mutex _observerMutex;
     Retained<LiveQuerier> _bgQuerier;
     set<c4QueryObserver*> _observers;
 };
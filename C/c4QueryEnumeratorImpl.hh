@@ -78,6 +78,10 @@ namespace c4Internal {
             }
         }
 
+        alloc_slice continuation() const {
+            return enumerator().continuation();
+        }
+
         C4QueryEnumeratorImpl* refresh() {
             QueryEnumerator* newEnum = enumerator().refresh(_query);
             if (newEnum)
@@ -227,6 +227,8 @@ typedef C4_ENUM(int32_t, C4ErrorCode) {
     kC4ErrorCantUpgradeDatabase,/*30*/ // DB can't be upgraded (might be unsupported dev version)
     kC4ErrorDeltaBaseUnknown,       // Replicator can't apply delta: base revision body is missing
     kC4ErrorCorruptDelta,           // Replicator can't apply delta: delta data invalid
+    kC4ErrorQueryCanceled,          // Query was stopped by c4query_cancel
+    kC4ErrorQueryTimeout,           // Query took longer than its timeout
     kC4NumErrorCodesPlus1
 };
 
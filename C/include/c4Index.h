@@ -33,6 +33,9 @@ extern "C" {
         kC4FullTextIndex,      ///< Full-text index
         kC4ArrayIndex,         ///< Index of array values, for use with UNNEST
         kC4PredictiveIndex,    ///< Index of prediction() results (Enterprise Edition only)
+        kC4SpatialIndex,       ///< R-tree index of 2D points or boxes, for GEO_ functions
+        kC4VectorIndex,        ///< Approximate nearest-neighbor index of numeric arrays
+        kC4AggregateIndex,     ///< Materialized GROUP BY results: counts, sums, mins & maxes
     };
 
 
@@ -75,7 +78,7 @@ extern "C" {
         The name is used to identify the index for later updating or deletion; if an index with the
         same name already exists, it will be replaced unless it has the exact same expressions.
 
-        Currently four types of indexes are supported:
+        Currently seven types of indexes are supported:
 
         * Value indexes speed up queries by making it possible to look up property (or expression)
           values without scanning every document. They're just like regular indexes in SQL or N1QL.
@@ -90,6 +93,13 @@ extern "C" {
           (across all documents) as a table in the SQLite database, and creating a SQL index on it.
         * Predictive indexes optimize queries that use the PREDICTION() function, by materializing
           the function's results as a table and creating a SQL index on a result property.
+        * Spatial indexes store a 2D bounding box per document in an R-tree, for geographic
+          queries using the GEO_WITHIN(), GEO_INTERSECTS() and GEO_DISTANCE() functions.
+        * Vector indexes find the documents whose numeric-array property (such as an embedding)
+          is nearest to a target vector, using the VECTOR_DISTANCE() function, without reading
+          every document.
+        * Aggregate indexes store the grouped results of an aggregate query, and keep them up to
+          date as documents change, so the query can be answered without scanning the documents.
 
         Note: If some documents are missing the values to be indexed,
         those documents will just be omitted from the index. It's not an error.
@@ -102,11 +112,53 @@ extern "C" {
         In a predictive index, the expression is a PREDICTION() call in JSON query syntax,
         including the optional 3rd parameter that gives the result property to extract (and index.)
 
+        In a spatial index, `WHAT` has either two expressions, the X and Y (longitude and latitude)
+        of a point, or four expressions, the minimum X, minimum Y, maximum X and maximum Y of a
+        box. Documents whose values aren't all numbers are omitted. A query refers to the index by
+        name: `["GEO_WITHIN()", name, minX, minY, maxX, maxY]` is true if the document's box is
+        inside the given box, `["GEO_INTERSECTS()", name, minX, minY, maxX, maxY]` is true if it
+        overlaps it, and `["GEO_DISTANCE()", name, x, y]` returns the distance from the point to the
+        document's box, which is useful in `ORDER_BY` together with `LIMIT` to find the nearest
+        documents. Queries using these functions only return documents that are in the index.
+        Coordinates are stored as 32-bit floats, rounded outwards, so boxes may be very slightly
+        larger than the indexed values.
+
+        In a vector index, `WHAT` has a single expression, which must evaluate to an array of
+        numbers; all of them must have the same length. The vectors are partitioned into clusters
+        when the index is created, and each document's vector is stored with its nearest cluster.
+        `["VECTOR_DISTANCE()", name, target, probes]` returns the Euclidean distance between the
+        document's vector and `target`, searching only the `probes` clusters (default 8) nearest
+        to the target; use it in `ORDER_BY` together with `LIMIT` to get the approximate nearest
+        documents. More probes are slower but find more of the true nearest neighbors. As with
+        spatial indexes, queries only return documents that are in the index. Vectors are stored
+        as 32-bit floats.
+
+        In an aggregate index, `WHAT` mixes group keys with calls of `COUNT()`, `SUM()`, `AVG()`,
+        `MIN()` or `MAX()` on a single expression. The index stores one row per distinct combination
+        of the group keys (in order), holding the running counts, sums, minimums and maximums of
+        the documents in that group, and triggers update the rows as documents are saved or
+        deleted. A query whose `GROUP_BY` is the index's group keys, whose `WHERE` is the same as
+        the index's, and whose `WHAT`, `HAVING` and `ORDER_BY` only use the group keys and those
+        aggregates, reads its results from the index instead. Sums of non-integer values are kept
+        incrementally, so they may differ from a rescan by floating-point rounding.
+
         `indexSpecJSON` specifies the index as a JSON object, with properties:
         * `WHAT`: An array of expressions in the JSON query syntax. (Note that each
           expression is already an array, so there are two levels of nesting.)
         * `WHERE`: An optional expression. Including this creates a _partial index_: documents
           for which this expression returns `false` or `null` will be skipped.
+        * `INCLUDE`: (value indexes only) An optional array of expressions whose values will be
+          stored along with the index, making it a _covering index_. A query that returns any
+          of these expressions in its `WHAT` clause will read them from the index instead of
+          from the document bodies.
+        * `MERGE`: (full-text indexes only) An optional non-negative integer: the maximum number
+          of pages the housekeeping task (see `c4db_startHousekeeping`) may write per step when
+          incrementally merging the index's segments while the database is idle. Defaults to 100;
+          0 disables background merging.
+        * `CENTROIDS`: (vector indexes only) An optional non-negative integer: the number of clusters
+          to partition the vectors into. Defaults to 0, which uses about the square root of the
+          number of documents. Clusters are computed when the index is created, so an index
+          created on an empty or very different data set should be deleted and recreated later.
 
         For backwards compatibility, `indexSpecJSON` may be an array; this is treated as if it were
         a dictionary with a `WHAT` key mapping to that array.
@@ -153,6 +205,37 @@ extern "C" {
     C4SliceResult c4db_getIndexesInfo(C4Database* database C4NONNULL,
                                     C4Error* outError) C4API;
 
+    /** Turns recording of the database's query workload on or off. While it's on, each run of a
+        query on this C4Database records the query's plan, its number of runs, the rows it read
+        in full table scans, and the time it took. Turning recording on clears any previously
+        recorded workload.
+        @param database  The database whose queries to record.
+        @param record  True to record, false to stop. */
+    void c4db_setQueryWorkloadRecording(C4Database* database C4NONNULL,
+                                        bool record) C4API;
+
+    /** Suggests indexes based on the query workload recorded since
+        `c4db_setQueryWorkloadRecording` was called.
+
+        A query whose plan scans the whole table may get a value index on the properties its
+        `WHERE` clause compares with constants, or on its `ORDER_BY` properties if it has a
+        `LIMIT`. One that searches a property for a substring, with `LIKE '%...'` or `CONTAINS()`,
+        may get a full-text index (the test must be rewritten as a `MATCH` to use it.) An
+        `UNNEST` that has no array index gets one.
+
+        @param database  The database to advise.
+        @param outError  On failure, will be set to the error status.
+        @return  A Fleece-encoded dictionary, or NULL on failure. Its keys are:
+            * `suggestions`: An array of dictionaries, most beneficial first, each with
+              `type` (a C4IndexType), `expr` (the index spec JSON to pass to `c4db_createIndex`),
+              `reason`, `queries` (the number of recorded queries it would help), `runs` (their
+              total number of runs), `rowsScanned` (the rows those runs read in full table
+              scans) and `time` (the seconds those runs took: the most the index could save.)
+            * `unused`: An array of the names of existing indexes that no recorded query used.
+              This is empty if nothing was recorded. */
+    C4SliceResult c4db_getIndexAdvice(C4Database* database C4NONNULL,
+                                      C4Error* outError) C4API;
+
     /** @} */
 
 #ifdef __cplusplus
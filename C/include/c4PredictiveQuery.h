@@ -102,6 +102,45 @@ extern "C" {
     bool c4pred_unregisterModel(const char* C4NONNULL name) C4API;
 
 
+    /** Optional capabilities of a predictive model, for \ref c4pred_registerModelWithOptions.
+        (They aren't in C4PredictiveModel, whose layout can't change, since it's passed by value.)
+        Zero-initialize it, so any options you don't set are off. */
+    typedef struct {
+        /** Optional: runs the prediction on many inputs at once. If non-NULL, this is called
+            instead of `prediction` while a predictive index is being built, with batches of
+            documents' inputs. The same rules apply as for the model's `prediction`.
+            @param context  The value of the C4PredictiveModel's `context` field.
+            @param inputs  An array of `count` input dictionaries.
+            @param count  The number of inputs.
+            @param database  The database being indexed.
+            @param outResults  An array of `count` results, each initially {NULL, 0}, in which to
+                    store the output of each prediction (as in the return value of `prediction`.)
+            @param error  Store an error here on failure.
+            @return  True on success, false if an error occurred. */
+        bool (*predictionBatch)(void* context,
+                                const FLDict inputs[] C4NONNULL,
+                                size_t count,
+                                C4Database* C4NONNULL database,
+                                C4SliceResult outResults[] C4NONNULL,
+                                C4Error *error);
+
+        /** Optional: the maximum number of results to cache, keyed by the database and a
+            digest of the input dictionary, so that calls with an input already seen don't re-run
+            the model. Only set this if the model is deterministic (see the warning on
+            C4PredictiveModel's `prediction`.)
+            Zero, the default, disables caching. */
+        size_t cacheCapacity;
+    } C4PredictiveModelOptions;
+
+    /** Registers a predictive model, like \ref c4pred_registerModel, with optional capabilities.
+        @param name  The name of the model.
+        @param model  The model.
+        @param options  The model's optional capabilities, or NULL for none. */
+    void c4pred_registerModelWithOptions(const char* C4NONNULL name,
+                                         C4PredictiveModel model,
+                                         const C4PredictiveModelOptions *options) C4API;
+
+
     /** @} */
 
 #ifdef __cplusplus
@@ -73,12 +73,76 @@ extern "C" {
     FLString c4query_columnTitle(C4Query* C4NONNULL, unsigned column) C4API;
 
 
+    //////// QUERY STATISTICS:
+
+
+    /** Execution statistics of a query, accumulated over all the times it's been run since
+        collection was enabled by \ref c4query_setCollectStats. Times are in seconds. */
+    typedef struct {
+        uint64_t runCount;          ///< Number of times the query has been run
+        uint64_t rowsReturned;      ///< Total number of result rows produced
+        uint64_t fullScanSteps;     ///< Rows stepped through by full table scans (add an index!)
+        uint64_t sortOperations;    ///< Number of sort operations (ORDER BY not using an index)
+        uint64_t autoIndexRows;     ///< Rows inserted into transient indexes SQLite had to build
+        uint64_t vmSteps;           ///< SQLite virtual-machine operations; a measure of total work
+        uint64_t fleeceCalls;       ///< Number of document bodies evaluated by query functions
+        uint64_t parallelRuns;      ///< Runs split up across threads (see c4query_setParallelism)
+        double   stepTime;          ///< Time spent by SQLite finding result rows
+        double   encodeTime;        ///< Time spent encoding result rows
+        double   maxRunTime;        ///< Time taken by the slowest single run
+    } C4QueryStats;
+
+
+    /** Turns collection of execution statistics on or off. Collecting adds a little overhead to
+        each run, so it's off by default. Either way, any existing statistics are cleared.
+        The query plan is available from \ref c4query_explain. */
+    void c4query_setCollectStats(C4Query *query C4NONNULL, bool collect) C4API;
+
+    /** Copies the query's accumulated execution statistics to `outStats`.
+        Returns false (leaving `outStats` alone) if statistics aren't being collected. */
+    bool c4query_getStats(C4Query *query C4NONNULL, C4QueryStats *outStats C4NONNULL) C4API;
+
+    /** Sets a run time, in seconds, above which any query will be logged as a warning to the
+        Query log domain, along with its plan. Zero (the default) disables this. */
+    void c4query_setSlowQueryThreshold(double seconds) C4API;
+
+
+    //////// PARALLEL EXECUTION:
+
+
+    /** Allows an aggregate query to be run on up to `maxThreads` threads at once, each
+        aggregating part of the database on its own connection, with the partial results merged.
+        Only queries whose results are all group keys or count(), sum(), min(), max() or avg()
+        calls, and that have no HAVING, ORDER_BY, LIMIT, OFFSET, joins or full-text matches, can
+        be run this way; others (and small databases) are run serially as usual. A query run
+        within a transaction is always run serially.
+        Results are the same either way, except that a grouped query's rows come out in the
+        order of their group keys. Zero or 1 (the default) disables this. At most 8 threads are
+        used, and no more than the number of CPU cores. */
+    void c4query_setParallelism(C4Query *query C4NONNULL, unsigned maxThreads) C4API;
+
+
+    //////// PERSISTENT LIVE RESULTS:
+
+
+    /** Makes the query's observers (see \ref c4queryobs_create) save its latest results in the
+        database. When an identical query (same language, expression and parameters) is observed
+        later, even after the app restarts, its observers are called with the saved results
+        right away, instead of waiting for the query to run: they're final if the database
+        hasn't changed since they were saved, and otherwise are followed by the current results
+        if those differ. Must be called before enabling an observer. */
+    void c4query_setPersistentResults(C4Query *query C4NONNULL, bool persist) C4API;
+
+
     //////// RUNNING QUERIES:
 
 
     /** Options for running queries. */
     typedef struct {
         bool rankFullText;      ///< Should full-text results be ranked by relevance?
+        C4Slice continuation;   ///< Token from c4queryenum_getContinuation, to get the next page
+        bool countOnly;         ///< Only count the rows: the enumerator has a row count but no rows
+        uint64_t maxRows;       ///< If nonzero, stop reading rows after this many
     } C4QueryOptions;
 
 
@@ -122,11 +186,48 @@ extern "C" {
         @param query  The compiled query to run.
         @param encodedParameters  JSON- or Fleece-encoded dictionary whose keys correspond
                 to the named parameters in the query expression, and values correspond to the
-                values to bind. Any unbound parameters will be `null`. */
+                values to bind. Any unbound parameters will be `null`. If this isn't a valid
+                dictionary, running the query with these parameters fails with its error. */
     void c4query_setParameters(C4Query *query C4NONNULL,
                                C4String encodedParameters) C4API;
 
 
+    /** Types of values in a C4QueryParameter. */
+    typedef C4_ENUM(uint8_t, C4QueryParameterType) {
+        kC4ParameterNull,           ///< JSON null (no value field is used)
+        kC4ParameterBool,           ///< `value.boolean`
+        kC4ParameterInt,            ///< `value.integer`
+        kC4ParameterDouble,         ///< `value.number`
+        kC4ParameterString,         ///< `value.string` (UTF-8)
+        kC4ParameterData,           ///< `value.data` (binary data)
+    };
+
+    /** A typed query parameter value, for \ref c4query_setParameterValues. */
+    typedef struct {
+        C4String name;              ///< Name of the parameter, without the '$'
+        C4QueryParameterType type;  ///< Which member of `value` is used
+        union {
+            bool     boolean;
+            int64_t  integer;
+            double   number;
+            C4String string;
+            C4Slice  data;
+        } value;
+    } C4QueryParameter;
+
+    /** Sets the parameter values to use when running the query, like
+        \ref c4query_setParameters, but from an array of typed values. This avoids formatting
+        and parsing JSON, which matters when a query is re-run at a high rate with new values.
+        (Passing Fleece-encoded data to \ref c4query_setParameters is equally efficient.)
+        @param query  The compiled query.
+        @param params  Array of parameter values; any query parameters not given will be `null`.
+                If a value has an unknown type, running the query with these fails.
+        @param count  Number of items in `params`. */
+    void c4query_setParameterValues(C4Query *query C4NONNULL,
+                                    const C4QueryParameter params[],
+                                    size_t count) C4API;
+
+
     /** Runs a compiled query.
         NOTE: Queries will run much faster if the appropriate properties are indexed.
         Indexes must be created explicitly by calling `c4db_createIndex`.
@@ -141,12 +242,53 @@ extern "C" {
                                    C4String encodedParameters,
                                    C4Error *outError) C4API;
 
+    /** Callback for \ref c4query_runAsync, called once the query has finished running.
+        @warning  This function is called on a random background thread!
+        @param query  The query that was run.
+        @param results  An enumerator of the results, or NULL on failure. It's released after the
+                        callback returns; call \ref c4queryenum_retain to keep it.
+        @param error  The error, if `results` is NULL. A run stopped by \ref c4query_cancel fails
+                        with kC4ErrorQueryCanceled, one that exceeded its timeout with
+                        kC4ErrorQueryTimeout.
+        @param context  The `context` parameter you passed to \ref c4query_runAsync. */
+    typedef void (*C4QueryRunCallback)(C4Query *query C4NONNULL,
+                                       C4QueryEnumerator *results,
+                                       C4Error error,
+                                       void *context);
+
+    /** Runs a compiled query on a background thread, returning immediately, and calls the
+        callback with the results or error when it's done. The parameters are the same as
+        \ref c4query_run's. The query is run on the database's background connection, so it
+        doesn't see changes made in a transaction that's still open.
+        If the run can't even be started (e.g. the parameters are invalid), the callback is
+        called with the error before this function returns. */
+    void c4query_runAsync(C4Query *query C4NONNULL,
+                          const C4QueryOptions *options,
+                          C4String encodedParameters,
+                          C4QueryRunCallback callback C4NONNULL,
+                          void *context) C4API;
+
+    /** Stops every run of the query that's in progress or waiting to start, synchronous (on
+        another thread) or asynchronous. They fail with kC4ErrorQueryCanceled. Runs started
+        after this call aren't affected. */
+    void c4query_cancel(C4Query *query C4NONNULL) C4API;
+
+    /** Sets the maximum time, in seconds, that a run of the query may take; a run that takes
+        longer stops and fails with kC4ErrorQueryTimeout. Zero (the default) means no limit.
+        The time of an asynchronous run starts when it begins running, not when it's queued. */
+    void c4query_setTimeout(C4Query *query C4NONNULL, double seconds) C4API;
+
     /** Given a C4FullTextMatch from the enumerator, returns the entire text of the property that
         was matched. (The result depends only on the term's `dataSource` and `property` fields,
         so if you get multiple matches of the same property in the same document, you can skip
         redundant calls with the same values.)
         To find the actual word that was matched, use the term's `start` and `length` fields
-        to get a substring of the returned (UTF-8) string. */
+        to get a substring of the returned (UTF-8) string.
+        This looks up the text in the index, once per call. To highlight the matches of many rows,
+        it's faster to have the query return them, by calling the `snippet()` function in
+        its WHAT clause: `['snippet()', indexName, start, end, ellipsis, wordCount]` returns the
+        text around the row's matches, with each one between `start` and `end` (which default to
+        `<b>` and `</b>`.) */
     C4StringResult c4query_fullTextMatched(C4Query *query C4NONNULL,
                                            const C4FullTextMatch *term C4NONNULL,
                                            C4Error *outError) C4API;
@@ -158,6 +300,10 @@ extern "C" {
 
     /** Returns the total number of rows in the query, if known.
         Not all query enumerators may support this (but the current implementation does.)
+        This is the cheapest way to count the rows: run the query with the `countOnly` option,
+        which steps through the rows without reading their columns. (With the `maxRows` option,
+        the count is at most `maxRows`; a `maxRows` of 1 makes a fast "does anything match?"
+        check.)
         @param e  The query enumerator
         @param outError  On failure, an error will be stored here (probably kC4ErrorUnsupported.)
         @return  The number of rows, or -1 on failure. */
@@ -180,6 +326,19 @@ extern "C" {
                                            C4Error *outError) C4API
     { return c4queryenum_seek(e, -1, outError); }
 
+    /** Returns an opaque token for getting the next page of results, by "keyset pagination":
+        run the same query with this token as the `continuation` option, and it returns only the
+        rows that sort after this enumerator's last row. Unlike OFFSET, this doesn't step through
+        the preceding rows, so every page is as fast to get as the first.
+        Only a non-aggregate query with ORDER_BY and LIMIT (but no OFFSET) and no joins or
+        UNNESTs can be paged; otherwise this fails with kC4ErrorUnsupported. It also fails that
+        way if the query was run with the `countOnly` option, since there are no rows.
+        @param e  The query enumerator
+        @param outError  On failure, an error will be stored here.
+        @return  The continuation token, or a null slice if there are no rows (or on failure.) */
+    C4SliceResult c4queryenum_getContinuation(C4QueryEnumerator *e C4NONNULL,
+                                              C4Error *outError) C4API;
+
     /** Checks whether the query results have changed since this enumerator was created;
         if so, returns a new enumerator. Otherwise returns NULL. */
     C4QueryEnumerator* c4queryenum_refresh(C4QueryEnumerator *e C4NONNULL,
@@ -190,6 +349,57 @@ extern "C" {
     void c4queryenum_close(C4QueryEnumerator*) C4API;
 
 
+    //////// COLUMNAR RESULTS:
+
+
+    /** The type of the values in a column of \ref C4QueryColumns. */
+    typedef C4_ENUM(uint8_t, C4QueryColumnType) {
+        kC4ColumnNull,          ///< Every value is null or missing; there are no value buffers
+        kC4ColumnInteger,       ///< Values are in `integers`
+        kC4ColumnDouble,        ///< Values are in `doubles`
+        kC4ColumnString,        ///< UTF-8 strings, in `bytes` delimited by `offsets`
+        kC4ColumnFleece,        ///< Other or mixed types; each value is a Fleece doc in `bytes`
+    };
+
+    /** One column of a query's columnar results. Row `i`'s value is at index `i` of `integers`
+        or `doubles` (0 if it's null), or is `bytes[offsets[i] ..< offsets[i+1]]`.
+        The pointers are valid until the C4QueryColumns is released. */
+    typedef struct {
+        C4QueryColumnType type;
+        const uint8_t* validity;    ///< Bit `i % 8` of byte `i / 8` is set if row i isn't null
+        const int64_t* integers;
+        const double* doubles;
+        const uint64_t* offsets;    ///< rowCount+1 byte offsets
+        const uint8_t* bytes;
+    } C4QueryColumn;
+
+    /** Query results stored by column, in typed buffers that can be read without decoding any
+        Fleece. Created by \ref c4query_runColumnar. */
+    typedef struct C4QueryColumns C4QueryColumns;
+
+    /** Runs a query and returns its results by column instead of as an enumerator. This is
+        much faster for reading many rows of numbers, or strings, into columnar data structures.
+        The `maxRows` option applies; `countOnly` doesn't. */
+    C4QueryColumns* c4query_runColumnar(C4Query *query C4NONNULL,
+                                        const C4QueryOptions *options,
+                                        C4String encodedParameters,
+                                        C4Error *outError) C4API;
+
+    /** Returns the number of rows in the results. */
+    uint64_t c4querycolumns_getRowCount(C4QueryColumns *columns C4NONNULL) C4API;
+
+    /** Returns the number of columns in the results. */
+    unsigned c4querycolumns_getColumnCount(C4QueryColumns *columns C4NONNULL) C4API;
+
+    /** Gets a column of the results. Returns false if the index is out of range. */
+    bool c4querycolumns_getColumn(C4QueryColumns *columns C4NONNULL,
+                                  unsigned columnIndex,
+                                  C4QueryColumn *outColumn C4NONNULL) C4API;
+
+    /** Frees the results. */
+    void c4querycolumns_release(C4QueryColumns*) C4API;
+
+
     /** @} */
 
 #ifdef __cplusplus
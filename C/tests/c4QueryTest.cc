@@ -20,6 +20,8 @@
 #include "c4BlobStore.h"
 #include "c4Observer.h"
 #include "StringUtil.hh"
+#include <atomic>
+#include <mutex>
 #include <thread>
 
 
@@ -171,6 +173,237 @@ N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query sorted", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query count only and max rows", "[Query][C]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"),
+            json5("[['.', 'name', 'last']]"));
+    C4Error error;
+    C4QueryOptions options = kC4DefaultQueryOptions;
+
+    // Count-only: the enumerator has the row count, but no rows:
+    options.countOnly = true;
+    auto e = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e);
+    CHECK(c4queryenum_getRowCount(e, &error) == 8);
+    CHECK(!c4queryenum_next(e, &error));
+    CHECK(error.code == 0);
+    c4queryenum_release(e);
+
+    // First rows only:
+    options.countOnly = false;
+    options.maxRows = 3;
+    e = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e);
+    CHECK(c4queryenum_getRowCount(e, &error) == 3);
+    vector<string> docIDs;
+    while (c4queryenum_next(e, &error))
+        docIDs.push_back(slice(FLValue_AsString(FLArrayIterator_GetValueAt(&e->columns, 0))).asString());
+    CHECK(error.code == 0);
+    CHECK(docIDs == (vector<string>{"0000015", "0000036", "0000072"}));
+    c4queryenum_release(e);
+
+    // Existence check:
+    options.countOnly = true;
+    options.maxRows = 1;
+    e = c4query_run(query, &options, kC4SliceNull, &error);
+    REQUIRE(e);
+    CHECK(c4queryenum_getRowCount(e, &error) == 1);
+    c4queryenum_release(e);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query columnar results", "[Query][C]") {
+    compileSelect(json5("{WHAT: [['.name.first'], ['length()', ['.name.first']], \
+                                 ['*', 0.5, ['length()', ['.name.first']]], ['.name'], ['.nosuchprop']], \
+                          WHERE: ['=', ['.contact.address.state'], 'CA'], \
+                       ORDER_BY: [['.name.last']]}"));
+    // Get the first names and the names as JSON row by row, to compare:
+    auto rows = runCollecting<pair<string,string>>(nullptr, [&](C4QueryEnumerator *e) {
+        CHECK((e->missingColumns & 0x10) != 0);
+        slice first = FLValue_AsString(FLArrayIterator_GetValueAt(&e->columns, 0));
+        fleece::alloc_slice json = FLValue_ToJSON(FLArrayIterator_GetValueAt(&e->columns, 3));
+        return make_pair(first.asString(), json.asString());
+    });
+    REQUIRE(rows.size() == 8);
+
+    C4Error error;
+    C4QueryColumns *columns = c4query_runColumnar(query, &kC4DefaultQueryOptions, kC4SliceNull,
+                                                  &error);
+    REQUIRE(columns);
+    REQUIRE(c4querycolumns_getRowCount(columns) == 8);
+    REQUIRE(c4querycolumns_getColumnCount(columns) == 5);
+
+    C4QueryColumn names, lengths, halves, dicts, missing;
+    REQUIRE(c4querycolumns_getColumn(columns, 0, &names));
+    REQUIRE(c4querycolumns_getColumn(columns, 1, &lengths));
+    REQUIRE(c4querycolumns_getColumn(columns, 2, &halves));
+    REQUIRE(c4querycolumns_getColumn(columns, 3, &dicts));
+    REQUIRE(c4querycolumns_getColumn(columns, 4, &missing));
+    CHECK(!c4querycolumns_getColumn(columns, 5, &missing));
+    CHECK(names.type == kC4ColumnString);
+    CHECK(lengths.type == kC4ColumnInteger);
+    CHECK(halves.type == kC4ColumnDouble);
+    CHECK(dicts.type == kC4ColumnFleece);
+    CHECK(missing.type == kC4ColumnNull);
+
+    for (unsigned i = 0; i < 8; ++i) {
+        CHECK((names.validity[i / 8] & (1 << (i % 8))) != 0);
+        CHECK((missing.validity[i / 8] & (1 << (i % 8))) == 0);
+        string name((const char*)&names.bytes[names.offsets[i]],
+                    names.offsets[i+1] - names.offsets[i]);
+        CHECK(name == rows[i].first);
+        CHECK(lengths.integers[i] == (int64_t)name.size());
+        CHECK(halves.doubles[i] == 0.5 * name.size());
+        slice dictData(&dicts.bytes[dicts.offsets[i]], dicts.offsets[i+1] - dicts.offsets[i]);
+        fleece::alloc_slice dictJSON = FLValue_ToJSON(FLValue_FromData(dictData, kFLTrusted));
+        CHECK(dictJSON.asString() == rows[i].second);
+    }
+    c4querycolumns_release(columns);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query columnar results of mixed types", "[Query][C]") {
+    {
+        TransactionHelper t(db);
+        const char* bodies[] = {
+            "{\"order\": 1, \"mixed\": 7,       \"dictFirst\": {\"a\": 1}}",
+            "{\"order\": 2, \"mixed\": \"seven\", \"dictFirst\": 3}",
+            "{\"order\": 3, \"mixed\": 8,       \"dictFirst\": \"x\"}",
+            "{\"order\": 4,                     \"dictFirst\": 4.5}",
+            "{\"order\": 5, \"mixed\": {\"b\": [1, 2]}, \"dictFirst\": {\"c\": null}}",
+        };
+        int i = 0;
+        for (const char *body : bodies) {
+            C4Error error;
+            C4SliceResult data = c4db_encodeJSON(db, c4str(body), &error);
+            REQUIRE(data.buf);
+            createNewRev(db, c4str(("mixed" + to_string(++i)).c_str()), (C4Slice)data);
+            c4slice_free(data);
+        }
+    }
+    compileSelect(json5("{WHAT: [['.mixed'], ['.dictFirst']], \
+                          WHERE: ['>', ['.order'], 0], \
+                       ORDER_BY: [['.order']]}"));
+    // Get each row's values as JSON, or "" if missing, to compare:
+    auto rows = runCollecting<pair<string,string>>(nullptr, [&](C4QueryEnumerator *e) {
+        string json[2];
+        for (unsigned col = 0; col < 2; ++col) {
+            if ((e->missingColumns & (1 << col)) == 0) {
+                fleece::alloc_slice j = FLValue_ToJSON(FLArrayIterator_GetValueAt(&e->columns, col));
+                json[col] = j.asString();
+            }
+        }
+        return make_pair(json[0], json[1]);
+    });
+    REQUIRE(rows.size() == 5);
+
+    C4Error error;
+    C4QueryColumns *columns = c4query_runColumnar(query, &kC4DefaultQueryOptions, kC4SliceNull,
+                                                  &error);
+    REQUIRE(columns);
+    REQUIRE(c4querycolumns_getRowCount(columns) == 5);
+    C4QueryColumn mixed, dictFirst;
+    REQUIRE(c4querycolumns_getColumn(columns, 0, &mixed));
+    REQUIRE(c4querycolumns_getColumn(columns, 1, &dictFirst));
+    CHECK(mixed.type == kC4ColumnFleece);
+    CHECK(dictFirst.type == kC4ColumnFleece);
+
+    auto columnJSON = [](const C4QueryColumn &column, unsigned i) -> string {
+        if ((column.validity[i / 8] & (1 << (i % 8))) == 0)
+            return "";
+        slice data(&column.bytes[column.offsets[i]], column.offsets[i+1] - column.offsets[i]);
+        fleece::alloc_slice json = FLValue_ToJSON(FLValue_FromData(data, kFLTrusted));
+        return json.asString();
+    };
+    for (unsigned i = 0; i < 5; ++i) {
+        CHECK(columnJSON(mixed, i) == rows[i].first);
+        CHECK(columnJSON(dictFirst, i) == rows[i].second);
+    }
+    CHECK(rows[3].first == "");
+    c4querycolumns_release(columns);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query index advice", "[Query][C]") {
+    C4Error error;
+    REQUIRE(c4db_createIndex(db, C4STR("byLast"), C4STR("[[\".name.last\"]]"), kC4ValueIndex,
+                             nullptr, &error));
+    c4db_setQueryWorkloadRecording(db, true);
+
+    string byState = json5("['=', ['.', 'contact', 'address', 'state'], 'CA']");
+    compile(byState);
+    CHECK(run().size() == 8);
+    CHECK(run().size() == 8);
+    compile(json5("['LIKE', ['.name.first'], '%an%']"));
+    CHECK(run().size() > 0);
+
+    C4SliceResult advice = c4db_getIndexAdvice(db, &error);
+    REQUIRE(advice.buf);
+    FLDict root = FLValue_AsDict(FLValue_FromData((FLSlice)advice, kFLTrusted));
+    FLArray suggestions = FLValue_AsArray(FLDict_Get(root, "suggestions"_sl));
+    REQUIRE(FLArray_Count(suggestions) == 2);
+    // The query run twice scanned the most rows, so it comes first:
+    FLDict first = FLValue_AsDict(FLArray_Get(suggestions, 0));
+    CHECK(FLValue_AsInt(FLDict_Get(first, "type"_sl)) == kC4ValueIndex);
+    CHECK(slice(FLValue_AsString(FLDict_Get(first, "expr"_sl))) == "[[\".contact.address.state\"]]"_sl);
+    CHECK(FLValue_AsInt(FLDict_Get(first, "queries"_sl)) == 1);
+    CHECK(FLValue_AsInt(FLDict_Get(first, "runs"_sl)) == 2);
+    CHECK(FLValue_AsInt(FLDict_Get(first, "rowsScanned"_sl)) >= 200);
+    FLDict second = FLValue_AsDict(FLArray_Get(suggestions, 1));
+    CHECK(FLValue_AsInt(FLDict_Get(second, "type"_sl)) == kC4FullTextIndex);
+    CHECK(slice(FLValue_AsString(FLDict_Get(second, "expr"_sl))) == "[[\".name.first\"]]"_sl);
+    FLArray unused = FLValue_AsArray(FLDict_Get(root, "unused"_sl));
+    REQUIRE(FLArray_Count(unused) == 1);
+    CHECK(slice(FLValue_AsString(FLArray_Get(unused, 0))) == "byLast"_sl);
+    c4slice_free(advice);
+
+    // Follow the first suggestion; the query's plan changes, so it's no longer suggested:
+    REQUIRE(c4db_createIndex(db, C4STR("byState"), C4STR("[[\".contact.address.state\"]]"),
+                             kC4ValueIndex, nullptr, &error));
+    compile(byState);
+    CHECK(run().size() == 8);
+    advice = c4db_getIndexAdvice(db, &error);
+    REQUIRE(advice.buf);
+    root = FLValue_AsDict(FLValue_FromData((FLSlice)advice, kFLTrusted));
+    suggestions = FLValue_AsArray(FLDict_Get(root, "suggestions"_sl));
+    REQUIRE(FLArray_Count(suggestions) == 1);
+    CHECK(FLValue_AsInt(FLDict_Get(FLValue_AsDict(FLArray_Get(suggestions, 0)), "type"_sl))
+          == kC4FullTextIndex);
+    unused = FLValue_AsArray(FLDict_Get(root, "unused"_sl));
+    REQUIRE(FLArray_Count(unused) == 1);
+    CHECK(slice(FLValue_AsString(FLArray_Get(unused, 0))) == "byLast"_sl);
+    c4slice_free(advice);
+
+    c4db_setQueryWorkloadRecording(db, false);
+}
+
+
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query statistics", "[Query][C]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"),
+            json5("[['.', 'name', 'last']]"));
+    C4QueryStats stats;
+    CHECK(!c4query_getStats(query, &stats));
+
+    c4query_setCollectStats(query, true);
+    REQUIRE(c4query_getStats(query, &stats));
+    CHECK(stats.runCount == 0);
+
+    CHECK(run().size() == 8);
+    CHECK(run().size() == 8);
+    REQUIRE(c4query_getStats(query, &stats));
+    CHECK(stats.runCount == 2);
+    CHECK(stats.rowsReturned == 16);
+    CHECK(stats.fullScanSteps >= 2 * 100);      // no index, so every doc is scanned
+    CHECK(stats.sortOperations >= 2);
+    CHECK(stats.vmSteps > 0);
+    CHECK(stats.fleeceCalls >= 2 * 100);
+    CHECK(stats.stepTime > 0.0);
+    CHECK(stats.maxRunTime > 0.0);
+
+    c4query_setCollectStats(query, false);
+    CHECK(!c4query_getStats(query, &stats));
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query bindings", "[Query][C]") {
     compile(json5("['=', ['.', 'contact', 'address', 'state'], ['$', 1]]"));
     CHECK(run("{\"1\": \"CA\"}") == (vector<string>{"0000001", "0000015", "0000036", "0000043", "0000053", "0000064", "0000072", "0000073"}));
@@ -179,6 +412,53 @@ N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query bindings", "[Query][C]") {
 }
 
 
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query typed bindings", "[Query][C][!throws]") {
+    compile(json5("['AND', ['=', ['.', 'contact', 'address', 'state'], ['$', 'state']],"
+                         " ['>=', ['.', 'contact', 'address', 'zip'], ['$', 'zip']]]"));
+    C4QueryParameter params[2] = {};
+    params[0].name = C4STR("state");
+    params[0].type = kC4ParameterString;
+    params[0].value.string = C4STR("CA");
+    params[1].name = C4STR("zip");
+    params[1].type = kC4ParameterString;
+    params[1].value.string = C4STR("94000");
+    c4query_setParameterValues(query, params, 2);
+    CHECK(run() == (vector<string>{"0000015", "0000073"}));
+
+    // Rebinding the same query with new values:
+    params[0].value.string = C4STR("TX");
+    params[1].value.string = C4STR("0");
+    c4query_setParameterValues(query, params, 2);
+    CHECK(run() == (vector<string>{"0000018", "0000044", "0000055", "0000057"}));
+
+    // Numbers sort before strings, so every (string) zip code is >= a numeric parameter:
+    params[1].type = kC4ParameterInt;
+    params[1].value.integer = 99999;
+    c4query_setParameterValues(query, params, 2);
+    CHECK(run() == (vector<string>{"0000018", "0000044", "0000055", "0000057"}));
+
+    // Invalid parameters make runs fail, until valid ones are set:
+    {
+        ExpectingExceptions x;
+        C4Error error;
+        c4query_setParameters(query, C4STR("{\"state\": "));
+        CHECK(c4query_run(query, nullptr, kC4SliceNull, &error) == nullptr);
+        CHECK(error.domain == LiteCoreDomain);
+        CHECK(error.code == kC4ErrorInvalidParameter);
+        c4query_setParameters(query, C4STR("[\"CA\"]"));
+        CHECK(c4query_run(query, nullptr, kC4SliceNull, &error) == nullptr);
+        CHECK(error.code == kC4ErrorInvalidParameter);
+        params[1].type = (C4QueryParameterType)99;
+        c4query_setParameterValues(query, params, 2);
+        CHECK(c4query_run(query, nullptr, kC4SliceNull, &error) == nullptr);
+        CHECK(error.code == kC4ErrorInvalidParameter);
+    }
+    params[1].type = kC4ParameterInt;
+    c4query_setParameterValues(query, params, 2);
+    CHECK(run() == (vector<string>{"0000018", "0000044", "0000055", "0000057"}));
+}
+
+
 // Check binding arrays and dicts
 N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query binding types", "[Query][C]") {
     vector<string> queries = {
@@ -934,6 +1214,214 @@ N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query observer", "[Query][C][!throws]") {
     CHECK(c4queryenum_getRowCount(e2, &error) == 8);
 }
 
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query observers of identical queries", "[Query][C][!throws]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+    C4Error error;
+    c4::ref<C4Query> query2 = c4query_new(db, c4str(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']").c_str()), &error);
+    REQUIRE(query2);
+
+    struct State {
+        c4::ref<C4QueryObserver> obs;
+        atomic<int> count {0};
+    };
+
+    auto callback = [](C4QueryObserver *obs, C4Query *query, void *context) {
+        auto state = (State*)context;
+        CHECK(obs == state->obs);
+        ++state->count;
+    };
+    State state1, state2;
+    state1.obs = c4queryobs_create(query, callback, &state1);
+    state2.obs = c4queryobs_create(query2, callback, &state2);
+    c4queryobs_setEnabled(state1.obs, true);
+    c4queryobs_setEnabled(state2.obs, true);
+
+    C4Log("---- Waiting for both query observers...");
+    WaitUntil(2000, [&]{return state1.count > 0 && state2.count > 0;});
+    CHECK(state1.count == 1);
+    CHECK(state2.count == 1);
+
+    // Each observer gets its own enumerator of the same results:
+    c4::ref<C4QueryEnumerator> e1 = c4queryobs_getEnumerator(state1.obs, true, &error);
+    c4::ref<C4QueryEnumerator> e2 = c4queryobs_getEnumerator(state2.obs, true, &error);
+    REQUIRE(e1);
+    REQUIRE(e2);
+    CHECK(e1 != e2);
+    CHECK(c4queryenum_getRowCount(e1, &error) == 8);
+    CHECK(c4queryenum_getRowCount(e2, &error) == 8);
+    REQUIRE(c4queryenum_next(e1, &error));
+    REQUIRE(c4queryenum_next(e2, &error));
+    CHECK(FLValue_AsString(FLArrayIterator_GetValueAt(&e1->columns, 0))
+          == FLValue_AsString(FLArrayIterator_GetValueAt(&e2->columns, 0)));
+
+    // After one observer is disabled, the other still gets notified:
+    c4queryobs_setEnabled(state1.obs, false);
+    state1.count = state2.count = 0;
+    addPersonInState("after1", "CA");
+
+    C4Log("---- Waiting for remaining query observer...");
+    WaitUntil(2000, [&]{return state2.count > 0;});
+    CHECK(state2.count == 1);
+    CHECK(state1.count == 0);
+    e2 = c4queryobs_getEnumerator(state2.obs, true, &error);
+    REQUIRE(e2);
+    CHECK(c4queryenum_getRowCount(e2, &error) == 9);
+
+    c4queryobs_setEnabled(state2.obs, false);
+}
+
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query observer persistent results", "[Query][C][!throws]") {
+    string queryStr = json5("['=', ['.', 'contact', 'address', 'state'], 'CA']");
+
+    struct State {
+        c4::ref<C4QueryObserver> obs;
+        mutex m;
+        vector<int64_t> rowCounts;      // Row count of each notification's results
+    };
+    auto callback = [](C4QueryObserver *obs, C4Query *query, void *context) {
+        auto state = (State*)context;
+        C4Error error;
+        c4::ref<C4QueryEnumerator> e = c4queryobs_getEnumerator(obs, true, &error);
+        lock_guard<mutex> lock(state->m);
+        state->rowCounts.push_back(e ? c4queryenum_getRowCount(e, &error) : -1);
+    };
+    // Observes the query until it's been notified `n` times, then calls `then` if given, and
+    // waits a bit for any more:
+    auto observe = [&](size_t n, function<void()> then = nullptr) {
+        C4Error error;
+        c4query_release(query);
+        query = c4query_new(db, c4str(queryStr.c_str()), &error);
+        REQUIRE(query);
+        c4query_setPersistentResults(query, true);
+        State state;
+        state.obs = c4queryobs_create(query, callback, &state);
+        c4queryobs_setEnabled(state.obs, true);
+        WaitUntil(2000, [&]{lock_guard<mutex> lock(state.m); return state.rowCounts.size() >= n;});
+        if (then)
+            then();
+        this_thread::sleep_for(chrono::milliseconds(500));
+        c4queryobs_setEnabled(state.obs, false);
+        state.obs = nullptr;
+        c4query_release(query);
+        query = nullptr;
+        return state.rowCounts;
+    };
+
+    // The first time, the query runs and its results are saved:
+    CHECK(observe(1) == (vector<int64_t>{8}));
+
+    // After reopening, the saved results are current:
+    reopenDB();
+    CHECK(observe(1) == (vector<int64_t>{8}));
+
+    // The sequence the saved results are current as of (the key is a digest of the query's
+    // language, expression and parameters):
+    auto savedSequence = [&]() -> C4SequenceNumber {
+        string key = "0:" + queryStr;
+        key += '\0';
+        C4BlobKey digest = c4blob_computeKey(slice(key));
+        string hexKey = slice(digest.bytes, sizeof(digest.bytes)).hexString();
+        C4Error error;
+        C4RawDocument *raw = c4raw_get(db, C4STR("liveQueryResults"), slice(hexKey), &error);
+        REQUIRE(raw);
+        FLDict saved = FLValue_AsDict(FLValue_FromData(raw->body, kFLUntrusted));
+        auto seq = FLValue_AsUnsigned(FLDict_Get(saved, "seq"_sl));
+        c4raw_free(raw);
+        return seq;
+    };
+
+    // A change that doesn't affect the results doesn't notify, but the saved results are
+    // brought up to date, so after reopening they're still current:
+    CHECK(observe(1, [&]{
+        addPersonInState("after0", "NY");
+        C4SequenceNumber seq = c4db_getLastSequence(db);
+        WaitUntil(2000, [&]{return savedSequence() == seq;});
+        // Results are saved at most every few seconds, so another change right after isn't:
+        addPersonInState("after0b", "NY");
+        this_thread::sleep_for(chrono::milliseconds(750));
+        CHECK(savedSequence() == seq);
+    }) == (vector<int64_t>{8}));
+    // ...until the query stops:
+    WaitUntil(2000, [&]{return savedSequence() == c4db_getLastSequence(db);});
+    reopenDB();
+    CHECK(savedSequence() == c4db_getLastSequence(db));
+    CHECK(observe(1) == (vector<int64_t>{8}));
+
+    // After a change, the saved results are delivered, then the new ones:
+    addPersonInState("after1", "CA");
+    reopenDB();
+    CHECK(observe(2) == (vector<int64_t>{8, 9}));
+}
+
+N_WAY_TEST_CASE_METHOD(C4QueryTest, "C4Query async run", "[Query][C][!throws]") {
+    compile(json5("['=', ['.', 'contact', 'address', 'state'], 'CA']"));
+
+    struct State {
+        C4Query *query;
+        int count = 0;
+        int64_t rowCount = -1;
+        C4Error error = {};
+    };
+
+    auto callback = [](C4Query *query, C4QueryEnumerator *e, C4Error err, void *context) {
+        C4Log("---- Async query callback called!");
+        auto state = (State*)context;
+        CHECK(query == state->query);
+        state->rowCount = e ? c4queryenum_getRowCount(e, nullptr) : -1;
+        state->error = err;
+        ++state->count;
+    };
+    State state;
+    state.query = query;
+    c4query_runAsync(query, &kC4DefaultQueryOptions, kC4SliceNull, callback, &state);
+    WaitUntil(2000, [&]{return state.count > 0;});
+    CHECK(state.count == 1);
+    CHECK(state.rowCount == 8);
+    CHECK(state.error.code == 0);
+
+    // A run that fails reports the error through the callback:
+    state = State();
+    state.query = query;
+    {
+        ExpectingExceptions x;
+        c4query_runAsync(query, &kC4DefaultQueryOptions, C4STR("{\"oops"), callback, &state);
+        WaitUntil(2000, [&]{return state.count > 0;});
+    }
+    CHECK(state.count == 1);
+    CHECK(state.rowCount == -1);
+    CHECK(state.error.domain == LiteCoreDomain);
+
+    // A slow query (a 3-way join) can be stopped:
+    compileSelect(json5("{WHAT: [['count()', ['.a.name.first']]],\
+                          FROM: [{as: 'a'},\
+                                 {as: 'b', on: ['>=', ['.b.name.first'], ['.a.name.first']]},\
+                                 {as: 'c', on: ['>=', ['.c.name.first'], ['.b.name.first']]}]}"));
+    state = State();
+    state.query = query;
+    SECTION("Cancel") {
+        c4query_runAsync(query, &kC4DefaultQueryOptions, kC4SliceNull, callback, &state);
+        c4query_cancel(query);
+        WaitUntil(5000, [&]{return state.count > 0;});
+        CHECK(state.count == 1);
+        CHECK(state.rowCount == -1);
+        CHECK(state.error.domain == LiteCoreDomain);
+        CHECK(state.error.code == kC4ErrorQueryCanceled);
+    }
+    SECTION("Timeout") {
+        c4query_setTimeout(query, 0.001);
+        C4Error error;
+        CHECK(c4query_run(query, &kC4DefaultQueryOptions, kC4SliceNull, &error) == nullptr);
+        CHECK(error.domain == LiteCoreDomain);
+        CHECK(error.code == kC4ErrorQueryTimeout);
+
+        c4query_runAsync(query, &kC4DefaultQueryOptions, kC4SliceNull, callback, &state);
+        WaitUntil(5000, [&]{return state.count > 0;});
+        CHECK(state.count == 1);
+        CHECK(state.error.code == kC4ErrorQueryTimeout);
+    }
+}
+
+
 N_WAY_TEST_CASE_METHOD(C4QueryTest, "Delete index", "[Query][C][!throws]") {
     C4Error err;
     C4String names[2] = { C4STR("length"), C4STR("byStreet") };
@@ -59,7 +59,7 @@ namespace litecore {
     }
 
 
-    void BackgroundDB::useInTransaction(TransactionTask task) {
+    void BackgroundDB::useInTransaction(TransactionTask task, bool notifyObservers) {
         use([=](DataFile* dataFile) {
             if (!dataFile)
                 return;
@@ -83,11 +83,15 @@ namespace litecore {
             }
 
             t.commit();
-            // Notify other Database instances of any changes:
-            t.notifyCommitted(sequenceTracker);
+            if (notifyObservers) {
+                // Notify other Database instances of any changes:
+                t.notifyCommitted(sequenceTracker);
+            }
             sequenceTracker.endTransaction(true);
-            // Notify my own observers:
-            notifyTransactionObservers();
+            if (notifyObservers) {
+                // Notify my own observers:
+                notifyTransactionObservers();
+            }
         });
     }
 
@@ -28,7 +28,11 @@ namespace litecore {
 
         using TransactionTask = function_ref<bool(DataFile*, SequenceTracker*)>;
 
-        void useInTransaction(TransactionTask task);
+        /// Runs the task in a transaction on the background connection, committing it if the
+        /// task returns true. If `notifyObservers` is false, the commit isn't reported to
+        /// TransactionObservers or other Database instances; this is for maintenance work that
+        /// doesn't change any documents, so it shouldn't wake up observers like live queries.
+        void useInTransaction(TransactionTask task, bool notifyObservers =true);
 
         class TransactionObserver {
         public:
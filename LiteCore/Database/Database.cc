@@ -30,6 +30,7 @@
 #include "BlobStore.hh"
 #include "Upgrader.hh"
 #include "SecureRandomize.hh"
+#include "SecureDigest.hh"
 #include "StringUtil.hh"
 #include <functional>
 
@@ -432,6 +433,46 @@ namespace c4Internal {
     }
 
 
+    Retained<LiveQuerier> Database::addLiveQueryDelegate(Query *query,
+                                                         slice parameters,
+                                                         LiveQuerier::Delegate *delegate,
+                                                         bool persistResults)
+    {
+        // The key identifies the query's results: its language, expression and parameters.
+        string key = format("%d:", (int)query->language());
+        key += string(query->expression());
+        key += '\0';
+        key += string(parameters);
+
+        lock_guard<mutex> lock(_liveQueriersMutex);
+        Retained<LiveQuerier> &querier = _liveQueriers[key];
+        bool isNew = !querier;
+        if (isNew)
+            querier = new LiveQuerier(this, query, true, delegate);
+        else
+            querier->addDelegate(delegate);
+        if (persistResults)
+            querier->persistResults(slice(SHA1(slice(key))).hexString());
+        if (isNew)
+            querier->start(Query::Options(alloc_slice(parameters)));
+        return querier;
+    }
+
+
+    void Database::removeLiveQueryDelegate(LiveQuerier *querier, LiveQuerier::Delegate *delegate) {
+        lock_guard<mutex> lock(_liveQueriersMutex);
+        if (querier->removeDelegate(delegate)) {
+            querier->stop();
+            for (auto i = _liveQueriers.begin(); i != _liveQueriers.end(); ++i) {
+                if (i->second == querier) {
+                    _liveQueriers.erase(i);
+                    break;
+                }
+            }
+        }
+    }
+
+
     bool Database::startHousekeeping() {
         if (!_housekeeper) {
             if (config.flags & kC4DB_ReadOnly)
@@ -24,9 +24,11 @@
 #include "DataFile.hh"
 #include "FilePath.hh"
 #include "InstanceCounted.hh"
+#include "LiveQuerier.hh"
 #include "access_lock.hh"
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 #include <unordered_set>
 
 namespace fleece { namespace impl {
@@ -155,6 +157,22 @@ namespace c4Internal {
         BackgroundDB* backgroundDatabase();
         void stopBackgroundTasks();
 
+        /** Registers a delegate for continuous (live) results of a query. Identical live queries
+            (same language, expression and parameters) share a single LiveQuerier, so the query
+            only runs once per database change however many observers there are.
+            If `persistResults` is true, the LiveQuerier saves its results in the database, and
+            starts with those saved by an identical live query (see LiveQuerier::persistResults.)
+            A shared LiveQuerier runs the Query of the delegate that created it, with no options
+            besides the parameters; it persists its results if any of its delegates asked to. */
+        Retained<LiveQuerier> addLiveQueryDelegate(Query* NONNULL,
+                                                   slice parameters,
+                                                   LiveQuerier::Delegate* NONNULL,
+                                                   bool persistResults =false);
+
+        /** Unregisters a delegate added by addLiveQueryDelegate. The LiveQuerier is stopped
+            when its last delegate is removed. */
+        void removeLiveQueryDelegate(LiveQuerier* NONNULL, LiveQuerier::Delegate* NONNULL);
+
 #if 0 // unused
         bool mustUseVersioning(C4DocumentVersioning, C4Error*) noexcept;
 #endif
@@ -192,6 +210,8 @@ namespace c4Internal {
         recursive_mutex             _clientMutex;           // Mutex for c4db_lock/unlock
         unique_ptr<BackgroundDB>    _backgroundDB;          // for background operations
         Retained<Housekeeper>       _housekeeper;           // for expiration/cleanup tasks
+        std::unordered_map<string, Retained<LiveQuerier>> _liveQueriers; // Shared live queries
+        mutex                       _liveQueriersMutex;     // Protects _liveQueriers
     };
 
 }
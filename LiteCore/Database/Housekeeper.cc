@@ -28,14 +28,31 @@ namespace litecore {
     using namespace c4Internal;
     using namespace actor;
 
+    // How long the database must go without a commit before FTS indexes are merged:
+    static constexpr auto kFTSMergeIdleDelay = chrono::seconds(10);
+
+    // Interval between successive merge steps, as long as the database stays idle:
+    static constexpr auto kFTSMergeStepInterval = chrono::milliseconds(200);
+
+    // How long the database must go without a commit before query statistics are refreshed:
+    static constexpr auto kStatsIdleDelay = chrono::seconds(30);
+
+    // Interval between successive statistics refresh steps (one KeyStore each):
+    static constexpr auto kStatsStepInterval = chrono::seconds(1);
+
     Housekeeper::Housekeeper(Database *db)
     :Actor("Housekeeper")
     ,_bgdb(db->backgroundDatabase())
     ,_expiryTimer(std::bind(&Housekeeper::_doExpiration, this))
+    ,_ftsMergeTimer(std::bind(&Housekeeper::_doFTSMerge, this))
+    ,_statsTimer(std::bind(&Housekeeper::_doRefreshStatistics, this))
     { }
 
 
     void Housekeeper::start() {
+        _bgdb->addTransactionObserver(this);
+        _ftsMergeTimer.fireAfter(kFTSMergeIdleDelay);
+        _statsTimer.fireAfter(kStatsIdleDelay);
         enqueue(&Housekeeper::_scheduleExpiration);
     }
 
@@ -48,6 +65,9 @@ namespace litecore {
 
     void Housekeeper::_stop() {
         _expiryTimer.stop();
+        _ftsMergeTimer.stop();
+        _statsTimer.stop();
+        _bgdb->removeTransactionObserver(this);
         LogToAt(DBLog, Verbose, "Housekeeper: stopped.");
     }
 
@@ -83,6 +103,62 @@ namespace litecore {
     }
 
 
+    // Called on an arbitrary thread after any transaction commits.
+    void Housekeeper::transactionCommitted() {
+        // Each commit postpones merging and statistics refreshes, so they only happen once the
+        // database goes idle. (This doesn't have to be enqueued, since Timer is thread-safe.)
+        // My own maintenance steps don't notify observers, so they don't postpone each other.
+        _ftsMergeTimer.fireAfter(kFTSMergeIdleDelay);
+        _statsTimer.fireAfter(kStatsIdleDelay);
+    }
+
+
+    // Runs one bounded incremental-merge step on the FTS indexes, in its own short transaction
+    // so it never blocks writers for long. Reschedules itself while there's more to merge.
+    // (Merging changes no documents, so the commit doesn't notify observers; otherwise every
+    // step would re-run every live query.)
+    void Housekeeper::_doFTSMerge() {
+        bool moreWork = false;
+        try {
+            _bgdb->useInTransaction([&](DataFile* dataFile, SequenceTracker*) -> bool {
+                moreWork = dataFile->mergeFullTextIndexes();
+                return moreWork;
+            }, false);
+        } catch (const exception &x) {
+            LogToAt(DBLog, Warning, "Housekeeper: error merging FTS indexes: %s", x.what());
+            moreWork = false;
+        }
+
+        if (moreWork)
+            _ftsMergeTimer.fireAfter(kFTSMergeStepInterval);
+        else
+            LogToAt(DBLog, Verbose, "Housekeeper: FTS indexes are fully merged");
+    }
+
+
+    // Refreshes the query-planner statistics of one KeyStore that's had many writes since they
+    // were gathered, and retrains one vector index whose clusters no longer fit its vectors, in
+    // its own short transaction. Reschedules itself while it finds something to do.
+    // (Like merging, this changes no documents, so the commit doesn't notify observers; and if
+    // it did nothing, the transaction is aborted.)
+    void Housekeeper::_doRefreshStatistics() {
+        bool moreWork = false;
+        try {
+            _bgdb->useInTransaction([&](DataFile* dataFile, SequenceTracker*) -> bool {
+                moreWork = dataFile->refreshStatistics();
+                moreWork = dataFile->retrainVectorIndexes() || moreWork;
+                return moreWork;
+            }, false);
+        } catch (const exception &x) {
+            LogToAt(DBLog, Warning, "Housekeeper: error refreshing query statistics: %s", x.what());
+            moreWork = false;
+        }
+
+        if (moreWork)
+            _statsTimer.fireAfter(kStatsStepInterval);
+    }
+
+
     void Housekeeper::documentExpirationChanged(expiration_t exp) {
         // This doesn't have to be enqueued, since Timer is thread-safe.
         if (exp == 0)
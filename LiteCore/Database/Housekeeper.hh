@@ -9,15 +9,15 @@
 #include "Record.hh"
 #include "Actor.hh"
 #include "Timer.hh"
+#include "BackgroundDB.hh"
 
 namespace c4Internal {
     class Database;
 }
 
 namespace litecore {
-    class BackgroundDB;
 
-    class Housekeeper : public actor::Actor {
+    class Housekeeper : public actor::Actor, private BackgroundDB::TransactionObserver {
     public:
         /// Creates a Housekeeper for a Database.
         explicit Housekeeper(c4Internal::Database* NONNULL);
@@ -37,9 +37,14 @@ namespace litecore {
         void _stop();
         void _scheduleExpiration();
         void _doExpiration();
+        void transactionCommitted() override;
+        void _doFTSMerge();
+        void _doRefreshStatistics();
 
         BackgroundDB* _bgdb;
         actor::Timer _expiryTimer;
+        actor::Timer _ftsMergeTimer;            // Fires when the db has been idle for a while
+        actor::Timer _statsTimer;               // Fires when the db has been idle for longer
     };
 
 
@@ -22,6 +22,7 @@
 #include "Database.hh"
 #include "StringUtil.hh"
 #include "c4ExceptionUtils.hh"
+#include <algorithm>
 #include <inttypes.h>
 
 namespace litecore {
@@ -38,6 +39,17 @@ namespace litecore {
     static constexpr delay_t kShortDelay   = chrono::milliseconds(  0);
     static constexpr delay_t kLongDelay    = chrono::milliseconds(500);
 
+    // KeyStore in which the results of persistent live queries are saved:
+    static const string kSavedResultsKeyStoreName = "liveQueryResults";
+
+    // Saved results expire if they aren't saved again within this time (ms), i.e. if no live
+    // query has run with them for that long:
+    static constexpr expiration_t kSavedResultsLifetime = 7 * 24 * 60 * 60 * 1000ll;
+
+    // Results are saved at most this often (and when the querier stops), since each save is a
+    // write transaction competing with the app's own:
+    static constexpr delay_t kSaveInterval = chrono::seconds(10);
+
 
     LiveQuerier::LiveQuerier(c4Internal::Database *db,
                              Query *query,
@@ -48,8 +60,8 @@ namespace litecore {
     ,_backgroundDB(db->backgroundDatabase())
     ,_expression(query->expression())
     ,_language(query->language())
+    ,_delegates{delegate}
     ,_continuous(continuous)
-    ,_delegate(delegate)
     {
         logInfo("Created on Query %s", query->loggingName().c_str());
         // Note that we don't keep a reference to `_query`, because it's tied to `db`, but we
@@ -76,6 +88,16 @@ namespace litecore {
     }
 
 
+    void LiveQuerier::persistResults(slice key) {
+        enqueue(&LiveQuerier::_persistResults, alloc_slice(key));
+    }
+
+
+    void LiveQuerier::afterNotifications(std::function<void()> fn) {
+        enqueue(&LiveQuerier::_call, fn);
+    }
+
+
     void LiveQuerier::stop() {
         logInfo("Stopping");
         _stopping = true;
@@ -83,6 +105,24 @@ namespace litecore {
     }
 
 
+    void LiveQuerier::addDelegate(Delegate *delegate) {
+        {
+            std::lock_guard<std::mutex> lock(_delegatesMutex);
+            _delegates.push_back(delegate);
+        }
+        enqueue(&LiveQuerier::_catchUp, delegate);
+    }
+
+
+    bool LiveQuerier::removeDelegate(Delegate *delegate) {
+        std::lock_guard<std::mutex> lock(_delegatesMutex);
+        auto i = std::find(_delegates.begin(), _delegates.end(), delegate);
+        if (i != _delegates.end())
+            _delegates.erase(i);
+        return _delegates.empty();
+    }
+
+
     // Database change (transaction committed) notification
     void LiveQuerier::transactionCommitted() {
         enqueue(&LiveQuerier::_dbChanged, clock::now());
@@ -94,6 +134,8 @@ namespace litecore {
 
     void LiveQuerier::_stop() {
         if (_query) {
+            if (_unsavedResults)
+                saveResults();
             _backgroundDB->use([&](DataFile *df) {
                 _query = nullptr;
                 _currentEnumerator = nullptr;
@@ -106,6 +148,44 @@ namespace litecore {
     }
 
 
+    void LiveQuerier::_call(std::function<void()> fn) {
+        fn();
+    }
+
+
+    void LiveQuerier::_persistResults(alloc_slice key) {
+        if (!_continuous || _persistenceKey == key)
+            return;
+        _persistenceKey = key;
+        if (_currentEnumerator)
+            resultsChanged();
+    }
+
+
+    // Notes that the current results need saving, and saves them now or schedules that.
+    void LiveQuerier::resultsChanged() {
+        if (!_persistenceKey)
+            return;
+        _unsavedResults = true;
+        if (_saveScheduled)
+            return;
+        delay_t sinceSave = clock::now() - _lastSaveTime;
+        if (sinceSave >= kSaveInterval) {
+            saveResults();
+        } else {
+            enqueueAfter(kSaveInterval - sinceSave, &LiveQuerier::_saveResults);
+            _saveScheduled = true;
+        }
+    }
+
+
+    void LiveQuerier::_saveResults() {
+        _saveScheduled = false;
+        if (_query && _unsavedResults)
+            saveResults();
+    }
+
+
     void LiveQuerier::_dbChanged(clock::time_point when) {
         // Do nothing if there's already a _runQuery call pending (but not yet running),
         // or I've already been told to stop, or the query can't be run:
@@ -129,9 +209,9 @@ namespace litecore {
 
         _waitingToRun = false;
         logVerbose("Running query...");
-        Retained<QueryEnumerator> newQE;
+        Retained<QueryEnumerator> newQE, savedQE;
+        bool savedIsCurrent = false;
         C4Error error = {};
-        fleece::Stopwatch st;
         _backgroundDB->use([&](DataFile *df) {
             try {
                 // Create my own Query object associated with the Backgrounder's DataFile:
@@ -139,11 +219,42 @@ namespace litecore {
                     _query = df->defaultKeyStore().compileQuery(_expression, _language);
                     if (_continuous)
                         _backgroundDB->addTransactionObserver(this);
+                    // Start with the saved results, if any:
+                    if (_persistenceKey) {
+                        savedQE = restoreResults(df, options);
+                        if (savedQE) {
+                            _savedSequence = savedQE->lastSequence();
+                            _savedPurgeCount = savedQE->purgeCount();
+                            auto &keyStore = df->defaultKeyStore();
+                            savedIsCurrent = savedQE->lastSequence() == keyStore.lastSequence()
+                                          && savedQE->purgeCount() == keyStore.purgeCount();
+                        }
+                    }
                 }
-                // Now run the query:
-                newQE = _query->createEnumerator(&options);
             } catchError(&error);
         });
+
+        if (savedQE) {
+            // Deliver the saved results right away. If the database hasn't changed since they
+            // were saved they're current, and there's no need to run the query:
+            logInfo("Restored %s results saved at seq %" PRIu64,
+                    (savedIsCurrent ? "current" : "provisional"), savedQE->lastSequence());
+            _currentEnumerator = savedQE;
+            if (_stopping)
+                return;
+            notifyDelegates(savedQE, {});
+            if (savedIsCurrent)
+                return;
+        }
+
+        fleece::Stopwatch st;
+        if (_query) {
+            _backgroundDB->use([&](DataFile *df) {
+                try {
+                    newQE = _query->createEnumerator(&options);
+                } catchError(&error);
+            });
+        }
         auto time = st.elapsedMS();
 
         if (!newQE)
@@ -154,10 +265,18 @@ namespace litecore {
                 if (_currentEnumerator && !_currentEnumerator->obsoletedBy(newQE)) {
                     logVerbose("Results unchanged at seq %" PRIu64 " (%.3fms)",
                                newQE->lastSequence(), time);
+                    // The results are the same, but newQE knows they're current as of its
+                    // sequence and purge count; save that (unless the saved ones are already),
+                    // so a restart doesn't re-run them:
+                    _currentEnumerator = newQE;
+                    if (newQE->lastSequence() != _savedSequence
+                            || newQE->purgeCount() != _savedPurgeCount)
+                        resultsChanged();
                     return; // no delegate call
                 }
                 logInfo("Results changed at seq %" PRIu64 " (%.3fms)", newQE->lastSequence(), time);
                 _currentEnumerator = newQE;
+                resultsChanged();
             }
         } else {
             logInfo("...finished one-shot query in %.3fms", time);
@@ -166,7 +285,91 @@ namespace litecore {
         if (_stopping)
             return;
         
-        _delegate->liveQuerierUpdated(newQE, error);
+        notifyDelegates(newQE, error);
+    }
+
+
+    // Reads the results saved under my persistence key, if any.
+    Retained<QueryEnumerator> LiveQuerier::restoreResults(DataFile *df,
+                                                          const Query::Options &options)
+    {
+        Record rec = df->getKeyStore(kSavedResultsKeyStoreName, KeyStore::Capabilities::defaults)
+                        .get(_persistenceKey);
+        if (!rec.exists())
+            return nullptr;
+        Retained<QueryEnumerator> qe = _query->restoreResults(rec.body(), &options);
+        if (!qe)
+            logInfo("Saved results are obsolete; ignoring them");
+        return qe;
+    }
+
+
+    // Saves the current results under my persistence key. This isn't a change any observer
+    // cares about, so it's committed without notifying them. Each save renews the results'
+    // expiration, and the first also purges any saved results that have expired.
+    void LiveQuerier::saveResults() {
+        if (!_persistenceKey || !_currentEnumerator)
+            return;
+        _unsavedResults = false;
+        _lastSaveTime = clock::now();
+        try {
+            _backgroundDB->use([&](DataFile *df) {
+                if (!df)
+                    return;
+                alloc_slice data = _query->saveResults(_currentEnumerator);
+                auto &keyStore = df->getKeyStore(kSavedResultsKeyStoreName,
+                                                 KeyStore::Capabilities::defaults);
+                Transaction t(df);
+                keyStore.set(_persistenceKey, data, t);
+                expiration_t now = KeyStore::now();
+                keyStore.setExpiration(_persistenceKey, now + kSavedResultsLifetime);
+                if (!_expiredSavedResults) {
+                    if (expiration_t next = keyStore.nextExpiration(); next > 0 && next <= now)
+                        keyStore.expireRecords();
+                    _expiredSavedResults = true;
+                }
+                t.commit();
+                _savedSequence = _currentEnumerator->lastSequence();
+                _savedPurgeCount = _currentEnumerator->purgeCount();
+            });
+        } catch (const exception &x) {
+            warn("Couldn't save query results: %s", x.what());
+        }
+    }
+
+
+    // Gives a newly-added delegate the current results, if there are any yet.
+    void LiveQuerier::_catchUp(Delegate *delegate) {
+        if (_stopping || !_currentEnumerator)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(_delegatesMutex);
+            if (std::find(_delegates.begin(), _delegates.end(), delegate) == _delegates.end())
+                return;
+        }
+        logVerbose("Sending current results to new delegate");
+        Retained<QueryEnumerator> qe = _currentEnumerator->clone();
+        delegate->liveQuerierUpdated(qe, {});
+    }
+
+
+    // Calls every delegate. Each one gets its own enumerator, since an enumerator has its own
+    // iteration state and the delegates may be on different threads. The mutex isn't held
+    // during the calls, since a delegate may add or remove delegates, or be slow.
+    void LiveQuerier::notifyDelegates(QueryEnumerator *qe, C4Error error) {
+        std::vector<Delegate*> delegates;
+        {
+            std::lock_guard<std::mutex> lock(_delegatesMutex);
+            delegates = _delegates;
+        }
+        bool first = true;
+        for (auto delegate : delegates) {
+            Retained<QueryEnumerator> delegateQE = qe;
+            if (qe && !first)
+                delegateQE = qe->clone();
+            first = false;
+            delegate->liveQuerierUpdated(delegateQE, error);
+        }
     }
 
 }
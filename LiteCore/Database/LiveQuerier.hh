@@ -13,7 +13,10 @@
 #include "Logging.hh"
 #include <atomic>
 #include <chrono>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace c4Internal {
     class Database;
@@ -22,7 +25,10 @@ namespace c4Internal {
 namespace litecore {
 
     /** Runs a query in the background, and optionally watches for the query results to change
-        as documents change. */
+        as documents change.
+        A continuous LiveQuerier can have multiple delegates; each is notified of every new
+        result, so identical live queries can share a single LiveQuerier. (See
+        Database::addLiveQueryDelegate.) */
     class LiveQuerier : public actor::Actor,
                         BackgroundDB::TransactionObserver,
                         Logging, fleece::InstanceCounted
@@ -42,8 +48,29 @@ namespace litecore {
 
         void start(Query::Options);
 
+        /// Makes a continuous querier save its latest results in the database, under `key`. When
+        /// a querier with the same key starts later, even in another process, it gives its
+        /// delegates the saved results right away: as final if the database hasn't changed since,
+        /// otherwise provisionally while the query runs. Call this before start().
+        /// Results are saved at most every few seconds, and when the querier stops. Saved
+        /// results expire if no querier has saved them again for a week.
+        void persistResults(slice key);
+
         void stop();
 
+        /// Adds another delegate. If the query has already produced results, the new delegate
+        /// will be called with (a copy of) them soon afterwards.
+        void addDelegate(Delegate* NONNULL);
+
+        /// Removes a delegate. Delegates are called without any lock held, so one already being
+        /// notified on the querier's thread may still be called once after this returns; the
+        /// delegate has to ignore that call, and stay alive until then (see afterNotifications.)
+        /// Returns true if there are no delegates left.
+        bool removeDelegate(Delegate* NONNULL);
+
+        /// Calls `fn` on the querier's thread, after any delegate call already in progress.
+        void afterNotifications(std::function<void()> fn);
+
     protected:
         virtual ~LiveQuerier();
         virtual std::string loggingIdentifier() const override;
@@ -57,14 +84,30 @@ namespace litecore {
         void _runQuery(Query::Options);
         void _stop();
         void _dbChanged(clock::time_point);
+        void _catchUp(Delegate*);
+        void _call(std::function<void()>);
+        void _persistResults(alloc_slice key);
+        Retained<QueryEnumerator> restoreResults(DataFile*, const Query::Options&);
+        void resultsChanged();
+        void _saveResults();
+        void saveResults();
+        void notifyDelegates(QueryEnumerator*, C4Error);
 
         Retained<c4Internal::Database> _database;       // The database
         BackgroundDB* _backgroundDB;                    // Shadow DB on background thread
-        Delegate* _delegate;                            // Whom ya gonna call?
+        std::vector<Delegate*> _delegates;              // Whom ya gonna call?
+        std::mutex _delegatesMutex;                     // Protects _delegates
         alloc_slice _expression;                        // The query text
         QueryLanguage _language;                        // The query language (JSON or N1QL)
         Retained<Query> _query;                         // Compiled query
         Retained<QueryEnumerator> _currentEnumerator;   // Latest query results
+        alloc_slice _persistenceKey;                    // Key the results are saved under
+        sequence_t _savedSequence {0};                  // Sequence of the saved results
+        uint64_t _savedPurgeCount {0};                  // Purge count of the saved results
+        clock::time_point _lastSaveTime;                // Time the results were last saved
+        bool _unsavedResults {false};                   // Do the results need saving?
+        bool _saveScheduled {false};                    // Is a call to _saveResults scheduled?
+        bool _expiredSavedResults {false};              // Have expired saved results been purged?
         clock::time_point _lastTime;                    // Time the query last ran
         bool _continuous;                               // Do I keep running until stopped?
         bool _waitingToRun {false};                     // Is a call to _runQuery scheduled?
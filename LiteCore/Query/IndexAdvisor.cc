@@ -0,0 +1,447 @@
+//
+// IndexAdvisor.cc
+//
+// Copyright © 2018 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "IndexAdvisor.hh"
+#include "SQLiteDataFile.hh"
+#include "QueryParser+Private.hh"
+#include "StringUtil.hh"
+#include "FleeceImpl.hh"
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+
+namespace litecore {
+    using namespace qp;
+
+
+#pragma mark - WORKLOAD:
+
+
+    void QueryWorkload::setRecording(bool recording) {
+        lock_guard<mutex> lock(_mutex);
+        if (recording)
+            _entries.clear();
+        _recording = recording;
+    }
+
+
+    void QueryWorkload::record(const string &keyStoreName,
+                               const string &sql,
+                               slice json,
+                               uint64_t fullScanSteps,
+                               double elapsedTime,
+                               function_ref<vector<string>()> getPlan)
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (!_recording)
+            return;
+        Entry &entry = _entries[sql];
+        if (entry.sql.empty()) {
+            entry.keyStoreName = keyStoreName;
+            entry.json = string(json);
+            entry.sql = sql;
+        }
+        if (entry.plan.empty() || entry.planIsStale) {
+            try {
+                entry.plan = getPlan();
+                entry.planIsStale = false;
+            } catch (...) { }
+        }
+        ++entry.runCount;
+        entry.fullScanSteps += fullScanSteps;
+        entry.totalTime += elapsedTime;
+    }
+
+
+    void QueryWorkload::invalidatePlans() {
+        lock_guard<mutex> lock(_mutex);
+        for (auto &item : _entries)
+            item.second.planIsStale = true;
+    }
+
+
+    vector<QueryWorkload::Entry> QueryWorkload::entries() const {
+        lock_guard<mutex> lock(_mutex);
+        vector<Entry> result;
+        for (auto &item : _entries)
+            result.push_back(item.second);
+        return result;
+    }
+
+
+#pragma mark - QUERY PLANS:
+
+
+    // Splits a line of EXPLAIN QUERY PLAN output into words.
+    static vector<string> planWords(const string &line) {
+        vector<string> words;
+        istringstream in(line);
+        string word;
+        while (in >> word)
+            words.push_back(word);
+        return words;
+    }
+
+
+    // True if a line of a query plan scans every row of one of the given tables or aliases.
+    // SQLite 3.36 and later write "SCAN <alias>"; earlier versions "SCAN TABLE <table> AS <alias>".
+    // A scan "USING" an index, or of a virtual table, isn't a full scan of a KeyStore's table.
+    static bool isFullScan(const vector<string> &words, const set<string> &tables) {
+        if (words.size() < 2 || words[0] != "SCAN")
+            return false;
+        if (find(words.begin(), words.end(), "USING") != words.end()
+                || find(words.begin(), words.end(), "VIRTUAL") != words.end())
+            return false;
+        size_t i = (words[1] == "TABLE") ? 2 : 1;
+        if (i < words.size() && tables.count(words[i]))
+            return true;
+        return i + 2 < words.size() && words[i+1] == "AS" && tables.count(words[i+2]);
+    }
+
+
+    // True if a line of a query plan iterates a virtual table with the given alias, as an
+    // UNNEST does when it has no array index.
+    static bool isVirtualTableScan(const vector<string> &words, const string &alias) {
+        return words.size() >= 2 && words[0] == "SCAN"
+            && find(words.begin(), words.end(), "VIRTUAL") != words.end()
+            && find(words.begin(), words.end(), alias) != words.end();
+    }
+
+
+    // True if a line of a query plan uses the named SQLite index.
+    static bool usesIndex(const vector<string> &words, const string &name) {
+        for (size_t i = 0; i + 1 < words.size(); ++i) {
+            if (words[i] == "INDEX" && words[i+1] == name)
+                return true;
+        }
+        return false;
+    }
+
+
+#pragma mark - QUERY ANALYSIS:
+
+
+    // The parts of a query that an index could speed up.
+    class QueryShape {
+    public:
+        QueryShape(const Value *query) {
+            const Dict *select = query->asDict();
+            const Value *where = nullptr;
+            if (!select) {
+                const Array *a = query->asArray();
+                if (a && a->count() > 1 && a->get(0)->asString() == "SELECT"_sl)
+                    select = a->get(1)->asDict();
+                else
+                    where = query;          // A bare WHERE clause
+            }
+            if (select) {
+                where = getCaseInsensitive(select, "WHERE"_sl);
+                parseFrom(getCaseInsensitive(select, "FROM"_sl));
+                if (getCaseInsensitive(select, "LIMIT"_sl))
+                    parseOrderBy(getCaseInsensitive(select, "ORDER_BY"_sl));
+            }
+            if (_docAliases.empty())
+                _docAliases.insert(kDefaultTableAlias);
+
+            vector<const Array*> conjuncts;
+            collectConjuncts(where, conjuncts);
+            for (auto test : conjuncts)
+                parseTest(test);
+        }
+
+        // Names a query plan may use for the document table
+        const set<string>& docAliases() const                   {return _docAliases;}
+
+        // Properties tested by equality, then by range, in the WHERE clause
+        vector<string> equalities, ranges;
+        // Properties sorted by, if the query has a LIMIT
+        vector<string> orderBy;
+        // Properties searched for substrings
+        vector<string> substrings;
+        // UNNEST aliases, and the array properties they iterate
+        vector<pair<string,string>> unnests;
+
+    private:
+        void parseFrom(const Value *from) {
+            bool first = true;
+            for (Array::iterator i(from ? from->asArray() : nullptr); i; ++i) {
+                const Dict *entry = i.value()->asDict();
+                const Value *as = entry ? getCaseInsensitive(entry, "AS"_sl) : nullptr;
+                slice alias = as ? as->asString() : nullslice;
+                if (!alias)
+                    continue;
+                if (first) {
+                    _mainAlias = string(alias);
+                    _docAliases.insert(_mainAlias);
+                    first = false;
+                } else if (auto unnest = getCaseInsensitive(entry, "UNNEST"_sl)) {
+                    string property = docProperty(unnest);
+                    if (!property.empty())
+                        unnests.emplace_back(string(alias), property);
+                } else {
+                    _docAliases.insert(string(alias));      // a join with the document table
+                }
+            }
+        }
+
+        void parseOrderBy(const Value *orderBy) {
+            for (Array::iterator i(orderBy ? orderBy->asArray() : nullptr); i; ++i) {
+                const Value *term = i.value();
+                const Array *a = term->asArray();
+                if (a && a->count() == 2 && (a->get(0)->asString().caseEquivalent("ASC"_sl)
+                                          || a->get(0)->asString().caseEquivalent("DESC"_sl)))
+                    term = a->get(1);
+                string property = docProperty(term);
+                if (property.empty()) {
+                    orderBy.clear();        // An index can't provide the whole ordering
+                    return;
+                }
+                orderBy.push_back(property);
+            }
+        }
+
+        static void collectConjuncts(const Value *expr, vector<const Array*> &conjuncts) {
+            const Array *a = expr ? expr->asArray() : nullptr;
+            if (!a || a->empty())
+                return;
+            if (a->get(0)->asString().caseEquivalent("AND"_sl)) {
+                for (uint32_t i = 1; i < a->count(); ++i)
+                    collectConjuncts(a->get(i), conjuncts);
+            } else {
+                conjuncts.push_back(a);
+            }
+        }
+
+        void parseTest(const Array *test) {
+            slice op = test->get(0)->asString();
+            auto count = test->count();
+            if (op == "="_sl || op == "=="_sl || op.caseEquivalent("IS"_sl)
+                             || op.caseEquivalent("IN"_sl)) {
+                if (count == 3)
+                    addComparison(test->get(1), test->get(2), equalities,
+                                  !op.caseEquivalent("IN"_sl));
+            } else if (op == "<"_sl || op == "<="_sl || op == ">"_sl || op == ">="_sl) {
+                if (count == 3)
+                    addComparison(test->get(1), test->get(2), ranges, true);
+            } else if (op.caseEquivalent("BETWEEN"_sl)) {
+                if (count == 4 && isConstant(test->get(2)) && isConstant(test->get(3)))
+                    addProperty(docProperty(test->get(1)), ranges);
+            } else if (op.caseEquivalent("LIKE"_sl)) {
+                // LIKE is evaluated by a function, so only a full-text index can replace it:
+                if (count == 3 && test->get(2)->asString().hasPrefix("%"_sl))
+                    addProperty(docProperty(test->get(1)), substrings);
+            } else if (op.caseEquivalent("CONTAINS()"_sl)) {
+                if (count == 3 && isConstant(test->get(2)))
+                    addProperty(docProperty(test->get(1)), substrings);
+            }
+        }
+
+        // Adds the property side of `property OP constant` (or, if `symmetric`, of
+        // `constant OP property`) to the list.
+        void addComparison(const Value *lhs, const Value *rhs, vector<string> &list,
+                           bool symmetric)
+        {
+            if (isConstant(rhs))
+                addProperty(docProperty(lhs), list);
+            else if (symmetric && isConstant(lhs))
+                addProperty(docProperty(rhs), list);
+        }
+
+        static void addProperty(const string &property, vector<string> &list) {
+            if (!property.empty() && find(list.begin(), list.end(), property) == list.end())
+                list.push_back(property);
+        }
+
+        // True if a node is a literal or a parameter, or an array literal of those.
+        static bool isConstant(const Value *node) {
+            const Array *a = node->asArray();
+            if (!a)
+                return true;
+            if (a->empty())
+                return false;
+            slice op = a->get(0)->asString();
+            if (op.hasPrefix("$"_sl))
+                return true;
+            if (op != "[]"_sl)
+                return false;
+            for (uint32_t i = 1; i < a->count(); ++i)
+                if (!isConstant(a->get(i)))
+                    return false;
+            return true;
+        }
+
+        // Returns the path of a property of the main document source, without the alias, or ""
+        // if the node isn't one. Meta-properties like _id are already indexed, so they're skipped.
+        string docProperty(const Value *node) const {
+            string path = string(propertyFromNode(node));
+            if (!_mainAlias.empty()) {
+                if (!hasPrefix(path, _mainAlias + "."))
+                    return "";
+                path = path.substr(_mainAlias.size() + 1);
+            }
+            if (path.empty() || path[0] == '_')
+                return "";
+            return path;
+        }
+
+        string _mainAlias;              // Alias of the first FROM item, which prefixes properties
+        set<string> _docAliases;
+    };
+
+
+#pragma mark - ADVISOR:
+
+
+    // Returns the WHAT clause of an index on the given properties, as JSON.
+    static string whatJSON(const vector<string> &properties) {
+        Encoder enc;
+        enc.beginArray();
+        for (auto &property : properties) {
+            enc.beginArray();
+            enc.writeString("." + property);
+            enc.endArray();
+        }
+        enc.endArray();
+        Retained<Doc> doc = enc.finishDoc();
+        return string(doc->root()->toJSON());
+    }
+
+
+    static string joined(const vector<string> &strings) {
+        stringstream out;
+        for (size_t i = 0; i < strings.size(); ++i)
+            out << (i ? ", " : "") << strings[i];
+        return out.str();
+    }
+
+
+    IndexAdvice IndexAdvice::analyze(const vector<QueryWorkload::Entry> &entries,
+                                     const vector<SQLiteIndexSpec> &existingIndexes)
+    {
+        IndexAdvice advice;
+        map<string, Suggestion> suggestions;    // Keyed by type, KeyStore and WHAT clause
+
+        auto suggest = [&](const QueryWorkload::Entry &entry, IndexSpec::Type type,
+                           const string &what, const string &reason) {
+            // Don't suggest an index that exists; SQLite must have decided not to use it:
+            for (auto &spec : existingIndexes) {
+                if (spec.type == type && spec.keyStoreName == entry.keyStoreName
+                        && spec.expressionJSON && string(spec.what()->toJSON()) == what)
+                    return;
+            }
+            Suggestion &s = suggestions[CONCAT(type << '/' << entry.keyStoreName << '/' << what)];
+            if (s.queryCount == 0) {
+                s.type = type;
+                s.keyStoreName = entry.keyStoreName;
+                s.expressionJSON = what;
+                s.reason = reason;
+            }
+            ++s.queryCount;
+            s.runCount += entry.runCount;
+            s.fullScanSteps += entry.fullScanSteps;
+            s.totalTime += entry.totalTime;
+        };
+
+        for (auto &entry : entries) {
+            if (entry.plan.empty())
+                continue;
+            try {
+                Retained<Doc> doc = Doc::fromJSON(slice(entry.json));
+                QueryShape shape(doc->root());
+
+                set<string> docTables = shape.docAliases();
+                docTables.insert("kv_" + entry.keyStoreName);
+                bool fullScan = false;
+                vector<vector<string>> plan;
+                for (auto &line : entry.plan) {
+                    plan.push_back(planWords(line));
+                    fullScan = fullScan || isFullScan(plan.back(), docTables);
+                }
+
+                if (fullScan) {
+                    vector<string> columns = shape.equalities;
+                    if (!shape.ranges.empty() && find(columns.begin(), columns.end(),
+                                                      shape.ranges[0]) == columns.end())
+                        columns.push_back(shape.ranges[0]);     // (only one range can use it)
+                    if (!columns.empty())
+                        suggest(entry, IndexSpec::kValue, whatJSON(columns),
+                                "Full scan to test " + joined(columns));
+                    else if (!shape.orderBy.empty())
+                        suggest(entry, IndexSpec::kValue, whatJSON(shape.orderBy),
+                                "Full scan and sort by " + joined(shape.orderBy)
+                                + " for a LIMIT");
+                    for (auto &property : shape.substrings)
+                        suggest(entry, IndexSpec::kFullText, whatJSON({property}),
+                                "Full scan to search " + property + " for a substring;"
+                                " the test must be rewritten as a MATCH to use this index");
+                }
+
+                for (auto &unnest : shape.unnests) {
+                    for (auto &words : plan) {
+                        if (isVirtualTableScan(words, unnest.first)) {
+                            suggest(entry, IndexSpec::kArray, whatJSON({unnest.second}),
+                                    "UNNEST of " + unnest.second + " reads every document");
+                            break;
+                        }
+                    }
+                }
+            } catch (const std::exception&) {
+                // The query was compiled, so this shouldn't happen; at worst there's no advice
+            }
+        }
+
+        for (auto &item : suggestions)
+            advice.suggestions.push_back(move(item.second));
+        sort(advice.suggestions.begin(), advice.suggestions.end(),
+             [](const Suggestion &a, const Suggestion &b) {
+                 if (a.fullScanSteps != b.fullScanSteps)
+                     return a.fullScanSteps > b.fullScanSteps;
+                 return a.totalTime > b.totalTime;
+             });
+
+        // Find the indexes no recorded query used. A value index appears in plans by name; the
+        // other types have their own tables, which the query's SQL names.
+        if (!entries.empty()) {
+            for (auto &spec : existingIndexes) {
+                bool used = false;
+                for (auto &entry : entries) {
+                    if (entry.keyStoreName != spec.keyStoreName)
+                        continue;
+                    if (spec.type != IndexSpec::kValue && !spec.indexTableName.empty()
+                            && entry.sql.find('"' + spec.indexTableName + '"') != string::npos) {
+                        used = true;
+                    } else {
+                        for (auto &line : entry.plan)
+                            if (usesIndex(planWords(line), spec.name))
+                                used = true;
+                    }
+                    if (used)
+                        break;
+                }
+                if (!used)
+                    advice.unusedIndexes.push_back(spec.name);
+            }
+        }
+        return advice;
+    }
+
+}
@@ -0,0 +1,100 @@
+//
+// IndexAdvisor.hh
+//
+// Copyright © 2018 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include "IndexSpec.hh"
+#include "function_ref.hh"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace litecore {
+
+    struct SQLiteIndexSpec;
+
+
+    /** Records the queries run on a database connection: each compiled query's plan, and how
+        often it ran and how long it took. Recording is off by default. */
+    class QueryWorkload {
+    public:
+        struct Entry {
+            std::string keyStoreName;           ///< KeyStore the query runs on
+            std::string json;                   ///< The query, in JSON form
+            std::string sql;                    ///< The compiled SQL
+            std::vector<std::string> plan;      ///< Lines of SQLite's EXPLAIN QUERY PLAN output
+            uint64_t runCount {0};              ///< Number of times the query ran
+            uint64_t fullScanSteps {0};         ///< Rows stepped through by full table scans
+            double   totalTime {0};             ///< Total run time, in seconds
+            bool     planIsStale {false};       ///< Indexes changed since the plan was recorded
+        };
+
+        /** Turns recording on or off. Turning it on clears any previously recorded workload. */
+        void setRecording(bool recording);
+        bool recording() const                                  {return _recording;}
+
+        /** Adds a run of a query. `getPlan` is only called if the query's plan isn't known yet,
+            or may have changed since it was last recorded. */
+        void record(const std::string &keyStoreName,
+                    const std::string &sql,
+                    slice json,
+                    uint64_t fullScanSteps,
+                    double elapsedTime,
+                    function_ref<std::vector<std::string>()> getPlan);
+
+        /** Marks the recorded plans as stale, since creating or deleting an index can change
+            them. Each is recorded again the next time its query runs. */
+        void invalidatePlans();
+
+        std::vector<Entry> entries() const;
+
+    private:
+        std::atomic<bool> _recording {false};
+        std::map<std::string, Entry> _entries;      // Keyed by SQL
+        mutable std::mutex _mutex;
+    };
+
+
+    /** Index suggestions derived from a QueryWorkload. */
+    struct IndexAdvice {
+        struct Suggestion {
+            IndexSpec::Type type;               ///< kValue, kFullText or kArray
+            std::string keyStoreName;           ///< KeyStore to create the index in
+            std::string expressionJSON;         ///< The index's WHAT clause, as a JSON array
+            std::string reason;                 ///< Human-readable explanation
+            unsigned queryCount {0};            ///< Number of recorded queries it would help
+            uint64_t runCount {0};              ///< Total runs of those queries
+            uint64_t fullScanSteps {0};         ///< Rows those runs stepped through in full scans
+            double   totalTime {0};             ///< Time those runs took: the most it can save
+        };
+
+        /** Suggested new indexes, most beneficial first (by rows scanned, then by time.) */
+        std::vector<Suggestion> suggestions;
+
+        /** Names of existing indexes that none of the recorded queries used. Empty if nothing
+            has been recorded. */
+        std::vector<std::string> unusedIndexes;
+
+        /** Analyzes the recorded queries whose plans do full scans of a KeyStore's table, and
+            finds the existing indexes that no recorded plan uses. */
+        static IndexAdvice analyze(const std::vector<QueryWorkload::Entry>&,
+                                   const std::vector<SQLiteIndexSpec> &existingIndexes);
+    };
+
+}
@@ -19,6 +19,7 @@
 #include "IndexSpec.hh"
 #include "QueryParser+Private.hh"
 #include "Error.hh"
+#include <algorithm>
 
 namespace litecore {
     using namespace fleece;
@@ -69,5 +70,68 @@ namespace litecore {
         return nullptr;
     }
 
+    const Array* IndexSpec::included() const {
+        if (auto dict = doc()->asDict(); dict) {
+            if (auto includeVal = qp::getCaseInsensitive(dict, "INCLUDE"); includeVal) {
+                auto include = qp::requiredArray(includeVal, "Index INCLUDE term");
+                for (Array::iterator i(include); i; ++i)
+                    qp::requiredArray(i.value(), "Index INCLUDE expression");
+                return include;
+            }
+        }
+        return nullptr;
+    }
+
+    unsigned IndexSpec::ftsMergePages() const {
+        if (expressionJSON) {
+            if (auto dict = doc()->asDict(); dict) {
+                if (auto mergeVal = qp::getCaseInsensitive(dict, "MERGE"); mergeVal) {
+                    if (type != kFullText)
+                        error::_throw(error::InvalidQuery,
+                                      "Only full-text indexes can have a MERGE term");
+                    if (!mergeVal->isInteger() || mergeVal->asInt() < 0)
+                        error::_throw(error::InvalidQuery,
+                                      "Index MERGE term must be a non-negative integer");
+                    return (unsigned)std::min(mergeVal->asInt(), int64_t(UINT32_MAX));
+                }
+            }
+        }
+        return kDefaultFTSMergePages;
+    }
+
+    unsigned IndexSpec::vectorCentroids() const {
+        if (expressionJSON) {
+            if (auto dict = doc()->asDict(); dict) {
+                if (auto centroidsVal = qp::getCaseInsensitive(dict, "CENTROIDS"); centroidsVal) {
+                    if (type != kVector)
+                        error::_throw(error::InvalidQuery,
+                                      "Only vector indexes can have a CENTROIDS term");
+                    if (!centroidsVal->isInteger() || centroidsVal->asInt() < 0)
+                        error::_throw(error::InvalidQuery,
+                                      "Index CENTROIDS term must be a non-negative integer");
+                    return (unsigned)std::min(centroidsVal->asInt(), int64_t(UINT32_MAX));
+                }
+            }
+        }
+        return 0;
+    }
+
+    bool IndexSpec::collationSortKeys() const {
+        if (expressionJSON) {
+            if (auto dict = doc()->asDict(); dict) {
+                if (auto sortKeysVal = qp::getCaseInsensitive(dict, "SORT_KEYS"); sortKeysVal) {
+                    if (type != kValue)
+                        error::_throw(error::InvalidQuery,
+                                      "Only value indexes can have a SORT_KEYS term");
+                    if (sortKeysVal->type() != kBoolean)
+                        error::_throw(error::InvalidQuery,
+                                      "Index SORT_KEYS term must be a boolean");
+                    return sortKeysVal->asBool();
+                }
+            }
+        }
+        return false;
+    }
+
 
 }
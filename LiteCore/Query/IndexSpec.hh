@@ -31,6 +31,9 @@ namespace litecore {
             kFullText,      ///< Full-text index, for MATCH queries
             kArray,         ///< Index of array values, for UNNEST queries
             kPredictive,    ///< Index of prediction results
+            kSpatial,       ///< R-tree index of 2D points or boxes, for GEO_ functions
+            kVector,        ///< Approximate nearest-neighbor index of numeric arrays
+            kAggregate,     ///< Materialized GROUP BY results: counts, sums, mins & maxes
         };
 
         struct Options {
@@ -54,7 +57,8 @@ namespace litecore {
         void validateName() const;
 
         const char* typeName() const {
-            static const char* kTypeName[] = {"value", "full-text", "array", "predictive"};
+            static const char* kTypeName[] = {"value", "full-text", "array", "predictive",
+                                                "spatial", "vector", "aggregate"};
             return kTypeName[type];
         }
 
@@ -66,6 +70,25 @@ namespace litecore {
         /** The optional WHERE clause: the condition for a partial index */
         const fleece::impl::Array* where() const;
 
+        /** The optional INCLUDE clause: extra expressions a value index stores, so queries
+            returning them needn't read the document bodies */
+        const fleece::impl::Array* included() const;
+
+        /** The optional MERGE term of a full-text index: the maximum number of pages each
+            background incremental merge step may write. 0 disables background merging. */
+        unsigned ftsMergePages() const;
+
+        static constexpr unsigned kDefaultFTSMergePages = 100;
+
+        /** The optional CENTROIDS term of a vector index: the number of clusters the vectors are
+            partitioned into. 0 (the default) picks a number based on the number of documents. */
+        unsigned vectorCentroids() const;
+
+        /** The optional SORT_KEYS term of a value index: if true, expressions with a Unicode
+            COLLATE are indexed by their collation sort keys (see fl_sortkey), so collated
+            comparisons and sorts using the index compare plain bytes. */
+        bool collationSortKeys() const;
+
         std::string const            name;
         Type        const            type;
         alloc_slice const            expressionJSON;
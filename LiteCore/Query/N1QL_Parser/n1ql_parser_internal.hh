@@ -279,7 +279,7 @@ static const char* kFunctions[] = {         // (copied from LiteCore's QueryPars
     "isarray",  "isatom",  "isboolean",  "isnumber",  "isobject",  "isstring",  "type",  "toarray",
     "toatom",  "toboolean",  "tonumber",  "toobject",  "tostring",
     // FTS (not standard N1QL):
-    "rank",
+    "rank",  "snippet",
     // Aggregate functions:
     "avg",  "count",  "max",  "min",  "sum",
     // Predictive query:
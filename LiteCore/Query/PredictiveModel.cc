@@ -20,12 +20,14 @@
 //
 
 #include "PredictiveModel.hh"
+#include "SecureDigest.hh"
 #include <mutex>
 #include <unordered_map>
 
 namespace litecore {
     using namespace std;
     using namespace fleece;
+    using namespace fleece::impl;
 
     // HACK: Making this a pointer to avoid the dynamic atexit destructor
     // Since the "unregister" callback potentially calls into managed code
@@ -35,7 +37,8 @@ namespace litecore {
         = new unordered_map<string, Retained<PredictiveModel>>;
     static mutex sRegistryMutex;
 
-    void PredictiveModel::registerAs(const std::string &name) {
+    void PredictiveModel::registerAs(const std::string &name, size_t cacheCapacity) {
+        setCacheCapacity(cacheCapacity);
         lock_guard<mutex> lock(sRegistryMutex);
         sRegistry->erase(name);
         sRegistry->insert({name, this});
@@ -54,6 +57,141 @@ namespace litecore {
         return i->second;
     }
 
+
+#pragma mark - BATCHES:
+
+
+    vector<alloc_slice> PredictiveModel::predictions(const vector<const Dict*> &inputs,
+                                                     DataFile::Delegate *delegate,
+                                                     C4Error *outError) noexcept
+    {
+        vector<alloc_slice> results;
+        results.reserve(inputs.size());
+        for (auto input : inputs) {
+            results.push_back(prediction(input, delegate, outError));
+            if (!results.back() && outError->code != 0)
+                return {};
+        }
+        return results;
+    }
+
+
+#pragma mark - CACHE:
+
+
+    // The cache key is the database's path plus a SHA-1 digest of the input's canonical JSON
+    // form. (A model may be used by several databases, whose results mustn't be mixed up.)
+    PredictiveModel::Digest PredictiveModel::digestOf(const Dict *input, const string &database) {
+        SHA1 digest(input->toJSON(true));
+        return database + '\0' + string(slice(digest));
+    }
+
+
+    bool PredictiveModel::lookUp(const Digest &digest, alloc_slice &outResult) {
+        lock_guard<mutex> lock(_cacheMutex);
+        auto i = _cacheMap.find(digest);
+        if (i == _cacheMap.end())
+            return false;
+        _cacheList.splice(_cacheList.begin(), _cacheList, i->second);   // mark most recent
+        outResult = i->second->second;
+        return true;
+    }
+
+
+    void PredictiveModel::store(const Digest &digest, alloc_slice result) {
+        lock_guard<mutex> lock(_cacheMutex);
+        if (_cacheCapacity == 0 || _cacheMap.find(digest) != _cacheMap.end())
+            return;
+        _cacheList.emplace_front(digest, result);
+        _cacheMap[digest] = _cacheList.begin();
+        while (_cacheMap.size() > _cacheCapacity) {
+            _cacheMap.erase(_cacheList.back().first);
+            _cacheList.pop_back();
+        }
+    }
+
+
+    void PredictiveModel::setCacheCapacity(size_t capacity) {
+        lock_guard<mutex> lock(_cacheMutex);
+        _cacheCapacity = capacity;
+        while (_cacheMap.size() > _cacheCapacity) {
+            _cacheMap.erase(_cacheList.back().first);
+            _cacheList.pop_back();
+        }
+    }
+
+
+    alloc_slice PredictiveModel::cachedPrediction(const Dict *input,
+                                                  DataFile::Delegate *delegate,
+                                                  const string &database,
+                                                  C4Error *outError) noexcept
+    {
+        {
+            lock_guard<mutex> lock(_cacheMutex);
+            if (_cacheCapacity == 0)
+                return prediction(input, delegate, outError);
+        }
+        Digest digest;
+        try {
+            digest = digestOf(input, database);
+            alloc_slice result;
+            if (lookUp(digest, result))
+                return result;
+        } catch (const exception&) {
+            return prediction(input, delegate, outError);
+        }
+
+        alloc_slice result = prediction(input, delegate, outError);
+        if (result || outError->code == 0) {       // A null result is cacheable; an error isn't
+            try {
+                store(digest, result);
+            } catch (const exception&) { }
+        }
+        return result;
+    }
+
+
+    vector<alloc_slice> PredictiveModel::cachedPredictions(const vector<const Dict*> &inputs,
+                                                           DataFile::Delegate *delegate,
+                                                           const string &database,
+                                                           C4Error *outError) noexcept
+    {
+        {
+            lock_guard<mutex> lock(_cacheMutex);
+            if (_cacheCapacity == 0)
+                return predictions(inputs, delegate, outError);
+        }
+        try {
+            // Look up every input; collect the ones that miss the cache:
+            vector<alloc_slice> results(inputs.size());
+            vector<Digest> digests(inputs.size());
+            vector<const Dict*> missing;
+            vector<size_t> missingIndex;
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                digests[i] = digestOf(inputs[i], database);
+                if (!lookUp(digests[i], results[i])) {
+                    missing.push_back(inputs[i]);
+                    missingIndex.push_back(i);
+                }
+            }
+            if (missing.empty())
+                return results;
+
+            // Run the model on just those:
+            vector<alloc_slice> computed = predictions(missing, delegate, outError);
+            if (computed.size() != missing.size())
+                return {};
+            for (size_t m = 0; m < missing.size(); ++m) {
+                results[missingIndex[m]] = computed[m];
+                store(digests[missingIndex[m]], computed[m]);
+            }
+            return results;
+        } catch (const exception &x) {
+            *outError = c4error_make(LiteCoreDomain, kC4ErrorUnexpectedError, slice(x.what()));
+            return {};
+        }
+    }
+
 }
 
 #endif
@@ -10,7 +10,11 @@
 #include "c4Base.h"
 #include "fleece/slice.hh"
 #include "Value.hh"
+#include <list>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #ifdef COUCHBASE_ENTERPRISE
 
@@ -22,10 +26,52 @@ namespace litecore {
                                                DataFile::Delegate* NONNULL,
                                                C4Error* NONNULL) noexcept =0;
 
-        void registerAs(const std::string &name);
+        /** Runs the model on many inputs in one call; used when building predictive indexes.
+            The default implementation calls `prediction` for each input; models backed by ML
+            libraries that can evaluate batches should override it. On failure, sets the error
+            and returns an empty vector. */
+        virtual std::vector<fleece::alloc_slice> predictions(
+                                        const std::vector<const fleece::impl::Dict*>&,
+                                        DataFile::Delegate* NONNULL,
+                                        C4Error* NONNULL) noexcept;
+
+        /** Like `prediction`, but first looks up the input in the model's cache, if it has one.
+            `database` identifies the database (its path), since results are only reused
+            within the same database. */
+        fleece::alloc_slice cachedPrediction(const fleece::impl::Dict* NONNULL,
+                                             DataFile::Delegate* NONNULL,
+                                             const std::string &database,
+                                             C4Error* NONNULL) noexcept;
+
+        /** Like `predictions`, but only passes the model the inputs that aren't cached. */
+        std::vector<fleece::alloc_slice> cachedPredictions(
+                                        const std::vector<const fleece::impl::Dict*>&,
+                                        DataFile::Delegate* NONNULL,
+                                        const std::string &database,
+                                        C4Error* NONNULL) noexcept;
+
+        /** Registers the model under a name. If `cacheCapacity` is nonzero, up to that many
+            results are cached, keyed by the database and a digest of the input; only models
+            that are deterministic should do this. */
+        void registerAs(const std::string &name, size_t cacheCapacity =0);
         static bool unregister(const std::string &name);
 
         static fleece::Retained<PredictiveModel> named(const std::string&);
+
+    private:
+        using Digest = std::string;
+
+        static Digest digestOf(const fleece::impl::Dict*, const std::string &database);
+        void setCacheCapacity(size_t capacity);
+        bool lookUp(const Digest&, fleece::alloc_slice &outResult);
+        void store(const Digest&, fleece::alloc_slice result);
+
+        // LRU cache of results, keyed by the database and a digest of the input:
+        using LRUList = std::list<std::pair<Digest, fleece::alloc_slice>>;
+        std::mutex _cacheMutex;
+        size_t _cacheCapacity {0};                                  // 0 means no caching
+        LRUList _cacheList;                                         // most recent first
+        std::unordered_map<Digest, LRUList::iterator> _cacheMap;
     };
 
 }
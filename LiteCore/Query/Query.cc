@@ -21,6 +21,7 @@
 #include "DataFile.hh"
 #include "Logging.hh"
 #include "StringUtil.hh"
+#include <algorithm>
 
 
 namespace litecore {
@@ -56,6 +57,54 @@ namespace litecore {
     }
 
 
+    alloc_slice Query::encodeParameters(const alloc_slice &params) {
+        if (params.size >= 2 && params[0] == '{' && params[params.size-1] == '}')
+            return fleece::impl::JSONConverter::convertJSON(params);
+        return params;
+    }
+
+
+    std::atomic<double> Query::sSlowQueryThreshold {0.0};
+
+
+    void Query::setCollectingStatistics(bool collect) {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _collectingStats = collect;
+        _stats = Statistics();
+    }
+
+
+    bool Query::getStatistics(Statistics &outStats) const {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        if (!_collectingStats)
+            return false;
+        outStats = _stats;
+        return true;
+    }
+
+
+    void Query::addStatistics(const Statistics &run) {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        if (_collectingStats)
+            _stats.add(run);
+    }
+
+
+    void Query::Statistics::add(const Statistics &s) {
+        runCount        += s.runCount;
+        rowsReturned    += s.rowsReturned;
+        fullScanSteps   += s.fullScanSteps;
+        sortOperations  += s.sortOperations;
+        autoIndexRows   += s.autoIndexRows;
+        vmSteps         += s.vmSteps;
+        fleeceCalls     += s.fleeceCalls;
+        parallelRuns    += s.parallelRuns;
+        stepTime        += s.stepTime;
+        encodeTime      += s.encodeTime;
+        maxRunTime      = std::max(maxRunTime, s.maxRunTime);
+    }
+
+
     Query::parseError::parseError(const char *message, int errPos)
     :error(error::LiteCore, error::InvalidQuery,
            format("%s near character %d", message, errPos+1))
@@ -23,11 +23,64 @@
 #include "Error.hh"
 #include "Logging.hh"
 #include <atomic>
+#include <mutex>
+#include <vector>
 
 namespace litecore {
     class QueryEnumerator;
 
 
+    /** Lets runs of a query be stopped from another thread. A run whose Query::Options have a
+        QueryCancellation stops with a QueryCanceled error soon after `cancel` is called (or
+        right away, if it was called before the run started.) */
+    class QueryCancellation : public RefCounted {
+    public:
+        void cancel()                       {_canceled = true;}
+        bool canceled() const               {return _canceled;}
+    private:
+        std::atomic<bool> _canceled {false};
+    };
+
+
+    /** Query results stored by column instead of by row, as produced by Query::runColumnar.
+        Each column's values are in typed buffers that can be read directly, without decoding
+        any Fleece. Row `i` of a column is at index `i` of its buffer, even if it's null. */
+    class ColumnarResult : public RefCounted {
+    public:
+        enum ColumnType : uint8_t {
+            kNullColumn,        ///< Every value is null or missing
+            kIntegerColumn,     ///< Values are in `integers`
+            kDoubleColumn,      ///< Values are in `doubles`
+            kStringColumn,      ///< UTF-8 strings in `bytes`, delimited by `offsets`
+            kFleeceColumn,      ///< Other or mixed types; each value is a Fleece doc in `bytes`
+        };
+
+        struct Column {
+            ColumnType type {kNullColumn};
+            std::vector<uint8_t> validity;  ///< Bit i%8 of byte i/8 is set if row i isn't null
+            std::vector<int64_t> integers;
+            std::vector<double> doubles;
+            std::vector<uint64_t> offsets;  ///< Row i's value is bytes[offsets[i]..offsets[i+1]]
+            std::vector<uint8_t> bytes;
+
+            bool isNull(uint64_t row) const {
+                return (validity[row / 8] & (1 << (row % 8))) == 0;
+            }
+        };
+
+        ColumnarResult(std::vector<Column> &&columns, uint64_t rowCount)
+        :_columns(std::move(columns)), _rowCount(rowCount) { }
+
+        uint64_t rowCount() const                   {return _rowCount;}
+        unsigned columnCount() const                {return (unsigned)_columns.size();}
+        const Column& column(unsigned i) const      {return _columns.at(i);}
+
+    private:
+        std::vector<Column> const _columns;
+        uint64_t const _rowCount;
+    };
+
+
     /** Abstract base class of compiled database queries.
         These are created by the factory method KeyStore::compileQuery(). */
     class Query : public RefCounted, public Logging {
@@ -67,14 +120,18 @@ namespace litecore {
             Options() { }
             
             Options(const Options &o)
-            :paramBindings(o.paramBindings), afterSequence(o.afterSequence) { }
+            :paramBindings(o.paramBindings), afterSequence(o.afterSequence)
+            ,continuation(o.continuation), cancellation(o.cancellation), timeout(o.timeout)
+            ,countOnly(o.countOnly), maxRows(o.maxRows) { }
 
             template <class T>
-            Options(T bindings, sequence_t afterSeq =0, uint64_t withPurgeCount =0)
-            :paramBindings(bindings), afterSequence(afterSeq), purgeCount(withPurgeCount) { }
+            Options(T bindings, sequence_t afterSeq =0, uint64_t withPurgeCount =0,
+                    alloc_slice continueFrom =nullslice)
+            :paramBindings(bindings), afterSequence(afterSeq), purgeCount(withPurgeCount)
+            ,continuation(continueFrom) { }
 
-            Options after(sequence_t afterSeq) const {return Options(paramBindings, afterSeq, purgeCount);}
-            Options withPurgeCount(uint64_t purgeCnt) const {return Options(paramBindings, afterSequence, purgeCnt);}
+            Options after(sequence_t afterSeq) const {return Options(*this, afterSeq, purgeCount);}
+            Options withPurgeCount(uint64_t purgeCnt) const {return Options(*this, afterSequence, purgeCnt);}
 
             bool notOlderThan(sequence_t afterSeq, uint64_t purgeCnt) const {
                 return afterSequence > 0 && afterSequence >= afterSeq && purgeCnt == purgeCount;
@@ -83,19 +140,95 @@ namespace litecore {
             alloc_slice const paramBindings;
             sequence_t const  afterSequence {0};
             uint64_t const purgeCount {0};
+            alloc_slice const continuation;     ///< Token from QueryEnumerator::continuation()
+            Retained<QueryCancellation> cancellation;   ///< Stops the run when canceled
+            double timeout {0};                 ///< Seconds a run may take (else QueryTimeout)
+            bool countOnly {false};             ///< Only count the rows; the enumerator has none
+            uint64_t maxRows {0};               ///< If nonzero, stop after reading this many rows
+
+        private:
+            Options(const Options &o, sequence_t afterSeq, uint64_t purgeCnt)
+            :paramBindings(o.paramBindings), afterSequence(afterSeq), purgeCount(purgeCnt)
+            ,continuation(o.continuation), cancellation(o.cancellation), timeout(o.timeout)
+            ,countOnly(o.countOnly), maxRows(o.maxRows) { }
         };
 
         virtual QueryEnumerator* createEnumerator(const Options* =nullptr) =0;
 
+        /** Encodes an enumerator's results, and the database state they reflect, so they can be
+            stored and given to restoreResults later, even by another process. */
+        virtual alloc_slice saveResults(QueryEnumerator* NONNULL) =0;
+
+        /** Returns an enumerator over results encoded by saveResults, without running the query.
+            Its lastSequence and purgeCount are those of the saved results, so `obsoletedBy` or
+            `refresh` tell whether they're still current. Returns null if the data is invalid or
+            was saved by a query that compiled differently. */
+        virtual QueryEnumerator* restoreResults(slice savedResults, const Options* =nullptr) =0;
+
+        /** Runs the query and returns its results by column (see ColumnarResult.) Options that
+            only apply to enumerators, like `countOnly`, are ignored. */
+        virtual Retained<ColumnarResult> runColumnar(const Options* =nullptr) =0;
+
+        /** Converts parameter bindings given as a JSON object to Fleece; Fleece data is returned
+            as-is. Callers that run a query repeatedly can do this once up front. */
+        static alloc_slice encodeParameters(const alloc_slice &jsonOrFleece);
+
+
+        /** Execution statistics, accumulated over every run since collection was enabled.
+            (Must match the layout of C4QueryStats.) Times are in seconds. */
+        struct Statistics {
+            uint64_t runCount {0};          ///< Number of times the query has been run
+            uint64_t rowsReturned {0};      ///< Total number of result rows produced
+            uint64_t fullScanSteps {0};     ///< Rows stepped through by full table scans
+            uint64_t sortOperations {0};    ///< Number of sort operations performed
+            uint64_t autoIndexRows {0};     ///< Rows inserted into transient automatic indexes
+            uint64_t vmSteps {0};           ///< SQLite virtual-machine operations executed
+            uint64_t fleeceCalls {0};       ///< Document bodies evaluated by Fleece functions
+            uint64_t parallelRuns {0};      ///< Runs split up across threads (see setParallelism)
+            double   stepTime {0};          ///< Time spent stepping the SQLite statement
+            double   encodeTime {0};        ///< Time spent encoding result rows
+            double   maxRunTime {0};        ///< Time taken by the slowest single run
+
+            void add(const Statistics&);
+        };
+
+        /** Turns statistics collection on or off. Either way, existing statistics are cleared. */
+        void setCollectingStatistics(bool collect);
+        bool collectingStatistics() const                               {return _collectingStats;}
+
+        /** Copies the accumulated statistics to `outStats`; returns false if not collecting. */
+        bool getStatistics(Statistics &outStats) const;
+
+        /** Lets an aggregate query run on up to `maxThreads` threads at once, each aggregating a
+            range of documents on its own database connection. Zero or one (the default) means
+            a single thread. Queries whose partial results can't be merged ignore this
+            (see QueryParser::PartialAggregation.) */
+        void setParallelism(unsigned maxThreads)                        {_parallelism = maxThreads;}
+        unsigned parallelism() const                                    {return _parallelism;}
+
+        /** Sets the minimum run time (in seconds) at which any query is logged as a warning,
+            along with its plan. Zero (the default) disables the slow-query log. */
+        static void setSlowQueryThreshold(double seconds)               {sSlowQueryThreshold = seconds;}
+        static double slowQueryThreshold()                              {return sSlowQueryThreshold;}
+
     protected:
         Query(KeyStore &keyStore, slice expression, QueryLanguage language);
         virtual ~Query();
         virtual std::string loggingIdentifier() const override;
+
+        /** Called by implementations after each run, if collectingStatistics() is true. */
+        void addStatistics(const Statistics&);
         
     private:
         KeyStore* _keyStore;
         alloc_slice _expression;
         QueryLanguage _language;
+        std::atomic<bool> _collectingStats {false};
+        std::atomic<unsigned> _parallelism {0};
+        Statistics _stats;
+        mutable std::mutex _statsMutex;
+
+        static std::atomic<double> sSlowQueryThreshold;
     };
 
 
@@ -118,6 +251,12 @@ namespace litecore {
         virtual int64_t getRowCount() const         {return -1;}
         virtual void seek(int64_t rowIndex)         {error::_throw(error::UnsupportedOperation);}
 
+        /** Returns an opaque token that, passed as Options::continuation to the same query,
+            makes it return the rows that sort after the last row of these results. Returns null
+            if there are no rows. Throws UnsupportedOperation if the query isn't pageable
+            (see QueryParser::keyset), or if this is a count-only run (Options::countOnly.) */
+        virtual alloc_slice continuation() const    {error::_throw(error::UnsupportedOperation);}
+
         virtual bool hasFullText() const                        {return false;}
         virtual const FullTextTerms& fullTextTerms()            {return _fullTextTerms;}
 
@@ -127,6 +266,10 @@ namespace litecore {
 
         virtual bool obsoletedBy(const QueryEnumerator*) =0;
 
+        /** Returns a new enumerator with the same results, positioned before the first row.
+            This lets the same results be handed to multiple clients, each iterating separately. */
+        virtual QueryEnumerator* clone() =0;
+
     protected:
         QueryEnumerator(const Query::Options *options, sequence_t lastSeq, uint64_t purgeCount)
         :_options(options ? *options : Query::Options{})
@@ -45,9 +45,20 @@ namespace litecore { namespace qp {
     constexpr slice kArrayFnNameWithParens = "array_of()"_sl;
     constexpr slice kDictFnName = "dict_of"_sl;
     constexpr slice kVersionFnName  = "fl_version"_sl;
+    constexpr slice kSortKeyFnName  = "fl_sortkey"_sl;
 
     // Existing SQLite FTS rank function:
     constexpr slice kRankFnName  = "rank"_sl;
+    constexpr slice kBM25FnName  = "bm25"_sl;
+    constexpr slice kSnippetFnName = "snippet"_sl;
+
+    // Spatial functions, which require an R-tree spatial index:
+    constexpr slice kGeoWithinFnName     = "geo_within"_sl;
+    constexpr slice kGeoIntersectsFnName = "geo_intersects"_sl;
+    constexpr slice kGeoDistanceFnName   = "geo_distance"_sl;
+
+    // Vector similarity function, which requires a vector index:
+    constexpr slice kVectorDistanceFnName = "vector_distance"_sl;
 
     constexpr slice kArrayCountFnName = "array_count"_sl;
 
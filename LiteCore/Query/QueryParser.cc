@@ -33,6 +33,7 @@
 #include "NumConversion.hh"
 #include <utility>
 #include <algorithm>
+#include <cmath>
 
 using namespace std;
 using namespace fleece;
@@ -158,6 +159,10 @@ namespace litecore {
         _variables.clear();
         _ftsTables.clear();
         _indexJoinTables.clear();
+        _vectorSearches.clear();
+        _keyset.reset();
+        _partialAggregation.reset();
+        _aggregateView.reset();
         _aliases.clear();
         _dbAlias.clear();
         _columnTitles.clear();
@@ -235,9 +240,24 @@ namespace litecore {
                     "Sorry, multiple MATCHes of the same property are not allowed");
         }
 
+        // If an aggregate index has the query's results, read them from there instead:
+        if (findAggregateView(where, operands)) {
+            writeAggregateViewSelect(operands);
+            return;
+        }
+
         // Add the indexed prediction() calls to _indexJoinTables now
         findPredictionCalls(operands);
 
+        // Likewise for WHAT expressions stored in covering indexes
+        findCoveredResults(operands);
+
+        // ...and for the spatial indexes named by GEO_ functions
+        findSpatialIndexes(operands);
+
+        // ...and for the vector indexes named by VECTOR_DISTANCE
+        findVectorSearches(operands);
+
         _sql << "SELECT ";
 
         // DISTINCT:
@@ -265,10 +285,12 @@ namespace litecore {
         }
 
         // FROM clause:
+        auto startPosOfFrom = _sql.tellp();
         writeFromClause(from);
 
         // WHERE clause:
         writeWhereClause(where);
+        auto endPosOfWhere = _sql.tellp();
 
         // GROUP_BY clause:
         bool grouped = (writeSelectListClause(operands, "GROUP_BY"_sl, " GROUP BY ") > 0);
@@ -286,6 +308,7 @@ namespace litecore {
         }
 
         // Now go back and prepend some WHAT columns needed for FTS:
+        size_t ftsColumnsLength = 0;
         if(!_isAggregateQuery && !_ftsTables.empty()) {
             stringstream extra;
             extra << _dbAlias << ".rowid";
@@ -296,6 +319,7 @@ namespace litecore {
                 extra << ", offsets(" << alias << ".\"" << ftsTable << "\")";
             }
             extra << ", ";
+            ftsColumnsLength = extra.str().size();
             string str = _sql.str();
             str.insert((string::size_type)startPosOfWhat, extra.str());
             _sql.str(str);
@@ -304,14 +328,44 @@ namespace litecore {
         }
 
         // ORDER_BY clause:
-        writeSelectListClause(operands, "ORDER_BY"_sl, " ORDER BY ", true);
+        _writingSortKeys = true;
+        if (!writeKeysetOrderBy(operands))
+            writeSelectListClause(operands, "ORDER_BY"_sl, " ORDER BY ", true);
+        _writingSortKeys = false;
 
         // LIMIT, OFFSET clauses:
-        if (!writeOrderOrLimitClause(operands, "LIMIT"_sl,  "LIMIT")) {
-            if (getCaseInsensitive(operands, "OFFSET"_sl))
-                _sql << " LIMIT -1";            // SQL does not allow OFFSET without LIMIT
+        writeLimitAndOffset(operands);
+
+        size_t keyColumnsLength = 0;
+        if (_keyset) {
+            // Go back and prepend the sort keys as WHAT columns, after the FTS ones:
+            stringstream extra;
+            for (auto &key : _keyset->keys)
+                extra << key << ", ";
+            string str = _sql.str();
+            str.insert((string::size_type)startPosOfWhat + ftsColumnsLength, extra.str());
+            _keyset->firstColumn = _1stCustomResultCol;
+            _1stCustomResultCol += (unsigned)_keyset->keys.size();
+
+            // Split the SQL at the end of the WHERE clause, where a continuation's test goes:
+            auto split = (string::size_type)endPosOfWhere + ftsColumnsLength + extra.str().size();
+            _keyset->head = str.substr(0, split);
+            _keyset->tail = str.substr(split);
+            _sql.str(str);
+            _sql.seekp(0, stringstream::end);
+            keyColumnsLength = extra.str().size();
         }
-        writeOrderOrLimitClause(operands, "OFFSET"_sl, "OFFSET");
+
+        // A nearest-k spatial search only has to look at the part of the R-tree around the point.
+        // (Not in a keyset's continuations, whose rows aren't the nearest ones.)
+        if (auto geoDistance = nearestSpatialSearch(operands)) {
+            auto shift = ftsColumnsLength + keyColumnsLength;
+            writeNearestSpatialBox(geoDistance, operands,
+                                   (size_t)startPosOfFrom + shift, (size_t)endPosOfWhere + shift);
+        }
+
+        if (_isAggregateQuery && !distinctVal)
+            makePartialAggregation(operands, (size_t)startPosOfFrom, (size_t)endPosOfWhere);
     }
 
 
@@ -377,7 +431,9 @@ namespace litecore {
                 _aliases[_dbAlias] = kUnnestTableAlias;
             _sql << "CREATE INDEX \"" << name << "\" ON " << _tableName << " ";
             if (expressionsIter.count() > 0) {
+                _writingSortKeys = true;
                 writeColumnList(expressionsIter);
+                _writingSortKeys = false;
             } else {
                 // No expressions; index the entire body (this is used with unnested/array tables):
                 Assert(isUnnestedTable);
@@ -389,6 +445,15 @@ namespace litecore {
     }
 
 
+    void QueryParser::writeLimitAndOffset(const Dict *operands) {
+        if (!writeOrderOrLimitClause(operands, "LIMIT"_sl,  "LIMIT")) {
+            if (getCaseInsensitive(operands, "OFFSET"_sl))
+                _sql << " LIMIT -1";            // SQL does not allow OFFSET without LIMIT
+        }
+        writeOrderOrLimitClause(operands, "OFFSET"_sl, "OFFSET");
+    }
+
+
     bool QueryParser::writeOrderOrLimitClause(const Dict *operands,
                                               slice jsonKey,
                                               const char *sqlKeyword) {
@@ -402,6 +467,260 @@ namespace litecore {
     }
 
 
+#pragma mark - KEYSET PAGINATION:
+
+
+    bool QueryParser::isPageable(const Dict *operands) const {
+        if (_isNested || _isAggregateQuery
+                || !getCaseInsensitive(operands, "ORDER_BY"_sl)
+                || !getCaseInsensitive(operands, "LIMIT"_sl)
+                || getCaseInsensitive(operands, "OFFSET"_sl))
+            return false;
+        for (auto &alias : _aliases) {
+            if (alias.second != kDBAlias && alias.second != kResultAlias)
+                return false;       // Joins and UNNESTs can produce several rows per document
+        }
+        return true;
+    }
+
+
+    // Writes the ORDER BY clause of a pageable query, with the rowid appended as a tie-breaker so
+    // that every row has a distinct position, and creates _keyset with the SQL of each sort key.
+    // Returns false, writing nothing, if the query can't be paged.
+    bool QueryParser::writeKeysetOrderBy(const Dict *operands) {
+        auto orderBy = getCaseInsensitive(operands, "ORDER_BY"_sl);
+        if (!isPageable(operands) || requiredArray(orderBy, "ORDER BY parameter")->empty())
+            return false;
+
+        auto keyset = make_unique<Keyset>();
+        auto startPos = _sql.tellp();
+        _usedResultAlias = false;
+        _sql << " ORDER BY ";
+        // (Same context as writeSelectListClause, so the SQL is the same as it would write)
+        _context.push_back(&kExpressionListOperation);
+        _context.push_back(&kColumnListOperation);
+        _aggregatesOK = true;
+        for (Array::iterator i(orderBy->asArray()); i; ++i) {
+            auto keyPos = _sql.tellp();
+            parseCollatableNode(i.value());
+            string key = _sql.str().substr((size_t)keyPos);
+
+            // Strip the ASC or DESC the key was written with:
+            bool descending = false;
+            const Array *op = i.value()->asArray();
+            slice dir = (op && op->count() == 2) ? op->get(0)->asString() : nullslice;
+            if (dir.caseEquivalent("DESC"_sl) || dir.caseEquivalent("ASC"_sl)) {
+                descending = dir.caseEquivalent("DESC"_sl);
+                key.resize(key.size() - dir.size - 1);
+            }
+            keyset->keys.push_back(key);
+            keyset->descending.push_back(descending);
+            _sql << ", ";
+        }
+        _aggregatesOK = false;
+        _context.resize(_context.size() - 2);
+
+        if (_isAggregateQuery || _usedResultAlias) {
+            // The keys can't be evaluated in the WHAT and WHERE clauses; write a regular ORDER BY:
+            string str = _sql.str();
+            str.resize((size_t)startPos);
+            _sql.str(str);
+            _sql.seekp(0, stringstream::end);
+            return false;
+        }
+
+        string rowid = quoteTableName(_dbAlias) + ".rowid";
+        _sql << rowid;
+        keyset->keys.push_back(rowid);
+        keyset->descending.push_back(false);
+        _keyset = move(keyset);
+        return true;
+    }
+
+
+    string QueryParser::Keyset::keyParameter(size_t i) {
+        return ":_key" + to_string(i);
+    }
+
+
+    // A row sorts after the given one if, for some key, it has an equal value of every preceding
+    // key and a later value of that key. (SQLite sorts NULL before any other value.) Non-null key
+    // values are parameters, so only the pattern of nulls changes the SQL.
+    string QueryParser::Keyset::continuationSQL(const Array *lastKeys) const {
+        size_t nKeys = keys.size();
+        if (!lastKeys || lastKeys->count() != nKeys)
+            error::_throw(error::InvalidParameter, "Invalid query continuation");
+        vector<string> params;
+        for (uint32_t i = 0; i < nKeys; ++i) {
+            switch (lastKeys->get(i)->type()) {
+                case kNull:
+                    params.emplace_back();          // (empty if null)
+                    break;
+                case kNumber:
+                case kString:
+                case kData:
+                    params.push_back(keyParameter(i));
+                    break;
+                default:
+                    error::_throw(error::InvalidParameter, "Invalid query continuation");
+            }
+        }
+
+        stringstream sql;
+        sql << head << " AND (";
+        if (!params[0].empty()) {
+            // Redundant, but lets SQLite seek to the starting position in an index on the 1st key:
+            if (!descending[0])
+                sql << "(" << keys[0] << ") >= " << params[0] << " AND ";
+            else
+                sql << "((" << keys[0] << ") <= " << params[0] << " OR ("
+                    << keys[0] << ") IS NULL) AND ";
+        }
+        sql << "(";
+        bool first = true;
+        for (size_t i = 0; i < nKeys; ++i) {
+            if (descending[i] && params[i].empty())
+                continue;                           // nothing sorts after NULL in descending order
+            if (!first)
+                sql << " OR ";
+            first = false;
+            sql << "(";
+            for (size_t j = 0; j < i; ++j) {
+                sql << "(" << keys[j] << ")";
+                if (params[j].empty())
+                    sql << " IS NULL AND ";
+                else
+                    sql << " = " << params[j] << " AND ";
+            }
+            if (params[i].empty())
+                sql << "(" << keys[i] << ") IS NOT NULL";
+            else if (!descending[i])
+                sql << "(" << keys[i] << ") > " << params[i];
+            else
+                sql << "((" << keys[i] << ") < " << params[i] << " OR ("
+                    << keys[i] << ") IS NULL)";
+            sql << ")";
+        }
+        if (first)
+            sql << "0";
+        sql << "))" << tail;
+        return sql.str();
+    }
+
+
+#pragma mark - PARALLEL AGGREGATION:
+
+
+    // Sets _partialAggregation if the (just written) aggregate query can run in parallel.
+    void QueryParser::makePartialAggregation(const Dict *operands,
+                                             size_t startPosOfFrom, size_t endPosOfWhere)
+    {
+        if (_isNested || !_ftsTables.empty() || !_indexJoinTables.empty()
+                || getCaseInsensitive(operands, "HAVING"_sl)
+                || getCaseInsensitive(operands, "ORDER_BY"_sl)
+                || getCaseInsensitive(operands, "LIMIT"_sl)
+                || getCaseInsensitive(operands, "OFFSET"_sl))
+            return;
+        for (auto &alias : _aliases) {
+            if (alias.second != kDBAlias && alias.second != kResultAlias)
+                return;
+        }
+        string sql = _sql.str();
+        if (sql.find(" COLLATE ") != string::npos)
+            return;         // Merging compares values in binary order, as SQLite does by default
+        auto what = getCaseInsensitive(operands, "WHAT"_sl);
+        if (!what || !what->asArray() || what->asArray()->empty())
+            return;
+        auto groupBy = getCaseInsensitive(operands, "GROUP_BY"_sl);
+        auto groupByArray = groupBy ? groupBy->asArray() : nullptr;
+        unsigned groupKeysFound = 0;
+
+        // Write the partial query's result columns, in place of the WHAT clause's:
+        auto plan = make_unique<PartialAggregation>();
+        auto startPos = _sql.tellp();
+        _context.push_back(&kExpressionListOperation);
+        _context.push_back(&kColumnListOperation);
+        _aggregatesOK = true;
+        bool ok = true;
+        for (Array::iterator i(what->asArray()); i && ok; ++i) {
+            const Value *item = i.value();
+            const Array *as = item->asArray();
+            if (as && as->count() == 3 && as->get(0)->asString().caseEquivalent("AS"_sl))
+                item = as->get(1);
+            if (plan->columns.size() > 0)
+                _sql << ", ";
+
+            // Is it a GROUP_BY expression?
+            bool isKey = false;
+            for (Array::iterator g(groupByArray); g; ++g) {
+                if (item->isEqual(g.value())) {
+                    isKey = true;
+                    break;
+                }
+            }
+            if (isKey) {
+                ++groupKeysFound;
+                plan->columns.push_back(PartialAggregation::kGroupKey);
+                _sql << kResultFnName << "(";
+                parseNode(item);
+                _sql << ")";
+                continue;
+            }
+
+            // Is it a mergeable aggregate function call?
+            const Array *call = item->asArray();
+            slice fn = call ? call->get(0)->asString() : nullslice;
+            PartialAggregation::Merge merge;
+            if (fn.caseEquivalent("count()"_sl))
+                merge = PartialAggregation::kCount;
+            else if (fn.caseEquivalent("sum()"_sl))
+                merge = PartialAggregation::kSum;
+            else if (fn.caseEquivalent("min()"_sl))
+                merge = PartialAggregation::kMin;
+            else if (fn.caseEquivalent("max()"_sl))
+                merge = PartialAggregation::kMax;
+            else if (fn.caseEquivalent("avg()"_sl))
+                merge = PartialAggregation::kAvg;
+            else {
+                ok = false;
+                break;
+            }
+            plan->columns.push_back(merge);
+            auto callPos = _sql.tellp();
+            parseNode(item);
+            if (merge == PartialAggregation::kAvg) {
+                // "avg(x)" becomes "total(x), count(x)":
+                string args = _sql.str().substr((size_t)callPos + 3);
+                string str = _sql.str();
+                str.resize((size_t)callPos);
+                _sql.str(str);
+                _sql.seekp(0, stringstream::end);
+                _sql << "total" << args << ", count" << args;
+            }
+        }
+        _aggregatesOK = false;
+        _context.resize(_context.size() - 2);
+        string columns = _sql.str().substr((size_t)startPos);
+        sql.resize((size_t)startPos);
+        _sql.str(sql);
+        _sql.seekp(0, stringstream::end);
+
+        if (!ok || groupKeysFound != (groupByArray ? groupByArray->count() : 0))
+            return;
+        plan->head = "SELECT " + columns + sql.substr(startPosOfFrom, endPosOfWhere - startPosOfFrom);
+        plan->tail = sql.substr(endPosOfWhere);
+        plan->rowidSQL = quoteTableName(_dbAlias) + ".rowid";
+        _partialAggregation = move(plan);
+    }
+
+
+    string QueryParser::PartialAggregation::partialSQL(int64_t minRowid, int64_t maxRowid) const {
+        return format("%s AND %s BETWEEN %lld AND %lld%s",
+                      head.c_str(), rowidSQL.c_str(),
+                      (long long)minRowid, (long long)maxRowid, tail.c_str());
+    }
+
+
 #pragma mark - "FROM" / "JOIN" clauses:
 
 
@@ -533,6 +852,8 @@ namespace litecore {
             auto &alias = ftsTable.second;
             _sql << " JOIN \"" << table << "\" AS " << alias
                  << " ON " << alias << ".docid = " << quoteTableName(_dbAlias) << ".rowid";
+            if (auto search = _vectorSearches.find(table); search != _vectorSearches.end())
+                writeVectorProbes(table, alias, search->second);
         }
     }
 
@@ -551,6 +872,8 @@ namespace litecore {
     
     void QueryParser::parseNode(const Value *node) {
         _curNode = node;
+        if (_aggregateView && writeAggregateViewColumn(node, _context.back() == &kColumnListOperation))
+            return;
         switch (node->type()) {
             case kNull:
                 _sql << kNullFnName << "()";
@@ -597,6 +920,38 @@ namespace litecore {
     }
 
 
+    // True if the collation in effect is Unicode-aware and hasn't been written yet, and it should
+    // be applied to the expression by comparing sort keys (see setCollationSortKeys): either
+    // because an index is being created with sort keys, or because an index has the sort keys
+    // of this very expression.
+    bool QueryParser::collatingBySortKey(const Value *node) {
+        if (_collationUsed || !_collation.unicodeAware)
+            return false;
+        string sortKeyExpr = _collation.sqliteName() + " " + node->toJSONString();
+        if (!_collationSortKeys)
+            return _delegate.hasSortKeyIndex(sortKeyExpr);
+        if (*_collationSortKeys)
+            _sortKeyExpressions.insert(sortKeyExpr);
+        return *_collationSortKeys;
+    }
+
+
+    // Writes the collation sort key of an expression. (Strings only compare the same way by sort
+    // key as by collation if both sides of the comparison are sort keys.) The collator version
+    // makes the SQL, and so the expression of any index of it, specific to that version.
+    void QueryParser::parseSortKeyNode(const Value *node) {
+        _sql << kSortKeyFnName << "(";
+        _context.push_back(&kArgListOperation);     // prevents extra parens around operand
+        parseNode(node);
+        _context.pop_back();
+        _sql << ", ";
+        writeSQLString(slice(_collation.sqliteName()));
+        _sql << ", ";
+        writeSQLString(slice(CollationSortKeyVersion(_collation)));
+        _sql << ")";
+    }
+
+
     void QueryParser::parseOpNode(const Array *node) {
         Array::iterator array(node);
         require(array.count() > 0, "Empty JSON array");
@@ -682,6 +1037,13 @@ namespace litecore {
                 op = "!="_sl;
         }
 
+        // A Unicode-collated comparison may compare the sort keys of its operands instead:
+        bool sortKeys = (op == "<"_sl || op == "<="_sl || op == ">"_sl || op == ">="_sl
+                         || op == "="_sl || op == "!="_sl) && operands.count() == 2
+                      && (collatingBySortKey(operands[0]) || collatingBySortKey(operands[1]));
+        if (sortKeys)
+            _collationUsed = true;
+
         int n = 0;
         for (auto &i = operands; i; ++i) {
             // Write the operation/delimiter between arguments
@@ -690,7 +1052,10 @@ namespace litecore {
                     _sql << ' ';
                 _sql << op << ' ';
             }
-            parseCollatableNode(i.value());
+            if (sortKeys)
+                parseSortKeyNode(i.value());
+            else
+                parseCollatableNode(i.value());
         }
 
         if(functionWantsCollation) {
@@ -733,19 +1098,27 @@ namespace litecore {
                 title = string(requiredString(expr[2], "'AS' alias"));
 
                 result = expr[1];
-                _sql << kResultFnName << "(";
-                parseCollatableNode(result);
-                _sql << ") AS \"" << title << '"';
+                if (!writeCoveredResult(result)) {
+                    _sql << kResultFnName << "(";
+                    parseCollatableNode(result);
+                    _sql << ")";
+                }
+                _sql << " AS \"" << title << '"';
                 addAlias(title, kResultAlias);
             } else {
-                _sql << kResultFnName << "(";
-                if (result->type() == kString) {
+                if (writeCoveredResult(result)) {
+                    // Value is read from a covering index
+                } else if (result->type() == kString) {
                     // Convenience shortcut: interpret a string in a WHAT as a property path
-                    writePropertyGetter(kValueFnName, Path(result->asString()));
+                    _sql << kResultFnName << "(";
+                    if (!_aggregateView || !writeAggregateViewColumn(result, true))
+                        writePropertyGetter(kValueFnName, Path(result->asString()));
+                    _sql << ")";
                 } else {
+                    _sql << kResultFnName << "(";
                     parseCollatableNode(result);
+                    _sql << ")";
                 }
-                _sql << ")";
 
                 // Come up with a column title if there is no 'AS':
                 if (result->type() == kString) {
@@ -816,7 +1189,13 @@ namespace litecore {
         _context.pop_back();
 
         // Parse the expression:
-        parseNode(operands[1]);
+        if (_writingSortKeys && collatingBySortKey(operands[1])) {
+            // An ORDER BY or index key can be the collation sort key of the expression:
+            parseSortKeyNode(operands[1]);
+            _collationUsed = true;
+        } else {
+            parseNode(operands[1]);
+        }
 
         // If nothing in the expression (like a comparison operator) used the collation to generate
         // a SQL 'COLLATE', generate one now for the entire expression:
@@ -833,6 +1212,15 @@ namespace litecore {
 
     // Handles "x BETWEEN y AND z" expressions
     void QueryParser::betweenOp(slice op, Array::iterator& operands) {
+        if (collatingBySortKey(operands[0])) {
+            _collationUsed = true;
+            parseSortKeyNode(operands[0]);
+            _sql << ' ' << op << ' ';
+            parseSortKeyNode(operands[1]);
+            _sql << " AND ";
+            parseSortKeyNode(operands[2]);
+            return;
+        }
         parseCollatableNode(operands[0]);
         _sql << ' ' << op << ' ';
         parseNode(operands[1]);
@@ -1139,6 +1527,38 @@ namespace litecore {
             return;
         }
 
+        // Special case: "bm25(ftsName)" also needs the FTS table name, to look up corpus stats:
+        if (op.caseEquivalent(kBM25FnName)) {
+            string fts = FTSTableName(operands[0]);
+            auto i = _indexJoinTables.find(fts);
+            if (i == _indexJoinTables.end())
+                fail("bm25() can only be called on FTS indexes");
+            _sql << "bm25(matchinfo(" << i->second << ".\"" << i->first << "\", 'pcxl'), ";
+            writeSQLString(i->first);
+            _sql << ")";
+            return;
+        }
+
+        // Special case: "snippet(ftsName, [start, end, ellipsis, tokens])" is FTS4's snippet(),
+        // which marks up the matched words in the text around them without another lookup:
+        if (op.caseEquivalent(kSnippetFnName)) {
+            writeSnippet(operands);
+            return;
+        }
+
+        // Special case: the spatial functions turn into tests on an R-tree index's columns:
+        if (op.caseEquivalent(kGeoWithinFnName) || op.caseEquivalent(kGeoIntersectsFnName)
+                                                || op.caseEquivalent(kGeoDistanceFnName)) {
+            writeSpatialFunction(op, operands);
+            return;
+        }
+
+        // Special case: "vector_distance()" reads the vector from a vector index:
+        if (op.caseEquivalent(kVectorDistanceFnName)) {
+            writeVectorDistance(operands);
+            return;
+        }
+
         // Special case: "prediction()" may be indexed:
 #ifdef COUCHBASE_ENTERPRISE
         if (op.caseEquivalent(kPredictionFnName) && writeIndexedPrediction((const Array*)_curNode))
@@ -1299,6 +1719,7 @@ namespace litecore {
         }
 
         if(iType->second == kResultAlias && property[0].keyStr().asString() == iType->first) {
+            _usedResultAlias = true;
             // If the property in question is identified as an alias, emit that instead of
             // a standard getter since otherwise it will probably be wrong (i.e. doc["alias"]
             // vs alias -> doc["path"]["to"]["value"])
@@ -1504,6 +1925,37 @@ namespace litecore {
     }
 
 
+    // Writes a call to FTS4's snippet(), which returns the text around the words matched in a row,
+    // marked up. The optional arguments after the FTS index name are the markup to put before and
+    // after each match, the text marking omitted text, and the approximate number of words.
+    // <https://sqlite.org/fts3.html#snippet>
+    void QueryParser::writeSnippet(Array::iterator &operands) {
+        static constexpr slice kDefaultMarkup[3] = {"<b>"_sl, "</b>"_sl, "\u2026"_sl};
+        static constexpr int kDefaultTokens = 15;
+
+        string fts = FTSTableName(operands[0]);
+        auto i = _indexJoinTables.find(fts);
+        if (i == _indexJoinTables.end())
+            fail("snippet() can only be called on FTS indexes");
+        _context.push_back(&kArgListOperation);
+        _sql << "snippet(" << i->second << ".\"" << i->first << "\"";
+        for (unsigned arg = 1; arg <= 3; ++arg) {
+            _sql << ", ";
+            if (operands.count() > arg)
+                parseNode(operands[arg]);
+            else
+                writeSQLString(kDefaultMarkup[arg - 1]);
+        }
+        _sql << ", -1, ";                   // (-1 means the text can come from any column)
+        if (operands.count() > 4)
+            parseNode(operands[4]);
+        else
+            _sql << kDefaultTokens;
+        _sql << ")";
+        _context.pop_back();
+    }
+
+
 
 #pragma mark - UNNEST QUERY:
 
@@ -1516,20 +1968,23 @@ namespace litecore {
         for (Array::iterator i(expression); i; ++i) {
             if (maxItems > 0 && ++item > maxItems)
                 break;
-            alloc_slice json = i.value()->toJSON(true);
-            if (_propertiesUseSourcePrefix) {
-                // Strip ".doc" from property paths if necessary:
-                string s = json.asString();
-                replace(s, "[\"." + _dbAlias + ".", "[\".");
-                ctx << slice(s);
-            } else {
-                ctx << json;
-            }
+            ctx << slice(expressionJSON(i.value()));
         }
         return slice(ctx.finish()).base64String();
     }
 
 
+    // Returns the canonical JSON of an expression, for comparing or digesting it.
+    string QueryParser::expressionJSON(const Value *expression) const {
+        string json = expression->toJSON(true).asString();
+        if (_propertiesUseSourcePrefix) {
+            // Strip ".doc" from property paths if necessary:
+            replace(json, "[\"." + _dbAlias + ".", "[\".");
+        }
+        return json;
+    }
+
+
     // Returns the index table name for an unnested array property.
     string QueryParser::unnestedTableName(const Value *arrayExpr) const {
         string path(propertyFromNode(arrayExpr));
@@ -1550,6 +2005,542 @@ namespace litecore {
     }
 
 
+#pragma mark - COVERING INDEXES:
+
+
+    // Returns the name of the covering-index table storing the values of an expression.
+    string QueryParser::coveringTableName(const Value *expression) const {
+        return _delegate.coveringTableName(expressionIdentifier(requiredArray(expression,
+                                                                              "covered expression")));
+    }
+
+
+    // Adds join tables for the WHAT expressions whose values are stored in covering indexes,
+    // so they can be read from there instead of from the document bodies.
+    void QueryParser::findCoveredResults(const Dict *operands) {
+        auto what = getCaseInsensitive(operands, "WHAT"_sl);
+        if (!what || _delegate.coveringTableName("").empty())
+            return;
+        // Covering tables only have rows for live documents, and only describe the main source:
+        for (auto &alias : _aliases) {
+            if (alias.second != kDBAlias)
+                return;
+        }
+        for (DeepIterator di(operands); di; ++di) {
+            if (di.value()->asString().find(kDeletedProperty))
+                return;
+        }
+
+        for (Array::iterator i(what->asArray()); i; ++i) {
+            const Value *result = i.value();
+            Array::iterator expr(result->asArray());
+            if (expr && expr[0]->asString().caseEquivalent("AS"_sl))
+                result = expr[1];
+            if (result->asArray() && !result->asArray()->empty()) {
+                string table = coveringTableName(result);
+                if (_delegate.tableExists(table))
+                    indexJoinTableAlias(table, "cov");
+            }
+        }
+    }
+
+
+    // If the result expression is stored in a covering index, writes its column and returns true.
+    bool QueryParser::writeCoveredResult(const Value *result) {
+        auto array = result->asArray();
+        if (!array || array->empty() || _indexJoinTables.empty())
+            return false;
+        auto &alias = indexJoinTableAlias(coveringTableName(result));
+        if (alias.empty())
+            return false;
+        _sql << alias << ".value";
+        return true;
+    }
+
+
+#pragma mark - AGGREGATE INDEXES:
+
+
+    // Alias of an aggregate index's table, in a query that reads from it
+    static constexpr const char* kAggregateViewAlias = "_agg";
+
+    // The aggregate functions whose running values an aggregate index can store:
+    static constexpr slice kAggregateFnNames[] = {"count()"_sl, "sum()"_sl, "avg()"_sl,
+                                                  "min()"_sl, "max()"_sl};
+
+
+    /*static*/ slice QueryParser::aggregateCall(const Value *expression, const Value* &arg) {
+        const Array *call = expression->asArray();
+        if (!call || call->count() < 1 || call->count() > 2)
+            return nullslice;
+        slice fn = call->get(0)->asString();
+        for (slice name : kAggregateFnNames) {
+            if (fn.caseEquivalent(name)) {
+                arg = (call->count() > 1) ? call->get(1) : nullptr;
+                if (!arg && !fn.caseEquivalent("count()"_sl))
+                    return nullslice;
+                return slice(name.buf, name.size - 2);
+            }
+        }
+        return nullslice;
+    }
+
+
+    string QueryParser::aggregateIndexIdentifier(const vector<const Value*> &keys,
+                                                 const Value *where) const
+    {
+        SHA1Builder ctx;
+        for (auto key : keys)
+            ctx << slice(aggregateExpressionJSON(key, true));
+        if (where) {
+            ctx << "WHERE"_sl;
+            ctx << slice(expressionJSON(where));
+        }
+        return slice(ctx.finish()).base64String();
+    }
+
+
+    string QueryParser::aggregateColumnName(slice fn, const Value *arg) const {
+        if (!arg)
+            return "_n";
+        SHA1Builder ctx;
+        ctx << slice(aggregateExpressionJSON(arg, false));
+        return string(fn) + ":" + slice(ctx.finish()).base64String();
+    }
+
+
+    /*static*/ string QueryParser::aggregateKeyColumnName(size_t i) {
+        return format("k%zu", i);
+    }
+
+
+    // Returns the JSON of an expression, for matching it with an aggregate index's. In a column
+    // list (WHAT, GROUP_BY, ORDER_BY) a string is a property path, so it's given the JSON of the
+    // equivalent property expression.
+    string QueryParser::aggregateExpressionJSON(const Value *expression, bool inColumnList) const {
+        if (!inColumnList || expression->type() != kString)
+            return expressionJSON(expression);
+        string json = expression->toJSON(true).asString();
+        if (!hasPrefix(json, "\"."))
+            json.insert(1, ".");
+        json = "[" + json + "]";
+        if (_propertiesUseSourcePrefix)
+            replace(json, "[\"." + _dbAlias + ".", "[\".");
+        return json;
+    }
+
+
+    // Sets _aggregateView and returns true if the query's results can be read from an aggregate
+    // index: it has to group a single source by the index's keys, with the index's WHERE clause,
+    // and its WHAT, HAVING and ORDER_BY can only use the keys and the aggregates the index stores.
+    bool QueryParser::findAggregateView(const Value *where, const Dict *operands) {
+        auto what = getCaseInsensitive(operands, "WHAT"_sl);
+        auto groupBy = getCaseInsensitive(operands, "GROUP_BY"_sl);
+        const Array *whatArray = what ? what->asArray() : nullptr;
+        const Array *groupByArray = groupBy ? groupBy->asArray() : nullptr;
+        if (!whatArray || whatArray->empty() || !groupByArray || groupByArray->empty()
+                || !_ftsTables.empty() || _delegate.aggregateTableName("").empty())
+            return false;
+        for (auto &alias : _aliases) {
+            if (alias.second != kDBAlias)
+                return false;
+        }
+
+        vector<const Value*> keys;
+        for (Array::iterator i(groupByArray); i; ++i)
+            keys.push_back(i.value());
+        auto view = make_unique<AggregateView>();
+        view->table = _delegate.aggregateTableName(aggregateIndexIdentifier(keys, where));
+        auto columns = _delegate.tableColumns(view->table);
+        if (columns.empty())
+            return false;
+        view->columns.insert(columns.begin(), columns.end());
+        for (size_t i = 0; i < keys.size(); ++i)
+            view->keys.emplace(aggregateExpressionJSON(keys[i], true), aggregateKeyColumnName(i));
+        for (Array::iterator i(whatArray); i; ++i) {
+            Array::iterator expr(i.value()->asArray());
+            if (expr && expr.count() == 3 && expr[0]->asString().caseEquivalent("AS"_sl))
+                view->resultAliases.insert(string(expr[2]->asString()));
+        }
+        _aggregateView = move(view);
+
+        bool covered = true;
+        for (Array::iterator i(whatArray); i && covered; ++i) {
+            Array::iterator expr(i.value()->asArray());
+            if (expr && expr.count() == 3 && expr[0]->asString().caseEquivalent("AS"_sl))
+                covered = aggregateViewCovers(expr[1], false);
+            else
+                covered = aggregateViewCovers(i.value(), true);
+        }
+        if (auto having = getCaseInsensitive(operands, "HAVING"_sl); having && covered)
+            covered = aggregateViewCovers(having, false);
+        if (auto orderBy = getCaseInsensitive(operands, "ORDER_BY"_sl); orderBy && covered) {
+            const Array *orderByArray = orderBy->asArray();
+            covered = (orderByArray != nullptr);
+            for (Array::iterator i(orderByArray); i && covered; ++i)
+                covered = aggregateViewCovers(i.value(), true);
+        }
+        if (!covered)
+            _aggregateView.reset();
+        return covered;
+    }
+
+
+    // True if an expression can be computed from the columns of the _aggregateView's table.
+    bool QueryParser::aggregateViewCovers(const Value *node, bool inColumnList) const {
+        auto &view = *_aggregateView;
+        if (view.keys.find(aggregateExpressionJSON(node, inColumnList)) != view.keys.end())
+            return true;
+        switch (node->type()) {
+            case kString:
+                return !inColumnList;       // A literal; or else a property that isn't a key
+            case kDict:
+                for (Dict::iterator i(node->asDict()); i; ++i) {
+                    if (!aggregateViewCovers(i.value(), false))
+                        return false;
+                }
+                return true;
+            case kArray:
+                break;
+            default:
+                return true;
+        }
+
+        const Value *arg;
+        if (slice fn = aggregateCall(node, arg); fn) {
+            auto stored = [&](slice columnFn) {
+                return view.columns.count(aggregateColumnName(columnFn, arg)) > 0;
+            };
+            if (fn == "sum"_sl || fn == "avg"_sl)
+                return stored("count"_sl) && stored("sum"_sl);
+            else if (fn == "min"_sl || fn == "max"_sl)
+                return stored(fn);
+            else
+                return stored("count"_sl);
+        }
+
+        const Array *array = node->asArray();
+        slice op = array->empty() ? nullslice : array->get(0)->asString();
+        if (op.hasPrefix('.')) {
+            // A document property can't be read; but a result alias can:
+            Path path = propertyFromNode(node);
+            return !path.empty() && path[0].isKey()
+                && view.resultAliases.count(string(path[0].keyStr())) > 0;
+        }
+        if (!op || op.caseEquivalent("MATCH"_sl) || op.caseEquivalent("SELECT"_sl)
+                || op.caseEquivalent("EXISTS"_sl) || op.caseEquivalent("BLOB"_sl))
+            return false;
+        if (op.hasSuffix("()"_sl)) {
+            slice fnName(op.buf, op.size - 2);
+            for (auto spec = kFunctionList; spec->name; ++spec) {
+                if (fnName.caseEquivalent(spec->name)) {
+                    if (spec->aggregate)
+                        return false;       // An aggregate the index doesn't store
+                    break;
+                }
+            }
+            // Functions that read from other indexes or from the document itself:
+            for (slice fn : {kRankFnName, kBM25FnName, kSnippetFnName, kGeoWithinFnName,
+                             kGeoIntersectsFnName, kGeoDistanceFnName, kVectorDistanceFnName,
+                             kPredictionFnName}) {
+                if (fnName.caseEquivalent(fn))
+                    return false;
+            }
+        }
+        for (uint32_t i = 1; i < array->count(); ++i) {
+            if (!aggregateViewCovers(array->get(i), false))
+                return false;
+        }
+        return true;
+    }
+
+
+    // Writes a SELECT statement that reads an aggregate query's results from the rows (one per
+    // group) of an aggregate index's table, instead of scanning and grouping the documents.
+    void QueryParser::writeAggregateViewSelect(const Dict *operands) {
+        _isAggregateQuery = true;
+        _sql << "SELECT ";
+        auto distinct = getCaseInsensitive(operands, "DISTINCT"_sl);
+        if (distinct && distinct->asBool())
+            _sql << "DISTINCT ";
+        _1stCustomResultCol = 0;
+        writeSelectListClause(operands, "WHAT"_sl, "", true);
+
+        _sql << " FROM \"" << _aggregateView->table << "\" AS " << kAggregateViewAlias;
+
+        // The HAVING clause just filters the groups' rows:
+        if (auto having = getCaseInsensitive(operands, "HAVING"_sl); having) {
+            _sql << " WHERE ";
+            parseNode(having);
+        }
+
+        _writingSortKeys = true;
+        writeSelectListClause(operands, "ORDER_BY"_sl, " ORDER BY ", true);
+        _writingSortKeys = false;
+        writeLimitAndOffset(operands);
+    }
+
+
+    // If the expression is a group key or a stored aggregate of the _aggregateView, writes the
+    // SQL that reads it from the index's table and returns true.
+    bool QueryParser::writeAggregateViewColumn(const Value *node, bool inColumnList) {
+        auto column = [](const string &name) {
+            return CONCAT(kAggregateViewAlias << ".\"" << name << '"');
+        };
+        auto &keys = _aggregateView->keys;
+        if (auto i = keys.find(aggregateExpressionJSON(node, inColumnList)); i != keys.end()) {
+            _sql << column(i->second);
+            return true;
+        }
+
+        const Value *arg;
+        slice fn = aggregateCall(node, arg);
+        if (!fn)
+            return false;
+        string count = column(aggregateColumnName("count"_sl, arg));
+        if (fn == "count"_sl) {
+            _sql << count;
+        } else if (fn == "sum"_sl) {
+            // Like SQL's sum(), this is null if there are no non-null values:
+            _sql << "(CASE WHEN " << count << " > 0 THEN "
+                 << column(aggregateColumnName(fn, arg)) << " END)";
+        } else if (fn == "avg"_sl) {
+            _sql << "(CASE WHEN " << count << " > 0 THEN "
+                 << column(aggregateColumnName("sum"_sl, arg)) << " * 1.0 / " << count << " END)";
+        } else {
+            _sql << column(aggregateColumnName(fn, arg));
+        }
+        return true;
+    }
+
+
+#pragma mark - SPATIAL INDEXES:
+
+
+    // Returns the spatial index table name given the first parameter of a GEO_ function.
+    string QueryParser::spatialTableName(const Value *key) const {
+        string indexName( requiredString(key, "spatial index name") );
+        require(!indexName.empty() && indexName.find('"') == string::npos,
+                "spatial index name may not contain double-quotes nor be empty");
+        string table = _delegate.spatialTableName(indexName);
+        require(!table.empty(), "spatial indexes are not supported");
+        return table;
+    }
+
+
+    // Adds join tables for the spatial indexes used by GEO_WITHIN(), GEO_INTERSECTS() and
+    // GEO_DISTANCE() calls. Unlike the other index types, these functions can't fall back to
+    // evaluating against the document, so the index has to exist.
+    void QueryParser::findSpatialIndexes(const Value *root) {
+        auto addIndex = [this](const Array *call) {
+            string table = spatialTableName(call->get(1));
+            if (!_delegate.tableExists(table))
+                fail("no spatial index named '%s'", call->get(1)->asString().asString().c_str());
+            indexJoinTableAlias(table, "geo");
+        };
+        findNodes(root, "geo_within()"_sl, 1, addIndex);
+        findNodes(root, "geo_intersects()"_sl, 1, addIndex);
+        findNodes(root, "geo_distance()"_sl, 1, addIndex);
+    }
+
+
+    // Writes a GEO_ function call as SQL comparisons against the R-tree's bounding-box columns.
+    // SQLite's R-tree module uses the comparisons of the WITHIN and INTERSECTS tests to search
+    // the tree. GEO_DISTANCE is the distance from a point to the nearest edge of the box (zero if
+    // inside it), and is meant for ordering; with a LIMIT this yields the nearest k documents,
+    // which writeNearestSpatialBox() makes an R-tree search.
+    void QueryParser::writeSpatialFunction(slice fn, Array::iterator &operands) {
+        const string &alias = indexJoinTableAlias(spatialTableName(operands[0]));
+        Assert(!alias.empty());
+        _context.push_back(&kArgListOperation);
+        auto arg = [&](unsigned i) {
+            _sql << '(';
+            parseNode(operands[i]);
+            _sql << ')';
+        };
+        if (fn.caseEquivalent(kGeoDistanceFnName)) {
+            _sql << "sqrt(power(max(" << alias << ".minX - "; arg(1);
+            _sql << ", 0, "; arg(1); _sql << " - " << alias << ".maxX), 2) + power(max("
+                 << alias << ".minY - "; arg(2);
+            _sql << ", 0, "; arg(2); _sql << " - " << alias << ".maxY), 2))";
+        } else if (fn.caseEquivalent(kGeoWithinFnName)) {
+            _sql << "(" << alias << ".minX >= "; arg(1);
+            _sql << " AND " << alias << ".maxX <= "; arg(3);
+            _sql << " AND " << alias << ".minY >= "; arg(2);
+            _sql << " AND " << alias << ".maxY <= "; arg(4);
+            _sql << ")";
+        } else {
+            _sql << "(" << alias << ".maxX >= "; arg(1);
+            _sql << " AND " << alias << ".minX <= "; arg(3);
+            _sql << " AND " << alias << ".maxY >= "; arg(2);
+            _sql << " AND " << alias << ".minY <= "; arg(4);
+            _sql << ")";
+        }
+        _context.pop_back();
+    }
+
+
+    // Returns the GEO_DISTANCE() call if the query is a nearest-k search: its first ORDER BY key
+    // is the ascending distance from a constant point, and it has a LIMIT. Else returns nullptr.
+    const Array* QueryParser::nearestSpatialSearch(const Dict *operands) const {
+        if (_isNested || _isAggregateQuery || getCaseInsensitive(operands, "GROUP_BY"_sl)
+                      || !getCaseInsensitive(operands, "LIMIT"_sl))
+            return nullptr;
+        auto orderBy = getCaseInsensitive(operands, "ORDER_BY"_sl);
+        if (!orderBy || !orderBy->asArray() || orderBy->asArray()->empty())
+            return nullptr;
+        const Array *key = orderBy->asArray()->get(0)->asArray();
+        if (key && key->count() == 2 && key->get(0)->asString().caseEquivalent("ASC"_sl))
+            key = key->get(1)->asArray();
+        if (!key || key->count() != 4
+                 || !key->get(0)->asString().caseEquivalent("geo_distance()"_sl))
+            return nullptr;
+        for (unsigned i = 2; i <= 3; ++i) {
+            const Value *coord = key->get(i);
+            const Array *param = coord->asArray();
+            if (coord->type() != kNumber && !(param && param->count() == 1
+                                                    && param->get(0)->asString().hasPrefix('$')))
+                return nullptr;
+        }
+        return key;
+    }
+
+
+    // Restricts a nearest-k spatial search to a square around the point, so that SQLite's R-tree
+    // module searches only that part of the tree, instead of the query computing the distance of
+    // every indexed document and sorting them all.
+    //
+    // The square's radius comes from a recursive subquery that starts tiny and grows 4x at a time,
+    // until the square holds LIMIT+OFFSET rows that pass the WHERE clause, or it holds every entry
+    // of the index. Every entry touching a square of radius r is within r*sqrt(2) of the point, so
+    // a square widened by sqrt(2) holds all the rows at least as near as those; the results are
+    // the same as without it. `fromPos` and `wherePos` are the start of the FROM clause and the
+    // end of the WHERE clause in _sql.
+    void QueryParser::writeNearestSpatialBox(const Array *geoDistance, const Dict *operands,
+                                             size_t fromPos, size_t wherePos) {
+        string table = spatialTableName(geoDistance->get(1));
+        const string &alias = indexJoinTableAlias(table);
+        Assert(!alias.empty());
+        string x = nodeSQL(geoDistance->get(2)), y = nodeSQL(geoDistance->get(3));
+        string count = "MAX(0, " + nodeSQL(getCaseInsensitive(operands, "LIMIT"_sl)) + ")";
+        if (auto offset = getCaseInsensitive(operands, "OFFSET"_sl))
+            count += " + MAX(0, " + nodeSQL(offset) + ")";
+
+        auto square = [&](const string &boxAlias, const char *radius) {
+            stringstream s;
+            s << boxAlias << ".minX <= " << x << " + " << radius << " AND "
+              << boxAlias << ".maxX >= " << x << " - " << radius << " AND "
+              << boxAlias << ".minY <= " << y << " + " << radius << " AND "
+              << boxAlias << ".maxY >= " << y << " - " << radius;
+            return s.str();
+        };
+
+        string sql = _sql.str();
+        string fromWhere = sql.substr(fromPos, wherePos - fromPos);
+        sql.insert(wherePos, " AND (" + square(alias, "_geoR.r") + ")");
+
+        stringstream radius;
+        radius << "(WITH RECURSIVE _geoStep(r) AS (SELECT 1e-6 UNION ALL "
+                  "SELECT r * 4 FROM _geoStep WHERE r < 1e38"
+                  " AND (SELECT 1" << fromWhere << " AND (" << square(alias, "_geoStep.r")
+               << ") LIMIT 1 OFFSET " << count << " - 1) IS NULL"
+                  " AND (SELECT count(*) FROM \"" << table << "\" AS _geoAll WHERE "
+               << square("_geoAll", "_geoStep.r") << ")"
+                  " < (SELECT count(*) FROM \"" << table << "_rowid\"))"
+                  " SELECT max(r) * 1.4143 AS r FROM _geoStep) AS _geoR CROSS JOIN ";
+        sql.insert(fromPos + sizeof(" FROM ") - 1, radius.str());
+        _sql.str(sql);
+        _sql.seekp(0, stringstream::end);
+    }
+
+
+    // Returns the SQL that parseNode() writes for a node, in parentheses, leaving _sql unchanged.
+    string QueryParser::nodeSQL(const Value *node) {
+        auto pos = (size_t)_sql.tellp();
+        _sql << '(';
+        _context.push_back(&kArgListOperation);
+        parseNode(node);
+        _context.pop_back();
+        _sql << ')';
+        string sql = _sql.str();
+        string result = sql.substr(pos);
+        sql.resize(pos);
+        _sql.str(sql);
+        _sql.seekp(0, stringstream::end);
+        return result;
+    }
+
+
+#pragma mark - VECTOR INDEXES:
+
+
+    // Number of clusters of a vector index that are searched, if VECTOR_DISTANCE() doesn't say.
+    static constexpr int kDefaultVectorProbes = 8;
+
+
+    string QueryParser::vectorCentroidsTableName(const string &vectorTableName) {
+        return vectorTableName + ":centroids";
+    }
+
+
+    // Returns the vector index table name given the first parameter of VECTOR_DISTANCE().
+    string QueryParser::vectorTableName(const Value *key) const {
+        string indexName( requiredString(key, "vector index name") );
+        require(!indexName.empty() && indexName.find('"') == string::npos,
+                "vector index name may not contain double-quotes nor be empty");
+        string table = _delegate.vectorTableName(indexName);
+        require(!table.empty(), "vector indexes are not supported");
+        return table;
+    }
+
+
+    // Adds join tables for the vector indexes used by VECTOR_DISTANCE() calls, and remembers
+    // each call so the join can be limited to the clusters nearest the target.
+    void QueryParser::findVectorSearches(const Value *root) {
+        findNodes(root, "vector_distance()"_sl, 1, [this](const Array *call) {
+            string table = vectorTableName(call->get(1));
+            if (!_delegate.tableExists(table))
+                fail("no vector index named '%s'", call->get(1)->asString().asString().c_str());
+            indexJoinTableAlias(table, "vec");
+            auto [i, added] = _vectorSearches.insert({table, call});
+            require(added || i->second->isEqual(call),
+                    "all VECTOR_DISTANCE() calls on the same index must have the same target");
+        });
+    }
+
+
+    // Writes the join constraint that makes a vector index search only the `probes` clusters
+    // whose centroids are nearest to the target vector. This is what makes the search fast, and
+    // also what makes it approximate.
+    void QueryParser::writeVectorProbes(const string &table, const string &alias,
+                                        const Array *call)
+    {
+        _context.push_back(&kArgListOperation);
+        _sql << " AND " << alias << ".bucket IN (SELECT bucket FROM \""
+             << vectorCentroidsTableName(table)
+             << "\" ORDER BY vector_distance(vector, vector_encode(";
+        parseNode(call->get(2));
+        _sql << ")) LIMIT ";
+        if (call->count() > 3)
+            parseNode(call->get(3));
+        else
+            _sql << kDefaultVectorProbes;
+        _sql << ")";
+        _context.pop_back();
+    }
+
+
+    void QueryParser::writeVectorDistance(Array::iterator &operands) {
+        const string &alias = indexJoinTableAlias(vectorTableName(operands[0]));
+        Assert(!alias.empty());
+        _context.push_back(&kArgListOperation);
+        _sql << "vector_distance(" << alias << ".vector, vector_encode(";
+        parseNode(operands[1]);
+        _sql << "))";
+        _context.pop_back();
+    }
+
+
 #pragma mark - PREDICTIVE QUERY:
 
 
@@ -21,6 +21,7 @@
 #include "UnicodeCollator.hh"
 #include "Array.hh"
 #include <memory>
+#include <optional>
 #include <set>
 #include <sstream>
 #include <string>
@@ -50,6 +51,62 @@ namespace litecore {
             virtual std::string predictiveTableName(const std::string &property) const =0;
 #endif
             virtual bool tableExists(const std::string &tableName) const =0;
+            /** Name of the table storing a covering index's included expression, or empty if
+                covering indexes aren't supported. */
+            virtual std::string coveringTableName(const std::string &identifier) const {return "";}
+            /** Name of the R-tree table of a spatial index, or empty if spatial indexes
+                aren't supported. */
+            virtual std::string spatialTableName(const std::string &indexName) const {return "";}
+            /** Name of the table of a vector index, or empty if vector indexes aren't
+                supported. */
+            virtual std::string vectorTableName(const std::string &indexName) const {return "";}
+            /** Name of the table of an aggregate index (see aggregateIndexIdentifier), or empty
+                if aggregate indexes aren't supported. */
+            virtual std::string aggregateTableName(const std::string &identifier) const {return "";}
+            /** Names of a table's columns, or an empty vector if there's no such table. */
+            virtual std::vector<std::string> tableColumns(const std::string &tableName) const {return {};}
+            /** True if a value index stores the collation sort keys of an expression (see
+                IndexSpec::collationSortKeys), in which case comparisons and sorts of it by that
+                collation should use them too. The string identifies the collation and expression;
+                the index's are the ones its parser's sortKeyExpressions() returns. */
+            virtual bool hasSortKeyIndex(const std::string &sortKeyExpression) const {return false;}
+        };
+
+        /** Describes how to resume an ordered query just after a given row ("keyset pagination"),
+            instead of skipping rows with OFFSET. The query's result rows begin with hidden columns
+            holding each row's sort keys, the last of which is the document's rowid. */
+        struct Keyset {
+            std::vector<std::string> keys;      // SQL of the sort keys, ending with the rowid
+            std::vector<bool> descending;       // Which keys sort in descending order
+            unsigned firstColumn {0};           // Result column holding the first key
+            std::string head, tail;             // The SQL before & after the end of the WHERE
+
+            /** Returns the SQL of the query restricted to the rows that sort after the one whose
+                key values (as read from the hidden columns) are given. The non-null values
+                aren't in the SQL; they have to be bound to the parameters named by keyParameter. */
+            std::string continuationSQL(const fleece::impl::Array *lastKeys) const;
+
+            /** The SQL parameter that the i'th key's value is bound to in a continuation. */
+            static std::string keyParameter(size_t i);
+        };
+
+        /** Describes how to run an aggregate query in parallel: each thread runs a partial query
+            on a range of rowids, then the partial results are merged, row by row for each group. */
+        struct PartialAggregation {
+            enum Merge {
+                kGroupKey,      // A GROUP BY expression; rows with equal keys are merged
+                kCount,         // count(), merged by adding
+                kSum,           // sum(), merged by adding
+                kMin,           // min(), merged by taking the least
+                kMax,           // max(), merged by taking the greatest
+                kAvg,           // avg(), split into partial total() and count() columns
+            };
+            std::vector<Merge> columns;         // How to merge each result column
+            std::string head, tail;             // Partial SQL before & after the end of the WHERE
+            std::string rowidSQL;               // SQL expression of the document's rowid
+
+            /** The SQL of the partial query, restricted to rowids in [minRowid, maxRowid]. */
+            std::string partialSQL(int64_t minRowid, int64_t maxRowid) const;
         };
 
         QueryParser(const delegate &delegate)
@@ -59,6 +116,11 @@ namespace litecore {
         void setTableName(const std::string &name)                  {_tableName = name;}
         void setBodyColumnName(const std::string &name)             {_bodyColumnName = name;}
 
+        /** Makes Unicode-collated comparisons and sort keys compare collation sort keys
+            (fl_sortkey) instead of using a SQL COLLATE. By default this is done only for the
+            expressions the delegate's hasSortKeyIndex() accepts. */
+        void setCollationSortKeys(bool sortKeys)                    {_collationSortKeys = sortKeys;}
+
         void parse(const fleece::impl::Value*);
         void parseJSON(slice);
 
@@ -73,6 +135,10 @@ namespace litecore {
 
         std::string SQL()  const                                    {return _sql.str();}
 
+        /** The Unicode-collated expressions written as sort keys, in the form passed to the
+            delegate's hasSortKeyIndex(). */
+        const std::set<std::string>& sortKeyExpressions() const    {return _sortKeyExpressions;}
+
         const std::set<std::string>& parameters()                   {return _parameters;}
         const std::vector<std::string>& ftsTablesUsed() const       {return _ftsTables;}
         unsigned firstCustomResultColumn() const                    {return _1stCustomResultCol;}
@@ -81,6 +147,17 @@ namespace litecore {
         bool isAggregateQuery() const                               {return _isAggregateQuery;}
         bool usesExpiration() const                                 {return _checkedExpiration;}
 
+        /** Returns the keyset pagination info, or null if the query can't be paged. Only a
+            non-aggregate query on a single source, with ORDER_BY and LIMIT but no OFFSET,
+            can be paged. */
+        const Keyset* keyset() const                                {return _keyset.get();}
+
+        /** Returns the info for running the query in parallel, or null if it can't be. Only an
+            aggregate query on a single source, without DISTINCT, HAVING, ORDER_BY, LIMIT, OFFSET
+            or MATCH, can be; every WHAT item has to be a GROUP_BY expression or a count, sum,
+            min, max or avg call, and every GROUP_BY expression has to be in the WHAT. */
+        const PartialAggregation* partialAggregation() const        {return _partialAggregation.get();}
+
         std::string expressionSQL(const fleece::impl::Value*);
         std::string whereClauseSQL(const fleece::impl::Value*, string_view dbAlias);
         std::string eachExpressionSQL(const fleece::impl::Value*);
@@ -89,6 +166,24 @@ namespace litecore {
         std::string unnestedTableName(const fleece::impl::Value *key) const;
         std::string predictiveIdentifier(const fleece::impl::Value *) const;
         std::string predictiveTableName(const fleece::impl::Value *) const;
+        std::string coveringTableName(const fleece::impl::Value *) const;
+        std::string spatialTableName(const fleece::impl::Value *key) const;
+        std::string vectorTableName(const fleece::impl::Value *key) const;
+        static std::string vectorCentroidsTableName(const std::string &vectorTableName);
+
+        /** If the expression is a call of an aggregate function that an aggregate index can
+            store, returns its name ("count", "sum", "avg", "min" or "max") and sets `arg` to its
+            argument, or to null for `count()`. Otherwise returns nullslice. */
+        static slice aggregateCall(const fleece::impl::Value *expression,
+                                   const fleece::impl::Value* &arg);
+        /** Identifies an aggregate index by its group keys (in order) and its WHERE clause. */
+        std::string aggregateIndexIdentifier(const std::vector<const fleece::impl::Value*> &keys,
+                                             const fleece::impl::Value *where) const;
+        /** The column of an aggregate index's table storing the running "count", "sum", "min"
+            or "max" of an expression. (`count()` with no argument is the group's row count.) */
+        std::string aggregateColumnName(slice fn, const fleece::impl::Value *arg) const;
+        /** The column of an aggregate index's table storing its i'th group key. */
+        static std::string aggregateKeyColumnName(size_t i);
 
     private:
 
@@ -107,7 +202,9 @@ namespace litecore {
         { }
         QueryParser(const QueryParser *qp)
         :QueryParser(qp->_delegate, qp->_tableName, qp->_bodyColumnName)
-        { }
+        {
+            _isNested = true;
+        }
 
 
         struct Operation;
@@ -118,6 +215,14 @@ namespace litecore {
         struct JoinedOperations;
         static const JoinedOperations kJoinedOperationsList[];
 
+        // An aggregate index whose table the query's results are read from:
+        struct AggregateView {
+            std::string table;                              // Name of the index's table
+            std::map<std::string, std::string> keys;        // Group key JSON --> column name
+            std::set<std::string> columns;                  // All columns of the table
+            std::set<std::string> resultAliases;            // 'AS' names in the WHAT clause
+        };
+
         QueryParser(const QueryParser &qp) =delete;
         QueryParser& operator=(const QueryParser&) =delete;
 
@@ -141,6 +246,10 @@ namespace litecore {
         bool writeOrderOrLimitClause(const fleece::impl::Dict *operands,
                                      fleece::slice jsonKey,
                                      const char *keyword);
+        bool isPageable(const fleece::impl::Dict *operands) const;
+        bool writeKeysetOrderBy(const fleece::impl::Dict *operands);
+        void makePartialAggregation(const fleece::impl::Dict *operands,
+                                    size_t startPosOfFrom, size_t endPosOfWhere);
 
         void prefixOp(slice, fleece::impl::Array::iterator&);
         void postfixOp(slice, fleece::impl::Array::iterator&);
@@ -182,12 +291,17 @@ namespace litecore {
         void writeResultColumn(const fleece::impl::Value*);
         void writeCollation();
         void parseCollatableNode(const fleece::impl::Value*);
+        bool collatingBySortKey(const fleece::impl::Value*);
+        void parseSortKeyNode(const fleece::impl::Value*);
         void writeMetaProperty(slice fn, const std::string &tablePrefix, const char *property);
 
         void parseJoin(const fleece::impl::Dict*);
 
         unsigned findFTSProperties(const fleece::impl::Value *root);
         void findPredictionCalls(const fleece::impl::Value *root);
+        void findCoveredResults(const fleece::impl::Dict *operands);
+        void findSpatialIndexes(const fleece::impl::Value *root);
+        void findVectorSearches(const fleece::impl::Value *root);
         const std::string& indexJoinTableAlias(const std::string &key, const char *aliasPrefix =nullptr);
         const std::string&  FTSJoinTableAlias(const fleece::impl::Value *matchLHS, bool canAdd =false);
         const std::string&  predictiveJoinTableAlias(const fleece::impl::Value *expr, bool canAdd =false);
@@ -195,6 +309,25 @@ namespace litecore {
         std::string expressionIdentifier(const fleece::impl::Array *expression, unsigned maxItems =0) const;
         void findPredictiveJoins(const fleece::impl::Value *node, std::vector<std::string> &joins);
         bool writeIndexedPrediction(const fleece::impl::Array *node);
+        bool writeCoveredResult(const fleece::impl::Value *result);
+        std::string expressionJSON(const fleece::impl::Value *expression) const;
+        std::string aggregateExpressionJSON(const fleece::impl::Value *expression,
+                                            bool inColumnList) const;
+        bool findAggregateView(const fleece::impl::Value *where, const fleece::impl::Dict *operands);
+        bool aggregateViewCovers(const fleece::impl::Value *node, bool inColumnList) const;
+        void writeAggregateViewSelect(const fleece::impl::Dict *operands);
+        bool writeAggregateViewColumn(const fleece::impl::Value *node, bool inColumnList);
+        void writeLimitAndOffset(const fleece::impl::Dict *operands);
+        void writeSnippet(fleece::impl::Array::iterator &operands);
+        void writeSpatialFunction(slice fn, fleece::impl::Array::iterator &operands);
+        const fleece::impl::Array* nearestSpatialSearch(const fleece::impl::Dict *operands) const;
+        void writeNearestSpatialBox(const fleece::impl::Array *geoDistance,
+                                    const fleece::impl::Dict *operands,
+                                    size_t fromPos, size_t wherePos);
+        std::string nodeSQL(const fleece::impl::Value *node);
+        void writeVectorProbes(const std::string &table, const std::string &alias,
+                               const fleece::impl::Array *call);
+        void writeVectorDistance(fleece::impl::Array::iterator &operands);
 
         const delegate& _delegate;                  // delegate object (SQLiteKeyStore)
         std::string _tableName;                     // Name of the table containing documents
@@ -209,15 +342,24 @@ namespace litecore {
         std::set<std::string> _parameters;          // Plug-in "$" parameters found in parsing
         std::set<std::string> _variables;           // Active variables, inside ANY/EVERY exprs
         std::map<std::string, std::string> _indexJoinTables;  // index table name --> alias
+        std::map<std::string, const fleece::impl::Array*> _vectorSearches; // table --> call
         std::vector<std::string> _ftsTables;        // FTS virtual tables being used
+        std::unique_ptr<Keyset> _keyset;            // Keyset pagination info, if pageable
+        std::unique_ptr<PartialAggregation> _partialAggregation; // Parallel info, if possible
+        std::unique_ptr<AggregateView> _aggregateView; // Aggregate index answering the query
         unsigned _1stCustomResultCol {0};           // Index of 1st result after _baseResultColumns
         bool _aggregatesOK {false};                 // Are aggregate fns OK to call?
         bool _isAggregateQuery {false};             // Is this an aggregate query?
+        bool _isNested {false};                     // Is this a nested SELECT's parser?
+        bool _usedResultAlias {false};              // Has a result alias been referenced?
         bool _checkedDeleted {false};               // Has query accessed _deleted meta-property?
         bool _checkedExpiration {false};            // Has query accessed _expiration meta-property?
         Collation _collation;                       // Collation in use during parse
         bool _collationUsed {true};                 // Emitted SQL "COLLATION" yet?
         bool _functionWantsCollation {false};       // The current function wants to receive collation in its argument list
+        std::optional<bool> _collationSortKeys;     // Compare Unicode collations by sort key?
+        bool _writingSortKeys {false};              // Writing ORDER BY or index keys?
+        std::set<std::string> _sortKeyExpressions;  // Expressions written as sort keys
     };
 
 }
@@ -193,6 +193,16 @@ namespace litecore {
 
         // FTS (not standard N1QL):
         {"rank"_sl,             1, 1},
+        {"bm25"_sl,             1, 1},
+        {"snippet"_sl,          1, 5},
+
+        // Spatial (not standard N1QL):
+        {"geo_within"_sl,       5, 5},
+        {"geo_intersects"_sl,   5, 5},
+        {"geo_distance"_sl,     3, 3},
+
+        // Vector similarity (not standard N1QL):
+        {"vector_distance"_sl,  2, 3},
 
         // Aggregate functions:
         {"avg"_sl,              1, 1, nullslice, true},
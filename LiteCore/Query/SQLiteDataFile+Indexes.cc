@@ -18,6 +18,7 @@
 
 #include "SQLiteDataFile.hh"
 #include "SQLiteKeyStore.hh"
+#include "QueryParser.hh"
 #include "SQLite_Internal.hh"
 #include "Error.hh"
 #include "Logging.hh"
@@ -84,6 +85,15 @@ namespace litecore {
 
 
 
+    void SQLiteDataFile::updateIndexExpression(const litecore::IndexSpec &spec) {
+        SQLite::Statement stmt(*this, "UPDATE indexes SET expression=? WHERE name=?");
+        stmt.bindNoCopy(1, (char*)spec.expressionJSON.buf, (int)spec.expressionJSON.size);
+        stmt.bindNoCopy(2, spec.name);
+        LogStatement(stmt);
+        stmt.exec();
+    }
+
+
     void SQLiteDataFile::unregisterIndex(slice indexName) {
         SQLite::Statement stmt(*this, "DELETE FROM indexes WHERE name=?");
         stmt.bindNoCopy(1, (char*)indexName.buf, (int)indexName.size);
@@ -95,6 +105,28 @@ namespace litecore {
 #pragma mark - CREATING INDEXES:
 
 
+    // True if two value index specs have the same INCLUDE clause (or neither has one.)
+    static bool sameIncludedExpressions(const IndexSpec &spec1, const IndexSpec &spec2) {
+        auto included1 = spec1.expressionJSON ? spec1.included() : nullptr;
+        auto included2 = spec2.included();
+        if (!included1 || !included2)
+            return included1 == included2;
+        return included1->isEqual(included2);
+    }
+
+
+    // True if two index specs have the same WHAT and WHERE clauses. Needed for index types whose
+    // SQL schema doesn't mention the indexed expressions.
+    static bool sameIndexedExpressions(const IndexSpec &spec1, const IndexSpec &spec2) {
+        if (!spec1.expressionJSON || !spec1.what()->isEqual(spec2.what()))
+            return false;
+        auto where1 = spec1.where(), where2 = spec2.where();
+        if (!where1 || !where2)
+            return where1 == where2;
+        return where1->isEqual(where2);
+    }
+
+
     bool SQLiteDataFile::createIndex(const litecore::IndexSpec &spec,
                                      SQLiteKeyStore *keyStore,
                                      const string &indexTableName,
@@ -104,10 +136,25 @@ namespace litecore {
         if (auto existingSpec = getIndex(spec.name)) {
             if (existingSpec->type == spec.type && existingSpec->keyStoreName == keyStore->name()) {
                 bool same;
-                if (spec.type == IndexSpec::kFullText)
+                if (spec.type == IndexSpec::kFullText || spec.type == IndexSpec::kSpatial
+                                                      || spec.type == IndexSpec::kVector
+                                                      || spec.type == IndexSpec::kAggregate)
                     same = schemaExistsWithSQL(indexTableName, "table", indexTableName, indexSQL);
                 else
                     same = schemaExistsWithSQL(spec.name, "index", indexTableName, indexSQL);
+                if (same && spec.type == IndexSpec::kValue)
+                    same = sameIncludedExpressions(*existingSpec, spec);
+                if (same && (spec.type == IndexSpec::kSpatial || spec.type == IndexSpec::kVector
+                                                              || spec.type == IndexSpec::kAggregate))
+                    same = sameIndexedExpressions(*existingSpec, spec);
+                if (same && spec.type == IndexSpec::kVector)
+                    same = existingSpec->vectorCentroids() == spec.vectorCentroids();
+                if (same && spec.type == IndexSpec::kFullText
+                         && existingSpec->ftsMergePages() != spec.ftsMergePages()) {
+                    // Only the merge policy changed; that doesn't require rebuilding the index:
+                    updateIndexExpression(spec);
+                    return false;
+                }
                 if (same)
                     return false;       // This is a duplicate of an existing index; do nothing
             }
@@ -117,6 +164,7 @@ namespace litecore {
         LogTo(QueryLog, "Creating %s index: %s", spec.typeName(), indexSQL.c_str());
         exec(indexSQL);
         registerIndex(spec, keyStore->name(), indexTableName);
+        _queryWorkload.invalidatePlans();
         return true;
     }
 
@@ -129,10 +177,18 @@ namespace litecore {
         LogTo(QueryLog, "Deleting %s index '%s'",
               spec.typeName(), spec.name.c_str());
         unregisterIndex(spec.name);
-        if (spec.type != IndexSpec::kFullText)
+        _queryWorkload.invalidatePlans();
+        if (spec.type != IndexSpec::kFullText && spec.type != IndexSpec::kSpatial
+                                              && spec.type != IndexSpec::kVector
+                                              && spec.type != IndexSpec::kAggregate)
             exec(CONCAT("DROP INDEX IF EXISTS \"" << spec.name << "\""));
         if (!spec.indexTableName.empty())
             garbageCollectIndexTable(spec.indexTableName);
+        if (spec.type == IndexSpec::kVector)
+            exec(CONCAT("DROP TABLE IF EXISTS \""
+                        << QueryParser::vectorCentroidsTableName(spec.indexTableName) << "\""));
+        if (spec.type == IndexSpec::kValue && spec.expressionJSON && spec.included())
+            ((SQLiteKeyStore&)getKeyStore(spec.keyStoreName)).garbageCollectCoveringTables();
     }
 
 
@@ -158,6 +214,129 @@ namespace litecore {
     }
 
 
+#pragma mark - FULL-TEXT INDEX MAINTENANCE:
+
+
+    // Minimum number of segments at one level of an FTS4 b-tree that will be merged together.
+    static constexpr unsigned kFTSMergeMinSegments = 4;
+
+
+    // Runs one incremental merge step on every FTS index whose MERGE policy allows it.
+    // <https://sqlite.org/fts3.html#*fts4mergecmd>
+    bool SQLiteDataFile::mergeFullTextIndexes() {
+        Assert(inTransaction());
+        if (!indexTableExists())
+            return false;
+        bool changed = false;
+        for (auto &spec : getIndexes(nullptr)) {
+            if (spec.type != IndexSpec::kFullText || spec.indexTableName.empty())
+                continue;
+            unsigned pages = spec.ftsMergePages();
+            if (pages == 0)
+                continue;
+            // The merge command reports at least two changes if it did any work:
+            int changesBefore = sqlite3_total_changes(_sqlDb->getHandle());
+            exec(CONCAT("INSERT INTO \"" << spec.indexTableName << "\" (\"" << spec.indexTableName
+                        << "\") VALUES ('merge=" << pages << "," << kFTSMergeMinSegments << "')"));
+            if (sqlite3_total_changes(_sqlDb->getHandle()) - changesBefore >= 2) {
+                LogVerbose(QueryLog, "Merged segments of FTS index '%s'", spec.name.c_str());
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+
+#pragma mark - VECTOR INDEX MAINTENANCE:
+
+
+    // A vector index whose largest bucket has this many times the average number of vectors is
+    // badly unbalanced: queries probing that bucket compute most of the index's distances.
+    static constexpr int64_t kUnbalancedBucketFactor = 8;
+
+    // ...but it's only retrained if its size has changed by this fraction since it was trained,
+    // so that an index of inherently clumped vectors isn't retrained over and over.
+    static constexpr double kVectorsChangeFraction = 0.5;
+
+    // Maximum number of vectors moved to their new buckets per step, after retraining:
+    static constexpr int64_t kVectorsMovedPerStep = 1000;
+
+
+    // Performs one step of maintenance on the first vector index that needs it: moves a batch of
+    // vectors out of the buckets retired by the last retraining, or else retrains the index if it
+    // was created empty and now has vectors, or if its buckets have become badly unbalanced.
+    bool SQLiteDataFile::retrainVectorIndexes() {
+        Assert(inTransaction());
+        if (!indexTableExists())
+            return false;
+        for (auto &spec : getIndexes(nullptr)) {
+            if (spec.type != IndexSpec::kVector || spec.indexTableName.empty())
+                continue;
+            auto &keyStore = (SQLiteKeyStore&)getKeyStore(spec.keyStoreName);
+            if (keyStore.moveRetiredVectors(spec, kVectorsMovedPerStep))
+                return true;
+
+            auto &table = spec.indexTableName;
+            int64_t nCentroids = 0, trainedSize = 0;
+            {
+                SQLite::Statement stmt(*_sqlDb, CONCAT("SELECT count(vector), max(trainedSize) "
+                                           "FROM \"" << QueryParser::vectorCentroidsTableName(table)
+                                           << "\" WHERE NOT retired"));
+                if (stmt.executeStep()) {
+                    nCentroids = stmt.getColumn(0).getInt64();
+                    trainedSize = stmt.getColumn(1).getInt64();
+                }
+            }
+            int64_t vectors = 0, largestBucket = 0;
+            {
+                SQLite::Statement stmt(*_sqlDb, CONCAT("SELECT total(n), max(n) FROM "
+                                           "(SELECT count(*) AS n FROM \"" << table << "\" "
+                                           "GROUP BY bucket)"));
+                if (stmt.executeStep()) {
+                    vectors = stmt.getColumn(0).getInt64();
+                    largestBucket = stmt.getColumn(1).getInt64();
+                }
+            }
+
+            bool retrain;
+            if (nCentroids == 0) {
+                retrain = (vectors > 0);                // Created before there were any vectors
+            } else {
+                retrain = largestBucket > kUnbalancedBucketFactor * vectors / nCentroids
+                       && abs(vectors - trainedSize) >= int64_t(trainedSize * kVectorsChangeFraction);
+            }
+            if (retrain) {
+                logInfo("Retraining vector index '%s': %lld vectors, largest bucket %lld",
+                        spec.name.c_str(), (long long)vectors, (long long)largestBucket);
+                keyStore.trainVectorIndex(spec);
+                return true;
+            }
+        }
+        return false;
+    }
+
+
+#pragma mark - SORT-KEY INDEX MAINTENANCE:
+
+
+    // Rebuilds every value index of collation sort keys whose SQL differs from what creating it
+    // now would produce. That happens when the collator's version has changed (the version is
+    // part of each fl_sortkey call), or when the database is opened on a platform without sort
+    // keys, where the index is rebuilt with plain collated expressions instead.
+    void SQLiteDataFile::rebuildSortKeyIndexes() {
+        if (!indexTableExists())
+            return;
+        for (auto &spec : getIndexes(nullptr)) {
+            if (spec.type != IndexSpec::kValue || !spec.expressionJSON
+                                               || !spec.collationSortKeys())
+                continue;
+            auto &keyStore = (SQLiteKeyStore&)getKeyStore(spec.keyStoreName);
+            if (keyStore._createIndex(spec))
+                logInfo("Rebuilt index '%s' for the current collator", spec.name.c_str());
+        }
+    }
+
+
 #pragma mark - GETTING INDEX INFO:
 
 
@@ -237,6 +416,11 @@ namespace litecore {
     }
 
 
+    IndexAdvice SQLiteDataFile::adviseIndexes() {
+        return IndexAdvice::analyze(_queryWorkload.entries(), getIndexes(nullptr));
+    }
+
+
     void SQLiteDataFile::inspectIndex(slice name,
                                       int64_t &outRowCount,
                                       alloc_slice *outRows)
@@ -250,7 +434,9 @@ namespace litecore {
         auto spec = getIndex(name);
         if (!spec)
             error::_throw(error::NoSuchIndex);
-        else if (spec->type == IndexSpec::kFullText)
+        else if (spec->type == IndexSpec::kFullText || spec->type == IndexSpec::kSpatial
+                                                    || spec->type == IndexSpec::kVector
+                                                    || spec->type == IndexSpec::kAggregate)
             error::_throw(error::UnsupportedOperation);
 
         // Construct a list of column names:
@@ -21,6 +21,10 @@
 #include "SQLiteFleeceUtil.hh"
 #include <sqlite3.h>
 #include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
 
 
 namespace litecore {
@@ -115,8 +119,125 @@ namespace litecore {
     }
 
 
+    /*
+     ** Okapi BM25 relevance function. Called as
+     **
+     **     bm25(matchinfo(documents, 'pcxl'), 'documents')
+     **
+     ** The second argument is the name of the FTS4 table. It must be a constant, so that the
+     ** corpus statistics (total document count and average column length) can be read once
+     ** from the table's "_stat" shadow table and cached as SQLite auxdata for the rest of the
+     ** statement, instead of asking matchinfo() to recompute them ('n' and 'a') for every row.
+     **
+     ** For each phrase and column the score adds
+     **
+     **     idf * tf * (k1 + 1) / (tf + k1 * (1 - b + b * <column length> / <avg column length>))
+     **
+     ** where idf = log(1 + (N - n + 0.5) / (n + 0.5)), N is the number of documents and n the
+     ** number of documents containing the phrase in that column.
+     */
+
+    static constexpr double kBM25_k1 = 1.2;
+    static constexpr double kBM25_b  = 0.75;
+
+    struct FTSCorpusStats {
+        double docCount {0};
+        std::vector<double> avgColumnLength;
+    };
+
+    // Decodes an FTS3/4 varint (same as sqlite3Fts3GetVarint.)
+    static const uint8_t* readFTSVarint(const uint8_t *p, const uint8_t *end, uint64_t &out) {
+        out = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            uint8_t byte = *p++;
+            out |= uint64_t(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return p;
+        }
+        return nullptr;
+    }
+
+    // Reads the document count and per-column token totals from the "<table>_stat" table.
+    static FTSCorpusStats* loadCorpusStats(sqlite3 *db, const char *ftsTable, int nCol) {
+        auto stats = new FTSCorpusStats;
+        stats->avgColumnLength.assign(nCol, 1.0);
+        std::string sql = "SELECT value FROM \"";
+        for (const char *c = ftsTable; *c; ++c) {
+            if (*c == '"')
+                sql += '"';
+            sql += *c;
+        }
+        sql += "_stat\" WHERE id=0";
+
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            return stats;
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto p = (const uint8_t*)sqlite3_column_blob(stmt, 0);
+            auto end = p + sqlite3_column_bytes(stmt, 0);
+            uint64_t n;
+            if (p && (p = readFTSVarint(p, end, n)) != nullptr) {
+                stats->docCount = double(n);
+                for (int iCol = 0; iCol < nCol && p; iCol++) {
+                    p = readFTSVarint(p, end, n);
+                    if (p && stats->docCount > 0)
+                        stats->avgColumnLength[iCol] = std::max(double(n) / stats->docCount, 1.0);
+                }
+            }
+        }
+        sqlite3_finalize(stmt);
+        return stats;
+    }
+
+    static void bm25func(sqlite3_context *ctx, int argc, sqlite3_value **argv) {
+        auto matchinfo = (const int32_t*)sqlite3_value_blob(argv[0]);
+        auto ftsTable = (const char*)sqlite3_value_text(argv[1]);
+        if (!matchinfo || !ftsTable) {
+            sqlite3_result_error(ctx, "nothing for bm25() to match", -1);
+            return;
+        }
+        int32_t nPhrase = matchinfo[0];
+        int32_t nCol = matchinfo[1];
+        if (sqlite3_value_bytes(argv[0]) < int((2 + 3*nPhrase*nCol + nCol) * sizeof(int32_t))) {
+            sqlite3_result_error(ctx, "bm25() requires matchinfo(table, 'pcxl')", -1);
+            return;
+        }
+
+        auto stats = (FTSCorpusStats*)sqlite3_get_auxdata(ctx, 1);
+        if (!stats) {
+            stats = loadCorpusStats(sqlite3_context_db_handle(ctx), ftsTable, nCol);
+            sqlite3_set_auxdata(ctx, 1, stats, [](void *s) {delete (FTSCorpusStats*)s;});
+            // SQLite may have freed it already if it couldn't store it:
+            stats = (FTSCorpusStats*)sqlite3_get_auxdata(ctx, 1);
+            if (!stats) {
+                sqlite3_result_error_nomem(ctx);
+                return;
+            }
+        }
+
+        const int32_t *hits = &matchinfo[2];
+        const int32_t *lengths = &matchinfo[2 + 3*nPhrase*nCol];
+        double N = stats->docCount;
+        double score = 0.0;
+        for (int32_t iPhrase = 0; iPhrase < nPhrase; iPhrase++) {
+            for (int32_t iCol = 0; iCol < nCol; iCol++) {
+                const int32_t *info = &hits[3 * (iPhrase*nCol + iCol)];
+                double tf = info[0];
+                if (tf <= 0)
+                    continue;
+                double n = info[2];
+                double idf = log(1.0 + (std::max(N - n, 0.0) + 0.5) / (n + 0.5));
+                double norm = 1.0 - kBM25_b + kBM25_b * lengths[iCol] / stats->avgColumnLength[iCol];
+                score += idf * (tf * (kBM25_k1 + 1.0)) / (tf + kBM25_k1 * norm);
+            }
+        }
+        sqlite3_result_double(ctx, score);
+    }
+
+
     const SQLiteFunctionSpec kRankFunctionsSpec[] = {
         { "rank",          1, rankfunc  },
+        { "bm25",          2, bm25func  },
         { }
     };
 
@@ -0,0 +1,537 @@
+//
+// SQLiteFTSTokenizer.cc
+//
+// Copyright (c) 2020 Couchbase, Inc All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLite_Internal.hh"
+#include "Error.hh"
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <list>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern "C" {
+    #include "fts3_tokenizer.h"
+    #include "sqlite3_unicodesn_tokenizer.h"
+}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define LITECORE_USES_SSE2 1
+#endif
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+#endif
+
+using namespace std;
+
+namespace litecore {
+
+    /*  This is an FTS3/4 tokenizer that wraps the 'unicodesn' tokenizer and registers itself
+        under the same name, so existing FTS tables pick it up without a schema change.
+        unicodesn classifies every character as Unicode and runs the Snowball stemmer on every
+        token, which dominates the cost of building a big full-text index. This wrapper:
+
+        - Classifies the input 16 bytes at a time (with SSE2 where available), producing bitmaps
+          of which bytes are ASCII letters/digits and which are non-ASCII. Word boundaries are
+          then found by scanning the bitmaps a 64-bit word at a time.
+        - Looks up each pure-ASCII word in an LRU cache of what unicodesn turns it into (its
+          stemmed token, or nothing if it's a stop-word.) Natural-language text is dominated by
+          a small vocabulary, so nearly every word is a cache hit.
+        - Hands any run of text containing non-ASCII bytes, and every cache miss, to unicodesn
+          itself, so the tokens, offsets and positions are exactly what unicodesn would produce.
+
+        ASCII letters and digits are always token characters to unicodesn, and all other ASCII
+        characters are separators, so a run of bytes bounded by ASCII separators can be
+        tokenized in isolation. To learn how many token positions a run consumes (stop-words may
+        or may not consume one) the run is tokenized with a sentinel token appended to it.
+
+        Tokenizing a MATCH expression is left entirely to unicodesn, since its behavior differs
+        while a query runs and the strings involved are tiny. */
+
+    static constexpr const char* kTokenizerName     = "unicodesn";
+    static constexpr const char* kBaseTokenizerName = "unicodesn_base";
+
+    static constexpr size_t kMaxCachedWordLength = 32;     // Longer words aren't cached
+    static constexpr size_t kStemCacheCapacity   = 4096;   // Max words cached per tokenizer
+
+    // A token that's appended to a run of text so its position shows how many positions the
+    // run used. It's a digit since no stemmer changes it and no stop-word list contains it.
+    static constexpr const char kSentinel[] = " 0";
+
+    // The unicodesn module, as registered by register_unicodesn_tokenizer:
+    static const sqlite3_tokenizer_module* sBaseModule;
+
+    // Set while a query is running on this thread (see FTSTokenizerRunningQuery):
+    static thread_local bool sRunningQuery = false;
+
+    // unicodesn's query mode is process-wide, so while a query runs on any thread, unicodesn may
+    // tokenize an index's text as a query, and its output mustn't be cached. These count the
+    // queries running, and the queries ever started, on all threads:
+    static atomic<unsigned> sRunningQueries {0};
+    static atomic<uint64_t> sQueriesStarted {0};
+
+
+#pragma mark - BITMAPS:
+
+
+    static inline unsigned countTrailingZeros(uint64_t bits) {
+        DebugAssert(bits != 0);
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned long i;
+        _BitScanForward64(&i, bits);
+        return i;
+#else
+        unsigned n = 0;
+        for (; !(bits & 1); bits >>= 1)
+            ++n;
+        return n;
+#endif
+    }
+
+
+    // Classifies the bytes of the input: a set bit in `wordBits` means an ASCII letter or
+    // digit, and a set bit in `highBits` means a non-ASCII byte.
+    struct ByteClasses {
+        vector<uint64_t> wordBits, highBits;
+        size_t size {0};
+
+        void scan(const uint8_t *s, size_t n) {
+            size = n;
+            wordBits.assign((n + 63) / 64, 0);
+            highBits.assign((n + 63) / 64, 0);
+            size_t i = 0;
+#if LITECORE_USES_SSE2
+            auto inRange = [](__m128i chars, char lo, char hi) {
+                return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(lo - 1)),
+                                     _mm_cmplt_epi8(chars, _mm_set1_epi8(hi + 1)));
+            };
+            for (; n - i >= 16; i += 16) {
+                __m128i chars = _mm_loadu_si128((const __m128i*)(s + i));
+                __m128i lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+                __m128i alnum = _mm_or_si128(inRange(lower, 'a', 'z'), inRange(chars, '0', '9'));
+                // (i is a multiple of 16, so the 16 bits never straddle two words)
+                wordBits[i / 64] |= uint64_t(_mm_movemask_epi8(alnum)) << (i % 64);
+                highBits[i / 64] |= uint64_t(_mm_movemask_epi8(chars)) << (i % 64);
+            }
+#endif
+            for (; i < n; ++i) {
+                uint8_t c = s[i];
+                if (c >= 0x80)
+                    highBits[i / 64] |= 1ull << (i % 64);
+                else if (uint8_t((c | 0x20) - 'a') < 26 || uint8_t(c - '0') < 10)
+                    wordBits[i / 64] |= 1ull << (i % 64);
+            }
+        }
+
+        // Returns the offset of the first byte at or after `pos` that is (if `inRun` is true)
+        // or isn't (if false) a letter, digit or non-ASCII byte; or `size` if there is none.
+        size_t find(size_t pos, bool inRun) const {
+            size_t w = pos / 64;
+            if (w >= wordBits.size())
+                return size;
+            uint64_t bits = runBits(w, inRun) & (~0ull << (pos % 64));
+            while (!bits) {
+                if (++w >= wordBits.size())
+                    return size;
+                bits = runBits(w, inRun);
+            }
+            return min(size, w * 64 + countTrailingZeros(bits));
+        }
+
+        // Returns true if any byte in [start, end) is non-ASCII.
+        bool anyHigh(size_t start, size_t end) const {
+            for (size_t w = start / 64; w * 64 < end; ++w) {
+                uint64_t bits = highBits[w];
+                if (w == start / 64)
+                    bits &= ~0ull << (start % 64);
+                if (w == (end - 1) / 64 && end % 64)
+                    bits &= ~(~0ull << (end % 64));
+                if (bits)
+                    return true;
+            }
+            return false;
+        }
+
+    private:
+        uint64_t runBits(size_t w, bool inRun) const {
+            uint64_t bits = wordBits[w] | highBits[w];
+            return inRun ? bits : ~bits;
+        }
+    };
+
+
+#pragma mark - TOKENIZER:
+
+
+    struct Token {
+        string text;
+        int start, end, position;
+    };
+
+
+    // What unicodesn turns a single ASCII word into.
+    struct StemEntry {
+        string token;           // The token, if any
+        int advance;            // Number of token positions the word consumes
+        bool hasToken;          // False if the word is a stop-word
+    };
+
+
+    struct FastTokenizer : public sqlite3_tokenizer {
+        sqlite3_tokenizer* base {nullptr};      // The wrapped unicodesn tokenizer
+        bool fastPath {false};                  // False if the sentinel trick doesn't work
+
+        ~FastTokenizer() {
+            if (base)
+                sBaseModule->xDestroy(base);
+        }
+
+        // Runs unicodesn over a string, appending the tokens to `tokens`.
+        int tokenize(const char *input, int length, vector<Token> &tokens) {
+            sqlite3_tokenizer_cursor *cursor;
+            int rc = sBaseModule->xOpen(base, input, length, &cursor);
+            if (rc != SQLITE_OK)
+                return rc;
+            cursor->pTokenizer = base;
+            const char *text;
+            int size, start, end, position;
+            while (SQLITE_OK == (rc = sBaseModule->xNext(cursor, &text, &size,
+                                                         &start, &end, &position))) {
+                tokens.push_back({string(text, size), start, end, position});
+            }
+            sBaseModule->xClose(cursor);
+            return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+        }
+
+        // Returns the cached result of tokenizing a lowercase ASCII word, or nullptr.
+        const StemEntry* lookUp(const string &word) {
+            auto i = _cacheMap.find(word);
+            if (i == _cacheMap.end())
+                return nullptr;
+            _cacheList.splice(_cacheList.begin(), _cacheList, i->second);
+            return &i->second->second;
+        }
+
+        void store(const string &word, StemEntry &&entry) {
+            _cacheList.emplace_front(word, move(entry));
+            _cacheMap[word] = _cacheList.begin();
+            if (_cacheList.size() > kStemCacheCapacity) {
+                _cacheMap.erase(_cacheList.back().first);
+                _cacheList.pop_back();
+            }
+        }
+
+    private:
+        // LRU cache of stems. (SQLite only uses a tokenizer from one connection, and
+        // connections aren't used concurrently, so this needs no mutex.)
+        using LRUList = list<pair<string, StemEntry>>;
+        LRUList _cacheList;                                     // most recent first
+        unordered_map<string, LRUList::iterator> _cacheMap;
+    };
+
+
+    struct FastCursor : public sqlite3_tokenizer_cursor {
+        FastTokenizer* tokenizer;
+        sqlite3_tokenizer_cursor* baseCursor {nullptr};    // Used if there's no fast path
+        const char* input;
+        size_t inputSize;
+        ByteClasses classes;
+        size_t pos {0};                 // Input offset to resume scanning from
+        int nextPosition {0};           // Position of the next token
+        vector<Token> pending;          // Tokens from unicodesn not yet returned
+        size_t pendingIndex {0};
+        Token current;                  // The token last returned
+        string word;                    // Scratch buffer for lowercasing
+
+        // Tokenizes the run input[start, end) with unicodesn, adding the tokens to `pending`.
+        // If the run is a single ASCII word, the result is added to the stem cache.
+        int tokenizeRun(size_t start, size_t end, bool cacheable) {
+            string text(input + start, end - start);
+            if (cacheable)
+                text = word;        // (the lowercased word)
+            text += kSentinel;
+            uint64_t queriesStarted = sQueriesStarted;
+            cacheable = cacheable && sRunningQueries == 0;
+            vector<Token> tokens;
+            int rc = tokenizer->tokenize(text.data(), int(text.size()), tokens);
+            if (rc != SQLITE_OK)
+                return rc;
+            // Don't cache the result if any query was running while unicodesn produced it:
+            cacheable = cacheable && sQueriesStarted == queriesStarted;
+
+            // The sentinel should be the last token; its position is how many the run uses:
+            int advance;
+            if (!tokens.empty() && tokens.back().start == int(end - start + 1)) {
+                advance = tokens.back().position;
+                tokens.pop_back();
+            } else {
+                advance = tokens.empty() ? 0 : tokens.back().position + 1;
+                cacheable = false;
+            }
+
+            if (cacheable && tokens.size() <= 1) {
+                bool hasToken = !tokens.empty();
+                if (!hasToken || (tokens[0].start == 0 && tokens[0].end == int(end - start)
+                                  && tokens[0].position == 0)) {
+                    tokenizer->store(word, {hasToken ? tokens[0].text : string(),
+                                            advance, hasToken});
+                }
+            }
+
+            pending.clear();
+            pendingIndex = 0;
+            for (auto &token : tokens) {
+                pending.push_back({move(token.text),
+                                   int(start) + token.start, int(start) + token.end,
+                                   nextPosition + token.position});
+            }
+            nextPosition += advance;
+            return SQLITE_OK;
+        }
+
+        // Produces the next token in `current`; returns SQLITE_DONE at the end.
+        int next() {
+            while (true) {
+                if (pendingIndex < pending.size()) {
+                    current = move(pending[pendingIndex++]);
+                    return SQLITE_OK;
+                }
+
+                size_t start = classes.find(pos, true);
+                if (start >= inputSize)
+                    return SQLITE_DONE;
+                size_t end = classes.find(start, false);
+                pos = end;
+
+                if (end - start > kMaxCachedWordLength || classes.anyHigh(start, end)) {
+                    int rc = tokenizeRun(start, end, false);
+                    if (rc != SQLITE_OK)
+                        return rc;
+                    continue;
+                }
+
+                word.assign(input + start, end - start);
+                for (char &c : word)
+                    c = char(tolower((unsigned char)c));
+                auto entry = tokenizer->lookUp(word);
+                if (!entry) {
+                    int rc = tokenizeRun(start, end, true);
+                    if (rc != SQLITE_OK)
+                        return rc;
+                    continue;
+                }
+
+                int position = nextPosition;
+                nextPosition += entry->advance;
+                if (entry->hasToken) {
+                    current.text = entry->token;
+                    current.start = int(start);
+                    current.end = int(end);
+                    current.position = position;
+                    return SQLITE_OK;
+                }
+            }
+        }
+    };
+
+
+#pragma mark - MODULE:
+
+
+    static int fastCreate(int argc, const char * const *argv,
+                          sqlite3_tokenizer **ppTokenizer) noexcept
+    {
+        try {
+            auto tokenizer = new FastTokenizer;
+            int rc = sBaseModule->xCreate(argc, argv, &tokenizer->base);
+            if (rc != SQLITE_OK) {
+                tokenizer->base = nullptr;
+                delete tokenizer;
+                return rc;
+            }
+            tokenizer->base->pModule = sBaseModule;
+
+            // Make sure the sentinel comes through unchanged, so runs can be measured:
+            vector<Token> tokens;
+            tokenizer->fastPath = (tokenizer->tokenize(kSentinel, int(strlen(kSentinel)),
+                                                       tokens) == SQLITE_OK
+                                   && tokens.size() == 1 && tokens[0].text == "0"
+                                   && tokens[0].start == 1 && tokens[0].position == 0);
+            *ppTokenizer = tokenizer;
+            return SQLITE_OK;
+        } catch (const bad_alloc&) {
+            return SQLITE_NOMEM;
+        }
+    }
+
+
+    static int fastDestroy(sqlite3_tokenizer *pTokenizer) noexcept {
+        delete static_cast<FastTokenizer*>(pTokenizer);
+        return SQLITE_OK;
+    }
+
+
+    static int fastOpen(sqlite3_tokenizer *pTokenizer, const char *input, int nBytes,
+                        sqlite3_tokenizer_cursor **ppCursor) noexcept
+    {
+        try {
+            auto tokenizer = static_cast<FastTokenizer*>(pTokenizer);
+            auto cursor = new FastCursor;
+            cursor->tokenizer = tokenizer;
+            if (!input) {
+                input = "";
+                nBytes = 0;
+            } else if (nBytes < 0) {
+                nBytes = int(strlen(input));
+            }
+            if (tokenizer->fastPath && !sRunningQuery) {
+                cursor->input = input;
+                cursor->inputSize = nBytes;
+                cursor->classes.scan((const uint8_t*)input, nBytes);
+            } else {
+                int rc = sBaseModule->xOpen(tokenizer->base, input, nBytes, &cursor->baseCursor);
+                if (rc != SQLITE_OK) {
+                    delete cursor;
+                    return rc;
+                }
+                cursor->baseCursor->pTokenizer = tokenizer->base;
+            }
+            *ppCursor = cursor;
+            return SQLITE_OK;
+        } catch (const bad_alloc&) {
+            return SQLITE_NOMEM;
+        }
+    }
+
+
+    static int fastClose(sqlite3_tokenizer_cursor *pCursor) noexcept {
+        auto cursor = static_cast<FastCursor*>(pCursor);
+        if (cursor->baseCursor)
+            sBaseModule->xClose(cursor->baseCursor);
+        delete cursor;
+        return SQLITE_OK;
+    }
+
+
+    static int fastNext(sqlite3_tokenizer_cursor *pCursor, const char **ppToken, int *pnBytes,
+                        int *piStartOffset, int *piEndOffset, int *piPosition) noexcept
+    {
+        auto cursor = static_cast<FastCursor*>(pCursor);
+        if (cursor->baseCursor)
+            return sBaseModule->xNext(cursor->baseCursor, ppToken, pnBytes,
+                                      piStartOffset, piEndOffset, piPosition);
+        try {
+            int rc = cursor->next();
+            if (rc == SQLITE_OK) {
+                auto &token = cursor->current;
+                *ppToken = token.text.data();
+                *pnBytes = int(token.text.size());
+                *piStartOffset = token.start;
+                *piEndOffset = token.end;
+                *piPosition = token.position;
+            }
+            return rc;
+        } catch (const bad_alloc&) {
+            return SQLITE_NOMEM;
+        }
+    }
+
+
+    static const sqlite3_tokenizer_module kFastModule = {
+        0,
+        fastCreate,
+        fastDestroy,
+        fastOpen,
+        fastClose,
+        fastNext,
+    };
+
+
+#pragma mark - REGISTRATION:
+
+
+    // Calls the SQL function fts3_tokenizer() to get or set a tokenizer module pointer.
+    static int fts3Tokenizer(sqlite3 *db, const char *name,
+                             const sqlite3_tokenizer_module **module, bool set)
+    {
+        sqlite3_stmt *stmt;
+        int rc = sqlite3_prepare_v2(db, (set ? "SELECT fts3_tokenizer(?, ?)"
+                                             : "SELECT fts3_tokenizer(?)"),
+                                    -1, &stmt, nullptr);
+        if (rc != SQLITE_OK)
+            return rc;
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        if (set)
+            sqlite3_bind_blob(stmt, 2, module, sizeof(*module), SQLITE_STATIC);
+        rc = sqlite3_step(stmt);
+        if (rc == SQLITE_ROW) {
+            if (!set) {
+                if (sqlite3_column_bytes(stmt, 0) == sizeof(*module))
+                    memcpy(module, sqlite3_column_blob(stmt, 0), sizeof(*module));
+                else
+                    rc = SQLITE_ERROR;
+            }
+            if (rc == SQLITE_ROW)
+                rc = SQLITE_OK;
+        }
+        sqlite3_finalize(stmt);
+        return rc;
+    }
+
+
+    int RegisterFTSTokenizer(sqlite3 *db) {
+        int rc = register_unicodesn_tokenizer(db);
+        if (rc != SQLITE_OK)
+            return rc;
+        const sqlite3_tokenizer_module *base;
+        rc = fts3Tokenizer(db, kTokenizerName, &base, false);
+        if (rc != SQLITE_OK)
+            return rc;
+        if (base != &kFastModule) {
+            DebugAssert(!sBaseModule || sBaseModule == base);
+            sBaseModule = base;
+        }
+        // Keep unicodesn available under another name (the tests compare the two):
+        rc = fts3Tokenizer(db, kBaseTokenizerName, &sBaseModule, true);
+        if (rc != SQLITE_OK)
+            return rc;
+        const sqlite3_tokenizer_module *fast = &kFastModule;
+        return fts3Tokenizer(db, kTokenizerName, &fast, true);
+    }
+
+
+    void FTSTokenizerRunningQuery(bool running) {
+        sRunningQuery = running;
+        if (running) {
+            ++sQueriesStarted;
+            ++sRunningQueries;
+            unicodesn_tokenizerRunningQuery(true);
+        } else {
+            unicodesn_tokenizerRunningQuery(false);
+            --sRunningQueries;
+        }
+    }
+
+}
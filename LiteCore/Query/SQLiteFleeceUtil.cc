@@ -125,10 +125,14 @@ namespace litecore {
     }
 
 
+    thread_local uint64_t QueryFleeceScope::sInstanceCount;
+
+
     QueryFleeceScope::QueryFleeceScope(sqlite3_context *ctx, sqlite3_value **argv)
     :Scope(argAsDocBody(ctx, argv[0], _copied),
            ((fleeceFuncContext*)sqlite3_user_data(ctx))->sharedKeys)
     {
+        ++sInstanceCount;
         if (data()) {
             root = Value::fromTrustedData(data());
             if (!root) {
@@ -285,6 +289,7 @@ namespace litecore {
     {
         registerFunctionSpecs(db, context, kFleeceFunctionsSpec);
         registerFunctionSpecs(db, context, kRankFunctionsSpec);
+        registerFunctionSpecs(db, context, kVectorFunctionsSpec);
         registerFunctionSpecs(db, context, kN1QLFunctionsSpec);
 #ifdef COUCHBASE_ENTERPRISE
         registerFunctionSpecs(db, context, kPredictFunctionsSpec);
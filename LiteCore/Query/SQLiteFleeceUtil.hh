@@ -48,6 +48,9 @@ namespace litecore {
         QueryFleeceScope(sqlite3_context *ctx, sqlite3_value **argv);
         ~QueryFleeceScope();
         const fleece::impl::Value *root;
+
+        // Number of scopes created on the current thread; used for query statistics.
+        static thread_local uint64_t sInstanceCount;
     private:
         bool _copied;
     };
@@ -136,6 +139,7 @@ namespace litecore {
     extern const SQLiteFunctionSpec kFleeceFunctionsSpec[];
     extern const SQLiteFunctionSpec kFleeceNullAccessorFunctionsSpec[];
     extern const SQLiteFunctionSpec kRankFunctionsSpec[];
+    extern const SQLiteFunctionSpec kVectorFunctionsSpec[];
     extern const SQLiteFunctionSpec kN1QLFunctionsSpec[];
 #ifdef COUCHBASE_ENTERPRISE
     extern const SQLiteFunctionSpec kPredictFunctionsSpec[];
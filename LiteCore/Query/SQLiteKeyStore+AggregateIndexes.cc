@@ -0,0 +1,268 @@
+//
+// SQLiteKeyStore+AggregateIndexes.cc
+//
+// Copyright © 2018 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteKeyStore.hh"
+#include "SQLiteDataFile.hh"
+#include "QueryParser.hh"
+#include "Error.hh"
+#include "StringUtil.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+#include <map>
+#include <sstream>
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+
+namespace litecore {
+
+    /*
+     An aggregate index materializes the results of a GROUP BY query. Its table has a row per
+     group: the group keys are in columns "k0", "k1", ..., the number of documents in the group
+     is in "_n", and each aggregated expression has columns (see QueryParser::aggregateColumnName)
+     holding the count of its non-null values and, as needed, its sum, minimum and maximum.
+
+     Triggers update a group's row as documents are added, changed or removed. Counts and sums are
+     just adjusted; but removing a document whose value is its group's minimum or maximum has to
+     recompute that from the group's other documents, which scans the KeyStore's table.
+
+     The keys, minimums and maximums are stored in the form a query result column takes (see
+     fl_result), so they can be returned as-is.
+     */
+
+
+    namespace {
+        // An aggregated expression, and the names of the columns storing its running values.
+        // (The sum, min and max columns are only present if some WHAT item needs them.)
+        struct AggregateColumns {
+            const Value *arg;
+            string count, sum, min, max;
+        };
+    }
+
+
+    bool SQLiteKeyStore::createAggregateIndex(const IndexSpec &spec) {
+        QueryParser qp(*this);
+
+        // The WHAT clause's aggregate function calls are the aggregates; the rest are group keys:
+        vector<const Value*> keys;
+        map<string, AggregateColumns> aggregates;       // keyed by count column name
+        for (Array::iterator i(spec.what()); i; ++i) {
+            const Value *arg;
+            slice fn = QueryParser::aggregateCall(i.value(), arg);
+            if (!fn) {
+                if (!i.value()->asArray())
+                    error::_throw(error::InvalidQuery,
+                                  "An aggregate index's group keys must be expressions");
+                keys.push_back(i.value());
+            } else if (arg) {
+                string count = qp.aggregateColumnName("count"_sl, arg);
+                auto &agg = aggregates.emplace(count, AggregateColumns{arg, count}).first->second;
+                if (fn == "sum"_sl || fn == "avg"_sl)
+                    agg.sum = qp.aggregateColumnName("sum"_sl, arg);
+                else if (fn == "min"_sl || fn == "max"_sl)
+                    (fn == "min"_sl ? agg.min : agg.max) = qp.aggregateColumnName(fn, arg);
+            }
+        }
+        if (keys.empty())
+            error::_throw(error::InvalidQuery, "An aggregate index must have a group key");
+
+        auto where = spec.where();
+        string table = aggregateTableName(qp.aggregateIndexIdentifier(keys, where));
+        for (auto &other : db().getIndexes(this)) {
+            if (other.indexTableName == table && other.name != spec.name)
+                error::_throw(error::InvalidParameter,
+                              "Aggregate index '%s' has the same group keys and WHERE clause",
+                              other.name.c_str());
+        }
+
+        // Create the table:
+        stringstream sql;
+        sql << "CREATE TABLE \"" << table << "\" (";
+        for (size_t i = 0; i < keys.size(); ++i)
+            sql << QueryParser::aggregateKeyColumnName(i) << ", ";
+        sql << "_n INTEGER NOT NULL";
+        for (auto &[_, agg] : aggregates) {
+            sql << ", \"" << agg.count << "\" INTEGER NOT NULL";
+            for (auto col : {&agg.sum, &agg.min, &agg.max}) {
+                if (!col->empty())
+                    sql << ", \"" << *col << '"';
+            }
+        }
+        sql << ")";
+        if (!db().createIndex(spec, this, table, sql.str()))
+            return false;
+
+        stringstream keyColumns, columns;
+        for (size_t i = 0; i < keys.size(); ++i)
+            keyColumns << (i ? ", " : "") << QueryParser::aggregateKeyColumnName(i);
+        db().exec(CONCAT("CREATE INDEX \"" << table << "::keys\" ON \"" << table << "\" ("
+                         << keyColumns.str() << ")"));
+
+        // The SQL of the keys' and aggregated expressions' values, reading the body from `body`:
+        auto keySQL = [&](const char *body) {
+            qp.setBodyColumnName(body);
+            vector<string> values;
+            for (auto key : keys)
+                values.push_back(CONCAT("fl_result(" << qp.expressionSQL(key) << ")"));
+            return values;
+        };
+        auto argSQL = [&](const char *body) {
+            qp.setBodyColumnName(body);
+            map<string, string> values;
+            for (auto &[count, agg] : aggregates)
+                values[count] = qp.expressionSQL(agg.arg);
+            return values;
+        };
+        // A test that a row of the table is the group whose keys are given:
+        auto groupTest = [&](const vector<string> &keyValues) {
+            stringstream test;
+            for (size_t i = 0; i < keyValues.size(); ++i)
+                test << (i ? " AND " : "") << QueryParser::aggregateKeyColumnName(i)
+                     << " IS " << keyValues[i];
+            return test.str();
+        };
+
+        qp.setBodyColumnName("body");
+        string whereNewSQL = qp.whereClauseSQL(where, "new");
+        string whereOldSQL = qp.whereClauseSQL(where, "old");
+        string whereDocSQL = qp.whereClauseSQL(where, "doc");
+        auto newKeys = keySQL("new.body"), oldKeys = keySQL("old.body"), docKeys = keySQL("doc.body");
+        auto newArgs = argSQL("new.body"), oldArgs = argSQL("old.body"), docArgs = argSQL("doc.body");
+
+        // Index the existing records:
+        stringstream populate, select;
+        populate << "INSERT INTO \"" << table << "\" (" << keyColumns.str() << ", _n";
+        select << "SELECT ";
+        for (auto &key : newKeys)
+            select << key << ", ";
+        select << "count(*)";
+        for (auto &[count, agg] : aggregates) {
+            auto &arg = newArgs[count];
+            populate << ", \"" << agg.count << '"';
+            select << ", count(" << arg << ")";
+            if (!agg.sum.empty()) {
+                populate << ", \"" << agg.sum << '"';
+                select << ", coalesce(sum(" << arg << "), 0)";
+            }
+            if (!agg.min.empty()) {
+                populate << ", \"" << agg.min << '"';
+                select << ", min(fl_result(" << arg << "))";
+            }
+            if (!agg.max.empty()) {
+                populate << ", \"" << agg.max << '"';
+                select << ", max(fl_result(" << arg << "))";
+            }
+        }
+        select << " FROM " << tableName() << " AS new " << whereNewSQL << " GROUP BY ";
+        for (size_t i = 0; i < keys.size(); ++i)
+            select << (i ? ", " : "") << (i + 1);
+        db().exec(populate.str() + ") " + select.str());
+
+        // Adding a document to its group creates the group's row if necessary, then updates it:
+        stringstream add;
+        add << "INSERT INTO \"" << table << "\" (" << keyColumns.str() << ", _n";
+        for (auto &[_, agg] : aggregates) {
+            add << ", \"" << agg.count << '"';
+            if (!agg.sum.empty())
+                add << ", \"" << agg.sum << '"';
+        }
+        add << ") SELECT ";
+        for (auto &key : newKeys)
+            add << key << ", ";
+        add << "0";
+        for (auto &[_, agg] : aggregates)
+            add << (agg.sum.empty() ? ", 0" : ", 0, 0");
+        add << " WHERE NOT EXISTS (SELECT 1 FROM \"" << table << "\" WHERE "
+            << groupTest(newKeys) << "); ";
+        add << "UPDATE \"" << table << "\" SET _n = _n + 1";
+        for (auto &[count, agg] : aggregates) {
+            auto &arg = newArgs[count];
+            add << ", \"" << agg.count << "\" = \"" << agg.count << "\" + (" << arg << " IS NOT NULL)";
+            if (!agg.sum.empty())
+                add << ", \"" << agg.sum << "\" = \"" << agg.sum << "\" + coalesce(" << arg << ", 0)";
+            for (auto [col, op] : {pair{&agg.min, "<"}, pair{&agg.max, ">"}}) {
+                if (col->empty())
+                    continue;
+                string value = "fl_result(" + arg + ")", current = "\"" + *col + "\"";
+                add << ", " << current << " = CASE WHEN " << current << " IS NULL OR "
+                    << value << ' ' << op << ' ' << current << " THEN " << value
+                    << " ELSE " << current << " END";
+            }
+        }
+        add << " WHERE " << groupTest(newKeys);
+
+        // Removing a document updates its group's row, deleting it if the group is now empty:
+        stringstream remove;
+        remove << "UPDATE \"" << table << "\" SET _n = _n - 1";
+        for (auto &[count, agg] : aggregates) {
+            auto &arg = oldArgs[count];
+            remove << ", \"" << agg.count << "\" = \"" << agg.count << "\" - (" << arg << " IS NOT NULL)";
+            if (!agg.sum.empty())
+                remove << ", \"" << agg.sum << "\" = \"" << agg.sum << "\" - coalesce(" << arg << ", 0)";
+        }
+        remove << " WHERE " << groupTest(oldKeys) << "; ";
+        remove << "DELETE FROM \"" << table << "\" WHERE " << groupTest(oldKeys) << " AND _n <= 0";
+        // ...and if its value was the group's minimum or maximum, that's recomputed:
+        stringstream inGroup;
+        for (size_t i = 0; i < keys.size(); ++i)
+            inGroup << " AND " << docKeys[i] << " IS " << oldKeys[i];
+        for (auto &[count, agg] : aggregates) {
+            for (auto [col, fn] : {pair{&agg.min, "min"}, pair{&agg.max, "max"}}) {
+                if (col->empty())
+                    continue;
+                remove << "; UPDATE \"" << table << "\" SET \"" << *col << "\" = "
+                       << "(SELECT " << fn << "(fl_result(" << docArgs[count] << ")) FROM "
+                       << tableName() << " AS doc " << whereDocSQL << inGroup.str() << ") "
+                       << "WHERE " << groupTest(oldKeys) << " AND \"" << *col << "\" IS "
+                       << "fl_result(" << oldArgs[count] << ")";
+            }
+        }
+
+        // Set up triggers to keep the table up to date
+        // ...on insertion:
+        createTrigger(table, "ins",
+                      "AFTER INSERT",
+                      whereNewSQL,
+                      add.str());
+
+        // ...on delete:
+        createTrigger(table, "del",
+                      "AFTER DELETE",
+                      whereOldSQL,
+                      remove.str());
+
+        // ...on update. Both triggers run after the update, so that recomputing a minimum or
+        // maximum sees the document's new value; running in either order gives the same result.
+        createTrigger(table, "upd",
+                      "AFTER UPDATE OF body, flags",
+                      whereOldSQL,
+                      remove.str());
+        createTrigger(table, "postupdate",
+                      "AFTER UPDATE OF body, flags",
+                      whereNewSQL,
+                      add.str());
+        return true;
+    }
+
+
+    string SQLiteKeyStore::aggregateTableName(const std::string &identifier) const {
+        return tableName() + ":aggregate:" + identifier;
+    }
+
+}
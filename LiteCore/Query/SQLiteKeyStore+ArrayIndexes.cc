@@ -81,15 +81,27 @@ namespace litecore {
                           "WHEN (old.flags & 1) = 0",
                           deleteTriggerExpr);
 
-            // ...on update:
+            // ...on update. Rather than deleting all the doc's rows and re-inserting every item,
+            // only write the items whose values changed, then delete any rows left past the end
+            // of the (possibly shorter) new array:
+            string updateTriggerExpr = CONCAT("INSERT OR REPLACE INTO \"" << unnestTableName <<
+                                              "\" (docid, i, body) "
+                                              "SELECT new.rowid, _each.rowid, _each.value " <<
+                                              "FROM " << eachExpr << " AS _each "
+                                              "WHERE _each.value IS NOT "
+                                                  "(SELECT body FROM \"" << unnestTableName << "\" "
+                                                  "WHERE docid = new.rowid AND i = _each.rowid); "
+                                              "DELETE FROM \"" << unnestTableName << "\" "
+                                              "WHERE docid = new.rowid AND i >= "
+                                                  "(SELECT count(*) FROM " << eachExpr << " AS _each)");
             createTrigger(unnestTableName, "preupdate",
                           "BEFORE UPDATE OF body, flags",
-                          "WHEN (old.flags & 1) = 0",
+                          "WHEN (old.flags & 1) = 0 AND (new.flags & 1) != 0",
                           deleteTriggerExpr);
             createTrigger(unnestTableName, "postupdate",
                           "AFTER UPDATE OF body, flags",
                           "WHEN (new.flags & 1 = 0)",
-                          insertTriggerExpr);
+                          updateTriggerExpr);
         }
         return unnestTableName;
     }
@@ -26,6 +26,7 @@
 #include "StringUtil.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include "Stopwatch.hh"
+#include "UnicodeCollator.hh"
 
 using namespace std;
 using namespace fleece;
@@ -43,6 +44,20 @@ namespace litecore {
          * A SQL table named `kv_default:prediction:DIGEST`, where DIGEST is a unique digest
             of the prediction function name and the parameter dictionary
          * An index on that table named `NAME`
+     - A value index with INCLUDE expressions (a covering index) also has, for each of those,
+       a SQL table named `kv_default:covering:DIGEST`, where DIGEST is a unique digest of the
+       expression. It maps each live doc's rowid to the expression's value, and can be shared
+       by multiple indexes. It's dropped when no index includes the expression any more.
+     - A spatial index is a SQLite R-tree virtual table named `kv_default:spatial:NAME`,
+       mapping each indexed doc's rowid to its bounding box.
+     - A vector index has two parts:
+         * A SQL table named `kv_default:vector:NAME`, mapping each indexed doc's rowid to its
+           vector and the number of the cluster it belongs to
+         * A SQL table named `kv_default:vector:NAME:centroids` of the clusters' centroids, and
+           of retired ones whose vectors haven't yet moved to the current clusters
+     - An aggregate index is a SQL table named `kv_default:aggregate:DIGEST`, where DIGEST is a
+       unique digest of the group keys and the WHERE clause. It has a row per group, holding the
+       group's keys and its running counts, sums, minimums and maximums.
 
      Index table:
         - name (string primary key)
@@ -55,7 +70,20 @@ namespace litecore {
 
     bool SQLiteKeyStore::createIndex(const IndexSpec &spec) {
         spec.validateName();
+        if (spec.type != IndexSpec::kValue && spec.included())
+            error::_throw(error::InvalidQuery, "Only value indexes can INCLUDE expressions");
+        (void)spec.ftsMergePages();     // validates the MERGE term, if any
+        (void)spec.vectorCentroids();   // validates the CENTROIDS term, if any
+        if (spec.collationSortKeys() && !CollationSortKeysSupported())
+            error::_throw(error::UnsupportedOperation,
+                          "Collation sort keys aren't supported on this platform");
+        return _createIndex(spec);
+    }
+
 
+    // Creates an already-validated index. (Also called by SQLiteDataFile to rebuild sort-key
+    // indexes; a SORT_KEYS term is ignored if the platform doesn't support sort keys.)
+    bool SQLiteKeyStore::_createIndex(const IndexSpec &spec) {
         Stopwatch st;
         Transaction t(db());
         bool created;
@@ -63,6 +91,9 @@ namespace litecore {
             case IndexSpec::kValue:      created = createValueIndex(spec); break;
             case IndexSpec::kFullText:   created = createFTSIndex(spec); break;
             case IndexSpec::kArray:      created = createArrayIndex(spec); break;
+            case IndexSpec::kSpatial:    created = createSpatialIndex(spec); break;
+            case IndexSpec::kVector:     created = createVectorIndex(spec); break;
+            case IndexSpec::kAggregate:  created = createAggregateIndex(spec); break;
 #ifdef COUCHBASE_ENTERPRISE
             case IndexSpec::kPredictive: created = createPredictiveIndex(spec); break;
 #endif
@@ -71,6 +102,7 @@ namespace litecore {
 
         if (created) {
             t.commit();
+            resetSortKeyExpressions();
             db().optimize();
             double time = st.elapsed();
             QueryLog.log((time < 3.0 ? LogLevel::Info : LogLevel::Warning),
@@ -85,9 +117,13 @@ namespace litecore {
                                      const string &sourceTableName,
                                      Array::iterator &expressions)
     {
-        Assert(spec.type != IndexSpec::kFullText);
+        Assert(spec.type != IndexSpec::kFullText && spec.type != IndexSpec::kSpatial
+                                                 && spec.type != IndexSpec::kVector
+                                                 && spec.type != IndexSpec::kAggregate);
         QueryParser qp(*this);
         qp.setTableName(CONCAT('"' << sourceTableName << '"'));
+        qp.setCollationSortKeys(spec.type == IndexSpec::kValue && spec.collationSortKeys()
+                                && CollationSortKeysSupported());
         qp.writeCreateIndex(spec.name,
                             expressions,
                             spec.where(),
@@ -103,6 +139,7 @@ namespace litecore {
         if (spec) {
             db().deleteIndex(*spec);
             t.commit();
+            resetSortKeyExpressions();
         } else {
             t.abort();
         }
@@ -155,7 +192,106 @@ namespace litecore {
 
     bool SQLiteKeyStore::createValueIndex(const IndexSpec &spec) {
         Array::iterator expressions(spec.what());
-        return createIndex(spec, tableName(), expressions);
+        if (!createIndex(spec, tableName(), expressions))
+            return false;
+        // (Create these after the index, since replacing an older index garbage-collects them)
+        if (auto included = spec.included(); included) {
+            for (Array::iterator i(included); i; ++i)
+                createCoveringTable(i.value());
+        }
+        return true;
+    }
+
+
+    // Creates a table storing the value of an expression for every live doc, unless it exists.
+    void SQLiteKeyStore::createCoveringTable(const Value *expression) {
+        QueryParser qp(*this);
+        auto kvTableName = tableName();
+        auto covTableName = qp.coveringTableName(expression);
+
+        string sql = CONCAT("CREATE TABLE \"" << covTableName << "\" "
+                            "(docid INTEGER PRIMARY KEY REFERENCES " << kvTableName << "(rowid), "
+                            " value) "
+                            "WITHOUT ROWID");
+        if (db().schemaExistsWithSQL(covTableName, "table", covTableName, sql))
+            return;
+        LogTo(QueryLog, "Creating covering table '%s' on %s", covTableName.c_str(),
+              expression->toJSONString().c_str());
+        db().exec(sql);
+
+        // Populate the table with data from existing documents. The values are stored in the
+        // form a query result column takes (see fl_result), so they can be returned as-is:
+        string valueExpr = qp.expressionSQL(expression);
+        db().exec(CONCAT("INSERT INTO \"" << covTableName << "\" (docid, value) "
+                         "SELECT rowid, fl_result(" << valueExpr << ") "
+                         "FROM " << kvTableName << " WHERE (flags & 1) = 0"));
+
+        // Set up triggers to keep the table up to date
+        // ...on insertion:
+        qp.setBodyColumnName("new.body");
+        valueExpr = qp.expressionSQL(expression);
+        string insertTriggerExpr = CONCAT("INSERT INTO \"" << covTableName << "\" (docid, value) "
+                                          "VALUES (new.rowid, fl_result(" << valueExpr << "))");
+        createTrigger(covTableName, "ins",
+                      "AFTER INSERT",
+                      "WHEN (new.flags & 1) = 0",
+                      insertTriggerExpr);
+
+        // ...on delete:
+        string deleteTriggerExpr = CONCAT("DELETE FROM \"" << covTableName << "\" "
+                                          "WHERE docid = old.rowid");
+        createTrigger(covTableName, "del",
+                      "BEFORE DELETE",
+                      "WHEN (old.flags & 1) = 0",
+                      deleteTriggerExpr);
+
+        // ...on update:
+        createTrigger(covTableName, "preupdate",
+                      "BEFORE UPDATE OF body, flags",
+                      "WHEN (old.flags & 1) = 0",
+                      deleteTriggerExpr);
+        createTrigger(covTableName, "postupdate",
+                      "AFTER UPDATE OF body, flags",
+                      "WHEN (new.flags & 1) = 0",
+                      insertTriggerExpr);
+    }
+
+
+    // Drops covering tables whose expressions are no longer included by any index.
+    void SQLiteKeyStore::garbageCollectCoveringTables() {
+        string prefix = coveringTableName("");
+        vector<string> tables;
+        {
+            SQLite::Statement stmt(db(), "SELECT name FROM sqlite_master "
+                                         "WHERE type='table' AND substr(name, 1, ?) = ?");
+            stmt.bind(1, (int)prefix.size());
+            stmt.bind(2, prefix);
+            while (stmt.executeStep())
+                tables.push_back(stmt.getColumn(0).getString());
+        }
+        if (tables.empty())
+            return;
+
+        set<string> inUse;
+        QueryParser qp(*this);
+        for (auto &spec : getIndexes()) {
+            if (spec.type == IndexSpec::kValue && spec.expressionJSON) {
+                if (auto included = spec.included(); included) {
+                    for (Array::iterator i(included); i; ++i)
+                        inUse.insert(qp.coveringTableName(i.value()));
+                }
+            }
+        }
+        for (auto &table : tables) {
+            if (inUse.find(table) == inUse.end())
+                db().garbageCollectIndexTable(table);
+        }
+    }
+
+
+    // Part of the QueryParser delegate API
+    string SQLiteKeyStore::coveringTableName(const string &identifier) const {
+        return tableName() + ":covering:" + identifier;
     }
 
 
@@ -167,4 +303,46 @@ namespace litecore {
         return db().tableExists(tableName);
     }
 
+
+    // Part of the QueryParser delegate API
+    vector<string> SQLiteKeyStore::tableColumns(const std::string &tableName) const {
+        vector<string> columns;
+        SQLite::Statement stmt(db(), "SELECT name FROM pragma_table_info(?)");
+        stmt.bind(1, tableName);
+        while (stmt.executeStep())
+            columns.push_back(stmt.getColumn(0).getString());
+        return columns;
+    }
+
+
+    // Part of the QueryParser delegate API. The sort-key expressions of this KeyStore's indexes
+    // are found by parsing their specs the way createIndex does, the first time this is called
+    // after opening or after an index is created or deleted.
+    bool SQLiteKeyStore::hasSortKeyIndex(const string &sortKeyExpression) const {
+        lock_guard<mutex> lock(_sortKeyMutex);
+        if (!_sortKeyExpressions) {
+            _sortKeyExpressions.emplace();
+            if (CollationSortKeysSupported()) {
+                for (auto &spec : getIndexes()) {
+                    if (spec.type != IndexSpec::kValue || !spec.expressionJSON
+                                                       || !spec.collationSortKeys())
+                        continue;
+                    QueryParser qp(*this);
+                    qp.setCollationSortKeys(true);
+                    Array::iterator expressions(spec.what());
+                    qp.writeCreateIndex(spec.name, expressions, spec.where(), false);
+                    auto &exprs = qp.sortKeyExpressions();
+                    _sortKeyExpressions->insert(exprs.begin(), exprs.end());
+                }
+            }
+        }
+        return _sortKeyExpressions->count(sortKeyExpression) > 0;
+    }
+
+
+    void SQLiteKeyStore::resetSortKeyExpressions() {
+        lock_guard<mutex> lock(_sortKeyMutex);
+        _sortKeyExpressions.reset();
+    }
+
 }
@@ -22,10 +22,13 @@
 #include "SQLiteKeyStore.hh"
 #include "SQLiteDataFile.hh"
 #include "QueryParser.hh"
+#include "PredictiveModel.hh"
 #include "Error.hh"
 #include "StringUtil.hh"
 #include "MutableArray.hh"
+#include "Doc.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
+#include <sqlite3.h>
 
 using namespace std;
 using namespace fleece;
@@ -33,6 +36,10 @@ using namespace fleece::impl;
 
 namespace litecore {
 
+    // Number of documents whose inputs are passed to the model at once while building an index.
+    static constexpr size_t kPredictionBatchSize = 64;
+
+
     bool SQLiteKeyStore::createPredictiveIndex(const IndexSpec &spec)
     {
         auto expressions = spec.what();
@@ -84,15 +91,12 @@ namespace litecore {
             db().exec(sql);
 
             // Populate the index-table with data from existing documents:
-            string predictExpr = qp.expressionSQL(expression);
-            db().exec(CONCAT("INSERT INTO \"" << predTableName << "\" (docid, body) "
-                             "SELECT rowid, " << predictExpr <<
-                             "FROM " << kvTableName << " WHERE (flags & 1) = 0"));
+            populatePredictionTable(predTableName, expression);
 
             // Set up triggers to keep the index-table up to date
             // ...on insertion:
             qp.setBodyColumnName("new.body");
-            predictExpr = qp.expressionSQL(expression);
+            string predictExpr = qp.expressionSQL(expression);
             string insertTriggerExpr = CONCAT("INSERT INTO \"" << predTableName <<
                                               "\" (docid, body) "
                                               "VALUES (new.rowid, " << predictExpr << ")");
@@ -109,20 +113,107 @@ namespace litecore {
                           "WHEN (old.flags & 1) = 0",
                           deleteTriggerExpr);
 
-            // ...on update:
+            // ...on update. The existing prediction is kept if the model's input is unchanged,
+            // since (being a pure function) the model would just return the same result:
+            string inputChanged = "1";
+            if (auto pred = expression->asArray(); pred && pred->count() >= 3) {
+                string newInput = qp.expressionSQL(pred->get(2));
+                qp.setBodyColumnName("old.body");
+                string oldInput = qp.expressionSQL(pred->get(2));
+                inputChanged = CONCAT("(" << oldInput << ") IS NOT (" << newInput << ")");
+            }
             createTrigger(predTableName, "preupdate",
                           "BEFORE UPDATE OF body, flags",
-                          "WHEN (old.flags & 1) = 0",
+                          CONCAT("WHEN (old.flags & 1) = 0 AND ((new.flags & 1) != 0 OR "
+                                 << inputChanged << ")"),
                           deleteTriggerExpr);
             createTrigger(predTableName, "postupdate",
                           "AFTER UPDATE OF body, flags",
-                          "WHEN (new.flags) & 1 = 0",
+                          CONCAT("WHEN (new.flags & 1) = 0 AND ((old.flags & 1) != 0 OR "
+                                 << inputChanged << ")"),
                           insertTriggerExpr);
         }
         return predTableName;
     }
 
 
+    // Fills a new prediction table from the existing documents. If the model is registered, the
+    // documents' inputs are passed to it in batches instead of calling prediction() on each row.
+    void SQLiteKeyStore::populatePredictionTable(const string &predTableName,
+                                                 const Value *expression)
+    {
+        QueryParser qp(*this);
+        auto pred = expression->asArray();
+        Retained<PredictiveModel> model;
+        if (pred && pred->count() >= 3 && pred->get(1)->asString())
+            model = PredictiveModel::named(string(pred->get(1)->asString()));
+        if (!model) {
+            // Let the prediction() SQL function report the problem, if any:
+            db().exec(CONCAT("INSERT INTO \"" << predTableName << "\" (docid, body) "
+                             "SELECT rowid, " << qp.expressionSQL(expression) <<
+                             "FROM " << tableName() << " WHERE (flags & 1) = 0"));
+            return;
+        }
+
+        SQLite::Statement select(db(), CONCAT("SELECT rowid, " << qp.expressionSQL(pred->get(2))
+                                              << " FROM " << tableName()
+                                              << " WHERE (flags & 1) = 0"));
+        SQLite::Statement insert(db(), CONCAT("INSERT INTO \"" << predTableName
+                                              << "\" (docid, body) VALUES (?, ?)"));
+        vector<int64_t> docIDs;
+        vector<Retained<Doc>> docs;
+        vector<const Dict*> inputs;
+        const char *dbPath = sqlite3_db_filename(((SQLite::Database&)db()).getHandle(), "main");
+
+        auto flush = [&]() {
+            if (inputs.empty())
+                return;
+            C4Error c4err = {};
+            vector<alloc_slice> results = model->cachedPredictions(inputs, db().delegate(),
+                                                                   (dbPath ? dbPath : ""),
+                                                                   &c4err);
+            if (results.size() != inputs.size()) {
+                alloc_slice msg(c4error_getMessage(c4err));
+                error((error::Domain)c4err.domain, c4err.code, string(msg))._throw();
+            }
+            for (size_t i = 0; i < results.size(); ++i) {
+                if (!results[i])
+                    continue;       // no result (MISSING) isn't stored
+                insert.bind(1, (long long)docIDs[i]);
+                insert.bindNoCopy(2, results[i].buf, (int)results[i].size);
+                insert.exec();
+                insert.reset();
+            }
+            docIDs.clear();
+            docs.clear();
+            inputs.clear();
+        };
+
+        LogTo(QueryLog, "Populating predictive table '%s' in batches of %zu",
+              predTableName.c_str(), kPredictionBatchSize);
+        while (select.executeStep()) {
+            auto col = select.getColumn(1);
+            if (col.isNull())
+                continue;
+            const Dict *input = nullptr;
+            Retained<Doc> doc;
+            if (col.getType() == SQLITE_BLOB) {
+                doc = new Doc(alloc_slice(col.getBlob(), col.getBytes()), Doc::kUntrusted,
+                              db().documentKeys());
+                input = doc->asDict();
+            }
+            if (!input)
+                error::_throw(error::InvalidQuery, "Parameter of prediction() must be a dictionary");
+            docIDs.push_back(select.getColumn(0).getInt64());
+            docs.push_back(doc);
+            inputs.push_back(input);
+            if (inputs.size() >= kPredictionBatchSize)
+                flush();
+        }
+        flush();
+    }
+
+
     string SQLiteKeyStore::predictiveTableName(const std::string &property) const {
         return tableName() + ":predict:" + property;
     }
@@ -0,0 +1,112 @@
+//
+// SQLiteKeyStore+SpatialIndexes.cc
+//
+// Copyright © 2018 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteKeyStore.hh"
+#include "SQLiteDataFile.hh"
+#include "QueryParser.hh"
+#include "Error.hh"
+#include "StringUtil.hh"
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+
+namespace litecore {
+
+    // Filters out rows whose bounding box isn't made of numbers, or is inside-out;
+    // an R-tree would otherwise coerce them to numbers, or fail the insert.
+    static constexpr const char* kValidBoxTest =
+        "typeof(minX) IN ('integer', 'real') AND typeof(maxX) IN ('integer', 'real') AND "
+        "typeof(minY) IN ('integer', 'real') AND typeof(maxY) IN ('integer', 'real') AND "
+        "minX <= maxX AND minY <= maxY";
+
+
+    // Creates a spatial index: an R-tree of each document's bounding box.
+    // <https://sqlite.org/rtree.html>
+    bool SQLiteKeyStore::createSpatialIndex(const IndexSpec &spec) {
+        auto spatialTableName = this->spatialTableName(spec.name);
+
+        // The WHAT clause is either a point (x, y) or a box (minX, minY, maxX, maxY):
+        QueryParser qp(*this);
+        qp.setBodyColumnName("new.body");
+        vector<string> exprs;
+        for (Array::iterator i(spec.what()); i; ++i)
+            exprs.push_back(qp.expressionSQL(i.value()));
+        if (exprs.size() == 2) {
+            exprs = {exprs[0], exprs[1], exprs[0], exprs[1]};
+        } else if (exprs.size() != 4) {
+            error::_throw(error::InvalidQuery,
+                          "A spatial index must have 2 (point) or 4 (box) expressions");
+        }
+        string columns = CONCAT("new.rowid AS docid, "
+                                << exprs[0] << " AS minX, " << exprs[2] << " AS maxX, "
+                                << exprs[1] << " AS minY, " << exprs[3] << " AS maxY");
+
+        auto where = spec.where();
+        qp.setBodyColumnName("body");
+        string whereNewSQL = qp.whereClauseSQL(where, "new");
+        string whereOldSQL = qp.whereClauseSQL(where, "old");
+
+        // Create the R-tree table:
+        string sql = CONCAT("CREATE VIRTUAL TABLE \"" << spatialTableName << "\" "
+                            "USING rtree(docid, minX, maxX, minY, maxY)");
+        if (!db().createIndex(spec, this, spatialTableName, sql))
+            return false;
+
+        // Index the existing records:
+        db().exec(CONCAT("INSERT INTO \"" << spatialTableName << "\" "
+                         "SELECT docid, minX, maxX, minY, maxY FROM "
+                         "(SELECT " << columns << " FROM kv_" << name() << " AS new "
+                         << whereNewSQL << ") WHERE " << kValidBoxTest));
+
+        // Set up triggers to keep the R-tree up to date
+        // ...on insertion:
+        string insertNewSQL = CONCAT("INSERT INTO \"" << spatialTableName << "\" "
+                                     "SELECT docid, minX, maxX, minY, maxY FROM "
+                                     "(SELECT " << columns << ") WHERE " << kValidBoxTest);
+        createTrigger(spatialTableName, "ins",
+                      "AFTER INSERT",
+                      whereNewSQL,
+                      insertNewSQL);
+
+        // ...on delete:
+        string deleteOldSQL = CONCAT("DELETE FROM \"" << spatialTableName
+                                     << "\" WHERE docid = old.rowid");
+        createTrigger(spatialTableName, "del",
+                      "AFTER DELETE",
+                      whereOldSQL,
+                      deleteOldSQL);
+
+        // ...on update:
+        createTrigger(spatialTableName, "preupdate",
+                      "BEFORE UPDATE OF body",
+                      whereOldSQL,
+                      deleteOldSQL);
+        createTrigger(spatialTableName, "postupdate",
+                      "AFTER UPDATE OF body",
+                      whereNewSQL,
+                      insertNewSQL);
+        return true;
+    }
+
+
+    string SQLiteKeyStore::spatialTableName(const std::string &indexName) const {
+        return tableName() + ":spatial:" + indexName;
+    }
+
+}
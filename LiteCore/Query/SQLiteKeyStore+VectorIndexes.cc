@@ -0,0 +1,323 @@
+//
+// SQLiteKeyStore+VectorIndexes.cc
+//
+// Copyright © 2018 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteKeyStore.hh"
+#include "SQLiteDataFile.hh"
+#include "QueryParser.hh"
+#include "Error.hh"
+#include "StringUtil.hh"
+#include "SQLiteCpp/SQLiteCpp.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
+
+using namespace std;
+using namespace fleece;
+using namespace fleece::impl;
+
+namespace litecore {
+
+    /*
+     A vector index is an inverted-file (IVF) index. When it's created, a sample of the vectors is
+     clustered with k-means. Then each vector is stored in the index table along with the number
+     ("bucket") of the cluster whose centroid is nearest to it. The table's primary key starts
+     with the bucket, so each cluster's vectors are stored together.
+
+     A query only computes the distances to the vectors in the few clusters whose centroids are
+     nearest to its target (see QueryParser::writeVectorProbes), instead of to every vector.
+     An index created before there are any vectors has a single placeholder bucket. The clusters
+     are retrained (see SQLiteDataFile::retrainVectorIndexes) once such an index has vectors, and
+     when the vectors have changed enough that one bucket is much bigger than the others.
+
+     Retraining adds the new clusters' centroids, with new bucket numbers, and marks the old ones
+     "retired". New vectors only go in the new buckets, while the vectors in retired buckets are
+     moved a batch at a time (see moveRetiredVectors); a retired centroid is deleted once its
+     bucket is empty. Until then queries can still probe it, so every vector remains findable.
+     The centroids table also records the number of vectors the index was trained on.
+     */
+
+    // Maximum number of clusters when the CENTROIDS term isn't given:
+    static constexpr size_t kMaxAutoCentroids = 256;
+
+    // Number of vectors, per cluster, sampled to compute the centroids:
+    static constexpr size_t kTrainingSamplesPerCentroid = 32;
+
+    // Maximum number of k-means iterations:
+    static constexpr int kMaxKMeansIterations = 10;
+
+
+    using Vector = vector<float>;
+
+    static vector<Vector> computeCentroids(vector<Vector> &samples, size_t k);
+
+
+    bool SQLiteKeyStore::createVectorIndex(const IndexSpec &spec) {
+        auto vectorTable = vectorTableName(spec.name);
+        auto centroidsTable = QueryParser::vectorCentroidsTableName(vectorTable);
+
+        Array::iterator iExprs(spec.what());
+        if (iExprs.count() != 1)
+            error::_throw(error::InvalidQuery, "A vector index must have exactly one expression");
+        QueryParser qp(*this);
+        qp.setBodyColumnName("new.body");
+        string vectorExpr = CONCAT("vector_encode(" << qp.expressionSQL(iExprs.value()) << ")");
+
+        auto where = spec.where();
+        qp.setBodyColumnName("body");
+        string whereNewSQL = qp.whereClauseSQL(where, "new");
+        string whereOldSQL = qp.whereClauseSQL(where, "old");
+
+        // Create the index table:
+        string sql = CONCAT("CREATE TABLE \"" << vectorTable << "\" "
+                            "(bucket INTEGER NOT NULL, "
+                            " docid INTEGER NOT NULL, "
+                            " vector BLOB NOT NULL, "
+                            " PRIMARY KEY (bucket, docid)) "
+                            "WITHOUT ROWID");
+        if (!db().createIndex(spec, this, vectorTable, sql))
+            return false;
+        db().exec(CONCAT("CREATE INDEX \"" << vectorTable << "::docid\" "
+                         "ON \"" << vectorTable << "\" (docid)"));
+
+        // Until the index is trained, a placeholder bucket (with no centroid) gets every vector:
+        db().exec(CONCAT("DROP TABLE IF EXISTS \"" << centroidsTable << "\""));
+        db().exec(CONCAT("CREATE TABLE \"" << centroidsTable << "\" "
+                         "(bucket INTEGER PRIMARY KEY, vector BLOB, "
+                         " retired INTEGER NOT NULL DEFAULT 0, trainedSize INTEGER)"));
+        db().exec(CONCAT("INSERT INTO \"" << centroidsTable << "\" (bucket) VALUES (0)"));
+
+        // The SQL that assigns a vector to its bucket and stores it:
+        stringstream centroidsTableStr;
+        QueryParser::writeSQLString(centroidsTableStr, slice(centroidsTable));
+        auto insertSQL = [&](const string &source) {
+            return CONCAT("INSERT INTO \"" << vectorTable << "\" (bucket, docid, vector) "
+                          "SELECT bucket, docid, vector FROM "
+                          "(SELECT vector_bucket(" << centroidsTableStr.str() << ", v) AS bucket, "
+                          "docid, v AS vector FROM "
+                          "(SELECT new.rowid AS docid, " << vectorExpr << " AS v" << source << ") "
+                          "WHERE v IS NOT NULL) "
+                          "WHERE bucket IS NOT NULL");
+        };
+
+        // Index the existing records:
+        db().exec(insertSQL(CONCAT(" FROM " << tableName() << " AS new " << whereNewSQL)));
+
+        // Set up triggers to keep the index up to date
+        // ...on insertion:
+        string insertNewSQL = insertSQL("");
+        createTrigger(vectorTable, "ins",
+                      "AFTER INSERT",
+                      whereNewSQL,
+                      insertNewSQL);
+
+        // ...on delete:
+        string deleteOldSQL = CONCAT("DELETE FROM \"" << vectorTable << "\" WHERE docid = old.rowid");
+        createTrigger(vectorTable, "del",
+                      "AFTER DELETE",
+                      whereOldSQL,
+                      deleteOldSQL);
+
+        // ...on update:
+        createTrigger(vectorTable, "preupdate",
+                      "BEFORE UPDATE OF body",
+                      whereOldSQL,
+                      deleteOldSQL);
+        createTrigger(vectorTable, "postupdate",
+                      "AFTER UPDATE OF body",
+                      whereNewSQL,
+                      insertNewSQL);
+
+        // Now cluster the vectors, and move them all to their clusters' buckets right away:
+        trainVectorIndex(spec);
+        moveRetiredVectors(spec, -1);
+        return true;
+    }
+
+
+    // Clusters a sample of a vector index's vectors with k-means, and replaces the index's
+    // centroids with the clusters', retiring the old ones. Vectors whose dimension differs from
+    // most of the others' can't be compared with the centroids, so they're dropped from the
+    // index, with a warning.
+    void SQLiteKeyStore::trainVectorIndex(const IndexSpec &spec) {
+        auto vectorTable = vectorTableName(spec.name);
+        auto centroidsTable = QueryParser::vectorCentroidsTableName(vectorTable);
+        unsigned nCentroids = spec.vectorCentroids();
+
+        // The most common vector size is the index's dimension:
+        int64_t vectorSize = 0;
+        {
+            SQLite::Statement select(db(), CONCAT("SELECT length(vector) AS size FROM \""
+                                                  << vectorTable << "\" GROUP BY size "
+                                                  "ORDER BY count(*) DESC LIMIT 1"));
+            if (select.executeStep())
+                vectorSize = select.getColumn(0).getInt64();
+        }
+        int dropped = db().exec(CONCAT("DELETE FROM \"" << vectorTable << "\" "
+                                       "WHERE length(vector) != " << vectorSize));
+        if (dropped > 0)
+            Warn("Vector index '%s' dropped %d vectors that don't have %zu dimensions",
+                 spec.name.c_str(), dropped, size_t(vectorSize) / sizeof(float));
+
+        // Sample the vectors, and cluster them:
+        size_t maxSamples = (nCentroids ? nCentroids : kMaxAutoCentroids)
+                                * kTrainingSamplesPerCentroid;
+        vector<Vector> samples;
+        size_t count = 0;
+        {
+            SQLite::Statement select(db(), CONCAT("SELECT vector FROM \"" << vectorTable << "\""));
+            minstd_rand random;     // deterministic, so the same data gets the same clusters
+            while (select.executeStep()) {
+                auto col = select.getColumn(0);
+                size_t dimension = col.getBytes() / sizeof(float);
+                // Reservoir sampling, so each vector is equally likely to be picked:
+                size_t slot = count++;
+                if (slot >= maxSamples) {
+                    slot = uniform_int_distribution<size_t>(0, slot)(random);
+                    if (slot >= maxSamples)
+                        continue;
+                }
+                Vector vec(dimension);
+                memcpy(vec.data(), col.getBlob(), dimension * sizeof(float));
+                if (slot < samples.size())
+                    samples[slot] = move(vec);
+                else
+                    samples.push_back(move(vec));
+            }
+        }
+        if (nCentroids == 0)
+            nCentroids = (unsigned)min(max(size_t(sqrt(double(count))), size_t(1)),
+                                       kMaxAutoCentroids);
+        vector<Vector> centroids = computeCentroids(samples, nCentroids);
+        LogTo(QueryLog, "Vector index '%s' has %zu vectors in %zu clusters",
+              spec.name.c_str(), count, centroids.size());
+
+        if (centroids.empty())
+            return;         // Nothing to train on; the current buckets stay
+
+        long long firstBucket = 0;
+        {
+            SQLite::Statement select(db(), CONCAT("SELECT max(bucket) FROM \""
+                                                  << centroidsTable << "\""));
+            if (select.executeStep())
+                firstBucket = select.getColumn(0).getInt64() + 1;
+        }
+        db().exec(CONCAT("UPDATE \"" << centroidsTable << "\" SET retired = 1"));
+        SQLite::Statement insert(db(), CONCAT("INSERT INTO \"" << centroidsTable
+                                              << "\" (bucket, vector, trainedSize) "
+                                              "VALUES (?, ?, ?)"));
+        for (size_t i = 0; i < centroids.size(); ++i) {
+            insert.bind(1, firstBucket + (long long)i);
+            insert.bindNoCopy(2, centroids[i].data(), int(centroids[i].size() * sizeof(float)));
+            insert.bind(3, (long long)count);
+            insert.exec();
+            insert.reset();
+        }
+    }
+
+
+    // Moves up to `limit` vectors (all of them if it's negative) from retired buckets to the
+    // buckets of their nearest current centroids, then deletes the retired centroids whose
+    // buckets are empty. Returns true if it moved or deleted anything.
+    bool SQLiteKeyStore::moveRetiredVectors(const IndexSpec &spec, int64_t limit) {
+        auto vectorTable = vectorTableName(spec.name);
+        auto centroidsTable = QueryParser::vectorCentroidsTableName(vectorTable);
+        stringstream centroidsTableStr;
+        QueryParser::writeSQLString(centroidsTableStr, slice(centroidsTable));
+        int moved = db().exec(CONCAT("UPDATE \"" << vectorTable << "\" SET bucket = "
+                                     "vector_bucket(" << centroidsTableStr.str() << ", vector) "
+                                     "WHERE docid IN (SELECT docid FROM \"" << vectorTable << "\" "
+                                     "WHERE bucket IN (SELECT bucket FROM \"" << centroidsTable
+                                     << "\" WHERE retired) LIMIT " << limit << ")"));
+        int deleted = db().exec(CONCAT("DELETE FROM \"" << centroidsTable << "\" "
+                                       "WHERE retired AND NOT EXISTS (SELECT 1 FROM \""
+                                       << vectorTable << "\" AS v "
+                                       "WHERE v.bucket = \"" << centroidsTable << "\".bucket)"));
+        return moved > 0 || deleted > 0;
+    }
+
+
+    string SQLiteKeyStore::vectorTableName(const std::string &indexName) const {
+        return tableName() + ":vector:" + indexName;
+    }
+
+
+    static float squaredDistance(const Vector &a, const Vector &b) {
+        float sum = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            float d = a[i] - b[i];
+            sum += d * d;
+        }
+        return sum;
+    }
+
+
+    // Clusters the sample vectors with Lloyd's k-means algorithm, returning up to k centroids.
+    static vector<Vector> computeCentroids(vector<Vector> &samples, size_t k) {
+        k = min(k, samples.size());
+        if (k == 0)
+            return {};
+        size_t dimension = samples[0].size();
+
+        // Start with k random samples as the centroids:
+        shuffle(samples.begin(), samples.end(), minstd_rand());
+        vector<Vector> centroids(samples.begin(), samples.begin() + k);
+
+        vector<size_t> assignment(samples.size(), SIZE_MAX);
+        for (int iteration = 0; iteration < kMaxKMeansIterations; ++iteration) {
+            // Assign each sample to its nearest centroid:
+            bool changed = false;
+            for (size_t s = 0; s < samples.size(); ++s) {
+                size_t best = 0;
+                float bestDistance = INFINITY;
+                for (size_t c = 0; c < k; ++c) {
+                    float d = squaredDistance(samples[s], centroids[c]);
+                    if (d < bestDistance) {
+                        bestDistance = d;
+                        best = c;
+                    }
+                }
+                if (best != assignment[s]) {
+                    assignment[s] = best;
+                    changed = true;
+                }
+            }
+            if (!changed)
+                break;
+
+            // Move each centroid to the mean of its samples (an empty cluster stays put):
+            vector<Vector> sums(k, Vector(dimension, 0.0f));
+            vector<size_t> counts(k, 0);
+            for (size_t s = 0; s < samples.size(); ++s) {
+                auto &sum = sums[assignment[s]];
+                for (size_t i = 0; i < dimension; ++i)
+                    sum[i] += samples[s][i];
+                ++counts[assignment[s]];
+            }
+            for (size_t c = 0; c < k; ++c) {
+                if (counts[c] == 0)
+                    continue;
+                for (size_t i = 0; i < dimension; ++i)
+                    centroids[c][i] = sums[c][i] / counts[c];
+            }
+        }
+        return centroids;
+    }
+
+}
@@ -507,21 +507,54 @@ namespace litecore {
 
     // contains(string, substring) returns 1 if `string` contains `substring`, else 0
     static void contains(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        bool result = ContainsUTF8(stringSliceArgument(argv[0]),
-                                   stringSliceArgument(argv[1]),
-                                   collationContextFromArg(ctx, argc, argv, 2));
+        slice str = stringSliceArgument(argv[0]), substr = stringSliceArgument(argv[1]);
+        auto &collation = collationContextFromArg(ctx, argc, argv, 2);
+        bool result;
+        if (collation.canCompareASCII && isASCII(str) && isASCII(substr))
+            result = ASCIIFind(str, substr, collation.caseSensitive) != nullptr;
+        else
+            result = ContainsUTF8(str, substr, collation);
         sqlite3_result_int(ctx, result);
     }
 
 
     // like() implements the LIKE match
     static void like(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
-        const int likeResult = LikeUTF8(valueAsStringSlice(argv[0]), valueAsStringSlice(argv[1]),
-                                        collationContextFromArg(ctx, argc, argv, 2));
+        slice comparand = valueAsStringSlice(argv[0]), pattern = valueAsStringSlice(argv[1]);
+        auto &collation = collationContextFromArg(ctx, argc, argv, 2);
+        int likeResult;
+        if (collation.canCompareASCII && isASCII(comparand) && isASCII(pattern))
+            likeResult = LikeASCII(comparand, pattern, collation.caseSensitive);
+        else
+            likeResult = LikeUTF8(comparand, pattern, collation);
         sqlite3_result_int(ctx, likeResult == kLikeMatch);
     }
 
 
+    // fl_sortkey(value, collation, version) returns the collation's sort key of a string, as a
+    // blob, so strings can be compared (and indexed) as plain bytes. Other values are returned
+    // as-is; they still sort before all the strings, as numbers sort before blobs.
+    // The version (see CollationSortKeyVersion) isn't used here, but it's part of the SQL of any
+    // index of sort keys, so that a query written with a different collator version won't match
+    // that index's expression and use its stale keys.
+    static void fl_sortkey(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
+        if (sqlite3_value_type(argv[0]) != SQLITE_TEXT) {
+            sqlite3_result_value(ctx, argv[0]);
+            return;
+        }
+        try {
+            alloc_slice key = CollationSortKey(valueAsStringSlice(argv[0]),
+                                               collationContextFromArg(ctx, argc, argv, 1));
+            if (!key)
+                sqlite3_result_error(ctx, "fl_sortkey: sort keys are not supported", -1);
+            else
+                setResultBlobFromData(ctx, key);
+        } catch (const std::exception &) {
+            sqlite3_result_error(ctx, "fl_sortkey: exception!", -1);
+        }
+    }
+
+
     // length() returns the length in characters of a string.
     static void length(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         auto str = stringSliceArgument(argv[0]);
@@ -532,8 +565,12 @@ namespace litecore {
     static void changeCase(sqlite3_context* ctx, sqlite3_value **argv, bool isUpper) noexcept {
         try {
             auto str = stringSliceArgument(argv[0]);
-            if (str)
-                result_alloc_slice(ctx, UTF8ChangeCase(str, isUpper));
+            if (str) {
+                if (isASCII(str))
+                    result_alloc_slice(ctx, ASCIIChangeCase(str, isUpper));
+                else
+                    result_alloc_slice(ctx, UTF8ChangeCase(str, isUpper));
+            }
         } catch (const std::exception &) {
             sqlite3_result_error(ctx, "upper() or lower() caught an exception!", -1);
         }
@@ -556,6 +593,13 @@ namespace litecore {
                 sqlite3_result_value(ctx, arg);
                 return;
             }
+            slice str = valueAsStringSlice(arg);
+            if (isASCII(str)) {
+                // Only ASCII whitespace can be trimmed, so there's no need to convert to UTF-16:
+                ASCIITrim(str, onSide);
+                setResultTextFromSlice(ctx, str);
+                return;
+            }
             auto chars = (const char16_t*)sqlite3_value_text16(arg);
             size_t count = sqlite3_value_bytes16(arg) / 2;
             UTF16Trim(chars, count, onSide);
@@ -658,13 +702,89 @@ namespace litecore {
 #pragma mark - REGULAR EXPRESSIONS:
 
 
+    // A compiled regex pattern. It's cached as SQLite auxdata of the pattern argument, so when
+    // the pattern is a literal or a bound parameter it's compiled only once per statement instead
+    // of once per row. A pattern with no metacharacters is matched as a plain substring, which
+    // avoids std::regex entirely.
+    class CachedRegex {
+    public:
+        explicit CachedRegex(slice pattern)
+        :_pattern(pattern)
+        ,_isLiteral(isLiteralPattern(pattern))
+        {
+            if (!_isLiteral)
+                _regex.assign((const char*)pattern.buf, pattern.size,
+                              regex_constants::ECMAScript | regex_constants::optimize);
+        }
+
+        bool isLiteral() const                  {return _isLiteral;}
+        const string& pattern() const           {return _pattern;}
+        const std::regex& regex() const         {return _regex;}
+
+        // Finds the first match in `str`; returns its byte offset, or -1 if not found.
+        int64_t search(slice str) const {
+            if (_isLiteral) {
+                auto pos = string_view((const char*)str.buf, str.size).find(_pattern);
+                return (pos == string_view::npos) ? -1 : int64_t(pos);
+            } else {
+                cmatch match;
+                if (!regex_search((const char*)str.buf, (const char*)str.end(), match, _regex))
+                    return -1;
+                return match.prefix().length();
+            }
+        }
+
+        // Returns the CachedRegex for argument `argNo`, creating and caching it if necessary.
+        // On failure (invalid pattern) sets a SQLite error result and returns nullptr.
+        static const CachedRegex* fromArg(sqlite3_context *ctx, sqlite3_value **argv, int argNo,
+                                          slice pattern) noexcept
+        {
+            auto cached = (CachedRegex*)sqlite3_get_auxdata(ctx, argNo);
+            if (cached)
+                return cached;
+            try {
+                cached = new CachedRegex(pattern);
+            } catch (const std::regex_error &x) {
+                string message = format("Invalid regular expression: %s", x.what());
+                sqlite3_result_error(ctx, message.c_str(), -1);
+                return nullptr;
+            } catch (const std::exception &) {
+                sqlite3_result_error_nomem(ctx);
+                return nullptr;
+            }
+            sqlite3_set_auxdata(ctx, argNo, cached, [](void *aux) {
+                delete (CachedRegex*)aux;
+            });
+            // SQLite deletes the auxdata immediately if it runs out of memory, so look it up
+            // again instead of using `cached`:
+            cached = (CachedRegex*)sqlite3_get_auxdata(ctx, argNo);
+            if (!cached)
+                sqlite3_result_error_nomem(ctx);
+            return cached;
+        }
+
+    private:
+        static bool isLiteralPattern(slice pattern) {
+            for (size_t i = 0; i < pattern.size; ++i) {
+                if (strchr("^$\\.*+?()[]{}|", pattern[i]) != nullptr)
+                    return false;       // (also catches a NUL byte)
+            }
+            return true;
+        }
+
+        string const _pattern;
+        bool const   _isLiteral;
+        std::regex   _regex;
+    };
+
+
     static void regexp_like(sqlite3_context* ctx, int argc, sqlite3_value **argv) noexcept {
         auto str = stringSliceArgument(argv[0]);
         auto pattern = stringSliceArgument(argv[1]);
         if (str && pattern) {
-            regex r((const char*)pattern.buf, pattern.size, regex_constants::ECMAScript);
-            bool result = regex_search((const char*)str.buf, (const char*)str.end(), r);
-            sqlite3_result_int(ctx, result != 0);
+            auto r = CachedRegex::fromArg(ctx, argv, 1, pattern);
+            if (r)
+                sqlite3_result_int(ctx, r->search(str) >= 0);
         }
     }
 
@@ -672,14 +792,9 @@ namespace litecore {
         auto str = stringSliceArgument(argv[0]);
         auto pattern = stringSliceArgument(argv[1]);
         if (str && pattern) {
-            regex r((const char*)pattern.buf, pattern.size, regex_constants::ECMAScript);
-            cmatch pattern_match;
-            if(!regex_search((const char*)str.buf, (const char*)str.end(), pattern_match, r)) {
-                sqlite3_result_int64(ctx, -1);
-                return;
-            }
-
-            sqlite3_result_int64(ctx, pattern_match.prefix().length());
+            auto r = CachedRegex::fromArg(ctx, argv, 1, pattern);
+            if (r)
+                sqlite3_result_int64(ctx, r->search(str));
         }
     }
 
@@ -693,24 +808,51 @@ namespace litecore {
                 n = sqlite3_value_int(argv[3]);
             }
 
-            regex r((const char*)pattern.buf, pattern.size, regex_constants::ECMAScript);
-            string s(str);
-            auto iter = sregex_iterator(s.begin(), s.end(), r);
-            auto last_iter = iter;
-            auto stop = sregex_iterator();
-            if (iter == stop) {
-                sqlite3_result_value(ctx, argv[0]);
-            } else {
-                string result;
-                auto out = back_inserter(result);
-                for(; n-- && iter != stop; ++iter) {
-                    out = copy(iter->prefix().first, iter->prefix().second, out);
-                    out = iter->format(out, (const char*)replacement.buf, (const char*)replacement.end());
-                    last_iter = iter;
+            auto r = CachedRegex::fromArg(ctx, argv, 1, pattern);
+            if (!r)
+                return;
+            try {
+                if (r->isLiteral() && pattern.size > 0 && !replacement.findByte('$')) {
+                    // Fast path: literal pattern and no '$' substitutions in the replacement:
+                    string_view s((const char*)str.buf, str.size);
+                    const string &literal = r->pattern();
+                    size_t pos = s.find(literal);
+                    if (pos == string_view::npos) {
+                        sqlite3_result_value(ctx, argv[0]);
+                        return;
+                    }
+                    string result;
+                    size_t start = 0;
+                    for (; n-- && pos != string_view::npos; pos = s.find(literal, start)) {
+                        result.append(s.substr(start, pos - start));
+                        result.append((const char*)replacement.buf, replacement.size);
+                        start = pos + literal.size();
+                    }
+                    result.append(s.substr(start));
+                    sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
+                    return;
                 }
 
-                out = copy(last_iter->suffix().first, last_iter->suffix().second, out);
-                sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
+                string s(str);
+                auto iter = sregex_iterator(s.begin(), s.end(), r->regex());
+                auto last_iter = iter;
+                auto stop = sregex_iterator();
+                if (iter == stop) {
+                    sqlite3_result_value(ctx, argv[0]);
+                } else {
+                    string result;
+                    auto out = back_inserter(result);
+                    for(; n-- && iter != stop; ++iter) {
+                        out = copy(iter->prefix().first, iter->prefix().second, out);
+                        out = iter->format(out, (const char*)replacement.buf, (const char*)replacement.end());
+                        last_iter = iter;
+                    }
+
+                    out = copy(last_iter->suffix().first, last_iter->suffix().second, out);
+                    sqlite3_result_text(ctx, result.c_str(), (int)result.size(), SQLITE_TRANSIENT);
+                }
+            } catch (const std::exception &) {
+                sqlite3_result_error(ctx, "regexp_replace() caught an exception!", -1);
             }
         }
     }
@@ -1242,6 +1384,7 @@ namespace litecore {
 
         { "fl_like",           2, like },
         { "fl_like",           3, like },
+        { "fl_sortkey",        3, fl_sortkey },
 
         { "regexp_contains",   2, regexp_like, },
         { "regexp_like",       2, regexp_like },
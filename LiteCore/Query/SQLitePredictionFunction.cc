@@ -63,7 +63,9 @@ namespace litecore {
             }
 
             C4Error error = {};
-            alloc_slice result = model->prediction((const Dict*)input, getDBDelegate(ctx), &error);
+            const char *dbPath = sqlite3_db_filename(sqlite3_context_db_handle(ctx), "main");
+            alloc_slice result = model->cachedPrediction((const Dict*)input, getDBDelegate(ctx),
+                                                         (dbPath ? dbPath : ""), &error);
             if (!result) {
                 if (error.code == 0) {
                     LogVerbose(QueryLog, "    ...prediction returned no result");
@@ -19,6 +19,7 @@
 #include "SQLiteKeyStore.hh"
 #include "SQLiteDataFile.hh"
 #include "SQLite_Internal.hh"
+#include "SQLiteFleeceUtil.hh"
 #include "Logging.hh"
 #include "Query.hh"
 #include "QueryParser.hh"
@@ -27,16 +28,22 @@
 #include "StringUtil.hh"
 #include "FleeceImpl.hh"
 #include "MutableDict.hh"
+#include "fleece/Mutable.hh"
 #include "Path.hh"
 #include "Stopwatch.hh"
+#include "SecureDigest.hh"
+#include "Channel.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include <sqlite3.h>
+#include <algorithm>
+#include <cctype>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <iostream>
-
-extern "C" {
-#include "sqlite3_unicodesn_tokenizer.h"        // for unicodesn_tokenizerRunningQuery()
-}
+#include <thread>
 
 using namespace std;
 using namespace fleece::impl;
@@ -53,6 +60,39 @@ namespace litecore {
     };
 
 
+    // Prepares a statement, and returns its sqlite3_stmt in `outHandle`. SQLiteCpp doesn't
+    // expose the handle, so it's identified as the connection's one statement with this SQL that
+    // didn't exist before `compile` was called. (A connection is only used by one thread at a
+    // time, so no other statement can be prepared on it meanwhile.) Callers keep the handle with
+    // the statement, so this happens only once per statement.
+    template <class STMT, class FN>
+    static STMT compileWithHandle(SQLiteDataFile &df, const string &sql,
+                                  sqlite3_stmt* &outHandle, FN compile)
+    {
+        sqlite3 *db = ((SQLite::Database&)df).getHandle();
+        auto withSameSQL = [&] {
+            vector<sqlite3_stmt*> stmts;
+            for (auto stmt = sqlite3_next_stmt(db, nullptr); stmt; stmt = sqlite3_next_stmt(db, stmt)) {
+                if (sql == sqlite3_sql(stmt))
+                    stmts.push_back(stmt);
+            }
+            return stmts;
+        };
+        auto before = withSameSQL();
+        STMT statement = compile();
+        outHandle = nullptr;
+        for (auto stmt : withSameSQL()) {
+            if (find(before.begin(), before.end(), stmt) == before.end()) {
+                outHandle = stmt;
+                break;
+            }
+        }
+        if (!outHandle)
+            error::_throw(error::UnexpectedError, "Can't find compiled query statement");
+        return statement;
+    }
+
+
     class SQLiteQuery : public Query {
     public:
         SQLiteQuery(SQLiteKeyStore &keyStore, slice queryStr, QueryLanguage language)
@@ -61,32 +101,26 @@ namespace litecore {
             static constexpr const char* kLanguageName[] = {"JSON", "N1QL"};
             logInfo("Compiling %s query: %.*s", kLanguageName[(int)language], SPLAT(queryStr));
 
+            QueryParser qp(keyStore);
             switch (language) {
                 case QueryLanguage::kJSON:
                     _json = queryStr;
+                    qp.parseJSON(_json);
                     break;
                 case QueryLanguage::kN1QL: {
                     unsigned errPos;
-                    FLMutableDict result = n1ql::parse(string(queryStr), &errPos);
-                    if (!result)
+                    FLMutableDict tree = n1ql::parse(string(queryStr), &errPos);
+                    if (!tree)
                         throw Query::parseError("N1QL syntax error", errPos);
-                    _json = ((MutableDict*)result)->toJSON(true);
-                    FLMutableDict_Release(result);
+                    _n1qlTree = tree;
+                    FLMutableDict_Release(tree);
+                    // Compile the parser's tree directly; its JSON form is only generated if
+                    // something asks for it (see json()), which saves encoding & re-parsing it.
+                    qp.parse((MutableDict*)n1qlTree());
                     break;
                 }
             }
 
-            QueryParser qp(keyStore);
-            qp.parseJSON(_json);
-
-            _parameters = qp.parameters();
-            for (auto p = _parameters.begin(); p != _parameters.end();) {
-                if (hasPrefix(*p, "opt_"))
-                    p = _parameters.erase(p);       // Optional param, don't warn if it's unbound
-                else
-                    ++p;
-            }
-
             _ftsTables = qp.ftsTablesUsed();
             for (auto ftsTable : _ftsTables) {
                 if (!keyStore.db().tableExists(ftsTable))
@@ -99,17 +133,37 @@ namespace litecore {
             string sql = qp.SQL();
             logInfo("Compiled as %s", sql.c_str());
             LogTo(SQL, "Compiled {Query#%u}: %s", getObjectRef(), sql.c_str());
-            _statement.reset(keyStore.compile(sql));
-            
+            _statement.reset(compileWithHandle<SQLite::Statement*>(keyStore.db(), sql,
+                                                                   _statementHandle, [&] {
+                return keyStore.compile(sql);
+            }));
+            resolveParameters(qp.parameters());
+
             _1stCustomResultColumn = qp.firstCustomResultColumn();
             _columnTitles = qp.columnTitles();
+
+            if (auto keyset = qp.keyset()) {
+                _keyset.reset(new QueryParser::Keyset(*keyset));
+                // Identifies this query in continuation tokens, so one can't be used with another:
+                _keysetDigest = alloc_slice(slice(SHA1(slice(sql))));
+            }
+            if (auto partial = qp.partialAggregation())
+                _partialAggregation.reset(new QueryParser::PartialAggregation(*partial));
         }
 
 
         virtual void close() override {
             logInfo("Closing query (db is closing)");
+            {
+                lock_guard<mutex> lock(_planMutex);
+                _statementHandle = nullptr;
+            }
             _statement.reset();
             _matchedTextStatement.reset();
+            {
+                lock_guard<mutex> lock(_continuationsMutex);
+                _continuations.clear();
+            }
             Query::close();
         }
 
@@ -172,30 +226,182 @@ namespace litecore {
                 result << " " << x.getColumn(3).getText() << "\n";
             }
 
-            result << '\n' << _json << '\n';
+            result << '\n' << json() << '\n';
             return result.str();
         }
 
+        // Returns the detail column of each row of the query plan.
+        vector<string> queryPlan() {
+            vector<string> plan;
+            auto &df = (SQLiteDataFile&) keyStore().dataFile();
+            SQLite::Statement x(df, "EXPLAIN QUERY PLAN " + statement()->getQuery());
+            while (x.executeStep())
+                plan.push_back(x.getColumn(3).getText());
+            return plan;
+        }
+
         QueryEnumerator* createEnumerator(const Options *options) override;
+        Retained<ColumnarResult> runColumnar(const Options *options) override;
+        alloc_slice saveResults(QueryEnumerator*) override;
+        QueryEnumerator* restoreResults(slice savedResults, const Options *options) override;
+
+        void logSlowQuery(double elapsedTime, uint64_t rowCount) {
+            string plan;
+            try {
+                plan = explain();
+            } catch (...) { }
+            warn("Slow query took %.3fms to return %llu rows:\n%s",
+                 elapsedTime * 1000, (unsigned long long)rowCount, plan.c_str());
+        }
 
-        shared_ptr<SQLite::Statement> statement() const {
+        // Adds a run to the database's query workload, if it's being recorded, and checks
+        // whether the query's plan has changed.
+        void recordWorkload(double elapsedTime, uint64_t fullScanSteps) {
+            checkPlan();
+            auto &workload = ((SQLiteDataFile&)keyStore().dataFile()).queryWorkload();
+            if (workload.recording())
+                workload.record(keyStore().name(), statement()->getQuery(), json(),
+                                fullScanSteps, elapsedTime, [&] {return queryPlan();});
+        }
+
+        using Query::addStatistics;
+
+        shared_ptr<SQLite::Statement> statement(sqlite3_stmt* *outHandle =nullptr) const {
             if (!_statement)
                 error::_throw(error::NotOpen);
+            if (outHandle)
+                *outHandle = _statementHandle;
             return _statement;
         }
 
+        // Returns the query restricted to the rows after those of a previous run, given the
+        // token returned by its enumerator's continuation() method, and the key values in the
+        // token that have to be bound to it (see QueryParser::Keyset::keyParameter.) Only the
+        // pattern of null keys changes the SQL, so the statements are compiled once and cached.
+        shared_ptr<SQLite::Statement> continuationStatement(slice token,
+                                                            sqlite3_stmt* &outHandle,
+                                                            const Array* &outLastKeys) const {
+            if (!_keyset)
+                error::_throw(error::UnsupportedOperation,
+                              "Query can't be paged; it needs ORDER_BY and LIMIT");
+            const Value *root = Value::fromData(token);
+            const Array *array = root ? root->asArray() : nullptr;
+            if (!array || array->count() != 2 || array->get(0)->asData() != _keysetDigest)
+                error::_throw(error::InvalidParameter, "Invalid query continuation");
+            outLastKeys = array->get(1)->asArray();
+            string sql = _keyset->continuationSQL(outLastKeys);
+
+            lock_guard<mutex> lock(_continuationsMutex);
+            auto &continuation = _continuations[sql];
+            if (!continuation.statement) {
+                LogTo(SQL, "Continuing {Query#%u}: %s", getObjectRef(), sql.c_str());
+                auto &sqliteKeyStore = (SQLiteKeyStore&)keyStore();
+                continuation.statement = compileWithHandle<shared_ptr<SQLite::Statement>>(
+                                                sqliteKeyStore.db(), sql, continuation.handle, [&] {
+                    return shared_ptr<SQLite::Statement>(sqliteKeyStore.compile(sql));
+                });
+            }
+            outHandle = continuation.handle;
+            return continuation.statement;
+        }
+
         unsigned objectRef() const                  {return getObjectRef();}   // (for logging)
 
-        set<string> _parameters;            // Names of the bindable parameters
+        // A bindable parameter, with its SQLite parameter index
+        struct Parameter {
+            string name;
+            int    index;
+            bool   optional;        // Optional params ("opt_" prefix) aren't warned about if unbound
+        };
+
+        const Parameter* findParameter(slice name) const {
+            for (auto &param : _parameters) {
+                if (name == slice(param.name))
+                    return &param;
+            }
+            return nullptr;
+        }
+
+        vector<Parameter> _parameters;      // The bindable parameters
+        unsigned _requiredParameterCount {0};
         vector<string> _ftsTables;          // Names of the FTS tables used
         unsigned _1stCustomResultColumn;    // Column index of the 1st column declared in JSON
+        unique_ptr<QueryParser::Keyset> _keyset;    // Keyset pagination info, if pageable
+        alloc_slice _keysetDigest;          // Digest of the SQL, for continuation tokens
+        struct Continuation {
+            shared_ptr<SQLite::Statement> statement;
+            sqlite3_stmt* handle {nullptr};
+        };
+        mutable map<string, Continuation> _continuations;   // Compiled continuations, by SQL
+        mutable mutex _continuationsMutex;
+        unique_ptr<QueryParser::PartialAggregation> _partialAggregation; // For parallel runs
 
     protected:
         ~SQLiteQuery() =default;
         string loggingClassName() const override    {return "Query";}
 
     private:
-        alloc_slice _json;                                  // Original JSON form of the query
+        // Looks up the SQLite indexes of the parameters once, so binding needn't do it by name.
+        void resolveParameters(const set<string> &names) {
+            for (const string &name : names) {
+                int index = sqlite3_bind_parameter_index(_statementHandle, ("$_" + name).c_str());
+                if (index == 0)
+                    continue;
+                bool optional = hasPrefix(name, "opt_");
+                _parameters.push_back({name, index, optional});
+                if (!optional)
+                    ++_requiredParameterCount;
+            }
+        }
+
+        // Records the query's plan the first time it runs. SQLite re-plans a statement when it
+        // re-prepares it, after the schema or the statistics (see DataFile::refreshStatistics)
+        // change; then the new plan is recorded, and logged if it differs from the old one.
+        // A new plan that does more full table scans is probably a regression, so it's a warning.
+        void checkPlan() {
+            lock_guard<mutex> lock(_planMutex);
+            if (!_statementHandle)
+                return;
+            int reprepareCount = sqlite3_stmt_status(_statementHandle,
+                                                     SQLITE_STMTSTATUS_REPREPARE, false);
+            if (!_plan.empty() && reprepareCount == _planReprepareCount)
+                return;
+            vector<string> plan = queryPlan();
+            if (!_plan.empty() && plan != _plan) {
+                auto fullScans = [](const vector<string> &lines) {
+                    return count_if(lines.begin(), lines.end(), [](const string &line) {
+                        return hasPrefix(line, "SCAN ") && line.find(" INDEX ") == string::npos
+                                                        && line.find("CONSTANT ROW") == string::npos;
+                    });
+                };
+                string was = join(_plan, "; "), now = join(plan, "; ");
+                if (fullScans(plan) > fullScans(_plan))
+                    warn("Query plan regressed to more full scans: was {%s}, now {%s}",
+                         was.c_str(), now.c_str());
+                else
+                    logInfo("Query plan changed: was {%s}, now {%s}", was.c_str(), now.c_str());
+            }
+            _plan = move(plan);
+            _planReprepareCount = reprepareCount;
+        }
+
+        // The JSON form of the query. For a N1QL query it's generated lazily from the parse tree.
+        alloc_slice json() const {
+            lock_guard<mutex> lock(_jsonMutex);
+            if (!_json && n1qlTree())
+                _json = ((MutableDict*)n1qlTree())->toJSON(true);
+            return _json;
+        }
+
+        FLMutableDict n1qlTree() const                     {return _n1qlTree;}
+
+        mutable alloc_slice _json;                          // JSON form of the query (see json())
+        ::fleece::MutableDict _n1qlTree;                    // N1QL parser's output, if N1QL
+        mutable mutex _jsonMutex;
+        sqlite3_stmt* _statementHandle {nullptr};          // _statement's SQLite handle
+        vector<string> _plan;                               // Plan, as of its first/latest run
+        int _planReprepareCount {0};                        // _statementHandle's re-prepares then
+        mutex _planMutex;
         shared_ptr<SQLite::Statement> _statement;           // Compiled SQLite statement
         unique_ptr<SQLite::Statement> _matchedTextStatement;// Gets the matched text
         vector<string> _columnTitles;                       // Titles of columns
@@ -220,21 +426,42 @@ namespace litecore {
         ,Logging(QueryLog)
         ,_recording(recording)
         ,_iter(_recording->asArray())
+        ,_rowCount(rowCount)
         ,_1stCustomResultColumn(query->_1stCustomResultColumn)
         ,_hasFullText(!query->_ftsTables.empty())
+        ,_keysetDigest(query->_keysetDigest)
         {
+            if (query->_keyset) {
+                _keysetColumn = query->_keyset->firstColumn;
+                _keysetCount = (unsigned)query->_keyset->keys.size();
+            }
             logInfo("Created on {Query#%u} with %llu rows (%zu bytes) in %.3fms",
                 query->objectRef(), rowCount, recording->data().size, elapsedTime*1000);
         }
 
+        SQLiteQueryEnumerator(const SQLiteQueryEnumerator &other)
+        :QueryEnumerator(&other._options, other._lastSequence, other._purgeCount)
+        ,Logging(QueryLog)
+        ,_recording(other._recording)
+        ,_iter(_recording->asArray())
+        ,_rowCount(other._rowCount)
+        ,_1stCustomResultColumn(other._1stCustomResultColumn)
+        ,_hasFullText(other._hasFullText)
+        ,_keysetDigest(other._keysetDigest)
+        ,_keysetColumn(other._keysetColumn)
+        ,_keysetCount(other._keysetCount)
+        { }
+
         ~SQLiteQueryEnumerator() {
             logInfo("Deleted");
         }
 
         virtual int64_t getRowCount() const override {
-            return _recording->asArray()->count() / 2;  // (every other row is a column bitmap)
+            return _rowCount;      // (a count-only run has a count but no recorded rows)
         }
 
+        Doc* recording() const                      {return _recording;}
+
         virtual void seek(int64_t rowIndex) override {
            auto rows = _recording->asArray();
            rowIndex *= 2;
@@ -277,6 +504,30 @@ namespace litecore {
         }
 
 
+        // The token is a Fleece array: [query digest, [last row's sort keys...]]
+        alloc_slice continuation() const override {
+            if (!_keysetDigest)
+                error::_throw(error::UnsupportedOperation,
+                              "Query can't be paged; it needs ORDER_BY and LIMIT");
+            if (_options.countOnly)
+                error::_throw(error::UnsupportedOperation,
+                              "A count-only query run has no rows to continue after");
+            auto rows = _recording->asArray();
+            if (rows->empty())
+                return nullslice;
+            auto lastRow = rows->get(rows->count() - 2)->asArray();
+            Encoder enc;
+            enc.beginArray(2);
+            enc.writeData(_keysetDigest);
+            enc.beginArray(_keysetCount);
+            for (unsigned i = 0; i < _keysetCount; ++i)
+                enc.writeValue(lastRow->get(_keysetColumn + i));
+            enc.endArray();
+            enc.endArray();
+            return enc.finish();
+        }
+
+
         virtual bool obsoletedBy(const QueryEnumerator *otherE) override {
             if (!otherE)
                 return false;
@@ -290,7 +541,8 @@ namespace litecore {
 
             if (other->lastSequence() <= _lastSequence) {
                 return false;
-            } else if (_recording->data() == other->_recording->data()) {
+            } else if (_recording->data() == other->_recording->data()
+                            && _rowCount == other->_rowCount) {
                 _lastSequence = (sequence_t)other->_lastSequence;
                 _purgeCount = (uint64_t)other->_purgeCount;
                 return false;
@@ -311,6 +563,10 @@ namespace litecore {
             return nullptr;
         }
 
+        QueryEnumerator* clone() override {
+            return new SQLiteQueryEnumerator(*this);
+        }
+
         bool hasFullText() const override {
             return _hasFullText;
         }
@@ -319,15 +575,24 @@ namespace litecore {
             _fullTextTerms.clear();
             uint64_t dataSource = _iter->asArray()->get(kFTSRowidCol)->asInt();
             // The offsets() function returns a string of space-separated numbers in groups of 4.
-            string offsets = _iter->asArray()->get(kFTSOffsetsCol)->asString().asString();
-            const char *termStr = offsets.c_str();
-            while (*termStr) {
+            // It's parsed in place, since there's one for every row of a full-text query.
+            slice offsets = _iter->asArray()->get(kFTSOffsetsCol)->asString();
+            auto pos = (const uint8_t*)offsets.buf, end = (const uint8_t*)offsets.end();
+            auto skipSpaces = [&] {
+                while (pos < end && !isdigit(*pos))
+                    ++pos;
+            };
+            auto readNumber = [&] {
+                skipSpaces();
+                uint32_t n = 0;
+                for (; pos < end && isdigit(*pos); ++pos)
+                    n = 10 * n + (*pos - '0');
+                return n;
+            };
+            for (skipSpaces(); pos < end; skipSpaces()) {
                 uint32_t n[4];
-                for (int i = 0; i < 4; ++i) {
-                    char *next;
-                    n[i] = (uint32_t)strtol(termStr, &next, 10);
-                    termStr = next;
-                }
+                for (int i = 0; i < 4; ++i)
+                    n[i] = readNumber();
                 _fullTextTerms.push_back({dataSource, n[0], n[1], n[2], n[3]});
                 // {rowid, key #, term #, byte offset, byte length}
             }
@@ -340,9 +605,460 @@ namespace litecore {
     private:
         Retained<Doc> _recording;
         Array::iterator _iter;
+        int64_t _rowCount;
         unsigned _1stCustomResultColumn;    // Column index of the 1st column declared in JSON
         bool _hasFullText;
         bool _first {true};
+        alloc_slice _keysetDigest;          // Query's digest, if it's pageable
+        unsigned _keysetColumn {0};         // Column index of the 1st sort key
+        unsigned _keysetCount {0};          // Number of sort key columns
+    };
+
+
+
+    // Snapshot of a statement's SQLite performance counters (see sqlite3_stmt_status.)
+    class StatementCounters {
+    public:
+        explicit StatementCounters(sqlite3_stmt *stmt)
+        :_stmt(stmt)
+        ,_fullScanSteps(get(SQLITE_STMTSTATUS_FULLSCAN_STEP))
+        ,_sortOperations(get(SQLITE_STMTSTATUS_SORT))
+        ,_autoIndexRows(get(SQLITE_STMTSTATUS_AUTOINDEX))
+        ,_vmSteps(get(SQLITE_STMTSTATUS_VM_STEP))
+        { }
+
+        // Stores the counters' increase since this object was created.
+        void getDeltas(Query::Statistics &stats) const {
+            stats.fullScanSteps  = get(SQLITE_STMTSTATUS_FULLSCAN_STEP) - _fullScanSteps;
+            stats.sortOperations = get(SQLITE_STMTSTATUS_SORT) - _sortOperations;
+            stats.autoIndexRows  = get(SQLITE_STMTSTATUS_AUTOINDEX) - _autoIndexRows;
+            stats.vmSteps        = get(SQLITE_STMTSTATUS_VM_STEP) - _vmSteps;
+        }
+
+    private:
+        uint64_t get(int op) const {
+            return _stmt ? sqlite3_stmt_status(_stmt, op, false) : 0;
+        }
+
+        sqlite3_stmt* const _stmt;
+        uint64_t const _fullScanSteps, _sortOperations, _autoIndexRows, _vmSteps;
+    };
+
+
+
+#pragma mark - INTERRUPTION:
+
+
+    // Number of SQLite virtual-machine operations between checks for cancellation or timeout.
+    static constexpr int kInterruptCheckInterval = 1000;
+
+
+    // Decides when a query run should stop, given its Options' cancellation and timeout.
+    // The timeout is measured from when the QueryInterrupter is created.
+    class QueryInterrupter {
+    public:
+        explicit QueryInterrupter(const Query::Options &options)
+        :_cancellation(options.cancellation)
+        ,_timeout(options.timeout)
+        { }
+
+        bool enabled() const                {return _cancellation || _timeout > 0;}
+
+        bool canceled() const               {return _cancellation && _cancellation->canceled();}
+        bool timedOut() const               {return _timeout > 0 && _timer.elapsed() >= _timeout;}
+        bool shouldStop() const             {return canceled() || timedOut();}
+
+        // Throws QueryCanceled or QueryTimeout if the run should stop.
+        void check() const {
+            if (canceled())
+                error::_throw(error::QueryCanceled);
+            else if (timedOut())
+                error::_throw(error::QueryTimeout);
+        }
+
+    private:
+        Retained<QueryCancellation> _cancellation;
+        double _timeout;
+        fleece::Stopwatch _timer;
+    };
+
+
+    // Installs a SQLite progress handler on a connection, for the lifetime of this object, that
+    // interrupts its statements when a QueryInterrupter says to stop. (Stepping an interrupted
+    // statement throws SQLITE_INTERRUPT; the caller should then call QueryInterrupter::check.)
+    class InterruptHandler {
+    public:
+        InterruptHandler(SQLiteDataFile &df, const QueryInterrupter &interrupter)
+        :_db(interrupter.enabled() ? ((SQLite::Database&)df).getHandle() : nullptr)
+        {
+            if (_db)
+                sqlite3_progress_handler(_db, kInterruptCheckInterval, &progress,
+                                         (void*)&interrupter);
+        }
+
+        ~InterruptHandler() {
+            if (_db)
+                sqlite3_progress_handler(_db, 0, nullptr, nullptr);
+        }
+
+    private:
+        static int progress(void *context) noexcept {
+            return ((const QueryInterrupter*)context)->shouldStop();
+        }
+
+        sqlite3* const _db;
+    };
+
+
+
+#pragma mark - PARALLEL AGGREGATION:
+
+
+    // Minimum number of rowids for each thread of a parallel run to aggregate; splitting a
+    // smaller table up costs more than it saves.
+    static constexpr int64_t kMinRowsPerThread = 1000;
+
+
+    // A SQLite value copied out of a result row, so it outlives the statement.
+    struct SQLValue {
+        int     type {SQLITE_NULL};
+        int64_t integer {0};
+        double  real {0};
+        string  bytes;              // Text or blob
+
+        SQLValue() =default;
+
+        explicit SQLValue(const SQLite::Column &col)
+        :type(col.getType())
+        {
+            switch (type) {
+                case SQLITE_INTEGER:    integer = col.getInt64(); break;
+                case SQLITE_FLOAT:      real = col.getDouble(); break;
+                case SQLITE_TEXT:
+                case SQLITE_BLOB:       bytes.assign((const char*)col.getBlob(), col.getBytes()); break;
+            }
+        }
+
+        bool isNull() const                 {return type == SQLITE_NULL;}
+        double asDouble() const             {return type == SQLITE_INTEGER ? double(integer) : real;}
+    };
+
+    // Compares values the way SQLite does with the BINARY collation: NULL sorts before numbers,
+    // which sort before text, which sorts before blobs.
+    static int compareSQLValues(const SQLValue &a, const SQLValue &b) {
+        auto rank = [](int type) {
+            switch (type) {
+                case SQLITE_NULL:   return 0;
+                case SQLITE_TEXT:   return 2;
+                case SQLITE_BLOB:   return 3;
+                default:            return 1;
+            }
+        };
+        int ra = rank(a.type), rb = rank(b.type);
+        if (ra != rb)
+            return ra - rb;
+        switch (ra) {
+            case 0:
+                return 0;
+            case 1:
+                if (a.type == SQLITE_INTEGER && b.type == SQLITE_INTEGER)
+                    return (a.integer > b.integer) - (a.integer < b.integer);
+                return (a.asDouble() > b.asDouble()) - (a.asDouble() < b.asDouble());
+            default:
+                return a.bytes.compare(b.bytes);
+        }
+    }
+
+    struct SQLRowLess {
+        bool operator() (const vector<SQLValue> &a, const vector<SQLValue> &b) const {
+            for (size_t i = 0; i < a.size(); ++i) {
+                int cmp = compareSQLValues(a[i], b[i]);
+                if (cmp != 0)
+                    return cmp < 0;
+            }
+            return false;
+        }
+    };
+
+    // Adds two values the way SQLite's sum() does: NULLs are ignored, and the result is an
+    // integer unless a value is a float (or the integer sum overflows.)
+    static void addSQLValue(SQLValue &sum, const SQLValue &value) {
+        if (value.isNull()) {
+            return;
+        } else if (sum.isNull()) {
+            sum = value;
+        } else if (sum.type == SQLITE_INTEGER && value.type == SQLITE_INTEGER
+                       && (value.integer >= 0 ? sum.integer <= INT64_MAX - value.integer
+                                              : sum.integer >= INT64_MIN - value.integer)) {
+            sum.integer += value.integer;
+        } else {
+            sum.real = sum.asDouble() + value.asDouble();
+            sum.type = SQLITE_FLOAT;
+        }
+    }
+
+
+    // Read connections that a parallel run's partial queries run on, reading the same snapshot of
+    // the database as the query's own connection. Each connection opens that snapshot in its own
+    // read transaction, so none of this waits for (or blocks) writers.
+    // <https://sqlite.org/c3ref/snapshot_open.html>
+    class ParallelSnapshot {
+    public:
+        explicit ParallelSnapshot(SQLiteDataFile &dataFile)
+        :_dataFile(dataFile)
+        { }
+
+        ~ParallelSnapshot() {
+            _transactions.clear();
+            for (auto &connection : _connections)
+                _dataFile.returnReadConnection(move(connection));
+        }
+
+        // Borrows `nThreads` connections and starts read transactions on them, at the snapshot
+        // that the query's own connection is reading in its read-only transaction. Returns false
+        // if the snapshot can't be opened (e.g. the WAL has been reset since), in which case the
+        // query should run serially.
+        bool begin(unsigned nThreads, int64_t minRowid, int64_t maxRowid) {
+            sqlite3_snapshot *snapshot;
+            if (sqlite3_snapshot_get(((SQLite::Database&)_dataFile).getHandle(), "main",
+                                     &snapshot) != SQLITE_OK)
+                return false;
+            while (_connections.size() < nThreads)
+                _connections.push_back(_dataFile.borrowReadConnection());
+            bool ok = true;
+            for (unsigned i = 0; i < nThreads && ok; ++i) {
+                _transactions.emplace_back(new ReadOnlyTransaction(_connections[i].get()));
+                ok = sqlite3_snapshot_open(((SQLite::Database&)*_connections[i]).getHandle(),
+                                           "main", snapshot) == SQLITE_OK;
+            }
+            sqlite3_snapshot_free(snapshot);
+            if (!ok) {
+                _transactions.clear();
+                return false;
+            }
+            _minRowid = minRowid;
+            _maxRowid = maxRowid;
+            return true;
+        }
+
+        unsigned threadCount() const                    {return (unsigned)_transactions.size();}
+        SQLiteDataFile& connection(unsigned i)          {return *_connections[i];}
+        int64_t minRowid() const                        {return _minRowid;}
+        int64_t maxRowid() const                        {return _maxRowid;}
+
+    private:
+        SQLiteDataFile &_dataFile;
+        vector<unique_ptr<SQLiteDataFile>> _connections;
+        vector<unique_ptr<ReadOnlyTransaction>> _transactions;
+        int64_t _minRowid {0}, _maxRowid {-1};
+    };
+
+
+    // The threads that run the partial queries of parallel runs. A thread is started the first
+    // time a run needs it, then waits for the next run's work, instead of every run starting and
+    // joining threads of its own.
+    class PartialQueryThreads {
+    public:
+        static PartialQueryThreads& shared() {
+            static auto sThreads = new PartialQueryThreads;    // (never freed; threads outlive it)
+            return *sThreads;
+        }
+
+        // Runs the tasks concurrently, each on a pool thread, and returns when they're all done.
+        // The tasks must not throw.
+        void run(const vector<function<void()>> &tasks) {
+            startThreads(tasks.size());
+            mutex doneMutex;
+            condition_variable doneCond;
+            size_t remaining = tasks.size();
+            for (auto &task : tasks) {
+                _queue.push([&] {
+                    task();
+                    lock_guard<mutex> lock(doneMutex);
+                    if (--remaining == 0)
+                        doneCond.notify_one();
+                });
+            }
+            unique_lock<mutex> lock(doneMutex);
+            doneCond.wait(lock, [&] {return remaining == 0;});
+        }
+
+    private:
+        void startThreads(size_t count) {
+            lock_guard<mutex> lock(_mutex);
+            for (; _threadCount < count; ++_threadCount) {
+                thread([this] {
+                    while (true)
+                        _queue.pop()();
+                }).detach();
+            }
+        }
+
+        actor::Channel<function<void()>> _queue;
+        mutex _mutex;
+        size_t _threadCount {0};
+    };
+
+
+#pragma mark - COLUMNAR RESULTS:
+
+
+    // Accumulates one column of a ColumnarResult. The column takes the type of its first non-null
+    // value, then widens as needed: integers become doubles if a double turns up, and if the
+    // types are otherwise mixed, every value is converted to Fleece.
+    class ColumnBuilder {
+    public:
+        using Column = ColumnarResult::Column;
+
+        explicit ColumnBuilder(SharedKeys *sk)
+        :_sk(sk)
+        { }
+
+        void add(SQLite::Column col) {
+            auto type = columnType(col);
+            if (type == ColumnarResult::kNullColumn) {
+                addNull();
+                return;
+            }
+            if (_col.type == ColumnarResult::kNullColumn)
+                startAs(type);
+            else if (_col.type == ColumnarResult::kIntegerColumn
+                        && type == ColumnarResult::kDoubleColumn)
+                convertToDoubles();
+            else if (type != _col.type && _col.type != ColumnarResult::kFleeceColumn
+                        && !(_col.type == ColumnarResult::kDoubleColumn
+                             && type == ColumnarResult::kIntegerColumn))
+                convertToFleece();      // (a Fleece column already holds any type)
+
+            switch (_col.type) {
+                case ColumnarResult::kIntegerColumn:
+                    _col.integers.push_back(col.getInt64());
+                    break;
+                case ColumnarResult::kDoubleColumn:
+                    _col.doubles.push_back(col.getDouble());
+                    break;
+                case ColumnarResult::kStringColumn:
+                    appendBytes(slice(col.getText(), (size_t)col.getBytes()));
+                    break;
+                default:
+                    appendBytes(encodeFleece(col));
+                    break;
+            }
+            addValidity(true);
+        }
+
+        Column finish()                     {return move(_col);}
+
+    private:
+        static ColumnarResult::ColumnType columnType(SQLite::Column &col) {
+            switch (col.getType()) {
+                case SQLITE_INTEGER:    return ColumnarResult::kIntegerColumn;
+                case SQLITE_FLOAT:      return ColumnarResult::kDoubleColumn;
+                case SQLITE_TEXT:       return ColumnarResult::kStringColumn;
+                case SQLITE_BLOB:       return ColumnarResult::kFleeceColumn;
+                default:                return ColumnarResult::kNullColumn;
+            }
+        }
+
+        void addNull() {
+            switch (_col.type) {
+                case ColumnarResult::kNullColumn:       break;
+                case ColumnarResult::kIntegerColumn:    _col.integers.push_back(0); break;
+                case ColumnarResult::kDoubleColumn:     _col.doubles.push_back(0.0); break;
+                default:                                appendBytes(nullslice); break;
+            }
+            addValidity(false);
+        }
+
+        void addValidity(bool valid) {
+            if (_rows % 8 == 0)
+                _col.validity.push_back(0);
+            if (valid)
+                _col.validity.back() |= uint8_t(1 << (_rows % 8));
+            ++_rows;
+        }
+
+        void appendBytes(slice bytes) {
+            _col.bytes.insert(_col.bytes.end(), (const uint8_t*)bytes.buf,
+                              (const uint8_t*)bytes.buf + bytes.size);
+            _col.offsets.push_back(_col.bytes.size());
+        }
+
+        // Gives the rows so far, which are all null, the given type.
+        void startAs(ColumnarResult::ColumnType type) {
+            _col.type = type;
+            switch (type) {
+                case ColumnarResult::kIntegerColumn:    _col.integers.assign(_rows, 0); break;
+                case ColumnarResult::kDoubleColumn:     _col.doubles.assign(_rows, 0.0); break;
+                default:                                _col.offsets.assign(_rows + 1, 0); break;
+            }
+        }
+
+        void convertToDoubles() {
+            _col.doubles.assign(_col.integers.begin(), _col.integers.end());
+            _col.integers = {};
+            _col.type = ColumnarResult::kDoubleColumn;
+        }
+
+        // Converts an integer, double or string column to Fleece.
+        void convertToFleece() {
+            Assert(_col.type != ColumnarResult::kFleeceColumn);
+            Column old = move(_col);
+            _col = Column();
+            _col.type = ColumnarResult::kFleeceColumn;
+            _col.validity = move(old.validity);
+            _col.offsets.push_back(0);
+            for (uint64_t row = 0; row < _rows; ++row) {
+                if (_col.isNull(row)) {
+                    appendBytes(nullslice);
+                    continue;
+                }
+                Encoder enc;
+                switch (old.type) {
+                    case ColumnarResult::kIntegerColumn:
+                        enc.writeInt(old.integers[row]);
+                        break;
+                    case ColumnarResult::kDoubleColumn:
+                        enc.writeDouble(old.doubles[row]);
+                        break;
+                    default:
+                        enc.writeString(slice(old.bytes.data() + old.offsets[row],
+                                              old.offsets[row + 1] - old.offsets[row]));
+                        break;
+                }
+                appendBytes(enc.finish());
+            }
+        }
+
+        // Encodes a value as a standalone Fleece document, without any shared keys.
+        alloc_slice encodeFleece(SQLite::Column &col) {
+            Encoder enc;
+            switch (col.getType()) {
+                case SQLITE_INTEGER:
+                    enc.writeInt(col.getInt64());
+                    break;
+                case SQLITE_FLOAT:
+                    enc.writeDouble(col.getDouble());
+                    break;
+                case SQLITE_TEXT:
+                    enc.writeString(slice(col.getText(), (size_t)col.getBytes()));
+                    break;
+                default: {
+                    slice data {col.getBlob(), (size_t)col.getBytes()};
+                    Scope fleeceScope(data, _sk);
+                    const Value *value = Value::fromTrustedData(data);
+                    if (!value)
+                        error::_throw(error::CorruptRevisionData);
+                    enc.writeValue(value);
+                    break;
+                }
+            }
+            return enc.finish();
+        }
+
+        SharedKeys* _sk;
+        Column _col;
+        uint64_t _rows {0};
     };
 
 
@@ -355,21 +1071,22 @@ namespace litecore {
         :_query(query)
         ,_lastSequence(lastSequence)
         ,_purgeCount(purgeCount)
-        ,_statement(query->statement())
+        ,_statement(options && options->continuation
+                        ? query->continuationStatement(options->continuation, _statementHandle,
+                                                       _lastKeys)
+                        : query->statement(&_statementHandle))
         ,_sk(query->keyStore().dataFile().documentKeys())
         ,_options(options ? *options : Query::Options())
+        ,_interrupter(_options)
         {
             _statement->clearBindings();
-            _unboundParameters = query->_parameters;
+            if (_lastKeys)
+                bindLastKeys();
+            unsigned nBound = 0;
             if (options && options->paramBindings.buf)
-                bindParameters(options->paramBindings);
-            if (!_unboundParameters.empty()) {
-                stringstream msg;
-                for (const string &param : _unboundParameters)
-                    msg << " $" << param;
-                Warn("Some query parameters were left unbound and will have value `MISSING`:%s",
-                     msg.str().c_str());
-            }
+                nBound = bindParameters(options->paramBindings);
+            if (nBound < query->_requiredParameterCount)
+                warnUnboundParameters();
 
             LogStatement(*_statement);
         }
@@ -380,51 +1097,166 @@ namespace litecore {
             } catch (...) { }
         }
 
-        void bindParameters(slice json) {
-            alloc_slice fleeceData;
-            if (json[0] == '{' && json[json.size-1] == '}')
-                fleeceData = JSONConverter::convertJSON(json);
-            else
-                fleeceData = json;
-            const Dict *root = Value::fromData(fleeceData)->asDict();
+        // Binds the parameters in a JSON or Fleece dict, using the indexes resolved when the
+        // query was compiled. Returns the number of required (non-optional) parameters bound.
+        unsigned bindParameters(const alloc_slice &params) {
+            _paramData = Query::encodeParameters(params);
+            const Value *rootVal = Value::fromData(_paramData);
+            const Dict *root = rootVal ? rootVal->asDict() : nullptr;
             if (!root)
                 error::_throw(error::InvalidParameter);
+            unsigned nRequiredBound = 0;
             for (Dict::iterator it(root); it; ++it) {
-                auto key = (string)it.keyString();
-                _unboundParameters.erase(key);
-                auto sqlKey = string("$_") + key;
-                const Value *val = it.value();
-                try {
-                    switch (val->type()) {
-                        case kNull:
-                            break;
-                        case kBoolean:
-                        case kNumber:
-                            if (val->isInteger() && !val->isUnsigned())
-                                _statement->bind(sqlKey, (long long)val->asInt());
-                            else
-                                _statement->bind(sqlKey, val->asDouble());
-                            break;
-                        case kString:
-                            _statement->bind(sqlKey, (string)val->asString());
-                            break;
-                        default: {
-                            // Encode other types as a Fleece blob:
-                            Encoder enc;
-                            enc.writeValue(val);
-                            alloc_slice asFleece = enc.finish();
-                            _statement->bind(sqlKey, asFleece.buf, (int)asFleece.size);
+                slice key = it.keyString();
+                auto param = _query->findParameter(key);
+                if (!param)
+                    error::_throw(error::InvalidQueryParam,
+                                  "Unknown query property '%.*s'", SPLAT(key));
+                if (!param->optional)
+                    ++nRequiredBound;
+                int index = param->index;
+                if (_lastKeys) {
+                    // A continuation's parameters may not have the same indexes as the query's:
+                    index = sqlite3_bind_parameter_index(_statementHandle,
+                                                         ("$_" + param->name).c_str());
+                    if (index == 0)
+                        continue;
+                }
+                bindValue(*_statement, index, it.value());
+            }
+            return nRequiredBound;
+        }
+
+        // Binds the (non-null) key values of the row a continuation starts after.
+        void bindLastKeys() {
+            for (uint32_t i = 0; i < _lastKeys->count(); ++i) {
+                const Value *key = _lastKeys->get(i);
+                int index = sqlite3_bind_parameter_index(_statementHandle,
+                                                 QueryParser::Keyset::keyParameter(i).c_str());
+                if (index == 0)
+                    continue;
+                if (key->type() == kData) {
+                    slice data = key->asData();         // a sort key, compared as a raw blob
+                    _statement->bind(index, data.buf, (int)data.size);
+                } else {
+                    bindValue(*_statement, index, key);
+                }
+            }
+        }
+
+        static void bindValue(SQLite::Statement &statement, int index, const Value *val) {
+            switch (val->type()) {
+                case kNull:
+                    break;
+                case kBoolean:
+                case kNumber:
+                    if (val->isInteger() && !val->isUnsigned())
+                        statement.bind(index, (long long)val->asInt());
+                    else
+                        statement.bind(index, val->asDouble());
+                    break;
+                case kString:
+                    statement.bind(index, (string)val->asString());
+                    break;
+                default: {
+                    // Encode other types as a Fleece blob:
+                    Encoder enc;
+                    enc.writeValue(val);
+                    alloc_slice asFleece = enc.finish();
+                    statement.bind(index, asFleece.buf, (int)asFleece.size);
+                    break;
+                }
+            }
+        }
+
+        // Binds the parameters to a partial query on a read connection. Its parameters may not
+        // have the same indexes as the query's, so they're looked up by name.
+        static void bindPartialParameters(sqlite3_stmt *stmt,
+                                          SQLite::Statement &statement,
+                                          const Dict *params)
+        {
+            for (Dict::iterator it(params); it; ++it) {
+                string name = "$_" + it.keyString().asString();
+                int index = sqlite3_bind_parameter_index(stmt, name.c_str());
+                if (index > 0)
+                    bindValue(statement, index, it.value());
+            }
+        }
+
+        // Merges a partial result row into an accumulated one with the same group keys.
+        static void mergePartialRow(const QueryParser::PartialAggregation &plan,
+                                    vector<SQLValue> &into, const vector<SQLValue> &row)
+        {
+            size_t c = 0;
+            for (auto merge : plan.columns) {
+                switch (merge) {
+                    case QueryParser::PartialAggregation::kGroupKey:
+                        break;
+                    case QueryParser::PartialAggregation::kCount:
+                    case QueryParser::PartialAggregation::kSum:
+                        addSQLValue(into[c], row[c]);
+                        break;
+                    case QueryParser::PartialAggregation::kMin:
+                    case QueryParser::PartialAggregation::kMax: {
+                        if (row[c].isNull())
                             break;
-                        }
+                        int cmp = into[c].isNull() ? 0 : compareSQLValues(row[c], into[c]);
+                        if (into[c].isNull()
+                                || (merge == QueryParser::PartialAggregation::kMin ? cmp < 0
+                                                                                   : cmp > 0))
+                            into[c] = row[c];
+                        break;
                     }
-                } catch (const SQLite::Exception &x) {
-                    if (x.getErrorCode() == SQLITE_RANGE)
-                        error::_throw(error::InvalidQueryParam,
-                                      "Unknown query property '%s'", key.c_str());
-                    else
-                        throw;
+                    case QueryParser::PartialAggregation::kAvg:
+                        addSQLValue(into[c], row[c]);           // total
+                        ++c;
+                        addSQLValue(into[c], row[c]);           // count
+                        break;
+                }
+                ++c;
+            }
+        }
+
+        // Like encodeColumn, but for a merged value.
+        bool encodeValue(Encoder &enc, const SQLValue &value) {
+            switch (value.type) {
+                case SQLITE_NULL:
+                    enc.writeNull();
+                    return false;
+                case SQLITE_INTEGER:
+                    enc.writeInt(value.integer);
+                    break;
+                case SQLITE_FLOAT:
+                    enc.writeDouble(value.real);
+                    break;
+                case SQLITE_BLOB: {
+                    slice data(value.bytes);
+                    Scope fleeceScope(data, _sk);
+                    const Value *fleeceValue = Value::fromTrustedData(data);
+                    if (!fleeceValue)
+                        error::_throw(error::CorruptRevisionData);
+                    enc.writeValue(fleeceValue);
+                    break;
                 }
+                case SQLITE_TEXT:
+                    enc.writeString(slice(value.bytes));
+                    break;
+            }
+            return true;
+        }
+
+        // Only called when some required parameter is known to be unbound:
+        void warnUnboundParameters() {
+            const Dict *root = nullptr;
+            if (_paramData)
+                root = Value::fromTrustedData(_paramData)->asDict();
+            stringstream msg;
+            for (auto &param : _query->_parameters) {
+                if (!param.optional && !(root && root->get(slice(param.name))))
+                    msg << " $" << param.name;
             }
+            Warn("Some query parameters were left unbound and will have value `MISSING`:%s",
+                 msg.str().c_str());
         }
 
         bool encodeColumn(Encoder &enc, int i) {
@@ -440,20 +1272,21 @@ namespace litecore {
                     enc.writeDouble(col.getDouble());
                     break;
                 case SQLITE_BLOB: {
+                    slice data {col.getBlob(), (size_t)col.getBytes()};
                     if (i >= _query->_1stCustomResultColumn) {
-                        slice fleeceData {col.getBlob(), (size_t)col.getBytes()};
-                        Scope fleeceScope(fleeceData, _sk);
-                        const Value *value = Value::fromTrustedData(fleeceData);
+                        Scope fleeceScope(data, _sk);
+                        const Value *value = Value::fromTrustedData(data);
                         if (!value)
                             error::_throw(error::CorruptRevisionData);
                         enc.writeValue(value);
-                        break;
+                    } else {
+                        enc.writeData(data);    // a sort key; kept as-is for the continuation
                     }
-                    // else fall through:
+                    break;
+                }
                 case SQLITE_TEXT:
                     enc.writeString(slice{col.getText(), (size_t)col.getBytes()});
                     break;
-                }
             }
             return true;
         }
@@ -472,30 +1305,243 @@ namespace litecore {
             enc.setSharedKeys(sk);
             enc.beginArray();
 
-            unicodesn_tokenizerRunningQuery(true);
+            // If collecting statistics, time the SQLite stepping separately from the encoding:
+            bool collectStats = _query->collectingStatistics();
+            unique_ptr<StatementCounters> counters;
+            uint64_t fleeceCalls = QueryFleeceScope::sInstanceCount;
+            fleece::Stopwatch stepTimer(false), encodeTimer(false);
+            auto &df = (SQLiteDataFile&)_query->keyStore().dataFile();
+            if (collectStats || df.queryWorkload().recording())
+                counters.reset(new StatementCounters(_statementHandle));
+
+            _interrupter.check();
+            InterruptHandler interruptHandler(df, _interrupter);
+            FTSTokenizerRunningQuery(true);
             try {
-                while (_statement->executeStep()) {
-                    uint64_t missingCols = 0;
-                    enc.beginArray(nCols);
-                    for (int i = 0; i < nCols; ++i) {
-                        if (!encodeColumn(enc, i) && i < 64)
-                            missingCols |= (1 << i);
-                    }
-                    enc.endArray();
-                    // Add an integer containing a bit-map of which columns are missing/undefined:
-                    enc.writeUInt(missingCols);
+                while (true) {
+                    if (collectStats) stepTimer.start();
+                    bool gotRow = _statement->executeStep();
+                    if (collectStats) stepTimer.stop();
+                    if (!gotRow)
+                        break;
                     ++rowCount;
+
+                    if (!_options.countOnly) {
+                        if (collectStats) encodeTimer.start();
+                        uint64_t missingCols = 0;
+                        enc.beginArray(nCols);
+                        for (int i = 0; i < nCols; ++i) {
+                            // (Bits are numbered from the 1st custom column; the hidden ones
+                            // before it, such as sort keys, may be null but aren't reported as
+                            // missing.)
+                            int bit = i - (int)_query->_1stCustomResultColumn;
+                            if (!encodeColumn(enc, i) && bit >= 0 && bit < 64)
+                                missingCols |= (1ull << bit);
+                        }
+                        enc.endArray();
+                        // Add an integer containing a bit-map of which columns are missing:
+                        enc.writeUInt(missingCols);
+                        if (collectStats) encodeTimer.stop();
+                    }
+
+                    if (rowCount == _options.maxRows)
+                        break;      // (The destructor resets the statement, skipping the rest)
+                }
+            } catch (...) {
+                FTSTokenizerRunningQuery(false);
+                _interrupter.check();       // (An interrupted statement throws SQLITE_INTERRUPT)
+                throw;
+            }
+            FTSTokenizerRunningQuery(false);
+
+            enc.endArray();
+            Retained<Doc> recording = enc.finishDoc();
+            double elapsed = st.elapsed();
+
+            Query::Statistics stats;
+            if (counters)
+                counters->getDeltas(stats);
+            if (collectStats) {
+                stats.runCount = 1;
+                stats.rowsReturned = rowCount;
+                stats.fleeceCalls = QueryFleeceScope::sInstanceCount - fleeceCalls;
+                stats.stepTime = stepTimer.elapsed();
+                stats.encodeTime = encodeTimer.elapsed();
+                stats.maxRunTime = elapsed;
+                _query->addStatistics(stats);
+            }
+            _query->recordWorkload(elapsed, stats.fullScanSteps);
+
+            double slowThreshold = Query::slowQueryThreshold();
+            if (slowThreshold > 0 && elapsed >= slowThreshold)
+                _query->logSlowQuery(elapsed, rowCount);
+
+            return new SQLiteQueryEnumerator(_query, &_options, _lastSequence, _purgeCount,
+                                             recording, rowCount, elapsed);
+        }
+
+        // Like fastForward, but stores the result columns (not the hidden ones before them) in
+        // typed per-column buffers instead of encoding the rows as Fleece.
+        Retained<ColumnarResult> runColumnar() {
+            fleece::Stopwatch st;
+            int nCols = _statement->getColumnCount();
+            int firstCol = (int)_query->_1stCustomResultColumn;
+            vector<ColumnBuilder> builders;
+            for (int i = firstCol; i < nCols; ++i)
+                builders.emplace_back(_sk);
+            uint64_t rowCount = 0;
+
+            auto &df = (SQLiteDataFile&)_query->keyStore().dataFile();
+            unique_ptr<StatementCounters> counters;
+            if (df.queryWorkload().recording())
+                counters.reset(new StatementCounters(_statementHandle));
+            _interrupter.check();
+            InterruptHandler interruptHandler(df, _interrupter);
+            FTSTokenizerRunningQuery(true);
+            try {
+                while (_statement->executeStep()) {
+                    for (int i = firstCol; i < nCols; ++i)
+                        builders[i - firstCol].add(_statement->getColumn(i));
+                    if (++rowCount == _options.maxRows)
+                        break;
                 }
             } catch (...) {
-                unicodesn_tokenizerRunningQuery(false);
+                FTSTokenizerRunningQuery(false);
+                _interrupter.check();
                 throw;
             }
-            unicodesn_tokenizerRunningQuery(false);
+            FTSTokenizerRunningQuery(false);
+
+            vector<ColumnarResult::Column> columns;
+            for (auto &builder : builders)
+                columns.push_back(builder.finish());
+
+            double elapsed = st.elapsed();
+            if (counters) {
+                Query::Statistics stats;
+                counters->getDeltas(stats);
+                _query->recordWorkload(elapsed, stats.fullScanSteps);
+            }
+            double slowThreshold = Query::slowQueryThreshold();
+            if (slowThreshold > 0 && elapsed >= slowThreshold)
+                _query->logSlowQuery(elapsed, rowCount);
+            return new ColumnarResult(move(columns), rowCount);
+        }
+
+        // Like fastForward, but splits the rowids into ranges and runs the query's partial
+        // aggregation of each range on its own thread and connection, then merges the results.
+        SQLiteQueryEnumerator* fastForwardInParallel(ParallelSnapshot &snapshot) {
+            fleece::Stopwatch st;
+            auto &plan = *_query->_partialAggregation;
+            unsigned nThreads = snapshot.threadCount();
+            const Dict *params = _paramData ? Value::fromTrustedData(_paramData)->asDict()
+                                            : nullptr;
+
+            // Run the partial queries:
+            _interrupter.check();
+            vector<vector<vector<SQLValue>>> partialRows(nThreads);
+            vector<exception_ptr> errors(nThreads);
+            vector<function<void()>> tasks;
+            int64_t span = snapshot.maxRowid() - snapshot.minRowid() + 1;
+            for (unsigned i = 0; i < nThreads; ++i) {
+                int64_t first = snapshot.minRowid() + span * i / nThreads;
+                int64_t last  = snapshot.minRowid() + span * (i + 1) / nThreads - 1;
+                string sql = plan.partialSQL(first, last);
+                tasks.emplace_back([&, i, sql] {
+                    try {
+                        auto &connection = snapshot.connection(i);
+                        InterruptHandler interruptHandler(connection, _interrupter);
+                        sqlite3_stmt *handle;
+                        auto statement = compileWithHandle<unique_ptr<SQLite::Statement>>(
+                                                            connection, sql, handle, [&] {
+                            return make_unique<SQLite::Statement>(connection, sql);
+                        });
+                        if (params)
+                            bindPartialParameters(handle, *statement, params);
+                        int nCols = statement->getColumnCount();
+                        while (statement->executeStep()) {
+                            vector<SQLValue> row;
+                            for (int c = 0; c < nCols; ++c)
+                                row.emplace_back(statement->getColumn(c));
+                            partialRows[i].push_back(move(row));
+                        }
+                    } catch (...) {
+                        errors[i] = current_exception();
+                    }
+                });
+            }
+            PartialQueryThreads::shared().run(tasks);
+            _interrupter.check();
+            for (auto &error : errors) {
+                if (error)
+                    rethrow_exception(error);
+            }
 
+            // Merge rows with the same group keys (in SQLite's GROUP BY order):
+            map<vector<SQLValue>, vector<SQLValue>, SQLRowLess> groups;
+            for (auto &rows : partialRows) {
+                for (auto &row : rows) {
+                    vector<SQLValue> key;
+                    size_t c = 0;
+                    for (auto merge : plan.columns) {
+                        if (merge == QueryParser::PartialAggregation::kGroupKey)
+                            key.push_back(row[c]);
+                        c += (merge == QueryParser::PartialAggregation::kAvg) ? 2 : 1;
+                    }
+                    auto i = groups.find(key);
+                    if (i == groups.end())
+                        groups.emplace(move(key), move(row));
+                    else
+                        mergePartialRow(plan, i->second, row);
+                }
+            }
+
+            // Record the merged rows, in the same form as fastForward:
+            Encoder enc;
+            auto sk = retained(new SharedKeys);
+            enc.setSharedKeys(sk);
+            enc.beginArray();
+            for (auto &group : groups) {
+                auto &row = group.second;
+                uint64_t missingCols = 0;
+                enc.beginArray(plan.columns.size());
+                size_t c = 0;
+                for (size_t i = 0; i < plan.columns.size(); ++i) {
+                    SQLValue value = row[c++];
+                    if (plan.columns[i] == QueryParser::PartialAggregation::kAvg) {
+                        const SQLValue &count = row[c++];
+                        if (count.isNull() || count.integer == 0)
+                            value = SQLValue();
+                        else
+                            value.real /= count.integer;
+                    }
+                    if (!encodeValue(enc, value) && i < 64)
+                        missingCols |= (1ull << i);
+                }
+                enc.endArray();
+                enc.writeUInt(missingCols);
+            }
             enc.endArray();
             Retained<Doc> recording = enc.finishDoc();
+            double elapsed = st.elapsed();
+            _query->logInfo("Ran in parallel on %u threads", nThreads);
+
+            if (_query->collectingStatistics()) {
+                Query::Statistics stats;
+                stats.runCount = 1;
+                stats.parallelRuns = 1;
+                stats.rowsReturned = groups.size();
+                stats.stepTime = stats.maxRunTime = elapsed;
+                _query->addStatistics(stats);
+            }
+            _query->recordWorkload(elapsed, 0);     // (The partial queries' scans aren't counted)
+
+            double slowThreshold = Query::slowQueryThreshold();
+            if (slowThreshold > 0 && elapsed >= slowThreshold)
+                _query->logSlowQuery(elapsed, groups.size());
+
             return new SQLiteQueryEnumerator(_query, &_options, _lastSequence, _purgeCount,
-                                             recording, rowCount, st.elapsed());
+                                             recording, groups.size(), elapsed);
         }
 
     private:
@@ -503,9 +1549,12 @@ namespace litecore {
         Query::Options _options;
         sequence_t _lastSequence;       // DB's lastSequence at the time the query ran
         uint64_t _purgeCount;           // DB's purgeCount at the time the query ran
+        sqlite3_stmt* _statementHandle {nullptr};   // _statement's SQLite handle
+        const Array* _lastKeys {nullptr};           // Keys a continuation starts after (in token)
         shared_ptr<SQLite::Statement> _statement;
-        set<string> _unboundParameters;
+        alloc_slice _paramData;         // Fleece-encoded parameters
         SharedKeys* _sk;
+        QueryInterrupter _interrupter;  // Stops the run if it's canceled or times out
     };
 
 
@@ -521,14 +1570,103 @@ namespace litecore {
     QueryEnumerator* SQLiteQuery::createEnumerator(const Options *options) {
         // Start a read-only transaction, to ensure that the result of lastSequence() and purgeCount() will be
         // consistent with the query results.
-        ReadOnlyTransaction t(keyStore().dataFile());
+        auto &dataFile = (SQLiteDataFile&) keyStore().dataFile();
+        ReadOnlyTransaction t(dataFile);
+
+        // An aggregate query may be split up across threads. (Not within a transaction, though,
+        // since other connections can't see its changes; nor if only the row count or the first
+        // rows are wanted.) Each thread needs a read connection, so there are no more threads
+        // than the pool keeps connections, or than there are CPU cores.
+        unique_ptr<ParallelSnapshot> snapshot;
+        unsigned maxThreads = min(parallelism(),
+                                  unsigned(SQLiteDataFile::kMaxPooledReadConnections));
+        unsigned cores = thread::hardware_concurrency();
+        if (cores > 0)
+            maxThreads = min(maxThreads, cores);
+        if (_partialAggregation && maxThreads > 1 && !dataFile.inTransaction()
+                && !(options && (options->countOnly || options->maxRows > 0)))
+            snapshot.reset(new ParallelSnapshot(dataFile));
 
         sequence_t curSeq = lastSequence();
         uint64_t purgeCnt = purgeCount();
+        if (snapshot) {
+            // Reading the table pins down the snapshot of the read-only transaction, which the
+            // other connections then open:
+            auto &sqliteKeyStore = (SQLiteKeyStore&)keyStore();
+            SQLite::Statement range(dataFile, "SELECT min(rowid), max(rowid) FROM "
+                                              + sqliteKeyStore.tableName());
+            range.executeStep();
+            int64_t minRowid = range.getColumn(0).getInt64();
+            int64_t maxRowid = range.getColumn(1).getInt64();
+            int64_t nThreads = min(int64_t(maxThreads),
+                                   (maxRowid - minRowid + 1) / kMinRowsPerThread);
+            if (nThreads <= 1 || !snapshot->begin(unsigned(nThreads), minRowid, maxRowid))
+                snapshot.reset();
+        }
+
         if(options && options->notOlderThan(curSeq, purgeCnt))
             return nullptr;
         SQLiteQueryRunner recorder(this, options, curSeq, purgeCnt);
+        if (snapshot)
+            return recorder.fastForwardInParallel(*snapshot);
         return recorder.fastForward();
     }
 
+
+
+    // The saved form of a query's results is a Fleece dict. Its "results" are the enumerator's
+    // recording, which has its own SharedKeys; their state is saved too, as "keys".
+    // "sql" is a digest of the query's SQL, since the recording's layout depends on it.
+    alloc_slice SQLiteQuery::saveResults(QueryEnumerator *qe) {
+        auto e = dynamic_cast<SQLiteQueryEnumerator*>(qe);
+        if (!e)
+            error::_throw(error::InvalidParameter, "Not an enumerator of this query");
+        Doc *recording = e->recording();
+        Encoder enc;
+        enc.beginDictionary();
+        enc.writeKey("sql");
+        enc.writeData(slice(SHA1(slice(statement()->getQuery()))));
+        enc.writeKey("seq");
+        enc.writeUInt(e->lastSequence());
+        enc.writeKey("purge");
+        enc.writeUInt(e->purgeCount());
+        enc.writeKey("rows");
+        enc.writeInt(e->getRowCount());
+        enc.writeKey("keys");
+        enc.writeData(recording->sharedKeys() ? recording->sharedKeys()->stateData() : alloc_slice());
+        enc.writeKey("results");
+        enc.writeData(recording->data());
+        enc.endDictionary();
+        return enc.finish();
+    }
+
+
+    QueryEnumerator* SQLiteQuery::restoreResults(slice savedResults, const Options *options) {
+        Retained<Doc> saved = new Doc(alloc_slice(savedResults), Doc::kUntrusted);
+        const Dict *root = saved->asDict();
+        const Value *sql, *seq, *purge, *rows, *keys, *results;
+        if (!root || !(sql = root->get("sql"_sl)) || !(seq = root->get("seq"_sl))
+                  || !(purge = root->get("purge"_sl)) || !(rows = root->get("rows"_sl))
+                  || !(keys = root->get("keys"_sl)) || !(results = root->get("results"_sl)))
+            return nullptr;
+        if (sql->asData() != slice(SHA1(slice(statement()->getQuery()))))
+            return nullptr;         // The query compiles differently now
+        auto sk = retained(new SharedKeys);
+        if (keys->asData() && !sk->loadFrom(keys->asData()))
+            return nullptr;
+        Retained<Doc> recording = new Doc(alloc_slice(results->asData()), Doc::kUntrusted, sk);
+        if (!recording->asArray())
+            return nullptr;
+        return new SQLiteQueryEnumerator(this, options, seq->asUnsigned(), purge->asUnsigned(),
+                                         recording, rows->asUnsigned(), 0.0);
+    }
+
+
+    Retained<ColumnarResult> SQLiteQuery::runColumnar(const Options *options) {
+        auto &dataFile = (SQLiteDataFile&) keyStore().dataFile();
+        ReadOnlyTransaction t(dataFile);
+        SQLiteQueryRunner runner(this, options, lastSequence(), purgeCount());
+        return runner.runColumnar();
+    }
+
 }
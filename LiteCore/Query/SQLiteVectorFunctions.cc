@@ -0,0 +1,195 @@
+//
+// SQLiteVectorFunctions.cc
+//
+// Copyright © 2018 Couchbase. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SQLiteFleeceUtil.hh"
+#include <sqlite3.h>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace litecore {
+    using namespace std;
+    using namespace fleece;
+    using namespace fleece::impl;
+
+    // Vectors are stored in vector indexes as blobs of native 32-bit floats. Blobs read from a
+    // table may not be aligned, so the floats are read with memcpy.
+
+
+    // vector_encode(array) converts a Fleece array of numbers to a vector blob.
+    // Returns null if the value isn't a non-empty array of numbers.
+    static void vector_encode(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        const Value *value = fleeceParam(ctx, argv[0], false);
+        const Array *array = value ? value->asArray() : nullptr;
+        if (!array || array->empty()) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        alloc_slice blob(array->count() * sizeof(float));
+        auto out = (float*)blob.buf;
+        for (Array::iterator i(array); i; ++i) {
+            if (i.value()->type() != kNumber) {
+                sqlite3_result_null(ctx);
+                return;
+            }
+            *out++ = i.value()->asFloat();
+        }
+        setResultBlobFromData(ctx, blob);
+    }
+
+
+    static inline size_t vectorDimension(sqlite3_value *arg) {
+        return sqlite3_value_bytes(arg) / sizeof(float);
+    }
+
+
+    static inline float floatAt(const void *vec, size_t i) {
+        float f;
+        memcpy(&f, (const uint8_t*)vec + i * sizeof(float), sizeof(float));
+        return f;
+    }
+
+
+    static float squaredDistance(const void *a, const void *b, size_t dimension) {
+        float sum = 0;
+        for (size_t i = 0; i < dimension; ++i) {
+            float d = floatAt(a, i) - floatAt(b, i);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+
+    // vector_distance(vector1, vector2) returns the Euclidean distance between two vector blobs.
+    static void vector_distance(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        if (sqlite3_value_type(argv[0]) != SQLITE_BLOB || sqlite3_value_type(argv[1]) != SQLITE_BLOB) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        auto a = sqlite3_value_blob(argv[0]);
+        auto b = sqlite3_value_blob(argv[1]);
+        size_t dimension = vectorDimension(argv[0]);
+        if (vectorDimension(argv[1]) != dimension) {
+            sqlite3_result_error(ctx, "vector_distance: vectors have different dimensions", -1);
+            return;
+        }
+        sqlite3_result_double(ctx, sqrt(squaredDistance(a, b, dimension)));
+    }
+
+
+    // The centroids of a vector index, loaded from its centroids table.
+    struct VectorCentroids {
+        size_t dimension {0};
+        vector<int64_t> buckets;
+        vector<float> vectors;          // All the centroids, concatenated
+        bool warnedDimension {false};   // Has a vector of the wrong dimension been logged?
+    };
+
+
+    static VectorCentroids* loadCentroids(sqlite3 *db, const char *table) {
+        auto centroids = new VectorCentroids;
+        string sql = "SELECT bucket, vector FROM \"";
+        for (const char *c = table; *c; ++c) {
+            if (*c == '"')
+                sql += '"';
+            sql += *c;
+        }
+        sql += "\" WHERE vector IS NOT NULL AND NOT retired";
+
+        sqlite3_stmt *stmt;
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            return centroids;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto vec = sqlite3_column_blob(stmt, 1);
+            size_t dimension = sqlite3_column_bytes(stmt, 1) / sizeof(float);
+            if (centroids->buckets.empty())
+                centroids->dimension = dimension;
+            else if (dimension != centroids->dimension)
+                continue;
+            centroids->buckets.push_back(sqlite3_column_int64(stmt, 0));
+            size_t start = centroids->vectors.size();
+            centroids->vectors.resize(start + dimension);
+            memcpy(&centroids->vectors[start], vec, dimension * sizeof(float));
+        }
+        sqlite3_finalize(stmt);
+        return centroids;
+    }
+
+
+    // vector_bucket(centroidsTable, vector) returns the bucket number of the current centroid
+    // nearest to the vector, or null if it doesn't have the same dimension as the centroids (with
+    // a warning, once per statement.) The table name must be a constant, so the centroids are
+    // read only once per statement.
+    static void vector_bucket(sqlite3_context *ctx, int argc, sqlite3_value **argv) noexcept {
+        auto table = (const char*)sqlite3_value_text(argv[0]);
+        if (!table || sqlite3_value_type(argv[1]) != SQLITE_BLOB) {
+            sqlite3_result_null(ctx);
+            return;
+        }
+        auto centroids = (VectorCentroids*)sqlite3_get_auxdata(ctx, 0);
+        if (!centroids) {
+            centroids = loadCentroids(sqlite3_context_db_handle(ctx), table);
+            sqlite3_set_auxdata(ctx, 0, centroids, [](void *c) {delete (VectorCentroids*)c;});
+            // SQLite may have freed it already if it couldn't store it:
+            centroids = (VectorCentroids*)sqlite3_get_auxdata(ctx, 0);
+            if (!centroids) {
+                sqlite3_result_error_nomem(ctx);
+                return;
+            }
+        }
+
+        if (centroids->buckets.empty()) {
+            // Index was created without any vectors to train on; everything goes in one bucket
+            sqlite3_result_int64(ctx, 0);
+            return;
+        }
+        size_t dimension = centroids->dimension;
+        if (vectorDimension(argv[1]) != dimension) {
+            if (!centroids->warnedDimension) {
+                Warn("vector_bucket: vectors without %zu dimensions can't go in the index; "
+                     "they won't be indexed (first one has %zu)",
+                     dimension, vectorDimension(argv[1]));
+                centroids->warnedDimension = true;
+            }
+            sqlite3_result_null(ctx);
+            return;
+        }
+        auto vec = sqlite3_value_blob(argv[1]);
+        size_t best = 0;
+        float bestDistance = INFINITY;
+        for (size_t i = 0; i < centroids->buckets.size(); ++i) {
+            float d = squaredDistance(vec, &centroids->vectors[i * dimension], dimension);
+            if (d < bestDistance) {
+                bestDistance = d;
+                best = i;
+            }
+        }
+        sqlite3_result_int64(ctx, centroids->buckets[best]);
+    }
+
+
+    const SQLiteFunctionSpec kVectorFunctionsSpec[] = {
+        { "vector_encode",      1, vector_encode },
+        { "vector_distance",    2, vector_distance },
+        { "vector_bucket",      2, vector_bucket },
+        { }
+    };
+
+}
@@ -99,6 +99,24 @@ namespace litecore {
 
         virtual void rekey(EncryptionAlgorithm, slice newKey);
 
+        /** Performs one bounded step of incremental index maintenance (e.g. merging full-text
+            index segments.) Must be called in a transaction. Returns true if it changed
+            anything, i.e. if calling it again may do more work. */
+        virtual bool mergeFullTextIndexes()                 {return false;}
+
+        /** Performs one bounded step of query-planner statistics maintenance: re-analyzes a
+            KeyStore that's had many writes since its statistics were gathered. Must be called in
+            a transaction. Returns true if it analyzed one, i.e. if calling it again may do more
+            work. */
+        virtual bool refreshStatistics()                    {return false;}
+
+        /** Performs one step of vector index maintenance: moves a batch of vectors into the
+            clusters an index was last re-clustered into, or else re-clusters an index that was
+            created empty and now has vectors, or whose clusters have become badly unbalanced.
+            Must be called in a transaction. Returns true if it did anything, i.e. if there may
+            be more to do. */
+        virtual bool retrainVectorIndexes()                 {return false;}
+
         Delegate* delegate() const                          {return _delegate;}
         fleece::impl::SharedKeys* documentKeys() const;
 
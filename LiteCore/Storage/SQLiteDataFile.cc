@@ -37,16 +37,13 @@
 #include "SecureRandomize.hh"
 #include "PlatformCompat.hh"
 #include "fleece/Fleece.hh"
+#include <algorithm>
 #include <mutex>
 #include <sqlite3.h>
 #include <sstream>
 #include <mutex>
 #include <thread>
 
-extern "C" {
-    #include "sqlite3_unicodesn_tokenizer.h"
-}
-
 #if __APPLE__
 #include <TargetConditionals.h>
 #else
@@ -82,11 +79,40 @@ namespace litecore {
     // If the database has many bytes of free space, vacuum it on close
     static const int64_t kVacuumSizeThreshold = 10 * MB;
 
+    // A KeyStore's statistics are refreshed once it's had this many writes since they were
+    // gathered, or this fraction of its row count, whichever is greater
+    static const uint64_t kStatsMinWrites = 1000;
+    static const double kStatsChangeFraction = 0.2;
+    // Maximum rows of each index that ANALYZE examines, so it takes bounded time
+    static const int kAnalysisLimit = 1000;
+
     // Database busy timeout; generally not needed since we have other arbitration that keeps
     // multiple threads from trying to start transactions at once, but another process might
     // open the database and grab the write lock.
     static const unsigned kBusyTimeoutSecs = 10;
 
+    // Delegate of the pooled read connections. It passes Fleece and blob access on to the
+    // delegate of the DataFile that owns the pool, but not commit notifications, since that
+    // DataFile gets those already.
+    class SQLiteDataFile::ReadConnectionDelegate : public DataFile::Delegate {
+    public:
+        explicit ReadConnectionDelegate(DataFile::Delegate *delegate)
+        :_delegate(delegate)
+        { }
+
+        slice fleeceAccessor(slice recordBody) const override {
+            return _delegate->fleeceAccessor(recordBody);
+        }
+
+        alloc_slice blobAccessor(const fleece::impl::Dict *blobDict) const override {
+            return _delegate->blobAccessor(blobDict);
+        }
+
+    private:
+        DataFile::Delegate* const _delegate;
+    };
+
+
     LogDomain SQL("SQL", LogLevel::Warning);
 
     void LogStatement(const SQLite::Statement &st) {
@@ -258,9 +284,18 @@ namespace litecore {
         // Register collators, custom functions, and the FTS tokenizer:
         RegisterSQLiteUnicodeCollations(sqlite, _collationContexts);
         RegisterSQLiteFunctions(sqlite, {delegate(), documentKeys()});
-        int rc = register_unicodesn_tokenizer(sqlite);
+        int rc = RegisterFTSTokenizer(sqlite);
         if (rc != SQLITE_OK)
             warn("Unable to register FTS tokenizer: SQLite err %d", rc);
+
+        // Indexes of collation sort keys made by another version of the collator are stale:
+        if (options().writeable) {
+            try {
+                rebuildSortKeyIndexes();
+            } catch (const std::exception &x) {
+                warn("Unable to rebuild collation sort-key indexes: %s", x.what());
+            }
+        }
     }
 
 
@@ -290,6 +325,10 @@ namespace litecore {
 
     // Called by DataFile::close (the public method)
     void SQLiteDataFile::_close(bool forDelete) {
+        {
+            lock_guard<mutex> lock(_readConnectionsMutex);
+            _readConnections.clear();
+        }
         _getLastSeqStmt.reset();
         _setLastSeqStmt.reset();
         _getPurgeCntStmt.reset();
@@ -327,6 +366,37 @@ namespace litecore {
     }
 
 
+#pragma mark - READ CONNECTIONS:
+
+
+    unique_ptr<SQLiteDataFile> SQLiteDataFile::borrowReadConnection() {
+        {
+            lock_guard<mutex> lock(_readConnectionsMutex);
+            if (!_readConnections.empty()) {
+                auto connection = move(_readConnections.back());
+                _readConnections.pop_back();
+                return connection;
+            }
+            if (!_readConnectionDelegate)
+                _readConnectionDelegate.reset(new ReadConnectionDelegate(delegate()));
+        }
+        Options readOptions = options();
+        readOptions.create = readOptions.writeable = readOptions.upgradeable = false;
+        logVerbose("Opening a read connection");
+        return unique_ptr<SQLiteDataFile>(
+                        sqliteFactory().openFile(filePath(), _readConnectionDelegate.get(),
+                                                 &readOptions));
+    }
+
+
+    void SQLiteDataFile::returnReadConnection(unique_ptr<SQLiteDataFile> connection) {
+        lock_guard<mutex> lock(_readConnectionsMutex);
+        if (isOpen() && _readConnections.size() < kMaxPooledReadConnections)
+            _readConnections.push_back(move(connection));
+        // (otherwise the connection is closed here)
+    }
+
+
     void SQLiteDataFile::decrypt() {
         auto alg = options().encryptionAlgorithm;
         if (!factory().encryptionEnabled(alg))
@@ -634,6 +704,77 @@ namespace litecore {
     }
 
 
+    // The row count of a table (or one of its indexes) as of its last ANALYZE, or 0 if unknown.
+    int64_t SQLiteDataFile::analyzedRowCount(const string &tableName) {
+        if (!tableExists("sqlite_stat1"))
+            return 0;
+        SQLite::Statement stmt(*_sqlDb, "SELECT stat FROM sqlite_stat1 WHERE tbl=? LIMIT 1");
+        stmt.bind(1, tableName);
+        return stmt.executeStep() ? atoll(stmt.getColumn(0).getText()) : 0;
+    }
+
+
+    // Re-analyzes the first KeyStore that's changed substantially since it was last analyzed.
+    // A KeyStore's write count is its last sequence plus its purge count, both of which only
+    // increase. The first time a KeyStore is seen its statistics are assumed to be current,
+    // unless it has none at all; `PRAGMA optimize` catches up on close anyway.
+    bool SQLiteDataFile::refreshStatistics() {
+        Assert(inTransaction());
+        vector<pair<string, uint64_t>> stores;
+        {
+            SQLite::Statement stmt(*_sqlDb, (_schemaVersion >= SchemaVersion::WithPurgeCount)
+                                               ? "SELECT name, lastSeq + purgeCnt FROM kvmeta"
+                                               : "SELECT name, lastSeq FROM kvmeta");
+            while (stmt.executeStep())
+                stores.emplace_back(stmt.getColumn(0).getString(), (int64_t)stmt.getColumn(1));
+        }
+
+        for (auto &[name, writes] : stores) {
+            string table = "kv_" + name;
+            if (!tableExists(table))
+                continue;
+            int64_t rowCount = analyzedRowCount(table);
+            if (auto i = _writesAtAnalyze.find(name); i == _writesAtAnalyze.end()) {
+                if (rowCount > 0 || intQuery(("SELECT max(rowid) FROM \"" + table + "\"").c_str())
+                                        < (int64_t)kStatsMinWrites) {
+                    _writesAtAnalyze[name] = writes;
+                    continue;
+                }
+            } else if (writes - i->second < max(kStatsMinWrites,
+                                                 uint64_t(rowCount * kStatsChangeFraction))) {
+                continue;
+            }
+            analyzeKeyStore(name);
+            _writesAtAnalyze[name] = writes;
+            return true;                // Leave any others for the next step
+        }
+        return false;
+    }
+
+
+    // Runs a bounded ANALYZE of a KeyStore's table and of its indexes' own tables.
+    void SQLiteDataFile::analyzeKeyStore(const string &keyStoreName) {
+        vector<string> tables {"kv_" + keyStoreName};
+        for (auto &spec : getIndexes(nullptr)) {
+            if (spec.keyStoreName != keyStoreName || spec.indexTableName.empty()
+                    || find(tables.begin(), tables.end(), spec.indexTableName) != tables.end())
+                continue;
+            // (Virtual tables, i.e. FTS and R-tree indexes, can't be analyzed.)
+            string sql;
+            if (getSchema(spec.indexTableName, "table", spec.indexTableName, sql)
+                    && !hasPrefix(sql, "CREATE VIRTUAL"))
+                tables.push_back(spec.indexTableName);
+        }
+
+        fleece::Stopwatch st;
+        exec(CONCAT("PRAGMA analysis_limit=" << kAnalysisLimit));
+        for (auto &table : tables)
+            exec("ANALYZE \"" + table + "\"");
+        logInfo("Refreshed query statistics of KeyStore '%s' (%zu tables) in %.3f sec",
+                keyStoreName.c_str(), tables.size(), st.elapsed());
+    }
+
+
     void SQLiteDataFile::vacuum(bool always) {
         // <https://blogs.gnome.org/jnelson/2015/01/06/sqlite-vacuum-and-auto_vacuum/>
         try {
@@ -20,8 +20,13 @@
 
 #include "DataFile.hh"
 #include "IndexSpec.hh"
+#include "IndexAdvisor.hh"
 #include "UnicodeCollator.hh"
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <vector>
 
 namespace SQLite {
     class Database;
@@ -49,6 +54,9 @@ namespace litecore {
         void compact() override;
         void optimize();
         void vacuum(bool always);
+        bool mergeFullTextIndexes() override;
+        bool refreshStatistics() override;
+        bool retrainVectorIndexes() override;
 
         static void shutdown() { }
 
@@ -85,6 +93,21 @@ namespace litecore {
                           int64_t &outRowCount,
                           alloc_slice *outRows =nullptr);
 
+        /** Returns a read-only connection to the same file, for running part of a query on
+            another thread. It comes from a pool, opening a new one if the pool is empty.
+            Give it back with returnReadConnection when done. At most kMaxPooledReadConnections
+            are kept in the pool; any more are closed when returned. */
+        std::unique_ptr<SQLiteDataFile> borrowReadConnection();
+        void returnReadConnection(std::unique_ptr<SQLiteDataFile>);
+
+        static constexpr size_t kMaxPooledReadConnections = 8;
+
+        /** Records the queries run on this connection, when enabled, for adviseIndexes(). */
+        QueryWorkload& queryWorkload()                      {return _queryWorkload;}
+
+        /** Suggests indexes to add or remove, based on the recorded query workload. */
+        IndexAdvice adviseIndexes();
+
     protected:
         std::string loggingClassName() const override       {return "DB";}
         void logKeyStoreOp(SQLiteKeyStore&, const char *op, slice key);
@@ -145,16 +168,27 @@ namespace litecore {
         void registerIndex(const litecore::IndexSpec&,
                            const std::string &keyStoreName,
                            const std::string &indexTableName);
+        void updateIndexExpression(const litecore::IndexSpec&);
         void unregisterIndex(slice indexName);
         void garbageCollectIndexTable(const std::string &tableName);
+        int64_t analyzedRowCount(const std::string &tableName);
+        void analyzeKeyStore(const std::string &keyStoreName);
         SQLiteIndexSpec specFromStatement(SQLite::Statement &stmt);
+        void rebuildSortKeyIndexes();
         std::vector<SQLiteIndexSpec> getIndexesOldStyle(const KeyStore *store =nullptr);
 
+        class ReadConnectionDelegate;
+
         std::unique_ptr<SQLite::Database>    _sqlDb;         // SQLite database object
         std::unique_ptr<SQLite::Statement>   _getLastSeqStmt, _setLastSeqStmt;
         std::unique_ptr<SQLite::Statement>   _getPurgeCntStmt, _setPurgeCntStmt;
         CollationContextVector               _collationContexts;
         SchemaVersion                        _schemaVersion {SchemaVersion::None};
+        std::unique_ptr<ReadConnectionDelegate> _readConnectionDelegate;
+        std::vector<std::unique_ptr<SQLiteDataFile>> _readConnections;  // Pool of idle connections
+        std::mutex                           _readConnectionsMutex;
+        QueryWorkload                        _queryWorkload;
+        std::map<std::string, uint64_t>      _writesAtAnalyze;  // KeyStore -> writeCount at ANALYZE
     };
 
 
@@ -22,6 +22,8 @@
 #include "FleeceImpl.hh"
 #include <mutex>
 #include <atomic>
+#include <optional>
+#include <set>
 
 namespace SQLite {
     class Column;
@@ -81,6 +83,12 @@ namespace litecore {
         virtual std::string predictiveTableName(const std::string &property) const override;
 #endif
         virtual bool tableExists(const std::string &tableName) const override;
+        virtual std::string coveringTableName(const std::string &identifier) const override;
+        virtual std::string spatialTableName(const std::string &indexName) const override;
+        virtual std::string vectorTableName(const std::string &indexName) const override;
+        virtual std::string aggregateTableName(const std::string &identifier) const override;
+        virtual std::vector<std::string> tableColumns(const std::string &tableName) const override;
+        virtual bool hasSortKeyIndex(const std::string &sortKeyExpression) const override;
 
 
     protected:
@@ -117,13 +125,22 @@ namespace litecore {
                            string_view operation,
                            std::string when,
                            string_view statements);
+        bool _createIndex(const IndexSpec&);
+        void resetSortKeyExpressions();
         bool createValueIndex(const IndexSpec&);
+        void createCoveringTable(const fleece::impl::Value *expression);
+        void garbageCollectCoveringTables();
         bool createIndex(const IndexSpec&,
                               const std::string &sourceTableName,
                               fleece::impl::Array::iterator &expressions);
         void _createFlagsIndex(const char *indexName NONNULL, DocumentFlags flag, bool &created);
         bool createFTSIndex(const IndexSpec&);
         bool createArrayIndex(const IndexSpec&);
+        bool createSpatialIndex(const IndexSpec&);
+        bool createVectorIndex(const IndexSpec&);
+        void trainVectorIndex(const IndexSpec&);
+        bool moveRetiredVectors(const IndexSpec&, int64_t limit);
+        bool createAggregateIndex(const IndexSpec&);
         std::string createUnnestedTable(const fleece::impl::Value *arrayPath, const IndexSpec::Options*);
         bool hasExpiration();
         void addExpiration();
@@ -131,6 +148,8 @@ namespace litecore {
 #ifdef COUCHBASE_ENTERPRISE
         bool createPredictiveIndex(const IndexSpec&);
         std::string createPredictionTable(const fleece::impl::Value *arrayPath, const IndexSpec::Options*);
+        void populatePredictionTable(const std::string &predTableName,
+                                     const fleece::impl::Value *expression);
         void garbageCollectPredictiveIndexes();
 #endif
 
@@ -152,6 +171,8 @@ namespace litecore {
         bool _hasExpirationColumn {false};
         bool _uncommittedExpirationColumn {false};
         mutable std::mutex _stmtMutex;
+        mutable std::optional<std::set<std::string>> _sortKeyExpressions; // (see hasSortKeyIndex)
+        mutable std::mutex _sortKeyMutex;
     };
 
 }
@@ -72,4 +72,13 @@ namespace litecore {
 
 
     void RegisterSQLiteFunctions(sqlite3 *db, fleeceFuncContext);
+
+
+    // Registers the 'unicodesn' FTS tokenizer, wrapped in LiteCore's faster ASCII tokenizer.
+    // (The plain unicodesn tokenizer remains available as 'unicodesn_base'.)
+    int RegisterFTSTokenizer(sqlite3 *db);
+
+    // Tells the FTS tokenizer whether a query is running on the current thread. Calls must be
+    // balanced, since they also count the queries running on all threads.
+    void FTSTokenizerRunningQuery(bool running);
 }
@@ -130,6 +130,63 @@ namespace litecore {
     }
 
 
+    int LikeASCII(slice comparand, slice pattern, bool caseSensitive) noexcept {
+        // Same algorithm as LikeUTF8, but every character is a single byte
+        auto s = (const uint8_t*)comparand.buf, sEnd = s + comparand.size;
+        auto p = (const uint8_t*)pattern.buf, pEnd = p + pattern.size;
+        const uint8_t *escaped = nullptr;       // One past the last escaped pattern char
+        auto equal = [caseSensitive](uint8_t a, uint8_t b) {
+            return a == b || (!caseSensitive && uint8_t((a | 0x20) - 'a') < 26
+                                             && (a | 0x20) == (b | 0x20));
+        };
+
+        while (p < pEnd) {
+            uint8_t c = *p++;
+            if (c == '%') {
+                // Skip over multiple '%' and '_' characters, consuming an input char for each '_':
+                while (p < pEnd && (*p == '%' || *p == '_')) {
+                    if (*p++ == '_') {
+                        if (s == sEnd)
+                            return kLikeNoWildcardMatch;
+                        ++s;
+                    }
+                }
+                if (p == pEnd)
+                    return kLikeMatch;
+                c = *p++;
+                if (c == '\\') {
+                    if (p == pEnd)
+                        return kLikeNoWildcardMatch;
+                    c = *p++;
+                }
+                // Match the rest of the pattern at each occurrence of `c` in the input:
+                while (s < sEnd) {
+                    if (!equal(*s++, c))
+                        continue;
+                    int match = LikeASCII(slice(s, sEnd), slice(p, pEnd), caseSensitive);
+                    if (match != kLikeNoMatch)
+                        return match;
+                }
+                return kLikeNoWildcardMatch;
+            }
+
+            if (c == '\\') {
+                if (p == pEnd)
+                    return kLikeNoMatch;
+                c = *p++;
+                escaped = p;
+            }
+            if (s < sEnd) {
+                uint8_t c2 = *s++;
+                if (equal(c2, c) || (c == '_' && p != escaped))
+                    continue;
+            }
+            return kLikeNoMatch;
+        }
+        return s == sEnd ? kLikeMatch : kLikeNoMatch;
+    }
+
+
     std::string Collation::sqliteName() const {
         if (unicodeAware) {
             std::stringstream name;
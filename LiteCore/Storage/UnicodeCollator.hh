@@ -90,9 +90,27 @@ namespace litecore {
     int LikeUTF8(fleece::slice str1, fleece::slice str2, const Collation&);
     int LikeUTF8(fleece::slice str1, fleece::slice str2, const CollationContext&);
 
+    /** Fast LIKE function for pure-ASCII strings; the result is the same as LikeUTF8's when the
+        CollationContext's canCompareASCII is true. */
+    int LikeASCII(fleece::slice str1, fleece::slice str2, bool caseSensitive) noexcept;
+
     /** Unicode-aware string containment function accepting two UTF-8 encoded strings*/
     bool ContainsUTF8(fleece::slice str, fleece::slice substr, const CollationContext &ctx);
 
+    /** Returns true if this platform's collator can produce sort keys (see CollationSortKey.) */
+    bool CollationSortKeysSupported();
+
+    /** Returns the sort key of a UTF-8 string: a binary string such that the sort keys of two
+        strings compare (with memcmp) the same way the strings do with the collation.
+        Returns a null slice if CollationSortKeysSupported() is false. */
+    fleece::alloc_slice CollationSortKey(fleece::slice str, const CollationContext&);
+
+    /** Returns a string identifying the version of the collator's rules for a collation. Sort
+        keys made by different versions may not compare correctly with each other, so anything
+        storing sort keys needs to be rebuilt when this changes.
+        Returns an empty string if CollationSortKeysSupported() is false. */
+    std::string CollationSortKeyVersion(const Collation&);
+
     /** Registers a specific SQLite collation function with the given options.
         The returned object needs to be kept alive until the database is closed, then deleted. */
     std::unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3*, const Collation&);
@@ -157,6 +157,22 @@ namespace litecore {
     }
 
 
+    // CoreFoundation has no API for getting a sort key.
+    bool CollationSortKeysSupported() {
+        return false;
+    }
+
+
+    alloc_slice CollationSortKey(slice str, const CollationContext &ctx) {
+        return nullslice;
+    }
+
+
+    string CollationSortKeyVersion(const Collation&) {
+        return "";
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
                                                                 const Collation &coll) {
         unique_ptr<CollationContext> context(new CFCollationContext(coll));
@@ -30,6 +30,8 @@
 #endif
 #include <locale>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 #if LITECORE_USES_ICU // See UnicodeCollator_*.cc for other implementations
 
@@ -49,6 +51,8 @@
 #pragma clang diagnostic ignored "-Wdocumentation"
 #include <unicode/uloc.h>
 #include <unicode/ucol.h>
+#include <unicode/ustring.h>
+#include <unicode/uversion.h>
 #pragma clang diagnostic pop
 
 // http://userguide.icu-project.org/collation
@@ -61,38 +65,54 @@ namespace litecore {
     using namespace fleece;
 
 
-    class ICUCollationContext : public CollationContext {
-    public:
-        UCollator* ucoll {nullptr};
+    // Opening and configuring an ICU collator is far more expensive than comparing strings with
+    // it, and contexts are created often (for every call of a function with a collation argument,
+    // and by CompareUTF8 and LikeUTF8.) So there's only one collator per set of options, shared
+    // by all contexts. ICU collators are thread-safe once configured, and these are never closed.
+    static const UCollator* sharedCollator(const Collation &collation) {
+        static mutex sMutex;
+        static unordered_map<string, UCollator*> sCollators;
 
-        ICUCollationContext(const Collation &collation)
-        :CollationContext(collation)
-        {
-            UErrorCode status = U_ZERO_ERROR;
-            ucoll = ucol_open(collation.localeName.asString().c_str(), &status);
-            if (U_SUCCESS(status)) {
-                if (status == U_USING_DEFAULT_WARNING)
-                    Warn("LiteCore indexer: unknown locale '%.*s', using default collator",
-                         SPLAT(collation.localeName));
-
-                if (collation.diacriticSensitive) {
-                    if (!collation.caseSensitive)
-                        ucol_setAttribute(ucoll, UCOL_STRENGTH, UCOL_SECONDARY, &status);
-                } else {
-                    ucol_setAttribute(ucoll, UCOL_STRENGTH, UCOL_PRIMARY, &status);
-                    if (collation.caseSensitive)
-                        ucol_setAttribute(ucoll, UCOL_CASE_LEVEL, UCOL_ON, &status);
-                }
+        string key = collation.sqliteName();        // (this encodes the options and locale)
+        lock_guard<mutex> lock(sMutex);
+        if (auto i = sCollators.find(key); i != sCollators.end())
+            return i->second;
+
+        UErrorCode status = U_ZERO_ERROR;
+        UCollator *ucoll = ucol_open(collation.localeName.asString().c_str(), &status);
+        if (U_SUCCESS(status)) {
+            if (status == U_USING_DEFAULT_WARNING)
+                Warn("LiteCore indexer: unknown locale '%.*s', using default collator",
+                     SPLAT(collation.localeName));
+
+            if (collation.diacriticSensitive) {
+                if (!collation.caseSensitive)
+                    ucol_setAttribute(ucoll, UCOL_STRENGTH, UCOL_SECONDARY, &status);
+            } else {
+                ucol_setAttribute(ucoll, UCOL_STRENGTH, UCOL_PRIMARY, &status);
+                if (collation.caseSensitive)
+                    ucol_setAttribute(ucoll, UCOL_CASE_LEVEL, UCOL_ON, &status);
             }
-            if (U_FAILURE(status))
-                error::_throw(error::UnexpectedError, "Failed to set up collation (ICU error %d)",
-                              (int)status);
         }
-
-        ~ICUCollationContext() {
+        if (U_FAILURE(status)) {
             if (ucoll)
                 ucol_close(ucoll);
+            error::_throw(error::UnexpectedError, "Failed to set up collation (ICU error %d)",
+                          (int)status);
         }
+        sCollators.emplace(key, ucoll);
+        return ucoll;
+    }
+
+
+    class ICUCollationContext : public CollationContext {
+    public:
+        const UCollator* ucoll;
+
+        ICUCollationContext(const Collation &collation)
+        :CollationContext(collation)
+        ,ucoll(sharedCollator(collation))
+        { }
     };
 
 
@@ -159,6 +179,55 @@ namespace litecore {
     }
 
 
+    bool CollationSortKeysSupported() {
+        return true;
+    }
+
+
+    alloc_slice CollationSortKey(slice str, const CollationContext &ctx) {
+        auto &coll = (const ICUCollationContext&)ctx;
+        // ucol_getSortKey takes UTF-16, so convert the string first:
+        UErrorCode status = U_ZERO_ERROR;
+        int32_t len16 = 0;
+        u_strFromUTF8(nullptr, 0, &len16, (const char*)str.buf, (int32_t)str.size, &status);
+        if (status != U_BUFFER_OVERFLOW_ERROR && U_FAILURE(status))
+            error::_throw(error::UnexpectedError, "Invalid UTF-8 string (ICU error %d)",
+                          (int)status);
+        status = U_ZERO_ERROR;
+        u16string chars(len16, u'\0');
+        u_strFromUTF8((UChar*)chars.data(), len16, nullptr,
+                      (const char*)str.buf, (int32_t)str.size, &status);
+        if (U_FAILURE(status))
+            error::_throw(error::UnexpectedError, "Invalid UTF-8 string (ICU error %d)",
+                          (int)status);
+
+        // Sort keys are usually a bit longer than the string; retry if the guess is too small:
+        alloc_slice key(2 * str.size + 16);
+        int32_t keyLen = ucol_getSortKey(coll.ucoll, (const UChar*)chars.data(), len16,
+                                         (uint8_t*)key.buf, (int32_t)key.size);
+        if (keyLen > (int32_t)key.size) {
+            key = alloc_slice(keyLen);
+            keyLen = ucol_getSortKey(coll.ucoll, (const UChar*)chars.data(), len16,
+                                     (uint8_t*)key.buf, (int32_t)key.size);
+        }
+        if (keyLen <= 0)
+            error::_throw(error::UnexpectedError, "Failed to get collation sort key");
+        key.shorten(keyLen - 1);        // (omit the trailing 00 byte)
+        return key;
+    }
+
+
+    // The collator's version changes with the ICU data's collation rules, e.g. when the OS
+    // updates ICU, and with the locale's tailoring.
+    string CollationSortKeyVersion(const Collation &collation) {
+        UVersionInfo version;
+        ucol_getVersion(sharedCollator(collation), version);
+        char str[U_MAX_VERSION_STRING_LENGTH];
+        u_versionToString(version, str);
+        return string("icu-") + str;
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
                                                                 const Collation &coll) {
         unique_ptr<CollationContext> context(new ICUCollationContext(coll));
@@ -33,6 +33,18 @@ namespace litecore {
         error::_throw(error::Unimplemented);
     }
 
+    bool CollationSortKeysSupported() {
+        return false;
+    }
+
+    alloc_slice CollationSortKey(slice str, const CollationContext&) {
+        return nullslice;
+    }
+
+    string CollationSortKeyVersion(const Collation&) {
+        return "";
+    }
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
                                                                 const Collation &coll) {
         return nullptr;
@@ -159,6 +159,44 @@ namespace litecore {
     }
 
 
+    bool CollationSortKeysSupported() {
+        return true;
+    }
+
+
+    alloc_slice CollationSortKey(slice str, const CollationContext &ctx) {
+        auto &coll = (const WinApiCollationContext&)ctx;
+        int len = (int)str.size;
+        TempArray(wchars, WCHAR, len + 1);
+        int size = MultiByteToWideChar(CP_UTF8, 0, (char *)str.buf, len, wchars, len + 1);
+        DWORD flags = LCMAP_SORTKEY | coll.flags;
+        int keyLen = LCMapStringEx(coll.localeName, flags, wchars, size, nullptr, 0,
+                                   nullptr, nullptr, 0);
+        if (keyLen <= 0)
+            error::_throw(error::UnexpectedError, "Failed to get collation sort key (Error %d)",
+                          (int)GetLastError());
+        alloc_slice key(keyLen);
+        LCMapStringEx(coll.localeName, flags, wchars, size, (LPWSTR)key.buf, keyLen,
+                      nullptr, nullptr, 0);
+        if (((const uint8_t*)key.buf)[keyLen - 1] == 0)
+            key.shorten(keyLen - 1);    // (omit the trailing 00 byte)
+        return key;
+    }
+
+
+    // The NLS version changes when Windows updates the sorting rules of the locale.
+    string CollationSortKeyVersion(const Collation &coll) {
+        WinApiCollationContext ctx(coll);
+        NLSVERSIONINFOEX info = {};
+        info.dwNLSVersionInfoSize = sizeof(info);
+        if (!GetNLSVersionEx(COMPARE_STRING, ctx.localeName, &info))
+            error::_throw(error::UnexpectedError, "Failed to get collation version (Error %d)",
+                          (int)GetLastError());
+        return format("win-%lx.%lx", (unsigned long)info.dwNLSVersion,
+                                     (unsigned long)info.dwDefinedVersion);
+    }
+
+
     unique_ptr<CollationContext> RegisterSQLiteUnicodeCollation(sqlite3* dbHandle,
         const Collation &coll) {
         unique_ptr<CollationContext> context(new WinApiCollationContext(coll));
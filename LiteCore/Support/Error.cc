@@ -228,6 +228,8 @@ namespace litecore {
             "database cannot be upgraded to the current version", // 30
             "can't apply document delta: base revision body unavailable",
             "can't apply document delta: format is invalid",
+            "query was canceled",
+            "query timed out",
         };
         static_assert(sizeof(kLiteCoreMessages)/sizeof(kLiteCoreMessages[0]) ==
                         error::NumLiteCoreErrorsPlus1, "Incomplete error message table");
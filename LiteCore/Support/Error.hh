@@ -78,6 +78,8 @@ namespace litecore {
             CantUpgradeDatabase,
             DeltaBaseUnknown,
             CorruptDelta,
+            QueryCanceled,
+            QueryTimeout,
 
             // Add new codes here. You MUST add messages to kLiteCoreMessages!
             // You MUST add corresponding kC4Err codes to the enum in C4Base.h!
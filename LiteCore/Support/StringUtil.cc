@@ -21,6 +21,12 @@
 #include "PlatformIO.hh"
 #include <sstream>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define LITECORE_USES_SSE2 1
+#endif
 
 namespace litecore {
 
@@ -205,7 +211,9 @@ namespace litecore {
 
     size_t UTF8Length(slice str) noexcept {
         // See <https://en.wikipedia.org/wiki/UTF-8>
-        size_t length = 0;
+        // Every ASCII byte is a character, so skip those quickly first:
+        size_t length = ASCIIPrefixLength(str);
+        str.moveStart(length);
         while (str.size > 0) {
             const size_t nextByteLength = NextUTF8Length(str);
             if(nextByteLength == 0) {
@@ -279,6 +287,137 @@ namespace litecore {
     }
 
 
+    //////// ASCII FAST PATHS:
+
+
+    static inline uint8_t asciiLowercase(uint8_t c) noexcept {
+        return (uint8_t(c - 'A') < 26) ? (c | 0x20) : c;
+    }
+
+
+    static inline bool asciiEqual(const uint8_t *a, const uint8_t *b, size_t n,
+                                  bool caseSensitive) noexcept
+    {
+        if (caseSensitive)
+            return memcmp(a, b, n) == 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (asciiLowercase(a[i]) != asciiLowercase(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+
+#if LITECORE_USES_SSE2
+    // Returns a mask of the bytes in the range [lo..hi]. (The signed comparison is fine since
+    // only ASCII bytes can be in the range; other bytes are negative.)
+    static inline __m128i inRange(__m128i chars, char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(lo - 1)),
+                             _mm_cmplt_epi8(chars, _mm_set1_epi8(hi + 1)));
+    }
+
+    static inline __m128i lowercase16(__m128i chars) {
+        return _mm_or_si128(chars, _mm_and_si128(inRange(chars, 'A', 'Z'), _mm_set1_epi8(0x20)));
+    }
+#endif
+
+
+    size_t ASCIIPrefixLength(slice str) noexcept {
+        auto begin = (const uint8_t*)str.buf, s = begin, end = s + str.size;
+#if LITECORE_USES_SSE2
+        for (; end - s >= 16; s += 16) {
+            if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)s)) != 0)
+                break;      // (the loop below will find which byte it is)
+        }
+#else
+        for (; end - s >= 8; s += 8) {
+            uint64_t word;
+            memcpy(&word, s, sizeof(word));
+            if (word & 0x8080808080808080ull)
+                break;
+        }
+#endif
+        while (s < end && *s < 0x80)
+            ++s;
+        return s - begin;
+    }
+
+
+    alloc_slice ASCIIChangeCase(slice str, bool toUppercase) {
+        alloc_slice result(str.size);
+        auto src = (const uint8_t*)str.buf, end = src + str.size;
+        auto dst = (uint8_t*)result.buf;
+        const char first = toUppercase ? 'a' : 'A';
+#if LITECORE_USES_SSE2
+        const __m128i caseBit = _mm_set1_epi8(0x20);
+        for (; end - src >= 16; src += 16, dst += 16) {
+            __m128i chars = _mm_loadu_si128((const __m128i*)src);
+            __m128i letters = inRange(chars, first, char(first + 25));
+            _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(chars, _mm_and_si128(letters, caseBit)));
+        }
+#endif
+        for (; src < end; ++src, ++dst)
+            *dst = (uint8_t(*src - first) < 26) ? (*src ^ 0x20) : *src;
+        return result;
+    }
+
+
+    const void* ASCIIFind(slice str, slice substr, bool caseSensitive) noexcept {
+        if (substr.size == 0)
+            return str.buf;
+        if (substr.size > str.size)
+            return nullptr;
+        auto s = (const uint8_t*)str.buf, needle = (const uint8_t*)substr.buf;
+        const size_t n = substr.size;
+        const uint8_t *lastStart = s + str.size - n;    // last position the match could start at
+        uint8_t first = needle[0], last = needle[n - 1];
+        if (!caseSensitive) {
+            first = asciiLowercase(first);
+            last = asciiLowercase(last);
+        }
+#if LITECORE_USES_SSE2
+        // Look for the first and last bytes of the needle at the right distance apart, 16
+        // positions at a time; only the candidates that match both get compared in full.
+        const __m128i firsts = _mm_set1_epi8(char(first)), lasts = _mm_set1_epi8(char(last));
+        for (; lastStart - s >= 15; s += 16) {
+            __m128i heads = _mm_loadu_si128((const __m128i*)s);
+            __m128i tails = _mm_loadu_si128((const __m128i*)(s + n - 1));
+            if (!caseSensitive) {
+                heads = lowercase16(heads);
+                tails = lowercase16(tails);
+            }
+            int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(heads, firsts),
+                                                       _mm_cmpeq_epi8(tails, lasts)));
+            for (int i = 0; mask != 0; ++i, mask >>= 1) {
+                if ((mask & 1) && asciiEqual(s + i, needle, n, caseSensitive))
+                    return s + i;
+            }
+        }
+#endif
+        for (; s <= lastStart; ++s) {
+            uint8_t c = caseSensitive ? *s : asciiLowercase(*s);
+            if (c == first && asciiEqual(s, needle, n, caseSensitive))
+                return s;
+        }
+        return nullptr;
+    }
+
+
+    void ASCIITrim(slice &str, int onSide) noexcept {
+        auto isSpace = [](uint8_t c) {return c == ' ' || (c >= 0x09 && c <= 0x0D);};
+        auto begin = (const uint8_t*)str.buf, end = begin + str.size;
+        if (onSide <= 0) {
+            while (begin < end && isSpace(*begin))
+                ++begin;
+        }
+        if (onSide >= 0) {
+            while (end > begin && isSpace(end[-1]))
+                --end;
+        }
+        str = slice(begin, end);
+    }
+
+
 #if !__APPLE__ && !defined(_MSC_VER) && !LITECORE_USES_ICU    // TODO: Full implementation of UTF8ChangeCase for other platforms (see StringUtil_Apple.mm)
 
     // Stub implementation for when case conversion is unavailable
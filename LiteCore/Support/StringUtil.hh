@@ -161,6 +161,30 @@ namespace litecore {
     /** Returns true if `c` is a Unicode whitespace character. */
     bool UTF16IsSpace(char16_t c) noexcept;
 
+    //////// ASCII FAST PATHS:
+
+    // These are much faster than the Unicode-aware functions above (they use SSE2 when available),
+    // and give the same results when the strings are pure ASCII.
+
+    /** Returns the number of bytes at the start of the string that are ASCII (less than 0x80). */
+    size_t ASCIIPrefixLength(fleece::slice) noexcept;
+
+    /** Returns true if the string contains only ASCII characters. */
+    static inline bool isASCII(fleece::slice str) noexcept {
+        return ASCIIPrefixLength(str) == str.size;
+    }
+
+    /** Returns a copy of a string with all ASCII letters converted to upper- or lowercase.
+        Non-ASCII bytes are copied unchanged. */
+    fleece::alloc_slice ASCIIChangeCase(fleece::slice str, bool toUppercase);
+
+    /** Returns a pointer to the first occurrence of `substr` in `str`, or nullptr if not found.
+        If `caseSensitive` is false, ASCII upper- and lowercase letters are equivalent. */
+    const void* ASCIIFind(fleece::slice str, fleece::slice substr, bool caseSensitive) noexcept;
+
+    /** Trims ASCII whitespace from one or both ends of the string, like UTF16Trim. */
+    void ASCIITrim(fleece::slice &str, int onSide) noexcept;
+
 }
 
 
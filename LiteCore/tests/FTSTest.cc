@@ -108,6 +108,56 @@ TEST_CASE_METHOD(FTSTest, "Query Full-Text English", "[Query][FTS]") {
 }
 
 
+TEST_CASE_METHOD(FTSTest, "Query Full-Text BM25", "[Query][FTS]") {
+    createIndex({"english", true});
+    Retained<Query> query{ store->compileQuery(json5(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                    ORDER_BY: [['DESC', ['bm25()', 'sentence']]],\
+                        WHAT: [['.sentence']]}]")) };
+    CHECK(query->explain().find("bm25(matchinfo(") != string::npos);
+
+    // Equal hit counts, so the shorter sentence ranks first; top-k via LIMIT:
+    testQuery(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'search'],\
+                    ORDER_BY: [['DESC', ['bm25()', 'sentence']]],\
+                        WHAT: [['.sentence']], LIMIT: 2}]",
+              {1, 2},
+              {3, 3});
+
+    ExpectException(error::LiteCore, error::InvalidQuery, [&]{
+        store->compileQuery(json5("['SELECT', {WHAT: [['bm25()', 'sentence']]}]"));
+    });
+}
+
+
+TEST_CASE_METHOD(FTSTest, "Query Full-Text Snippet", "[Query][FTS]") {
+    createIndex({"english", true});
+    auto snippets = [&](const char *what) {
+        Retained<Query> query{ store->compileQuery(json5(
+            string("['SELECT', {'WHERE': ['MATCH', 'sentence', 'adventures'], WHAT: [")
+                   + what + "]}]")) };
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        while (e->next())
+            results.push_back(e->columns()[0]->asString().asString());
+        return results;
+    };
+
+    auto results = snippets("['snippet()', 'sentence']");
+    REQUIRE(results.size() == 1);
+    CHECK(results[0].find("<b>adventures</b>") != string::npos);
+
+    results = snippets("['snippet()', 'sentence', '[', ']', '...', 4]");
+    REQUIRE(results.size() == 1);
+    CHECK(results[0].find("[adventures]") != string::npos);
+    CHECK(results[0].find("Looking") == string::npos);
+
+    ExpectException(error::LiteCore, error::InvalidQuery, [&]{
+        store->compileQuery(json5("['SELECT', {WHAT: [['snippet()', 'sentence']]}]"));
+    });
+}
+
+
 TEST_CASE_METHOD(FTSTest, "Query Full-Text English_US", "[Query][FTS]") {
     // Check that language+country code is allowed:
     createIndex({"en_US", true});
@@ -449,3 +499,54 @@ TEST_CASE_METHOD(FTSTest, "Test with non-string values", "[FTS][Query]") {
     Retained<QueryEnumerator> results(query->createEnumerator(&queryOptions));        
     CHECK(results->getRowCount() == 1);
 }
+
+
+TEST_CASE_METHOD(FTSTest, "Incremental FTS Merge", "[FTS][Query]") {
+    unsigned mergePages = 0;
+    SECTION("Default merge policy") {
+        store->createIndex("sentence", "[[\".sentence\"]]", IndexSpec::kFullText);
+        mergePages = IndexSpec::kDefaultFTSMergePages;
+    }
+    SECTION("Custom merge policy") {
+        store->createIndex("sentence", R"({"WHAT": [[".sentence"]], "MERGE": 16})",
+                           IndexSpec::kFullText);
+        mergePages = 16;
+    }
+    SECTION("Merging disabled") {
+        store->createIndex("sentence", R"({"WHAT": [[".sentence"]], "MERGE": 0})",
+                           IndexSpec::kFullText);
+    }
+
+    // Each transaction adds another segment to the FTS b-tree:
+    for (int i = 5; i < 15; i++) {
+        Transaction t(store->dataFile());
+        createDoc(t, i, stringWithFormat("Document %d is about search engines.", i));
+        t.commit();
+    }
+
+    unsigned steps = 0;
+    {
+        Transaction t(store->dataFile());
+        while (store->dataFile().mergeFullTextIndexes())
+            REQUIRE(++steps < 1000);
+        t.commit();
+    }
+    Log("Merged FTS index in %u steps", steps);
+    CHECK((steps > 0) == (mergePages > 0));
+
+    Retained<Query> query{ store->compileQuery(json5(
+        "['SELECT', {'WHERE': ['MATCH', 'sentence', 'engines'], WHAT: [['.sentence']]}]")) };
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    CHECK(e->getRowCount() == 11);
+}
+
+
+TEST_CASE_METHOD(FTSTest, "Invalid FTS Merge Policy", "[FTS][Query]") {
+    ExpectException(error::LiteCore, error::InvalidQuery, [&]{
+        store->createIndex("sentence", R"({"WHAT": [[".sentence"]], "MERGE": -1})",
+                           IndexSpec::kFullText);
+    });
+    ExpectException(error::LiteCore, error::InvalidQuery, [&]{
+        store->createIndex("num", R"({"WHAT": [[".num"]], "MERGE": 100})");
+    });
+}
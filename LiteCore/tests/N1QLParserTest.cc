@@ -19,6 +19,9 @@
 #include "QueryParserTest.hh"
 #include "n1ql_parser.hh"
 #include "StringUtil.hh"
+#include "Benchmark.hh"
+#include "QueryParser.hh"
+#include "FleeceImpl.hh"
 #include "fleece/Mutable.hh"
 #include <iostream>
 
@@ -51,6 +54,33 @@ protected:
         FLValue_Release(dict);
         return jsonResult;
     }
+
+    // Compiles N1QL to SQL the way queries used to: by way of the parse tree's JSON form.
+    string compileViaJSON(const char *n1ql, Benchmark &bench) {
+        bench.start();
+        unsigned errorPos;
+        FLMutableDict dict = n1ql::parse(n1ql, &errorPos);
+        alloc_slice json(FLValue_ToJSON((FLValue)dict));
+        FLValue_Release(dict);
+        QueryParser qp(*this);
+        qp.parseJSON(json);
+        string sql = qp.SQL();
+        bench.stop();
+        return sql;
+    }
+
+    // Compiles N1QL to SQL the way SQLiteQuery does: directly from the parse tree.
+    string compileDirect(const char *n1ql, Benchmark &bench) {
+        bench.start();
+        unsigned errorPos;
+        FLMutableDict dict = n1ql::parse(n1ql, &errorPos);
+        QueryParser qp(*this);
+        qp.parse((const fleece::impl::Value*)dict);
+        string sql = qp.SQL();
+        FLValue_Release(dict);
+        bench.stop();
+        return sql;
+    }
 };
 
 // NOTE: the translate() method converts `"` to `'` in its output, to make the string literals
@@ -248,3 +278,38 @@ TEST_CASE_METHOD(N1QLParserTest, "N1QL JOIN", "[Query][N1QL][C]") {
     CHECK(translate("SELECT db.name FROM db JOIN db AS other ON other.key = db.key CROSS JOIN x")
           == "{'FROM':[{'AS':'db'},{'AS':'other','JOIN':'INNER','ON':['=',['.other.key'],['.db.key']]},{'AS':'x','JOIN':'CROSS'}],'WHAT':[['.db.name']]}");
 }
+
+
+TEST_CASE_METHOD(N1QLParserTest, "N1QL compile performance", "[Query][N1QL][Perf][.slow]") {
+    // A selection of the queries from the tests above:
+    static const char* const kQueries[] = {
+        "SELECT FALSE",
+        "SELECT foo GROUP BY bar, baz HAVING hi",
+        "SELECT foo ORDER BY bar DESC",
+        "SELECT foo LIMIT 10 OFFSET 20",
+        "SELECT productId, color, categories WHERE categories[0] LIKE 'Bed%' AND test_id='where_func' ORDER BY productId LIMIT 3",
+        "SELECT foo WHERE foo = 'hi'",
+        "SELECT [17,null, [], 'hi'||'there']",
+        "SELECT DISTINCT foo",
+        "SELECT foo as A, bar as B",
+        "SELECT count(*)",
+        "SELECT power(1, cos(2))",
+        "SELECT (name = 'fred') COLLATE UNICODE CASE NODIACRITICS",
+        "SELECT file.name FROM db AS file",
+        "SELECT db.name FROM db JOIN db AS other ON other.key = db.key",
+        "SELECT db.name FROM db JOIN db AS other ON other.key = db.key CROSS JOIN x",
+    };
+    constexpr int kIterations = 2000;
+
+    Benchmark viaJSON, direct;
+    for (int i = 0; i < kIterations; ++i) {
+        for (auto n1ql : kQueries) {
+            string sql1 = compileViaJSON(n1ql, viaJSON);
+            string sql2 = compileDirect(n1ql, direct);
+            if (i == 0)
+                CHECK(sql1 == sql2);
+        }
+    }
+    viaJSON.printReport(1, "query compiled via JSON");
+    direct.printReport(1, "query compiled directly");
+}
@@ -37,6 +37,7 @@ public:
 
     DataFile* const db;
     bool allowCalls {true};
+    unsigned calls {0};
 
     virtual alloc_slice prediction(const Dict* input,
                                    DataFile::Delegate *delegate,
@@ -44,6 +45,7 @@ public:
 //        Log("8-ball input: %s", input->toJSONString().c_str());
         CHECK(allowCalls);
         CHECK(delegate == db->delegate());
+        ++calls;
         const Value *param = input->get("number"_sl);
         if (!param || param->type() != kNumber) {
             Log("8-ball: No 'number' property; returning MISSING");
@@ -300,4 +302,98 @@ TEST_CASE_METHOD(QueryTest, "Predictive Query cached only", "[Query][Predict]")
     PredictiveModel::unregister("8ball");
 }
 
+class BatchEightBall : public EightBall {
+public:
+    BatchEightBall(DataFile *db)     :EightBall(db) { }
+
+    unsigned batchCalls {0}, batchInputs {0};
+
+    virtual vector<alloc_slice> predictions(const vector<const Dict*> &inputs,
+                                            DataFile::Delegate *delegate,
+                                            C4Error *outError) noexcept override {
+        CHECK(allowCalls);
+        CHECK(inputs.size() <= 64);
+        ++batchCalls;
+        batchInputs += unsigned(inputs.size());
+        return PredictiveModel::predictions(inputs, delegate, outError);
+    }
+};
+
+
+TEST_CASE_METHOD(QueryTest, "Predictive Index batched and cached", "[Query][Predict]") {
+    addNumberedDocs(1, 100);
+
+    Retained<BatchEightBall> model = new BatchEightBall(db.get());
+    model->registerAs("8ball", 1000);
+
+    // Building the index passes the inputs to the model in batches:
+    store->createIndex("nums"_sl, json5("[['PREDICTION()', '8ball', {number: ['.num']}, '.square']]"),
+                       IndexSpec::kPredictive);
+    CHECK(model->batchCalls == 2);
+    CHECK(model->batchInputs == 100);
+
+    // Updating a doc without changing the model's input doesn't call the model:
+    model->allowCalls = false;
+    {
+        Transaction t(db);
+        writeNumberedDoc(10, "ten"_sl, t);
+        t.commit();
+    }
+
+    // Changing the input to one seen before gets the result from the cache:
+    {
+        Transaction t(db);
+        writeDoc("rec-010"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("num");
+            enc.writeInt(9);
+        });
+        t.commit();
+    }
+
+    Retained<Query> query{ store->compileQuery(json5(
+        "{'WHAT': [['._id']], 'WHERE': ['>=', ['PREDICTION()', '8ball', {number: ['.num']}, '.square'], 1],"
+        " 'ORDER_BY': [['._id']]}")) };
+    vector<string> results;
+    Retained<QueryEnumerator> e(query->createEnumerator());
+    while (e->next())
+        results.push_back(e->columns()[0]->asString().asString());
+    CHECK(results == (vector<string>{"rec-001", "rec-004", "rec-009", "rec-010", "rec-016",
+                                     "rec-025", "rec-036", "rec-049", "rec-064", "rec-081",
+                                     "rec-100"}));
+
+    PredictiveModel::unregister("8ball");
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Predictive Model cache", "[Query][Predict]") {
+    Retained<EightBall> model = new EightBall(db.get());
+    Encoder enc;
+    enc.beginDictionary();
+    enc.writeKey("number");
+    enc.writeInt(4);
+    enc.endDictionary();
+    Retained<Doc> input = enc.finishDoc();
+    auto predict = [&](const string &database) {
+        C4Error error = {};
+        CHECK(model->cachedPrediction(input->asDict(), db->delegate(), database, &error));
+    };
+
+    // By default nothing is cached, since the model might not be deterministic:
+    model->registerAs("8ball");
+    predict("db1");
+    predict("db1");
+    CHECK(model->calls == 2);
+
+    // With caching enabled, a result is only reused within the same database:
+    model->calls = 0;
+    model->registerAs("8ball", 10);
+    predict("db1");
+    predict("db1");
+    predict("db2");
+    CHECK(model->calls == 2);
+
+    PredictiveModel::unregister("8ball");
+}
+
+
 #endif // COUCHBASE_ENTERPRISE
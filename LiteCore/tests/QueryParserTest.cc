@@ -354,6 +354,33 @@ TEST_CASE_METHOD(QueryParserTest, "QueryParser Collate", "[Query][Collation]") {
 }
 
 
+TEST_CASE_METHOD(QueryParserTest, "QueryParser Collate Sort Keys", "[Query][Collation]") {
+    sortKeyIndexes = {"LCUnicode_C__ [\".name\"]", "LCUnicode____ [\".name\"]",
+                      "LCUnicode_C__ [\".title\"]"};
+    Collation coll;
+    coll.unicodeAware = true;
+    string v = "'" + CollationSortKeyVersion(coll) + "'";
+    CHECK(parseWhere("['COLLATE', {unicode: true, case:false}, ['=', ['.name'], ['$NAME']]]")
+          == "fl_sortkey(fl_value(body, 'name'), 'LCUnicode_C__', " + v + ") = fl_sortkey($_NAME, 'LCUnicode_C__', " + v + ")");
+    CHECK(parseWhere("['COLLATE', {unicode: true}, ['BETWEEN', ['.name'], 'a', 'm']]")
+          == "fl_sortkey(fl_value(body, 'name'), 'LCUnicode____', " + v + ") BETWEEN fl_sortkey('a', 'LCUnicode____', " + v + ") AND fl_sortkey('m', 'LCUnicode____', " + v + ")");
+    // Non-Unicode collations are still applied with COLLATE:
+    CHECK(parseWhere("['COLLATE', {case: false}, ['=', ['.name'], 'fred']]")
+          == "fl_value(body, 'name') COLLATE \"NOCASE\" = 'fred'");
+    // ...and so are expressions no index has the sort keys of:
+    CHECK(parseWhere("['COLLATE', {unicode: true}, ['=', ['.nickname'], 'fred']]")
+          == "fl_value(body, 'nickname') COLLATE \"LCUnicode____\" = 'fred'");
+    CHECK(parseWhere("['COLLATE', {unicode: true, locale: 'se'}, ['=', ['.name'], 'fred']]")
+          == "fl_value(body, 'name') COLLATE \"LCUnicode____se\" = 'fred'");
+    CHECK(parse("{WHAT: ['.title'], \
+              ORDER_BY: [ ['DESC', ['COLLATE', {'unicode':true, 'case':false}, ['.title']]] ]}")
+          == "SELECT fl_result(fl_value(_doc.body, 'title')) "
+               "FROM kv_default AS _doc "
+              "WHERE (_doc.flags & 1 = 0) "
+           "ORDER BY fl_sortkey(fl_value(_doc.body, 'title'), 'LCUnicode_C__', " + v + ") DESC");
+}
+
+
 TEST_CASE_METHOD(QueryParserTest, "QueryParser errors", "[Query][!throws]") {
     mustFail("['poop()', 1]");
     mustFail("['power()', 1]");
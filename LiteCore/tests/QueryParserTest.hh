@@ -19,6 +19,7 @@
 #pragma once
 #include "QueryParser.hh"
 #include "fleece/Fleece.h"
+#include <set>
 #include <string>
 #include "LiteCoreTest.hh"
 
@@ -44,9 +45,21 @@ protected:
     virtual std::string unnestedTableName(const std::string &property) const override {
         return tableName() + ":unnest:" + property;
     }
+    virtual std::string spatialTableName(const std::string &indexName) const override {
+        return tableName() + ":spatial:" + indexName;
+    }
+    virtual std::string vectorTableName(const std::string &indexName) const override {
+        return tableName() + ":vector:" + indexName;
+    }
+    virtual std::string aggregateTableName(const std::string &identifier) const override {
+        return tableName() + ":aggregate:" + identifier;
+    }
     virtual bool tableExists(const string &tableName) const override {
         return tablesExist;
     }
+    virtual bool hasSortKeyIndex(const std::string &sortKeyExpression) const override {
+        return sortKeyIndexes.count(sortKeyExpression) > 0;
+    }
 #ifdef COUCHBASE_ENTERPRISE
     virtual std::string predictiveTableName(const std::string &property) const override {
         return tableName() + ":predict:" + property;
@@ -54,4 +67,5 @@ protected:
 #endif
 
     bool tablesExist {false};
+    std::set<std::string> sortKeyIndexes;
 };
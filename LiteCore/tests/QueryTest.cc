@@ -18,6 +18,7 @@
 
 #include "QueryTest.hh"
 #include "SQLiteDataFile.hh"
+#include "UnicodeCollator.hh"
 #include <time.h>
 #include <float.h>
 
@@ -146,6 +147,546 @@ TEST_CASE_METHOD(QueryTest, "Partial Index with NOT MISSING", "[Query]") {
 }
 
 
+TEST_CASE_METHOD(QueryTest, "Covering Index", "[Query]") {
+    {
+        Transaction t(store->dataFile());
+        for (int i = 1; i <= 100; i++)
+            writeNumberedDoc(i, slice(numberString(i)), t);
+        t.commit();
+    }
+    store->createIndex("nums"_sl, R"({"WHAT":[[".num"]], "INCLUDE":[[".str"]]})"_sl);
+
+    auto collect = [&](Query *query) {
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        while (e->next())
+            results.push_back(e->columns()[0]->asString().asString());
+        return results;
+    };
+
+    const char *queryJson = "{WHAT: [['.str']], WHERE: ['AND', ['>=', ['.num'], 30], ['<=', ['.num'], 32]], "
+                            "ORDER_BY: [['.num']]}";
+    Retained<Query> query = store->compileQuery(json5(queryJson));
+    checkOptimized(query);
+    CHECK(query->explain().find(":covering:") != string::npos);
+    CHECK(collect(query) == (vector<string>{"three-zero", "three-one", "three-two"}));
+
+    // The covering table has to track updates and deletions:
+    {
+        Transaction t(store->dataFile());
+        writeNumberedDoc(31, "thirty-one"_sl, t);
+        t.commit();
+    }
+    deleteDoc("rec-032"_sl, true);
+    CHECK(collect(query) == (vector<string>{"three-zero", "thirty-one"}));
+
+    // Once the index is gone the query falls back to reading the document bodies:
+    store->deleteIndex("nums"_sl);
+    query = store->compileQuery(json5(queryJson));
+    CHECK(query->explain().find(":covering:") == string::npos);
+    CHECK(collect(query) == (vector<string>{"three-zero", "thirty-one"}));
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Collation Sort Key Index", "[Query][Collation]") {
+    auto writeName = [&](slice docID, slice name, Transaction &t) {
+        writeDoc(docID, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("name");
+            enc.writeString(name);
+        });
+    };
+    {
+        Transaction t(store->dataFile());
+        writeName("a1"_sl, "apple"_sl, t);
+        writeName("a2"_sl, "Äpfel"_sl, t);
+        writeName("b1"_sl, "banana"_sl, t);
+        writeName("b2"_sl, "Bär"_sl, t);
+        writeName("e1"_sl, "Émile"_sl, t);
+        t.commit();
+    }
+    const char *indexJson = R"({"WHAT":[["COLLATE", {"UNICODE":true, "CASE":false}, [".name"]]],
+                                "SORT_KEYS":true})";
+    if (!CollationSortKeysSupported()) {
+        ExpectException(error::LiteCore, error::UnsupportedOperation, [&]{
+            store->createIndex("names"_sl, slice(indexJson));
+        });
+        return;
+    }
+    store->createIndex("names"_sl, slice(indexJson));
+    {
+        Transaction t(store->dataFile());
+        writeName("e2"_sl, "eagle"_sl, t);
+        writeName("z1"_sl, "zebra"_sl, t);
+        t.commit();
+    }
+
+    auto names = [&](const char *queryJson, bool usesIndex) {
+        Retained<Query> query = store->compileQuery(json5(queryJson));
+        CHECK((query->explain().find("INDEX names") != string::npos) == usesIndex);
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        while (e->next())
+            results.push_back(e->columns()[0]->asString().asString());
+        return results;
+    };
+    const char *rangeQuery = "{WHAT: [['.name']], "
+                  "WHERE: ['COLLATE', {unicode: true, case: false}, ['>=', ['.name'], 'b']], "
+                  "ORDER_BY: [['COLLATE', {unicode: true, case: false}, ['.name']]]}";
+    CHECK(names(rangeQuery, true)
+          == (vector<string>{"banana", "Bär", "eagle", "Émile", "zebra"}));
+    CHECK(names("{WHAT: [['.name']], "
+                "WHERE: ['COLLATE', {unicode: true, case: false}, ['=', ['.name'], 'BANANA']]}",
+                true)
+          == (vector<string>{"banana"}));
+    // A different collation isn't in the index, so it's compared with COLLATE as usual:
+    CHECK(names("{WHAT: [['.name']], "
+                "WHERE: ['COLLATE', {unicode: true, diac: false}, ['=', ['.name'], 'Apfel']]}",
+                false)
+          == (vector<string>{"Äpfel"}));
+
+    // An index made by another version of the collator isn't used, and is rebuilt on reopening:
+    {
+        Transaction t(store->dataFile());
+        ((SQLiteDataFile&)store->dataFile()).exec(
+            "DROP INDEX names; "
+            "CREATE INDEX names ON kv_default "
+            "(fl_sortkey(fl_value(body, 'name'), 'LCUnicode_C__', 'icu-0.0.0.0'))");
+        t.commit();
+    }
+    CHECK(names(rangeQuery, false)
+          == (vector<string>{"banana", "Bär", "eagle", "Émile", "zebra"}));
+    reopenDatabase();
+    CHECK(names(rangeQuery, true)
+          == (vector<string>{"banana", "Bär", "eagle", "Émile", "zebra"}));
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Spatial Index", "[Query]") {
+    // A 10x10 grid of points, plus a doc without coordinates:
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < 100; i++) {
+            writeDoc(slice(stringWithFormat("pt-%02d", i)), DocumentFlags::kNone, t,
+                     [=](Encoder &enc) {
+                enc.writeKey("lon");
+                enc.writeInt(i % 10);
+                enc.writeKey("lat");
+                enc.writeInt(i / 10);
+            });
+        }
+        writeDoc("nowhere"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("lon");
+            enc.writeString("west");
+        });
+        t.commit();
+    }
+    store->createIndex("places"_sl, "[['.lon'], ['.lat']]"_sl, IndexSpec::kSpatial);
+
+    auto collect = [&](const char *queryJson) {
+        Retained<Query> query = store->compileQuery(json5(queryJson));
+        CHECK(query->explain().find(":spatial:places") != string::npos);
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        while (e->next())
+            results.push_back(e->columns()[0]->asString().asString());
+        return results;
+    };
+
+    CHECK(collect("{WHAT: [['._id']], WHERE: ['GEO_WITHIN()', 'places', 2.5, 3.5, 4.5, 4.5], "
+                  "ORDER_BY: [['._id']]}")
+          == (vector<string>{"pt-43", "pt-44"}));
+    CHECK(collect("{WHAT: [['._id']], WHERE: ['GEO_INTERSECTS()', 'places', 8, 8, 20, 20], "
+                  "ORDER_BY: [['._id']]}")
+          == (vector<string>{"pt-88", "pt-89", "pt-98", "pt-99"}));
+    CHECK(collect("{WHAT: [['._id']], ORDER_BY: [['GEO_DISTANCE()', 'places', 5.1, 7.2]], "
+                  "LIMIT: 3}")
+          == (vector<string>{"pt-75", "pt-85", "pt-76"}));
+
+    // Nearest-k searches a box around the point that grows until it holds enough matching rows:
+    {
+        Retained<Query> query = store->compileQuery(json5(
+            "{WHAT: [['._id']], ORDER_BY: [['GEO_DISTANCE()', 'places', 5.1, 7.2]], LIMIT: 3}"));
+        CHECK(query->explain().find("_geoStep") != string::npos);
+    }
+    CHECK(collect("{WHAT: [['._id']], WHERE: ['>', ['.lat'], 7], "
+                  "ORDER_BY: [['ASC', ['GEO_DISTANCE()', 'places', 5.1, 7.2]]], LIMIT: 2, OFFSET: 1}")
+          == (vector<string>{"pt-86", "pt-84"}));
+    CHECK(collect("{WHAT: [['._id']], ORDER_BY: [['GEO_DISTANCE()', 'places', -1000, 1000]], "
+                  "LIMIT: 200}").size() == 100);
+
+    // The R-tree has to track updates and deletions:
+    {
+        Transaction t(store->dataFile());
+        writeDoc("pt-43"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("lon");
+            enc.writeInt(50);
+            enc.writeKey("lat");
+            enc.writeInt(50);
+        });
+        t.commit();
+    }
+    deleteDoc("pt-44"_sl, true);
+    CHECK(collect("{WHAT: [['._id']], WHERE: ['GEO_WITHIN()', 'places', 2.5, 3.5, 4.5, 4.5]}")
+          .empty());
+    CHECK(collect("{WHAT: [['._id']], WHERE: ['GEO_WITHIN()', 'places', 49, 49, 51, 51]}")
+          == (vector<string>{"pt-43"}));
+
+    store->deleteIndex("places"_sl);
+    ExpectException(error::LiteCore, error::InvalidQuery, [&]{
+        store->compileQuery(json5("{WHAT: [['._id']], "
+                                  "WHERE: ['GEO_WITHIN()', 'places', 0, 0, 1, 1]}"));
+    });
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Vector Index", "[Query]") {
+    // A 20x10 grid of 2D vectors, plus a doc whose vector isn't numeric:
+    auto writeVector = [&](slice docID, float x, float y, Transaction &t) {
+        writeDoc(docID, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("vec");
+            enc.beginArray();
+            enc.writeFloat(x);
+            enc.writeFloat(y);
+            enc.endArray();
+        });
+    };
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < 200; i++)
+            writeVector(slice(stringWithFormat("v-%03d", i)), float(i % 20), float(i / 20), t);
+        writeDoc("bogus"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("vec");
+            enc.writeString("nope");
+        });
+        t.commit();
+    }
+    store->createIndex("vecs"_sl, R"({"WHAT":[[".vec"]], "CENTROIDS":4})"_sl, IndexSpec::kVector);
+
+    auto nearest = [&](const char *queryJson) {
+        Retained<Query> query = store->compileQuery(json5(queryJson));
+        CHECK(query->explain().find(":vector:vecs") != string::npos);
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        while (e->next())
+            results.push_back(e->columns()[0]->asString().asString());
+        return results;
+    };
+
+    // With only 4 clusters, the default number of probes searches all of them, so it's exact:
+    const char *queryJson = "{WHAT: [['._id']], "
+                            "ORDER_BY: [['VECTOR_DISTANCE()', 'vecs', ['[]', 5.2, 3.3]]], LIMIT: 3}";
+    CHECK(nearest(queryJson) == (vector<string>{"v-065", "v-085", "v-066"}));
+    CHECK(nearest("{WHAT: [['._id']], ORDER_BY: [['VECTOR_DISTANCE()', 'vecs', ['[]', 5.2, 3.3], 1]], "
+                  "LIMIT: 1}")
+          == (vector<string>{"v-065"}));
+
+    // The index has to track updates and deletions:
+    {
+        Transaction t(store->dataFile());
+        writeVector("v-065"_sl, 100, 100, t);
+        t.commit();
+    }
+    deleteDoc("v-066"_sl, true);
+    CHECK(nearest(queryJson) == (vector<string>{"v-085", "v-086", "v-063"}));
+
+    // Recreating the index with a different number of clusters rebuilds it:
+    store->createIndex("vecs"_sl, R"({"WHAT":[[".vec"]], "CENTROIDS":2})"_sl, IndexSpec::kVector);
+    CHECK(nearest(queryJson) == (vector<string>{"v-085", "v-086", "v-063"}));
+
+    store->deleteIndex("vecs"_sl);
+    ExpectException(error::LiteCore, error::InvalidQuery, [&]{
+        store->compileQuery(json5(queryJson));
+    });
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Vector Index Retraining", "[Query]") {
+    // The index is created before there are any vectors to cluster:
+    store->createIndex("vecs"_sl, R"({"WHAT":[[".vec"]], "CENTROIDS":4})"_sl, IndexSpec::kVector);
+    auto writeVector = [&](slice docID, std::initializer_list<float> coords, Transaction &t) {
+        writeDoc(docID, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("vec");
+            enc.beginArray();
+            for (float coord : coords)
+                enc.writeFloat(coord);
+            enc.endArray();
+        });
+    };
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < 200; i++)
+            writeVector(slice(stringWithFormat("v-%03d", i)), {float(i % 20), float(i / 20)}, t);
+        writeVector("3d"_sl, {1, 2, 3}, t);
+        t.commit();
+    }
+
+    // Housekeeping trains it, dropping the vector with the wrong dimension, then moves the
+    // vectors to their buckets; then it's up to date:
+    {
+        Transaction t(store->dataFile());
+        CHECK(store->dataFile().retrainVectorIndexes());
+        CHECK(store->dataFile().retrainVectorIndexes());
+        CHECK(!store->dataFile().retrainVectorIndexes());
+        t.commit();
+    }
+
+    auto nearest = [&](const char *queryJson) {
+        Retained<Query> query = store->compileQuery(json5(queryJson));
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        while (e->next())
+            results.push_back(e->columns()[0]->asString().asString());
+        return results;
+    };
+    CHECK(nearest("{WHAT: [['._id']], "
+                  "ORDER_BY: [['VECTOR_DISTANCE()', 'vecs', ['[]', 5.2, 3.3]]], LIMIT: 3}")
+          == (vector<string>{"v-065", "v-085", "v-066"}));
+    CHECK(nearest("{WHAT: [['._id']], "
+                  "ORDER_BY: [['VECTOR_DISTANCE()', 'vecs', ['[]', 0, 0], 4]], LIMIT: 300}").size()
+          == 200);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Vector Index Retraining In Steps", "[Query]") {
+    auto writeVector = [&](slice docID, std::initializer_list<float> coords, Transaction &t) {
+        writeDoc(docID, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("vec");
+            enc.beginArray();
+            for (float coord : coords)
+                enc.writeFloat(coord);
+            enc.endArray();
+        });
+    };
+    {
+        Transaction t(store->dataFile());
+        for (int i = 0; i < 200; i++)
+            writeVector(slice(stringWithFormat("v-%04d", i)), {float(i % 20), float(i / 20)}, t);
+        t.commit();
+    }
+    store->createIndex("vecs"_sl, R"({"WHAT":[[".vec"]], "CENTROIDS":16})"_sl, IndexSpec::kVector);
+
+    // Many more vectors, all in one place, unbalance the index:
+    {
+        Transaction t(store->dataFile());
+        for (int i = 200; i < 3200; i++)
+            writeVector(slice(stringWithFormat("v-%04d", i)), {0.5, 0.5}, t);
+        t.commit();
+    }
+
+    // Probing more buckets than there are centroids finds every vector:
+    auto countAll = [&]() {
+        Retained<Query> query = store->compileQuery(json5(
+                "{WHAT: [['._id']], "
+                "ORDER_BY: [['VECTOR_DISTANCE()', 'vecs', ['[]', 0.5, 0.5], 100]], LIMIT: 5000}"));
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        return e->getRowCount();
+    };
+    CHECK(countAll() == 3200);
+
+    // The size the index was trained at is saved, so even right after reopening, housekeeping
+    // sees that it's changed, and retrains it. Then the vectors move in batches, and queries
+    // (which probe the retired buckets too) find them all the while:
+    reopenDatabase();
+    int steps = 0;
+    {
+        Transaction t(store->dataFile());
+        CHECK(store->dataFile().retrainVectorIndexes());
+        while (store->dataFile().retrainVectorIndexes()) {
+            ++steps;
+            CHECK(countAll() == 3200);
+        }
+        t.commit();
+    }
+    CHECK(steps >= 3);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Aggregate Index", "[Query]") {
+    addNumberedDocs(1, 100);
+
+    auto rows = [&](const char *queryJson, bool fromIndex) {
+        Retained<Query> query = store->compileQuery(json5(queryJson));
+        CHECK((query->explain().find(":aggregate:") != string::npos) == fromIndex);
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator());
+        while (e->next()) {
+            string row;
+            for (Array::iterator i(e->columns()); i; ++i)
+                row += i.value()->toJSONString() + " ";
+            results.push_back(row);
+        }
+        return results;
+    };
+
+    const char* queries[] = {
+        "{WHAT: [['%', ['.num'], 7], ['count()'], ['sum()', ['.num']], ['avg()', ['.num']], "
+                "['min()', ['.num']], ['max()', ['.num']]], "
+         "GROUP_BY: [['%', ['.num'], 7]], ORDER_BY: [['%', ['.num'], 7]]}",
+        "{WHAT: [['AS', ['%', ['.num'], 7], 'mod'], ['AS', ['sum()', ['.num']], 'total']], "
+         "GROUP_BY: [['%', ['.num'], 7]], HAVING: ['>', ['count()'], 14], "
+         "ORDER_BY: [['DESC', ['.total']]], LIMIT: 3}",
+    };
+    vector<vector<string>> expected;
+    for (auto json : queries)
+        expected.push_back(rows(json, false));
+
+    store->createIndex("mods"_sl,
+                       R"({"WHAT": [["%", [".num"], 7], ["count()"], ["sum()", [".num"]],
+                                    ["min()", [".num"]], ["max()", [".num"]]]})"_sl,
+                       IndexSpec::kAggregate);
+    for (size_t i = 0; i < 2; ++i)
+        CHECK(rows(queries[i], true) == expected[i]);
+
+    // Queries with a different WHERE clause, or other aggregates, still scan the documents:
+    rows("{WHAT: [['%', ['.num'], 7], ['count()']], GROUP_BY: [['%', ['.num'], 7]], "
+         "WHERE: ['>', ['.num'], 50]}", false);
+    rows("{WHAT: [['%', ['.num'], 7], ['count()', ['.str']]], GROUP_BY: [['%', ['.num'], 7]]}", false);
+
+    // The index has to track insertions, updates (including of a group's maximum) and deletions:
+    {
+        Transaction t(store->dataFile());
+        writeNumberedDoc(101, nullslice, t);
+        writeDoc("rec-098"_sl, DocumentFlags::kNone, t, [=](Encoder &enc) {
+            enc.writeKey("num");
+            enc.writeInt(3);
+        });
+        t.commit();
+    }
+    deleteDoc("rec-001"_sl, true);
+    deleteDoc("rec-091"_sl, false);
+    for (size_t i = 0; i < 2; ++i) {
+        auto indexed = rows(queries[i], true);
+        CHECK(indexed != expected[i]);
+        expected[i] = indexed;
+    }
+    store->deleteIndex("mods"_sl);
+    for (size_t i = 0; i < 2; ++i)
+        CHECK(rows(queries[i], false) == expected[i]);
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query Continuation", "[Query]") {
+    addNumberedDocs(1, 100);
+    addArrayDocs(101, 5);       // These have no 'num', so they sort last (NULL) in DESC order
+
+    // The sort key has lots of duplicates, so the pages have to break ties by rowid:
+    auto ids = [&](Query *query, const Query::Options *options, alloc_slice *outContinuation) {
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator(options));
+        while (e->next())
+            results.push_back(e->columns()[0]->asString().asString());
+        if (outContinuation)
+            *outContinuation = e->continuation();
+        return results;
+    };
+    Retained<Query> all = store->compileQuery(json5(
+        "{WHAT: [['._id']], ORDER_BY: [['DESC', ['%', ['.num'], 7]], ['.type'], ['._sequence']]}"));
+    vector<string> expected = ids(all, nullptr, nullptr);
+    REQUIRE(expected.size() == 105);
+
+    Retained<Query> query = store->compileQuery(json5(
+        "{WHAT: [['._id']], ORDER_BY: [['DESC', ['%', ['.num'], 7]], ['.type']], LIMIT: 10}"));
+    vector<string> paged;
+    alloc_slice continuation;
+    unsigned pages = 0;
+    do {
+        Query::Options options(alloc_slice(), 0, 0, continuation);
+        auto page = ids(query, &options, &continuation);
+        CHECK(page.size() == min(size_t(10), expected.size() - paged.size()));
+        paged.insert(paged.end(), page.begin(), page.end());
+        ++pages;
+    } while (continuation);
+    CHECK(pages == 12);         // (the last page is empty)
+    CHECK(paged == expected);
+
+    // The continuation's key values are bound as parameters, along with the query's own:
+    Retained<Query> byNum = store->compileQuery(json5(
+        "{WHAT: [['._id']], WHERE: ['>=', ['.num'], ['$min']], ORDER_BY: [['.num']], "
+        "LIMIT: ['$n']}"));
+    paged.clear();
+    continuation = alloc_slice();
+    do {
+        Query::Options options(R"({"min": 51, "n": 20})"_sl, 0, 0, continuation);
+        auto page = ids(byNum, &options, &continuation);
+        paged.insert(paged.end(), page.begin(), page.end());
+    } while (continuation);
+    REQUIRE(paged.size() == 50);
+    CHECK(paged.front() == "rec-051");
+    CHECK(paged.back() == "rec-100");
+
+    // A continuation token only works with the query that produced it:
+    Retained<Query> other = store->compileQuery(json5(
+        "{WHAT: [['._id']], ORDER_BY: [['.num']], LIMIT: 10}"));
+    ids(query, nullptr, &continuation);
+    ExpectException(error::LiteCore, error::InvalidParameter, [&]{
+        Query::Options options(alloc_slice(), 0, 0, continuation);
+        ids(other, &options, nullptr);
+    });
+
+    // A query without a LIMIT can't be paged:
+    ExpectException(error::LiteCore, error::UnsupportedOperation, [&]{
+        ids(all, nullptr, &continuation);
+    });
+
+    // Nor can a count-only run, which has no last row to continue after:
+    ExpectException(error::LiteCore, error::UnsupportedOperation, [&]{
+        Query::Options options;
+        options.countOnly = true;
+        ids(query, &options, &continuation);
+    });
+}
+
+
+TEST_CASE_METHOD(QueryTest, "Query Parallel Aggregation", "[Query]") {
+    addNumberedDocs(1, 10000);
+
+    auto rows = [&](Query *query, const Query::Options *options) {
+        vector<string> results;
+        Retained<QueryEnumerator> e(query->createEnumerator(options));
+        while (e->next()) {
+            string row;
+            for (Array::iterator i(e->columns()); i; ++i)
+                row += i.value()->toJSONString() + " ";
+            results.push_back(row);
+        }
+        sort(results.begin(), results.end());
+        return results;
+    };
+
+    const char* queries[] = {
+        "{WHAT: [['count()', ['.num']], ['sum()', ['.num']], ['min()', ['.num']], "
+                "['max()', ['.num']], ['avg()', ['.num']]]}",
+        "{WHAT: [['%', ['.num'], 7], ['count()', ['.num']], ['sum()', ['.num']], "
+                "['avg()', ['.num']]], GROUP_BY: [['%', ['.num'], 7]]}",
+        "{WHAT: [['max()', ['.num']], ['min()', ['.num']]], WHERE: ['<', ['.num'], ['$max']]}",
+    };
+    for (auto json : queries) {
+        INFO("Query is " << json);
+        Retained<Query> query = store->compileQuery(json5(json));
+        Query::Options options(alloc_slice(strstr(json, "$max") ? "{\"max\": 5000}" : "{}"));
+        vector<string> serial = rows(query, &options);
+        query->setParallelism(4);
+        query->setCollectingStatistics(true);
+        CHECK(rows(query, &options) == serial);
+        CHECK(rows(query, &options) == serial);     // (this time the connections are reused)
+        Query::Statistics stats;
+        REQUIRE(query->getStatistics(stats));
+        CHECK(stats.parallelRuns == 2);
+    }
+
+    // A query that can't be split up still runs serially:
+    Retained<Query> query = store->compileQuery(json5(
+        "{WHAT: [['count()', ['.num']]], ORDER_BY: [['count()', ['.num']]], LIMIT: 1}"));
+    query->setParallelism(4);
+    query->setCollectingStatistics(true);
+    CHECK(rows(query, nullptr) == vector<string>{"10000 "});
+    Query::Statistics stats;
+    REQUIRE(query->getStatistics(stats));
+    CHECK(stats.runCount == 1);
+    CHECK(stats.parallelRuns == 0);
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query SELECT", "[Query]") {
     addNumberedDocs();
     // Use a (SQL) query based on the Fleece "num" property:
@@ -642,6 +1183,35 @@ TEST_CASE_METHOD(QueryTest, "Query regex", "[Query]") {
     REQUIRE(e->columns()[0]->asString() == "nothing"_sl);
     REQUIRE(e->next());
     REQUIRE(e->columns()[0]->asString() == "invalid"_sl);
+
+    // Literal patterns (no metacharacters) take a substring-search fast path:
+    query = store->compileQuery(json5(
+        "{'WHAT': ['._id', ['REGEXP_POSITION()', ['.value'], 'value']],"
+        " WHERE: ['REGEXP_CONTAINS()', ['.value'], 'ol val']}"));
+    e = (query->createEnumerator());
+    REQUIRE(e->getRowCount() == 1);
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "doc2"_sl);
+    CHECK(e->columns()[1]->asInt() == 5);
+
+    query = store->compileQuery(json5(
+       "{'WHAT': [['REGEXP_REPLACE()', ['.value'], 'value', 'thing']], ORDER_BY: [['._id']]}"));
+    e = (query->createEnumerator());
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "awesome thing"_sl);
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "cool thing"_sl);
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "invalid"_sl);
+
+    // The pattern may be a parameter:
+    query = store->compileQuery(json5(
+        "{'WHAT': ['._id'], WHERE: ['REGEXP_LIKE()', ['.value'], ['$pat']]}"));
+    Query::Options options("{\"pat\": \"^c.*e$\"}"_sl);
+    e = (query->createEnumerator(&options));
+    REQUIRE(e->getRowCount() == 1);
+    REQUIRE(e->next());
+    CHECK(e->columns()[0]->asString() == "doc2"_sl);
 }
 
 
@@ -1342,6 +1912,52 @@ TEST_CASE_METHOD(ArrayQueryTest, "Query UNNEST expression", "[Query]") {
     checkQuery(22, 2);
 }
 
+TEST_CASE_METHOD(ArrayQueryTest, "Array Index Update", "[Query][ArrayIndex]") {
+    auto writeTags = [&](vector<string> tags) {
+        Transaction t(store->dataFile());
+        writeDoc("doc"_sl, DocumentFlags::kNone, t, [&](Encoder &enc) {
+            enc.writeKey("tags");
+            enc.beginArray();
+            for (auto &tag : tags)
+                enc.writeString(tag);
+            enc.endArray();
+        });
+        t.commit();
+    };
+    auto tagged = [&](const char *tag) {
+        query = store->compileQuery(json5(
+            "['SELECT', {FROM: [{as: 'doc'}, {as: 'tag', 'unnest': ['.doc.tags']}],"
+                        "WHERE: ['=', ['.tag'], ['$tag']]}]"));
+        Query::Options options(alloc_slice(format("{\"tag\": \"%s\"}", tag)));
+        Retained<QueryEnumerator> e(query->createEnumerator(&options));
+        return e->getRowCount();
+    };
+
+    writeTags({"red", "green", "blue"});
+    store->createIndex("tagsIndex"_sl, "[[\".tags\"]]"_sl, IndexSpec::kArray);
+    CHECK(tagged("green") == 1);
+
+    // Change one item and drop the last one; only those rows should change:
+    writeTags({"red", "yellow"});
+    CHECK(tagged("red") == 1);
+    CHECK(tagged("yellow") == 1);
+    CHECK(tagged("green") == 0);
+    CHECK(tagged("blue") == 0);
+
+    // Grow the array, with a duplicate item:
+    writeTags({"red", "yellow", "red", "cyan"});
+    CHECK(tagged("red") == 2);
+    CHECK(tagged("cyan") == 1);
+
+    // Soft-delete and undelete:
+    deleteDoc("doc"_sl, false);
+    CHECK(tagged("red") == 0);
+    undeleteDoc("doc"_sl);
+    CHECK(tagged("red") == 2);
+    CHECK(tagged("yellow") == 1);
+}
+
+
 TEST_CASE_METHOD(QueryTest, "Query NULL check", "[Query]") {
 	{
         Transaction t(store->dataFile());
@@ -1688,3 +2304,37 @@ TEST_CASE_METHOD(QueryTest, "Query closes when db closes", "[Query]") {
     // Close & delete the database while the Query and QueryEnumerator still exist:
     deleteDatabase();
 }
+
+
+TEST_CASE_METHOD(QueryTest, "Refresh Query Statistics", "[Query]") {
+    auto &df = store->dataFile();
+    // The table's row count as of its last ANALYZE:
+    auto analyzedRows = [&]() -> int64_t {
+        alloc_slice rows = df.rawQuery("SELECT CAST(stat AS INTEGER) FROM sqlite_stat1 "
+                                       "WHERE tbl = 'kv_default' LIMIT 1");
+        auto row = Value::fromData(rows)->asArray()->get(0);
+        return row ? row->asArray()->get(0)->asInt() : 0;
+    };
+    auto refresh = [&] {
+        Transaction t(df);
+        while (df.refreshStatistics())
+            ;
+        t.commit();
+    };
+
+    // A large KeyStore with no statistics gets analyzed:
+    addNumberedDocs(1, 2000);
+    refresh();
+    int64_t rows = analyzedRows();
+    CHECK(rows > 0);
+
+    // A few writes don't trigger another ANALYZE...
+    addNumberedDocs(2001, 500);
+    refresh();
+    CHECK(analyzedRows() == rows);
+
+    // ...but many do:
+    addNumberedDocs(2501, 600);
+    refresh();
+    CHECK(analyzedRows() > rows);
+}
@@ -21,6 +21,7 @@
 #include "StringUtil.hh"
 #include "UnicodeCollator.hh"
 #include "FleeceImpl.hh"
+#include "Benchmark.hh"
 #include "SQLiteCpp/SQLiteCpp.h"
 #include <sqlite3.h>
 
@@ -347,6 +348,214 @@ TEST_CASE("Unicode string functions", "[Query]") {
     testTrim(u"\u2028\u2029\u2030\u205f\u3000", 2, 2);
 }
 
+TEST_CASE("ASCII string functions", "[Query]") {
+    CHECK(ASCIIPrefixLength(""_sl) == 0);
+    CHECK(ASCIIPrefixLength("hello there, this is more than 16 bytes"_sl) == 39);
+    CHECK(ASCIIPrefixLength("hello there, this is more than 16 bytes, café"_sl) == 44);
+    CHECK(isASCII("x"_sl));
+    CHECK(!isASCII("cafés"_sl));
+    CHECK(UTF8Length("hello there, this is more than 16 bytes, café"_sl) == 45);
+
+    CHECK(ASCIIChangeCase("Hello There, @[`{ Zebras! 0123456789 az"_sl, true)
+          == "HELLO THERE, @[`{ ZEBRAS! 0123456789 AZ"_sl);
+    CHECK(ASCIIChangeCase("Hello There, @[`{ Zebras! 0123456789 AZ"_sl, false)
+          == "hello there, @[`{ zebras! 0123456789 az"_sl);
+
+    slice str = "The quick brown fox jumps over the lazy dog"_sl;
+    CHECK(ASCIIFind(str, "The"_sl, true) == str.buf);
+    CHECK(ASCIIFind(str, "dog"_sl, true) == (const char*)str.buf + 40);
+    CHECK(ASCIIFind(str, "the"_sl, true) == (const char*)str.buf + 31);
+    CHECK(ASCIIFind(str, "LAZY DOG"_sl, false) == (const char*)str.buf + 35);
+    CHECK(ASCIIFind(str, "LAZY DOG"_sl, true) == nullptr);
+    CHECK(ASCIIFind(str, "dogs"_sl, true) == nullptr);
+    CHECK(ASCIIFind("aab"_sl, "ab"_sl, true) != nullptr);
+
+    CHECK(LikeASCII("Hello World"_sl, "hello%"_sl, false) == kLikeMatch);
+    CHECK(LikeASCII("Hello World"_sl, "hello%"_sl, true) == kLikeNoMatch);
+    CHECK(LikeASCII("Hello World"_sl, "%o_W%d"_sl, true) == kLikeMatch);
+    CHECK(LikeASCII("100%"_sl, "100\\%"_sl, true) == kLikeMatch);
+    CHECK(LikeASCII("1000"_sl, "100\\%"_sl, true) == kLikeNoMatch);
+
+    slice trimmed = "\t stuff goes here \r\n"_sl;
+    ASCIITrim(trimmed, 0);
+    CHECK(trimmed == "stuff goes here"_sl);
+}
+
+
+TEST_CASE("ASCII string function performance", "[Query][Perf][.slow]") {
+    // Compares the ASCII fast paths with the Unicode-aware functions they replace.
+    string text;
+    while (text.size() < 1000)
+        text += "The quick brown fox jumps over the lazy dog. ";
+    slice str(text);
+    auto collation = CollationContext::create(Collation(false, true, nullslice));
+    constexpr int kIterations = 100000;
+    size_t total = 0;
+
+    Benchmark b1, b2;
+    for (int i = 0; i < kIterations; ++i) {
+        b1.start(); total += UTF8Length(str); b1.stop();
+        b2.start(); total += ASCIIPrefixLength(str); b2.stop();
+    }
+    b1.printReport(1, "UTF8Length");
+    b2.printReport(1, "ASCIIPrefixLength");
+
+    Benchmark b3, b4;
+    for (int i = 0; i < kIterations / 10; ++i) {
+        b3.start(); total += UTF8ChangeCase(str, true).size; b3.stop();
+        b4.start(); total += ASCIIChangeCase(str, true).size; b4.stop();
+    }
+    b3.printReport(1, "UTF8ChangeCase");
+    b4.printReport(1, "ASCIIChangeCase");
+
+    Benchmark b5, b6;
+    for (int i = 0; i < kIterations / 10; ++i) {
+        b5.start(); total += ContainsUTF8(str, "LAZY CAT"_sl, *collation); b5.stop();
+        b6.start(); total += (ASCIIFind(str, "LAZY CAT"_sl, false) != nullptr); b6.stop();
+    }
+    b5.printReport(1, "ContainsUTF8");
+    b6.printReport(1, "ASCIIFind");
+
+    Benchmark b7, b8;
+    for (int i = 0; i < kIterations / 10; ++i) {
+        b7.start(); total += LikeUTF8(str, "%lazy cat%"_sl, *collation); b7.stop();
+        b8.start(); total += LikeASCII(str, "%lazy cat%"_sl, false); b8.stop();
+    }
+    b7.printReport(1, "LikeUTF8");
+    b8.printReport(1, "LikeASCII");
+    CHECK(total > 0);
+}
+
+
+// Returns the tokens an fts3tokenize table produces from `text`, as "token@start-end#position".
+static vector<string> ftsTokens(SQLite::Database &db, const string &table, const string &text) {
+    SQLite::Statement st(db, "SELECT token, start, \"end\", position FROM " + table
+                                + " WHERE input=?");
+    st.bind(1, text);
+    vector<string> tokens;
+    while (st.executeStep())
+        tokens.push_back(stringWithFormat("%s@%d-%d#%d", st.getColumn(0).getText(),
+                                          st.getColumn(1).getInt(), st.getColumn(2).getInt(),
+                                          st.getColumn(3).getInt()));
+    return tokens;
+}
+
+
+TEST_CASE("FTS tokenizer", "[Query][FTS]") {
+    // The fast tokenizer ('unicodesn') must produce exactly what the one it wraps does:
+    SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+    REQUIRE(RegisterFTSTokenizer(db.getHandle()) == SQLITE_OK);
+
+    const char* const kOptions[] = {
+        "",
+        ", \"stemmer=en\", \"stopwords=en\"",
+        ", \"stemmer=en\", \"remove_diacritics=0\"",
+        ", \"stopwordlist=the fox\"",
+    };
+    const string kLongWord(100, 'q');
+    const string kTexts[] = {
+        "",
+        " ,.;-- !! ",
+        "The quick brown fox jumps over the lazy dog's back; running, RUNNING & Runs 42 times!",
+        "Café crème brûlée — naïve résumé façade, 東京 is in Japan.",
+        "Supercalifragilisticexpialidocious-antidisestablishmentarianism x1y2z3 " + kLongWord,
+        "résumé" + kLongWord + "é the the the fox and the hound, the end",
+    };
+    for (auto options : kOptions) {
+        INFO("Options: " << options);
+        db.exec("DROP TABLE IF EXISTS temp.fast; DROP TABLE IF EXISTS temp.base");
+        db.exec(string("CREATE VIRTUAL TABLE temp.fast USING fts3tokenize(unicodesn") + options + ")");
+        db.exec(string("CREATE VIRTUAL TABLE temp.base USING fts3tokenize(unicodesn_base") + options + ")");
+        for (int pass = 0; pass < 2; ++pass) {      // 2nd pass hits the stem cache
+            for (auto &text : kTexts) {
+                INFO("Text: " << text);
+                CHECK(ftsTokens(db, "fast", text) == ftsTokens(db, "base", text));
+            }
+        }
+    }
+
+    db.exec("DROP TABLE temp.fast");
+    db.exec("CREATE VIRTUAL TABLE temp.fast USING fts3tokenize(unicodesn, \"stemmer=en\")");
+    CHECK(ftsTokens(db, "fast", "Running dogs") == (vector<string>{"run@0-7#0", "dog@8-12#1"}));
+}
+
+
+TEST_CASE("FTS tokenizer performance", "[Query][FTS][Perf][.slow]") {
+    // Compares the fast tokenizer with the plain unicodesn tokenizer, on English text.
+    static const char* const kWords[] = {
+        "the", "of", "and", "to", "in", "is", "was", "that", "for", "it", "with", "as", "his",
+        "on", "be", "at", "by", "had", "are", "but", "from", "or", "have", "an", "they", "which",
+        "one", "you", "were", "all", "we", "her", "she", "there", "would", "their", "been",
+        "running", "walked", "houses", "quickly", "searching", "documents", "engineering",
+        "database", "indexing", "replication", "conflicts", "revisions", "attachments",
+        "queries", "functionality", "applications", "organization", "international",
+        "happiness", "adventures", "connections", "generously", "performance", "Couchbase",
+        "LiteCore", "SQLite", "tokenizer", "stemming", "Snowball", "English", "language"};
+    constexpr size_t kNumWords = sizeof(kWords) / sizeof(kWords[0]);
+    constexpr int kParagraphs = 2000;
+
+    vector<string> paragraphs;
+    size_t totalBytes = 0;
+    uint32_t rand = 12345;
+    for (int p = 0; p < kParagraphs; ++p) {
+        string text;
+        while (text.size() < 1000) {
+            rand = rand * 1103515245 + 12345;
+            text += kWords[(rand >> 16) % kNumWords];
+            text += ((rand >> 8) % 12 == 0) ? ". " : " ";
+        }
+        totalBytes += text.size();
+        paragraphs.push_back(move(text));
+    }
+
+    SQLite::Database db(":memory:", SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE);
+    REQUIRE(RegisterFTSTokenizer(db.getHandle()) == SQLITE_OK);
+    const char* kStemmer = "\"stemmer=en\"", *kStopwords = "\"stopwords=en\"";
+
+    int64_t tokenCount[2] = {0, 0};
+    Benchmark tokenize[2];
+    const char* const kTokenizers[2] = {"unicodesn_base", "unicodesn"};
+    for (int t = 0; t < 2; ++t) {
+        db.exec(stringWithFormat("CREATE VIRTUAL TABLE temp.tok%d USING fts3tokenize(%s, %s, %s)",
+                                 t, kTokenizers[t], kStemmer, kStopwords));
+        SQLite::Statement st(db, stringWithFormat("SELECT count(*) FROM tok%d WHERE input=?", t));
+        for (auto &text : paragraphs) {
+            st.bind(1, text);
+            tokenize[t].start();
+            REQUIRE(st.executeStep());
+            tokenize[t].stop();
+            tokenCount[t] += st.getColumn(0).getInt64();
+            st.reset();
+        }
+    }
+    CHECK(tokenCount[0] == tokenCount[1]);
+    fprintf(stderr, "Tokenizing %d paragraphs, %.1f MB, %lld tokens:\n",
+            kParagraphs, totalBytes / 1.0e6, (long long)tokenCount[0]);
+    tokenize[0].printReport(1, "paragraph (unicodesn)");
+    tokenize[1].printReport(1, "paragraph (fast)");
+
+    Benchmark indexing[2];
+    for (int t = 0; t < 2; ++t) {
+        db.exec(stringWithFormat("CREATE VIRTUAL TABLE fts%d USING fts4(text, tokenize=%s %s %s)",
+                                 t, kTokenizers[t], kStemmer, kStopwords));
+        SQLite::Statement st(db, stringWithFormat("INSERT INTO fts%d (text) VALUES (?)", t));
+        indexing[t].start();
+        SQLite::Transaction transaction(db);
+        for (auto &text : paragraphs) {
+            st.bind(1, text);
+            st.exec();
+            st.reset();
+        }
+        transaction.commit();
+        indexing[t].stop();
+    }
+    indexing[0].printReport(1, "index build (unicodesn)");
+    indexing[1].printReport(1, "index build (fast)");
+    CHECK(db.execAndGet("SELECT count(*) FROM fts0 WHERE text MATCH 'runs'").getInt()
+          == db.execAndGet("SELECT count(*) FROM fts1 WHERE text MATCH 'runs'").getInt());
+}
+
+
 N_WAY_TEST_CASE_METHOD(SQLiteFunctionsTest, "N1QL string functions", "[Query]") {
     CHECK(query("SELECT N1QL_length('')") == (vector<string>{"0"}));
     CHECK(query("SELECT N1QL_length('12345')") == (vector<string>{"5"}));
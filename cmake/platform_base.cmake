@@ -37,6 +37,7 @@ function(set_litecore_source_base)
         LiteCore/Database/SequenceTracker.cc
         LiteCore/Database/TreeDocument.cc
         LiteCore/Database/Upgrader.cc 
+        LiteCore/Query/IndexAdvisor.cc
         LiteCore/Query/IndexSpec.cc
         LiteCore/Query/PredictiveModel.cc
         LiteCore/Query/Query.cc
@@ -47,13 +48,18 @@ function(set_litecore_source_base)
         LiteCore/Query/SQLiteFleeceFunctions.cc
         LiteCore/Query/SQLiteFleeceUtil.cc
         LiteCore/Query/SQLiteFTSRankFunction.cc
+        LiteCore/Query/SQLiteFTSTokenizer.cc
         LiteCore/Query/SQLiteKeyStore+ArrayIndexes.cc
         LiteCore/Query/SQLiteKeyStore+FTSIndexes.cc
         LiteCore/Query/SQLiteKeyStore+Indexes.cc
         LiteCore/Query/SQLiteKeyStore+PredictiveIndexes.cc
+        LiteCore/Query/SQLiteKeyStore+SpatialIndexes.cc
+        LiteCore/Query/SQLiteKeyStore+VectorIndexes.cc
+        LiteCore/Query/SQLiteKeyStore+AggregateIndexes.cc
         LiteCore/Query/SQLiteN1QLFunctions.cc
         LiteCore/Query/SQLitePredictionFunction.cc
         LiteCore/Query/SQLiteQuery.cc
+        LiteCore/Query/SQLiteVectorFunctions.cc
         LiteCore/Query/N1QL_Parser/n1ql.cc
         LiteCore/RevTrees/RawRevTree.cc
         LiteCore/RevTrees/RevID.cc